@@ -0,0 +1,22 @@
+#!/bin/sh
+
+. "$(dirname "$0")"/setup.sh
+
+bench_file << EOF
+function step(total, i) {
+    total + i % 7;
+}
+
+var total = 0;
+
+loop (1000000 as i) {
+    total = step(total, i);
+}
+
+println(total);
+EOF
+
+BLAZE_FLAGS="--engine=tree"
+bench_run "Loop with calls 1e6 times (tree-walker)"
+BLAZE_FLAGS="--engine=vm"
+bench_run "Loop with calls 1e6 times (bytecode VM)"
@@ -0,0 +1,13 @@
+#!/bin/sh
+
+bench_file() {
+    cat /dev/stdin > $FILE
+}
+
+# Runs the current file and prints the wall-clock time it took.
+bench_run() {
+    start=$(date +%s%N)
+    "$BLAZE" $BLAZE_FLAGS "$FILE" > /dev/null || exit 1
+    end=$(date +%s%N)
+    printf "\033[1;34mBENCH\033[0m %-48s %6d ms\n" "$1" $(( (end - start) / 1000000 ))
+}
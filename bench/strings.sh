@@ -0,0 +1,42 @@
+#!/bin/sh
+
+. "$(dirname "$0")"/setup.sh
+
+bench_file << EOF
+var s = "";
+
+loop (1000000 as i) {
+    s = s + "fragment";
+}
+
+println(s);
+EOF
+bench_run "Append 1e6 fragments to a string"
+
+bench_file << EOF
+var s = "";
+
+loop (1000000 as i) {
+    s = s + i + ",";
+}
+
+println(s);
+EOF
+bench_run "Append 1e6 integers to a string"
+
+bench_file << EOF
+var matches = 0;
+
+loop (1000000 as i) {
+    if (i == "500000") {
+        matches = matches + 1;
+    }
+
+    if ("needle" == "haystack") {
+        matches = matches + 1;
+    }
+}
+
+println(matches);
+EOF
+bench_run "Compare strings 2e6 times"
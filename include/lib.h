@@ -17,6 +17,14 @@ BUILTIN_FN(array);
 BUILTIN_FN(array_filter);
 BUILTIN_FN(read);
 BUILTIN_FN(exit);
+BUILTIN_FN(map);
+BUILTIN_FN(map_set);
+BUILTIN_FN(map_get);
+BUILTIN_FN(map_has);
+BUILTIN_FN(map_delete);
+BUILTIN_FN(map_size);
+BUILTIN_FN(map_keys);
+BUILTIN_FN(map_values);
 
 struct builtin_function
 {
@@ -32,6 +40,14 @@ static struct builtin_function builtin_functions[] = {
     { "array_filter", BUILTIN_FN_REF(array_filter), .fnval = NULL },
     { "read", BUILTIN_FN_REF(read), .fnval = NULL },
     { "exit", BUILTIN_FN_REF(exit), .fnval = NULL },
+    { "map", BUILTIN_FN_REF(map), .fnval = NULL },
+    { "map_set", BUILTIN_FN_REF(map_set), .fnval = NULL },
+    { "map_get", BUILTIN_FN_REF(map_get), .fnval = NULL },
+    { "map_has", BUILTIN_FN_REF(map_has), .fnval = NULL },
+    { "map_delete", BUILTIN_FN_REF(map_delete), .fnval = NULL },
+    { "map_size", BUILTIN_FN_REF(map_size), .fnval = NULL },
+    { "map_keys", BUILTIN_FN_REF(map_keys), .fnval = NULL },
+    { "map_values", BUILTIN_FN_REF(map_values), .fnval = NULL },
 };
 
 
@@ -6,9 +6,11 @@
 #define BLAZESCRIPT_PRINT_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include "datatype.h"
 
 void print_val(val_t *val);
 void print_val_internal(val_t *val, bool quote_strings);
+void fprint_val_internal(FILE *fp, val_t *val, bool quote_strings);
 
 #endif /* BLAZESCRIPT_PRINT_H */
@@ -0,0 +1,60 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_RCSTRING_H
+#define BLAZESCRIPT_RCSTRING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Strings up to this many bytes (excluding the NUL) are stored inline. */
+#define STRING_INLINE_SIZE 22
+#define STRING_IMMORTAL ((size_t) -1)
+/* Concatenations shorter than this are copied instead of building a rope. */
+#define STRING_ROPE_MIN_LENGTH 64
+
+/*
+ * A reference-counted, length-prefixed string. The contents are always
+ * NUL-terminated so that they can be handed to C functions directly, but
+ * the length is authoritative. A hash of 0 means it was not computed yet.
+ *
+ * A string whose data is NULL is a rope: the lazy concatenation of its two
+ * children. string_flatten() turns it into a flat string in place, so any
+ * code reading the contents must go through it.
+ */
+typedef struct string
+{
+    size_t refcount;
+    size_t length;
+    size_t capacity;
+    uint64_t hash;
+    char *data;
+
+    union {
+        char inline_data[STRING_INLINE_SIZE + 1];
+
+        struct {
+            struct string *left;
+            struct string *right;
+        } rope;
+    };
+} string_t;
+
+string_t *string_create(const char *data, size_t length);
+string_t *string_create_cstr(const char *cstr);
+string_t *string_alloc(size_t capacity);
+string_t *string_concat(const char *left, size_t left_length, const char *right, size_t right_length);
+string_t *string_concat_strings(string_t *left, string_t *right);
+const char *string_flatten(string_t *string);
+string_t *string_ref(string_t *string);
+void string_unref(string_t *string);
+void string_free(string_t *string);
+string_t *string_make_mutable(string_t *string);
+string_t *string_append(string_t *string, const char *data, size_t length);
+uint64_t string_hash(string_t *string);
+uint64_t string_hash_bytes(const char *data, size_t length);
+bool string_equals(string_t *a, string_t *b);
+
+#endif /* BLAZESCRIPT_RCSTRING_H */
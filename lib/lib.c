@@ -2,6 +2,8 @@
  * Created by rakinar2 on 8/26/23.
  */
 
+#define _GNU_SOURCE
+
 #include "include/lib.h"
 #include "alloca.h"
 #include "datatype.h"
@@ -43,7 +45,7 @@ BUILTIN_FN(print)
     for (size_t i = 0; i < argc; i++)
     {
         if (args[i].type == VAL_STRING)
-            printf("%s", args[i].strval);
+            fwrite(string_flatten(args[i].strval), 1, args[i].strval->length, stdout);
         else
             print_val_internal(&args[i], false);
 
@@ -89,7 +91,8 @@ BUILTIN_FN(read)
         }
     }
 
-    val.strval = line;
+    val.strval = string_create_cstr(line);
+    free(line);
     return val;
 }
 
@@ -141,4 +144,168 @@ BUILTIN_FN(array_filter)
     }
 
     return new_array;
-}
\ No newline at end of file
+}
+
+static bool map_fn_check_args(const char *fn_name, size_t argc, size_t min_argc, size_t max_argc, val_t *args)
+{
+    if (argc < min_argc || argc > max_argc)
+    {
+        if (min_argc == max_argc)
+            asprintf(&eval_fn_error, "function %s() requires exactly %zu arguments to be passed", fn_name, min_argc);
+        else
+            asprintf(&eval_fn_error, "function %s() requires %zu to %zu arguments to be passed", fn_name, min_argc, max_argc);
+
+        return false;
+    }
+
+    if (args[0].type != VAL_MAP)
+    {
+        asprintf(&eval_fn_error, "#1 argument passed to function %s() must be a map", fn_name);
+        return false;
+    }
+
+    return true;
+}
+
+static bool map_fn_key(const char *fn_name, val_t *val, map_key_t *key)
+{
+    if (!val_to_map_key(val, key))
+    {
+        asprintf(&eval_fn_error, "map keys passed to function %s() must be integers or strings, got %s",
+                 fn_name, val_type_to_str(val->type));
+        return false;
+    }
+
+    return true;
+}
+
+BUILTIN_FN(map)
+{
+    if (argc % 2 != 0)
+    {
+        eval_fn_error = strdup("function map() requires an even number of arguments (key, value pairs) to be passed");
+        return *scope->null;
+    }
+
+    val_t val = val_create(VAL_MAP);
+
+    for (size_t i = 0; i < argc; i += 2)
+    {
+        map_key_t key;
+
+        if (!map_fn_key("map", &args[i], &key))
+        {
+            MAP_FOREACH(val.mapval)
+            {
+                val_free(val.mapval->elements[i].value);
+            }
+
+            val_free_force_no_root(&val);
+            return *scope->null;
+        }
+
+        void *old = NULL;
+
+        map_set_key(val.mapval, key, val_copy_deep(&args[i + 1]), &old, MAP_CREATE | MAP_OVERWRITE);
+        val_free(old);
+    }
+
+    return val;
+}
+
+BUILTIN_FN(map_set)
+{
+    map_key_t key;
+
+    if (!map_fn_check_args("map_set", argc, 3, 3, args) || !map_fn_key("map_set", &args[1], &key))
+        return *scope->null;
+
+    void *old = NULL;
+
+    map_set_key(args[0].mapval, key, val_copy_deep(&args[2]), &old, MAP_CREATE | MAP_OVERWRITE);
+    val_free(old);
+    return *scope->null;
+}
+
+BUILTIN_FN(map_get)
+{
+    map_key_t key;
+
+    if (!map_fn_check_args("map_get", argc, 2, 3, args) || !map_fn_key("map_get", &args[1], &key))
+        return *scope->null;
+
+    map_entry_t *entry = map_get_entry(args[0].mapval, key);
+
+    if (entry == NULL)
+        return argc == 3 ? args[2] : *scope->null;
+
+    return *((val_t *) entry->value);
+}
+
+BUILTIN_FN(map_has)
+{
+    map_key_t key;
+
+    if (!map_fn_check_args("map_has", argc, 2, 2, args) || !map_fn_key("map_has", &args[1], &key))
+        return *scope->null;
+
+    val_t val = val_create(VAL_BOOLEAN);
+    val.boolval = map_get_entry(args[0].mapval, key) != NULL;
+    return val;
+}
+
+BUILTIN_FN(map_delete)
+{
+    map_key_t key;
+
+    if (!map_fn_check_args("map_delete", argc, 2, 2, args) || !map_fn_key("map_delete", &args[1], &key))
+        return *scope->null;
+
+    void *old = NULL;
+    val_t val = val_create(VAL_BOOLEAN);
+
+    val.boolval = map_delete_key(args[0].mapval, key, &old);
+    val_free(old);
+    return val;
+}
+
+BUILTIN_FN(map_size)
+{
+    if (!map_fn_check_args("map_size", argc, 1, 1, args))
+        return *scope->null;
+
+    val_t val = val_create(VAL_INTEGER);
+    val.intval = (long long int) args[0].mapval->size;
+    return val;
+}
+
+BUILTIN_FN(map_keys)
+{
+    if (!map_fn_check_args("map_keys", argc, 1, 1, args))
+        return *scope->null;
+
+    val_t val = val_create(VAL_ARRAY);
+
+    MAP_FOREACH(args[0].mapval)
+    {
+        val_t key = val_from_map_key(&args[0].mapval->elements[i]);
+        vector_push(val.arrval, val_copy(&key));
+    }
+
+    return val;
+}
+
+BUILTIN_FN(map_values)
+{
+    if (!map_fn_check_args("map_values", argc, 1, 1, args))
+        return *scope->null;
+
+    val_t val = val_create(VAL_ARRAY);
+
+    MAP_FOREACH(args[0].mapval)
+    {
+        vector_push(val.arrval, val_copy_deep(args[0].mapval->elements[i].value));
+    }
+
+    return val;
+}
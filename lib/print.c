@@ -5,53 +5,85 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-void print_val_internal(val_t *val, bool quote_strings)
+void fprint_val_internal(FILE *fp, val_t *val, bool quote_strings)
 {
     if (val == NULL)
     {
-        puts("[NULL]");
+        fputs("[NULL]\n", fp);
         return;
     }
 
     switch (val->type)
     {
         case VAL_INTEGER:
-            printf("\033[1;33m%lld\033[0m", val->intval);
+            fprintf(fp, "\033[1;33m%lld\033[0m", val->intval);
             break;
 
         case VAL_FLOAT:
-            printf("\033[1;33m%Lf\033[0m", val->floatval);
+            fprintf(fp, "\033[1;33m%Lf\033[0m", val->floatval);
             break;
 
         case VAL_STRING:
-            printf("\033[32m%s%s%s\033[0m", quote_strings ? "\"" : "", val->strval, quote_strings ? "\"" : "");
+            fprintf(fp, "\033[32m%s%.*s%s\033[0m", quote_strings ? "\"" : "",
+                    (int) val->strval->length, string_flatten(val->strval), quote_strings ? "\"" : "");
             break;
 
         case VAL_BOOLEAN:
-            printf("\033[36m%s\033[0m", val->boolval == true ? "true" : "false");
+            fprintf(fp, "\033[36m%s\033[0m", val->boolval == true ? "true" : "false");
             break;
 
         case VAL_NULL:
-            printf("\033[2mnull\033[0m");
+            fprintf(fp, "\033[2mnull\033[0m");
             break;
 
         case VAL_ARRAY:
-            printf("\033[34mArray (%zu)\033[0m [", val->arrval->length);
+            fprintf(fp, "\033[34mArray (%zu)\033[0m [", val->arrval->length);
 
             for (size_t i = 0; i < val->arrval->length; i++)
             {
-                print_val_internal((val_t *) val->arrval->data[i], true);
+                fprint_val_internal(fp, (val_t *) val->arrval->data[i], true);
 
                 if (i != val->arrval->length - 1)
-                    printf(", ");
+                    fprintf(fp, ", ");
             }
 
-            printf("]");
+            fprintf(fp, "]");
             break;
 
+        case VAL_MAP:
+        {
+            size_t printed = 0;
+
+            fprintf(fp, "\033[34mMap (%zu)\033[0m {", val->mapval->size);
+
+            MAP_FOREACH(val->mapval)
+            {
+                map_entry_t *entry = &val->mapval->elements[i];
+
+                if (printed++ != 0)
+                    fprintf(fp, ", ");
+
+                if (entry->key_type == MAP_KEY_INTEGER)
+                {
+                    long long int intkey;
+                    memcpy(&intkey, entry->key, sizeof intkey);
+                    fprintf(fp, "\033[1;33m%lld\033[0m", intkey);
+                }
+                else
+                    fprintf(fp, "\033[32m\"%s\"\033[0m", entry->key);
+
+                fprintf(fp, " => ");
+                fprint_val_internal(fp, (val_t *) entry->value, true);
+            }
+
+            fprintf(fp, "}");
+            break;
+        }
+
         case VAL_FUNCTION:
-            printf("\033[2m[Function%s]\033[0m", val->fnval->type == FN_USER_CUSTOM ? "" : " Built-in");
+            fprintf(fp, "\033[2m[Function%s]\033[0m", val->fnval->type == FN_USER_CUSTOM ? "" : " Built-in");
             break;
 
         default:
@@ -59,6 +91,11 @@ void print_val_internal(val_t *val, bool quote_strings)
     }
 }
 
+void print_val_internal(val_t *val, bool quote_strings)
+{
+    fprint_val_internal(stdout, val, quote_strings);
+}
+
 void print_val(val_t *val)
 {
     print_val_internal(val, true);
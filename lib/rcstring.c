@@ -0,0 +1,299 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#include "rcstring.h"
+#include "alloca.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325UL
+#define FNV_PRIME 0x100000001b3UL
+
+/*
+ * Ropes built by appending in a loop are a million levels deep, so walking
+ * them recursively would overflow the C stack.
+ */
+struct string_stack
+{
+    string_t **items;
+    size_t size;
+    size_t capacity;
+};
+
+static void string_stack_push(struct string_stack *stack, string_t *string)
+{
+    if (stack->size == stack->capacity)
+    {
+        stack->capacity = stack->capacity == 0 ? 16 : stack->capacity * 2;
+        stack->items = xrealloc(stack->items, sizeof (string_t *) * stack->capacity);
+    }
+
+    stack->items[stack->size++] = string;
+}
+
+static string_t *string_stack_pop(struct string_stack *stack)
+{
+    return stack->size == 0 ? NULL : stack->items[--stack->size];
+}
+
+string_t *string_alloc(size_t capacity)
+{
+    string_t *string = xmalloc(sizeof (string_t));
+
+    string->refcount = 1;
+    string->length = 0;
+    string->hash = 0;
+
+    if (capacity <= STRING_INLINE_SIZE)
+    {
+        string->data = string->inline_data;
+        string->capacity = STRING_INLINE_SIZE;
+    }
+    else
+    {
+        string->data = xmalloc(capacity + 1);
+        string->capacity = capacity;
+    }
+
+    string->data[0] = 0;
+    return string;
+}
+
+string_t *string_create(const char *data, size_t length)
+{
+    string_t *string = string_alloc(length);
+
+    memcpy(string->data, data, length);
+    string->data[length] = 0;
+    string->length = length;
+    return string;
+}
+
+string_t *string_create_cstr(const char *cstr)
+{
+    return string_create(cstr, strlen(cstr));
+}
+
+string_t *string_concat(const char *left, size_t left_length, const char *right, size_t right_length)
+{
+    string_t *string = string_alloc(left_length + right_length);
+
+    memcpy(string->data, left, left_length);
+    memcpy(string->data + left_length, right, right_length);
+    string->length = left_length + right_length;
+    string->data[string->length] = 0;
+    return string;
+}
+
+/*
+ * Concatenates two strings without copying either of them when the result
+ * is long; the rope keeps a reference to both operands until it is
+ * flattened. Repeated appends therefore cost O(1) each instead of copying
+ * the whole string every time.
+ */
+string_t *string_concat_strings(string_t *left, string_t *right)
+{
+    if (left->length == 0)
+        return string_ref(right);
+
+    if (right->length == 0)
+        return string_ref(left);
+
+    size_t length = left->length + right->length;
+
+    if (length < STRING_ROPE_MIN_LENGTH)
+        return string_concat(string_flatten(left), left->length, string_flatten(right), right->length);
+
+    string_t *string = xmalloc(sizeof (string_t));
+
+    string->refcount = 1;
+    string->length = length;
+    string->capacity = 0;
+    string->hash = 0;
+    string->data = NULL;
+    string->rope.left = string_ref(left);
+    string->rope.right = string_ref(right);
+    return string;
+}
+
+/*
+ * Returns the contents of a string, copying a rope into a single buffer
+ * the first time it is needed. The leaves are collected from right to left
+ * so that the left spine, which grows with every append, stays off the
+ * explicit stack.
+ */
+const char *string_flatten(string_t *string)
+{
+    if (string->data != NULL)
+        return string->data;
+
+    char *data = xmalloc(string->length + 1);
+    size_t offset = string->length;
+    struct string_stack pending = { 0 };
+    string_t *node = string;
+
+    while (node != NULL)
+    {
+        if (node->data == NULL)
+        {
+            string_stack_push(&pending, node->rope.left);
+            node = node->rope.right;
+            continue;
+        }
+
+        offset -= node->length;
+        memcpy(data + offset, node->data, node->length);
+        node = string_stack_pop(&pending);
+    }
+
+    free(pending.items);
+    data[string->length] = 0;
+
+    string_t *left = string->rope.left, *right = string->rope.right;
+
+    string->data = data;
+    string->capacity = string->length;
+    string_unref(left);
+    string_unref(right);
+    return data;
+}
+
+string_t *string_ref(string_t *string)
+{
+    if (string->refcount != STRING_IMMORTAL)
+        string->refcount++;
+
+    return string;
+}
+
+void string_unref(string_t *string)
+{
+    struct string_stack pending = { 0 };
+
+    while (string != NULL)
+    {
+        if (string->refcount != STRING_IMMORTAL)
+        {
+            assert(string->refcount > 0 && "String reference count underflow");
+
+            if (--string->refcount == 0)
+            {
+                if (string->data == NULL)
+                {
+                    string_stack_push(&pending, string->rope.left);
+                    string_stack_push(&pending, string->rope.right);
+                }
+                else if (string->data != string->inline_data)
+                    free(string->data);
+
+                free(string);
+            }
+        }
+
+        string = string_stack_pop(&pending);
+    }
+
+    free(pending.items);
+}
+
+/* Releases a string regardless of its reference count. */
+void string_free(string_t *string)
+{
+    if (string->data == NULL)
+    {
+        string_unref(string->rope.left);
+        string_unref(string->rope.right);
+    }
+    else if (string->data != string->inline_data)
+        free(string->data);
+
+    free(string);
+}
+
+/*
+ * Returns a string that the caller may modify in place. When the string
+ * is shared (or immortal) the contents are copied first and the caller's
+ * reference to the original is dropped. Ropes are flattened first.
+ */
+string_t *string_make_mutable(string_t *string)
+{
+    string_flatten(string);
+
+    if (string->refcount == 1)
+        return string;
+
+    string_t *copy = string_create(string->data, string->length);
+    string_unref(string);
+    return copy;
+}
+
+string_t *string_append(string_t *string, const char *data, size_t length)
+{
+    string = string_make_mutable(string);
+
+    if (string->length + length > string->capacity)
+    {
+        size_t new_capacity = string->capacity * 2;
+        bool is_self = data >= string->data && data <= string->data + string->length;
+        size_t self_offset = is_self ? (size_t) (data - string->data) : 0;
+
+        if (new_capacity < string->length + length)
+            new_capacity = string->length + length;
+
+        if (string->data == string->inline_data)
+        {
+            string->data = xmalloc(new_capacity + 1);
+            memcpy(string->data, string->inline_data, string->length + 1);
+        }
+        else
+            string->data = xrealloc(string->data, new_capacity + 1);
+
+        string->capacity = new_capacity;
+
+        if (is_self)
+            data = string->data + self_offset;
+    }
+
+    memmove(string->data + string->length, data, length);
+    string->length += length;
+    string->data[string->length] = 0;
+    string->hash = 0;
+    return string;
+}
+
+uint64_t string_hash_bytes(const char *data, size_t length)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char) data[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+uint64_t string_hash(string_t *string)
+{
+    if (string->hash == 0)
+        string->hash = string_hash_bytes(string_flatten(string), string->length);
+
+    return string->hash;
+}
+
+bool string_equals(string_t *a, string_t *b)
+{
+    if (a == b)
+        return true;
+
+    if (a->length != b->length)
+        return false;
+
+    if (a->hash != 0 && b->hash != 0 && a->hash != b->hash)
+        return false;
+
+    return memcmp(string_flatten(a), string_flatten(b), a->length) == 0;
+}
@@ -7,7 +7,13 @@
 #include <string.h>
 #include "datatype.h"
 #include "lib.h"
-#include "x86_64/stdio.h"
+#include "include/utils.h"
+#include "alloca.h"
+
+/* null, true and false, which compiled code shares instead of making its own. */
+__attribute__((used)) val_t libblaze_val_null = { .type = VAL_NULL };
+__attribute__((used)) val_t libblaze_val_true = { .type = VAL_BOOLEAN, .boolval = true };
+__attribute__((used)) val_t libblaze_val_false = { .type = VAL_BOOLEAN, .boolval = false };
 
 val_t *libblaze_val_create(val_type_t type)
 {
@@ -18,13 +24,13 @@ val_t *libblaze_val_create(val_type_t type)
 
 __attribute__((used)) void libblaze_val_set_strval(val_t *val, char *string)
 {
-    val->strval = strdup(string);
+    val->strval = string_create_cstr(string);
 }
 
 __attribute__((used)) val_t *libblaze_val_create_strval(char *string)
 {
     val_t *val = libblaze_val_create(VAL_STRING);
-    val->strval = strdup(string);
+    val->strval = string_create_cstr(string);
     return val;
 }
 
@@ -35,37 +41,347 @@ __attribute__((used)) val_t *libblaze_val_create_intval(uint64_t value)
     return val;
 }
 
-__attribute__((used)) void libblaze_val_alloc_str(val_t *val, size_t size)
+/* The shared value for a boolean, which compiled code keeps as a machine word. */
+__attribute__((used)) val_t *libblaze_val_boolean(uint64_t value)
 {
-    val->strval = xmalloc(size);
+    return value != 0 ? &libblaze_val_true : &libblaze_val_false;
 }
 
-__attribute__((used)) void libblaze_fn_println(uint64_t argc, ...)
+/* Makes an array of size elements, which libblaze_val_array_set() fills in. */
+__attribute__((used)) val_t *libblaze_val_create_array(uint64_t size)
 {
-    va_list args;
-    va_start(args, argc);
-    bool newline = true;
+    val_t *val = libblaze_val_create(VAL_ARRAY);
+    val->arrval = xmalloc(sizeof (vector_t));
+    val->arrval->length = size;
+    val->arrval->data = xcalloc(size == 0 ? 1 : size, sizeof (void *));
+    return val;
+}
+
+/* Stores element in the array, which takes it over. */
+__attribute__((used)) void libblaze_val_array_set(val_t *array, uint64_t index, val_t *element)
+{
+    array->arrval->data[index] = element;
+}
+
+/*
+ * Values belong to one variable or temporary each, so a value that is
+ * kept somewhere else is copied: arrays with their elements, strings by
+ * taking a reference.
+ */
+__attribute__((used)) val_t *libblaze_val_copy(val_t *val)
+{
+    if (val->type == VAL_ARRAY)
+    {
+        val_t *copy = libblaze_val_create_array(val->arrval->length);
+
+        for (size_t i = 0; i < val->arrval->length; i++)
+            copy->arrval->data[i] = libblaze_val_copy(val->arrval->data[i]);
+
+        return copy;
+    }
+
+    val_t *copy = libblaze_val_create(val->type);
+    *copy = *val;
+
+    if (val->type == VAL_STRING)
+        string_ref(val->strval);
+
+    return copy;
+}
+
+__attribute__((used)) uint64_t libblaze_val_truthy(val_t *val)
+{
+    return val->type != VAL_NULL &&
+           (val->type != VAL_BOOLEAN || val->boolval) &&
+           (val->type != VAL_INTEGER || val->intval != 0);
+}
+
+static const char *libblaze_val_type_to_str(val_type_t type)
+{
+    const char *translate[] = {
+        [VAL_INTEGER] = "INTEGER",
+        [VAL_BOOLEAN] = "BOOLEAN",
+        [VAL_STRING] = "STRING",
+        [VAL_FLOAT] = "FLOAT",
+        [VAL_FUNCTION] = "FUNCTION",
+        [VAL_NULL] = "NULL",
+        [VAL_OBJECT] = "OBJECT",
+        [VAL_ARRAY] = "ARRAY",
+        [VAL_MAP] = "MAP"
+    };
+
+    return type < (sizeof (translate) / sizeof (translate[0])) ? translate[type] : "UNKNOWN";
+}
+
+static long long int libblaze_val_to_int(const val_t *val)
+{
+    if (val->type == VAL_INTEGER)
+        return val->intval;
+
+    if (val->type == VAL_NULL)
+        return 0;
+
+    if (val->type == VAL_BOOLEAN)
+        return val->boolval;
+
+    return 1;
+}
+
+/* The textual form of a string operand, or NULL for values that have none. */
+static const char *libblaze_string_operand(const val_t *val, char *buf, size_t bufsize, size_t *length)
+{
+    switch (val->type)
+    {
+        case VAL_STRING:
+            *length = val->strval->length;
+            return string_flatten(val->strval);
+
+        case VAL_INTEGER:
+            *length = (size_t) snprintf(buf, bufsize, "%lld", val->intval);
+            return buf;
+
+        case VAL_BOOLEAN:
+            *length = val->boolval ? 4 : 5;
+            return val->boolval ? "true" : "false";
+
+        case VAL_NULL:
+            *length = 4;
+            return "null";
+
+        default:
+            return NULL;
+    }
+}
+
+static bool libblaze_val_compare_string(ast_bin_operator_t operator, val_t *left, val_t *right, const char *where)
+{
+    char left_buf[32], right_buf[32];
+    size_t left_length = 0, right_length = 0;
+    const char *left_str = libblaze_string_operand(left, left_buf, sizeof left_buf, &left_length);
+    const char *right_str = libblaze_string_operand(right, right_buf, sizeof right_buf, &right_length);
+    bool equal = left->type == VAL_STRING && right->type == VAL_STRING
+        ? string_equals(left->strval, right->strval)
+        : left_str != NULL && right_str != NULL && left_length == right_length &&
+          memcmp(left_str, right_str, left_length) == 0;
+
+    switch (operator)
+    {
+        case OP_CMP_EQ:
+            return equal;
+
+        case OP_CMP_EQ_S:
+            return equal && left->type == right->type;
+
+        case OP_CMP_NE:
+            return !equal;
+
+        case OP_CMP_NE_S:
+            return !equal && left->type == right->type;
+
+        default:
+            libblaze_fatal_error("%s: unsupported operator '%c' being used with type string", where, operator);
+            return false;
+    }
+}
+
+static val_t *libblaze_val_binary_string(ast_bin_operator_t operator, val_t *left, val_t *right, const char *where)
+{
+    if (operator != OP_PLUS)
+        return libblaze_val_boolean(libblaze_val_compare_string(operator, left, right, where));
+
+    char left_buf[32], right_buf[32];
+    size_t left_length = 0, right_length = 0;
+    const char *left_str = libblaze_string_operand(left, left_buf, sizeof left_buf, &left_length);
+    const char *right_str = libblaze_string_operand(right, right_buf, sizeof right_buf, &right_length);
+
+    if (left_str == NULL || right_str == NULL)
+        libblaze_fatal_error("%s: cannot use operator '+' with type string", where);
+
+    val_t *val = libblaze_val_create(VAL_STRING);
+    val->strval = string_concat(left_str, left_length, right_str, right_length);
+    return val;
+}
+
+/*
+ * Compares left and right like the interpreter does. where is the position
+ * of the expression, for error messages.
+ */
+__attribute__((used)) uint64_t libblaze_val_compare(uint64_t operator, val_t *left, val_t *right, const char *where)
+{
+    if (left->type == VAL_STRING || right->type == VAL_STRING)
+        return libblaze_val_compare_string((ast_bin_operator_t) operator, left, right, where);
+
+    long long int li = libblaze_val_to_int(left);
+    long long int ri = libblaze_val_to_int(right);
+    bool same_type = left->type == right->type;
+
+    switch (operator)
+    {
+        case OP_CMP_LT:
+            return li < ri;
+
+        case OP_CMP_GT:
+            return li > ri;
+
+        case OP_CMP_GE:
+            return li >= ri;
 
+        case OP_CMP_LE:
+            return li <= ri;
+
+        case OP_CMP_EQ:
+            return li == ri;
+
+        case OP_CMP_EQ_S:
+            return li == ri && same_type;
+
+        case OP_CMP_NE:
+            return li != ri;
+
+        case OP_CMP_NE_S:
+            return li != ri && same_type;
+
+        default:
+            libblaze_fatal_error("%s: unsupported comparison operator '%c' (%d)", where, (int) operator, (int) operator);
+            return false;
+    }
+}
+
+/* The remainder of two ints that compiled code keeps as machine words. */
+__attribute__((used)) int64_t libblaze_int_mod(int64_t left, int64_t right, const char *where)
+{
+    if (right == 0)
+        libblaze_fatal_error("%s: cannot divide %lli by zero", where, (long long int) left);
+
+    return right == -1 ? 0 : left % right;
+}
+
+static val_t *libblaze_val_binary_int(ast_bin_operator_t operator, long long int left, long long int right, const char *where)
+{
+    switch (operator)
+    {
+        case OP_PLUS:
+            return libblaze_val_create_intval((uint64_t) left + (uint64_t) right);
+
+        case OP_MINUS:
+            return libblaze_val_create_intval((uint64_t) left - (uint64_t) right);
+
+        case OP_TIMES:
+            return libblaze_val_create_intval((uint64_t) left * (uint64_t) right);
+
+        case OP_DIVIDE:
+        {
+            if (right == 0)
+                libblaze_fatal_error("%s: cannot divide %lli by zero", where, left);
+
+            val_t *val = libblaze_val_create(VAL_FLOAT);
+            val->floatval = (long double) left / (long double) right;
+            return val;
+        }
+
+        case OP_MODULUS:
+            return libblaze_val_create_intval((uint64_t) libblaze_int_mod(left, right, where));
+
+        default:
+            libblaze_fatal_error("%s: unsupported int operator '%c' (%d)", where, operator, operator);
+            return NULL;
+    }
+}
+
+/*
+ * Evaluates left operator right like the interpreter does, into a new
+ * value. where is the position of the expression, for error messages.
+ */
+__attribute__((used)) val_t *libblaze_val_binary(uint64_t operator, val_t *left, val_t *right, const char *where)
+{
+    if (operator >= OP_CMP_LT && operator <= OP_CMP_NE_S)
+        return libblaze_val_boolean(libblaze_val_compare(operator, left, right, where));
+
+    if (left->type == VAL_INTEGER && right->type == VAL_INTEGER)
+        return libblaze_val_binary_int((ast_bin_operator_t) operator, left->intval, right->intval, where);
+
+    if (left->type == VAL_STRING || right->type == VAL_STRING)
+        return libblaze_val_binary_string((ast_bin_operator_t) operator, left, right, where);
+
+    libblaze_fatal_error("%s: unsupported binary operation (lhs: %s, rhs: %s)", where,
+                         libblaze_val_type_to_str(left->type), libblaze_val_type_to_str(right->type));
+    return NULL;
+}
+
+__attribute__((used)) int64_t libblaze_int_iter_count(int64_t count, const char *where)
+{
+    if (count < 0)
+        libblaze_fatal_error("%s: the iteration count must not be a negative number", where);
+
+    return count;
+}
+
+/*
+ * The number of times a loop runs its body: an integer count, or for a
+ * boolean, none or all of them. where is the position of the loop, for
+ * the error message.
+ */
+__attribute__((used)) int64_t libblaze_val_iter_count(val_t *val, const char *where)
+{
+    if (val->type == VAL_BOOLEAN)
+        return val->boolval ? INT64_MAX : 0;
+
+    if (val->type != VAL_INTEGER)
+        libblaze_fatal_error("%s: type '%s' is not iterable", where, libblaze_val_type_to_str(val->type));
+
+    return libblaze_int_iter_count(val->intval, where);
+}
+
+__attribute__((used)) void libblaze_val_alloc_str(val_t *val, size_t size)
+{
+    val->strval = string_alloc(size);
+}
+
+/* Writes the values like the print() built-in of the interpreter does. */
+static void libblaze_print_vals(uint64_t argc, va_list args)
+{
     for (uint64_t i = 0; i < argc; i++)
     {
         val_t *val = va_arg(args, val_t *);
 
         if (val->type == VAL_STRING)
-            x86_64_libblaze_putstr(val->strval);
+            fwrite(string_flatten(val->strval), 1, val->strval->length, stdout);
         else
-        {
-            print_val(val);
-            newline = false;
-        }
+            print_val_internal(val, false);
 
         if (i != argc - 1)
-            x86_64_libblaze_putchar(' ');
+            putchar(' ');
     }
+}
+
+__attribute__((used)) void libblaze_fn_print(uint64_t argc, ...)
+{
+    va_list args;
+    va_start(args, argc);
+    libblaze_print_vals(argc, args);
+    va_end(args);
+}
 
-    if (newline)
-        x86_64_libblaze_putchar('\n');
+__attribute__((used)) void libblaze_fn_println(uint64_t argc, ...)
+{
+    va_list args;
+    va_start(args, argc);
+    libblaze_print_vals(argc, args);
+    putchar('\n');
+    va_end(args);
+}
 
+__attribute__((used)) void libblaze_fn_exit(uint64_t argc, ...)
+{
+    va_list args;
+    va_start(args, argc);
+    val_t *code = argc == 0 ? NULL : va_arg(args, val_t *);
     va_end(args);
+
+    if (code != NULL && code->type != VAL_INTEGER)
+        libblaze_fatal_error("#1 argument passed to function exit() must be an integer");
+
+    exit(code == NULL ? 0 : (int) code->intval);
 }
 
 __attribute__((used)) void libblaze_val_free(val_t *val)
@@ -73,7 +389,15 @@ __attribute__((used)) void libblaze_val_free(val_t *val)
     assert(val != NULL);
 
     if (val->type == VAL_STRING)
-        free(val->strval);
+        string_unref(val->strval);
+    else if (val->type == VAL_ARRAY)
+    {
+        for (size_t i = 0; i < val->arrval->length; i++)
+            libblaze_val_free(val->arrval->data[i]);
+
+        free(val->arrval->data);
+        free(val->arrval);
+    }
 
     free(val);
 }
@@ -3,6 +3,6 @@
 
 void x86_64_libblaze_putchar(char c);
 void x86_64_libblaze_puts(char *s);
-void x86_64_libblaze_putstr(char *s);
+void x86_64_libblaze_putstr(const char *s);
 
 #endif
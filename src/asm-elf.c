@@ -0,0 +1,812 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#define _GNU_SOURCE
+
+#include "asm-elf.h"
+#include "map.h"
+#include "utils.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+
+#include <elf.h>
+
+/*
+ * Layout of the object:
+ *
+ *   header, .text, .data, .rela.text, .symtab, .strtab, .shstrtab,
+ *   section headers
+ *
+ * and an empty .note.GNU-stack, which tells the linker that the stack
+ * need not be executable.
+ */
+enum
+{
+    ELF_SECTION_NULL,
+    ELF_SECTION_TEXT,
+    ELF_SECTION_DATA,
+    ELF_SECTION_RELA_TEXT,
+    ELF_SECTION_SYMTAB,
+    ELF_SECTION_STRTAB,
+    ELF_SECTION_SHSTRTAB,
+    ELF_SECTION_NOTE_GNU_STACK,
+    ELF_SECTION_COUNT
+};
+
+/* The symbols for the sections come first, so that relocations can refer to an offset in them. */
+enum
+{
+    ELF_SYMBOL_NULL,
+    ELF_SYMBOL_TEXT,
+    ELF_SYMBOL_DATA
+};
+
+enum
+{
+    X86_RAX, X86_RCX, X86_RDX, X86_RBX, X86_RSP, X86_RBP, X86_RSI, X86_RDI,
+    X86_R8, X86_R9
+};
+
+/* Condition codes, as in the low nibble of jcc and cmovcc. */
+enum
+{
+    X86_CC_E = 0x4, X86_CC_NE = 0x5, X86_CC_L = 0xC, X86_CC_GE = 0xD, X86_CC_LE = 0xE, X86_CC_G = 0xF
+};
+
+struct elf_buffer
+{
+    uint8_t *bytes;
+    size_t size;
+    size_t cap;
+};
+
+struct elf_label
+{
+    size_t section;
+    size_t offset;
+};
+
+/*
+ * A field of 32 bits in .text that refers to a label: a rel32 that ends
+ * the instruction (relative), or the address of the label, sign-extended
+ * by the instruction.
+ */
+struct elf_fixup
+{
+    size_t at;
+    char *label;
+    bool relative;
+};
+
+struct elf_assembler
+{
+    struct elf_buffer text;
+    struct elf_buffer data;
+    map_t labels;
+    map_t globals;
+    struct elf_fixup *fixups;
+    size_t fixup_count;
+};
+
+static void elf_emit(struct elf_buffer *buffer, const void *bytes, size_t size)
+{
+    if (buffer->size + size > buffer->cap)
+    {
+        while (buffer->size + size > buffer->cap)
+            buffer->cap = buffer->cap == 0 ? 4096 : buffer->cap * 2;
+
+        buffer->bytes = xrealloc(buffer->bytes, buffer->cap);
+    }
+
+    if (size != 0)
+        memcpy(buffer->bytes + buffer->size, bytes, size);
+
+    buffer->size += size;
+}
+
+static void emit_byte(struct elf_assembler *as, uint8_t byte)
+{
+    elf_emit(&as->text, &byte, 1);
+}
+
+static void emit_dword(struct elf_assembler *as, uint32_t dword)
+{
+    for (size_t i = 0; i < sizeof dword; i++)
+        emit_byte(as, (uint8_t) (dword >> (i * 8)));
+}
+
+static void emit_qword(struct elf_assembler *as, uint64_t qword)
+{
+    emit_dword(as, (uint32_t) qword);
+    emit_dword(as, (uint32_t) (qword >> 32));
+}
+
+static void elf_align(struct elf_buffer *buffer, size_t alignment)
+{
+    static const uint8_t zero[16] = { 0 };
+
+    elf_emit(buffer, zero, (alignment - buffer->size % alignment) % alignment);
+}
+
+static void elf_define_label(struct elf_assembler *as, const char *name, size_t section, size_t offset)
+{
+    struct elf_label *label = xmalloc(sizeof (struct elf_label));
+
+    label->section = section;
+    label->offset = offset;
+
+    if ((map_set(&as->labels, (char *) name, label, MAP_CREATE) & MAP_RESULT_NOT_CREATED) != 0)
+        fatal_error("symbol '%s' is already defined", name);
+}
+
+/* A 32-bit field that the label fills in once its address is known. */
+static void emit_label_field(struct elf_assembler *as, const char *label, bool relative)
+{
+    as->fixups = xrealloc(as->fixups, (as->fixup_count + 1) * sizeof (struct elf_fixup));
+    as->fixups[as->fixup_count++] = (struct elf_fixup) {
+        .at = as->text.size,
+        .label = strdup(label),
+        .relative = relative
+    };
+
+    emit_dword(as, 0);
+}
+
+static uint8_t x86_register(asm_node_register_t reg)
+{
+    static const uint8_t numbers[] = {
+        [ASM_INTEL_RAX] = X86_RAX,
+        [ASM_INTEL_RCX] = X86_RCX,
+        [ASM_INTEL_RBX] = X86_RBX,
+        [ASM_INTEL_RDX] = X86_RDX,
+        [ASM_INTEL_RDI] = X86_RDI,
+        [ASM_INTEL_RSI] = X86_RSI,
+        [ASM_INTEL_RSP] = X86_RSP,
+        [ASM_INTEL_RBP] = X86_RBP,
+        [ASM_INTEL_R8] = X86_R8,
+        [ASM_INTEL_R9] = X86_R9
+    };
+
+    if (reg > ASM_INTEL_R9)
+        fatal_error("register is not an x86-64 register");
+
+    return numbers[reg];
+}
+
+static bool x86_is_memory(const asm_node_operand_t *operand)
+{
+    return operand->type == ASM_OPERAND_ADDR_REG || operand->type == ASM_OPERAND_ADDR_OFFSET_REG;
+}
+
+static bool x86_is_register(const asm_node_operand_t *operand)
+{
+    return operand->type == ASM_OPERAND_REGISTER;
+}
+
+/* The register that rm names, or the base register of the memory it addresses. */
+static uint8_t x86_rm_register(const asm_node_operand_t *rm)
+{
+    switch (rm->type)
+    {
+        case ASM_OPERAND_REGISTER:
+            return x86_register(rm->cpu_register);
+
+        case ASM_OPERAND_ADDR_REG:
+            return x86_register(rm->addr_register);
+
+        case ASM_OPERAND_ADDR_OFFSET_REG:
+            return x86_register(rm->offset_register);
+
+        default:
+            fatal_error("operand is neither a register nor memory");
+            return 0;
+    }
+}
+
+/* A REX prefix; every operation that takes one here is a 64-bit one. */
+static void x86_rex(struct elf_assembler *as, bool wide, uint8_t reg, const asm_node_operand_t *rm)
+{
+    uint8_t rex = 0x40 | (wide ? 0x08 : 0) | ((reg >> 3) << 2) | (x86_rm_register(rm) >> 3);
+
+    if (rex != 0x40)
+        emit_byte(as, rex);
+}
+
+/* A ModRM byte for a register, or for [base + disp32]; %rsp needs a SIB byte as a base. */
+static void x86_modrm(struct elf_assembler *as, uint8_t reg, const asm_node_operand_t *rm)
+{
+    uint8_t base = x86_rm_register(rm);
+
+    if (x86_is_register(rm))
+    {
+        emit_byte(as, 0xC0 | (reg & 7) << 3 | (base & 7));
+        return;
+    }
+
+    int64_t disp = rm->type == ASM_OPERAND_ADDR_OFFSET_REG ? rm->offset : 0;
+
+    if (disp != (int32_t) disp)
+        fatal_error("memory operand is too far from its base register");
+
+    emit_byte(as, 0x80 | (reg & 7) << 3 | (base & 7));
+
+    if ((base & 7) == X86_RSP)
+        emit_byte(as, 0x24);
+
+    emit_dword(as, (uint32_t) disp);
+}
+
+/* An instruction of the form "REX.W opcode ModRM", with reg in the reg field. */
+static void x86_op(struct elf_assembler *as, const uint8_t *opcode, size_t opcode_size, uint8_t reg,
+                   const asm_node_operand_t *rm)
+{
+    x86_rex(as, true, reg, rm);
+    elf_emit(&as->text, opcode, opcode_size);
+    x86_modrm(as, reg, rm);
+}
+
+static void x86_imm32(struct elf_assembler *as, const asm_node_operand_t *imm)
+{
+    if (imm->immediate_label != NULL)
+        emit_label_field(as, imm->immediate_label, false);
+    else if (imm->immediate != (int32_t) imm->immediate)
+        fatal_error("immediate %li does not fit in 32 bits", imm->immediate);
+    else
+        emit_dword(as, (uint32_t) imm->immediate);
+}
+
+static bool x86_is_imm8(const asm_node_operand_t *imm)
+{
+    return imm->immediate_label == NULL && imm->immediate == (int8_t) imm->immediate;
+}
+
+/*
+ * mov, add, sub and cmp: the opcode for "op r/m64, r64", then the one
+ * for "op r64, r/m64", and the /digit and opcode for an immediate.
+ */
+struct x86_binary
+{
+    uint8_t to_rm;
+    uint8_t to_reg;
+    uint8_t digit;
+    uint8_t imm;
+};
+
+static void x86_encode_binary(struct elf_assembler *as, const struct x86_binary *op,
+                              const asm_node_operand_t *src, const asm_node_operand_t *dst)
+{
+    if (src->type == ASM_OPERAND_IMMEDIATE)
+    {
+        /* A mov of a constant that needs all 64 bits is a movabs. */
+        if (op->imm == 0xC7 && x86_is_register(dst) && src->immediate_label == NULL &&
+            src->immediate != (int32_t) src->immediate)
+        {
+            x86_rex(as, true, 0, dst);
+            emit_byte(as, 0xB8 + (x86_register(dst->cpu_register) & 7));
+            emit_qword(as, (uint64_t) src->immediate);
+            return;
+        }
+
+        if (op->imm == 0x81 && x86_is_imm8(src))
+        {
+            x86_op(as, (const uint8_t[]) { 0x83 }, 1, op->digit, dst);
+            emit_byte(as, (uint8_t) src->immediate);
+            return;
+        }
+
+        x86_op(as, &op->imm, 1, op->digit, dst);
+        x86_imm32(as, src);
+    }
+    else if (x86_is_register(src))
+        x86_op(as, &op->to_rm, 1, x86_register(src->cpu_register), dst);
+    else if (x86_is_register(dst))
+        x86_op(as, &op->to_reg, 1, x86_register(dst->cpu_register), src);
+    else
+        fatal_error("instruction takes at most one memory operand");
+}
+
+static uint8_t x86_condition(asm_node_inst_t inst)
+{
+    switch (inst)
+    {
+        case ASM_INST_JE:
+        case ASM_INST_CMOVE:
+            return X86_CC_E;
+
+        case ASM_INST_JNE:
+        case ASM_INST_CMOVNE:
+            return X86_CC_NE;
+
+        case ASM_INST_JL:
+        case ASM_INST_CMOVL:
+            return X86_CC_L;
+
+        case ASM_INST_JG:
+        case ASM_INST_CMOVG:
+            return X86_CC_G;
+
+        case ASM_INST_JLE:
+        case ASM_INST_CMOVLE:
+            return X86_CC_LE;
+
+        case ASM_INST_JGE:
+        case ASM_INST_CMOVGE:
+            return X86_CC_GE;
+
+        default:
+            fatal_error("instruction has no condition");
+            return 0;
+    }
+}
+
+static void x86_check_operands(const asm_node_t *node, size_t count)
+{
+    if (node->inst_operand_count != count)
+        fatal_error("instruction %d takes %zu operands, but has %zu", node->inst, count, node->inst_operand_count);
+
+    if (node->inst_suffix != ASM_SUF_NONE && node->inst_suffix != ASM_SUF_QWORD)
+        fatal_error("only 64-bit operations can be encoded");
+}
+
+/* The register, or the memory, that an instruction with a single operand reads or writes. */
+static const asm_node_operand_t *x86_rm_operand(const asm_node_t *node)
+{
+    const asm_node_operand_t *operand = &node->inst_operands[node->inst_operand_count - 1];
+
+    if (!x86_is_register(operand) && !x86_is_memory(operand))
+        fatal_error("operand of instruction %d must be a register or memory", node->inst);
+
+    return operand;
+}
+
+static const asm_node_operand_t *x86_reg_operand(const asm_node_t *node)
+{
+    const asm_node_operand_t *operand = &node->inst_operands[node->inst_operand_count - 1];
+
+    if (!x86_is_register(operand))
+        fatal_error("destination of instruction %d must be a register", node->inst);
+
+    return operand;
+}
+
+static void x86_encode(struct elf_assembler *as, const asm_node_t *node)
+{
+    static const struct x86_binary mov = { 0x89, 0x8B, 0, 0xC7 };
+    static const struct x86_binary add = { 0x01, 0x03, 0, 0x81 };
+    static const struct x86_binary sub = { 0x29, 0x2B, 5, 0x81 };
+    static const struct x86_binary cmp = { 0x39, 0x3B, 7, 0x81 };
+    const asm_node_operand_t *operands = node->inst_operands;
+
+    switch (node->inst)
+    {
+        case ASM_INST_RET:
+            x86_check_operands(node, 0);
+            emit_byte(as, 0xC3);
+            break;
+
+        case ASM_INST_SYSCALL:
+            x86_check_operands(node, 0);
+            emit_byte(as, 0x0F);
+            emit_byte(as, 0x05);
+            break;
+
+        case ASM_INST_MOV:
+        case ASM_INST_ADD:
+        case ASM_INST_SUB:
+        case ASM_INST_CMP:
+            x86_check_operands(node, 2);
+            x86_encode_binary(as, node->inst == ASM_INST_MOV ? &mov : node->inst == ASM_INST_ADD ? &add :
+                                  node->inst == ASM_INST_SUB ? &sub : &cmp, &operands[0], &operands[1]);
+            break;
+
+        case ASM_INST_LEA:
+            x86_check_operands(node, 2);
+
+            if (!x86_is_memory(&operands[0]))
+                fatal_error("lea takes the address of memory");
+
+            x86_op(as, (const uint8_t[]) { 0x8D }, 1, x86_register(x86_reg_operand(node)->cpu_register), &operands[0]);
+            break;
+
+        case ASM_INST_IMUL:
+        {
+            x86_check_operands(node, 2);
+            const asm_node_operand_t *dst = x86_reg_operand(node);
+            uint8_t reg = x86_register(dst->cpu_register);
+
+            if (operands[0].type != ASM_OPERAND_IMMEDIATE)
+                x86_op(as, (const uint8_t[]) { 0x0F, 0xAF }, 2, reg, &operands[0]);
+            else if (x86_is_imm8(&operands[0]))
+            {
+                x86_op(as, (const uint8_t[]) { 0x6B }, 1, reg, dst);
+                emit_byte(as, (uint8_t) operands[0].immediate);
+            }
+            else
+            {
+                x86_op(as, (const uint8_t[]) { 0x69 }, 1, reg, dst);
+                x86_imm32(as, &operands[0]);
+            }
+
+            break;
+        }
+
+        case ASM_INST_CMOVE:
+        case ASM_INST_CMOVNE:
+        case ASM_INST_CMOVL:
+        case ASM_INST_CMOVG:
+        case ASM_INST_CMOVLE:
+        case ASM_INST_CMOVGE:
+            x86_check_operands(node, 2);
+            x86_op(as, (const uint8_t[]) { 0x0F, 0x40 | x86_condition(node->inst) }, 2,
+                   x86_register(x86_reg_operand(node)->cpu_register), &operands[0]);
+            break;
+
+        case ASM_INST_PUSH:
+        case ASM_INST_POP:
+        {
+            x86_check_operands(node, 1);
+            const asm_node_operand_t *rm = x86_rm_operand(node);
+
+            if (x86_is_register(rm))
+            {
+                uint8_t reg = x86_register(rm->cpu_register);
+
+                x86_rex(as, false, 0, rm);
+                emit_byte(as, (node->inst == ASM_INST_PUSH ? 0x50 : 0x58) + (reg & 7));
+            }
+            else
+            {
+                x86_rex(as, false, 0, rm);
+                emit_byte(as, node->inst == ASM_INST_PUSH ? 0xFF : 0x8F);
+                x86_modrm(as, node->inst == ASM_INST_PUSH ? 6 : 0, rm);
+            }
+
+            break;
+        }
+
+        case ASM_INST_CALL:
+        case ASM_INST_JMP:
+        case ASM_INST_JE:
+        case ASM_INST_JNE:
+        case ASM_INST_JL:
+        case ASM_INST_JG:
+        case ASM_INST_JLE:
+        case ASM_INST_JGE:
+            x86_check_operands(node, 1);
+
+            if (operands[0].type != ASM_OPERAND_IDENTIFIER)
+                fatal_error("only jumps and calls to labels can be encoded");
+
+            if (node->inst == ASM_INST_CALL)
+                emit_byte(as, 0xE8);
+            else if (node->inst == ASM_INST_JMP)
+                emit_byte(as, 0xE9);
+            else
+            {
+                emit_byte(as, 0x0F);
+                emit_byte(as, 0x80 | x86_condition(node->inst));
+            }
+
+            emit_label_field(as, operands[0].identifier, true);
+            break;
+
+        default:
+            fatal_error("instruction %d cannot be encoded", node->inst);
+    }
+}
+
+static void elf_assemble(struct elf_assembler *as, const asm_node_t *node)
+{
+    switch (node->type)
+    {
+        case ASM_ROOT:
+            for (size_t i = 0; i < node->root_size; i++)
+                elf_assemble(as, &node->root_children[i]);
+
+            break;
+
+        case ASM_INSTRUCTION_ARRAY:
+            for (size_t i = 0; i < node->array_size; i++)
+                elf_assemble(as, &node->array_children[i]);
+
+            break;
+
+        case ASM_LABEL:
+            elf_define_label(as, node->label_name, ELF_SECTION_TEXT, as->text.size);
+            break;
+
+        case ASM_DIRECTIVE:
+            if (strcmp(node->directive_name, "globl") != 0 && strcmp(node->directive_name, "global") != 0)
+                fatal_error("directive '.%s' cannot be assembled", node->directive_name);
+
+            map_set(&as->globals, node->directive_params, (void *) node, MAP_CREATE | MAP_OVERWRITE);
+            break;
+
+        case ASM_INSTRUCTION:
+            x86_encode(as, node);
+            break;
+
+        case ASM_EMPTY:
+            break;
+
+        default:
+            fatal_error("invalid node");
+    }
+}
+
+/* The bytes of a quoted string, as asm_print_header() writes it for .string. */
+static void elf_emit_string(struct elf_buffer *buffer, const char *param, bool terminate)
+{
+    const char *c = param;
+
+    if (*c++ != '"')
+        fatal_error("string data must be quoted: %s", param);
+
+    while (*c != '"')
+    {
+        uint8_t byte;
+
+        if (*c == 0)
+            fatal_error("unterminated string data: %s", param);
+
+        if (*c != '\\')
+            byte = (uint8_t) *c++;
+        else if (c[1] >= '0' && c[1] <= '7')
+        {
+            byte = 0;
+            c++;
+
+            for (int digits = 0; digits < 3 && *c >= '0' && *c <= '7'; digits++)
+                byte = (uint8_t) (byte * 8 + (*c++ - '0'));
+        }
+        else
+        {
+            switch (c[1])
+            {
+                case 'n': byte = '\n'; break;
+                case 't': byte = '\t'; break;
+                case 'r': byte = '\r'; break;
+                case 0: fatal_error("unterminated string data: %s", param); return;
+                default: byte = (uint8_t) c[1]; break;
+            }
+
+            c += 2;
+        }
+
+        elf_emit(buffer, &byte, 1);
+    }
+
+    if (terminate)
+        elf_emit(buffer, "", 1);
+}
+
+static void elf_assemble_data(struct elf_assembler *as, const asm_data_t *data)
+{
+    for (size_t i = 0; i < data->data_lbl_count; i++)
+    {
+        const asm_data_lbl_t *lbl = &data->data[i];
+
+        elf_define_label(as, lbl->label, ELF_SECTION_DATA, as->data.size);
+
+        if (strcmp(lbl->directive, "string") == 0 || strcmp(lbl->directive, "asciz") == 0)
+            elf_emit_string(&as->data, lbl->param, true);
+        else if (strcmp(lbl->directive, "ascii") == 0)
+            elf_emit_string(&as->data, lbl->param, false);
+        else
+            fatal_error("data directive '.%s' cannot be assembled", lbl->directive);
+    }
+}
+
+static size_t elf_string(struct elf_buffer *strtab, const char *str)
+{
+    size_t offset = strtab->size;
+
+    elf_emit(strtab, str, strlen(str) + 1);
+    return offset;
+}
+
+static void elf_symbol(struct elf_buffer *symtab, size_t name, unsigned char bind, unsigned char type,
+                       size_t section, size_t value)
+{
+    Elf64_Sym symbol = {
+        .st_name = (Elf64_Word) name,
+        .st_info = ELF64_ST_INFO(bind, type),
+        .st_shndx = (Elf64_Section) section,
+        .st_value = value
+    };
+
+    elf_emit(symtab, &symbol, sizeof symbol);
+}
+
+/*
+ * Resolves the jumps and calls to labels in .text, and turns the other
+ * fields into relocations against the sections, or against the symbols
+ * that the object leaves undefined.
+ */
+static void elf_relocate(struct elf_assembler *as, struct elf_buffer *symtab, struct elf_buffer *strtab,
+                         struct elf_buffer *rela)
+{
+    map_t undefined = map_create();
+
+    for (size_t i = 0; i < as->fixup_count; i++)
+    {
+        const struct elf_fixup *fixup = &as->fixups[i];
+        const struct elf_label *label = map_get(&as->labels, fixup->label);
+        Elf64_Rela relocation = { .r_offset = fixup->at, .r_addend = fixup->relative ? -4 : 0 };
+        size_t symbol;
+
+        if (label != NULL && label->section == ELF_SECTION_TEXT && fixup->relative)
+        {
+            int32_t rel = (int32_t) ((int64_t) label->offset - (int64_t) (fixup->at + 4));
+            memcpy(as->text.bytes + fixup->at, &rel, sizeof rel);
+            continue;
+        }
+
+        if (label != NULL)
+        {
+            symbol = label->section == ELF_SECTION_TEXT ? ELF_SYMBOL_TEXT : ELF_SYMBOL_DATA;
+            relocation.r_addend += (Elf64_Sxword) label->offset;
+        }
+        else
+        {
+            symbol = (size_t) (uintptr_t) map_get(&undefined, fixup->label);
+
+            if (symbol == 0)
+            {
+                symbol = symtab->size / sizeof (Elf64_Sym);
+                elf_symbol(symtab, elf_string(strtab, fixup->label), STB_GLOBAL, STT_NOTYPE, SHN_UNDEF, 0);
+                map_set(&undefined, fixup->label, (void *) (uintptr_t) symbol, MAP_CREATE);
+            }
+        }
+
+        relocation.r_info = ELF64_R_INFO(symbol, !fixup->relative ? R_X86_64_32S :
+                                                 label == NULL ? R_X86_64_PLT32 : R_X86_64_PC32);
+        elf_emit(rela, &relocation, sizeof relocation);
+    }
+
+    map_free(&undefined);
+}
+
+static void elf_section(Elf64_Shdr *header, struct elf_buffer *shstrtab, const char *name, Elf64_Word type,
+                        Elf64_Xword flags, size_t offset, size_t size, size_t alignment)
+{
+    header->sh_name = (Elf64_Word) elf_string(shstrtab, name);
+    header->sh_type = type;
+    header->sh_flags = flags;
+    header->sh_offset = offset;
+    header->sh_size = size;
+    header->sh_addralign = alignment;
+}
+
+/* Appends a section to the object and returns its offset in the file. */
+static size_t elf_place(struct elf_buffer *object, const struct elf_buffer *section, size_t alignment)
+{
+    elf_align(object, alignment);
+
+    size_t offset = object->size;
+
+    elf_emit(object, section->bytes, section->size);
+    return offset;
+}
+
+bool asm_elf_write_object(FILE *file, asm_data_t *data, asm_node_t *node)
+{
+    struct elf_assembler as = {
+        .labels = map_create(),
+        .globals = map_create()
+    };
+    struct elf_buffer symtab = { 0 }, strtab = { 0 }, shstrtab = { 0 }, rela = { 0 }, object = { 0 };
+    Elf64_Shdr headers[ELF_SECTION_COUNT] = { 0 };
+
+    elf_assemble(&as, node);
+    elf_assemble_data(&as, data);
+
+    /* Local labels, like the ones of the compiler that start with a dot, stay out of the symbol table. */
+    elf_emit(&strtab, "", 1);
+    elf_symbol(&symtab, 0, STB_LOCAL, STT_NOTYPE, SHN_UNDEF, 0);
+    elf_symbol(&symtab, 0, STB_LOCAL, STT_SECTION, ELF_SECTION_TEXT, 0);
+    elf_symbol(&symtab, 0, STB_LOCAL, STT_SECTION, ELF_SECTION_DATA, 0);
+
+    for (int global = 0; global < 2; global++)
+    {
+        MAP_FOREACH(&as.labels)
+        {
+            const char *name = as.labels.elements[i].key;
+            const struct elf_label *label = as.labels.elements[i].value;
+
+            if ((map_get(&as.globals, name) != NULL) != global || (!global && name[0] == '.'))
+                continue;
+
+            elf_symbol(&symtab, elf_string(&strtab, name), global ? STB_GLOBAL : STB_LOCAL, STT_NOTYPE,
+                       label->section, label->offset);
+        }
+
+        if (!global)
+            headers[ELF_SECTION_SYMTAB].sh_info = (Elf64_Word) (symtab.size / sizeof (Elf64_Sym));
+    }
+
+    elf_relocate(&as, &symtab, &strtab, &rela);
+
+    elf_emit(&object, &(Elf64_Ehdr) { 0 }, sizeof (Elf64_Ehdr));
+    elf_emit(&shstrtab, "", 1);
+    elf_section(&headers[ELF_SECTION_TEXT], &shstrtab, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR,
+                elf_place(&object, &as.text, 16), as.text.size, 16);
+    elf_section(&headers[ELF_SECTION_DATA], &shstrtab, ".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE,
+                elf_place(&object, &as.data, 8), as.data.size, 8);
+    elf_section(&headers[ELF_SECTION_RELA_TEXT], &shstrtab, ".rela.text", SHT_RELA, SHF_INFO_LINK,
+                elf_place(&object, &rela, 8), rela.size, 8);
+    headers[ELF_SECTION_RELA_TEXT].sh_link = ELF_SECTION_SYMTAB;
+    headers[ELF_SECTION_RELA_TEXT].sh_info = ELF_SECTION_TEXT;
+    headers[ELF_SECTION_RELA_TEXT].sh_entsize = sizeof (Elf64_Rela);
+    elf_section(&headers[ELF_SECTION_SYMTAB], &shstrtab, ".symtab", SHT_SYMTAB, 0,
+                elf_place(&object, &symtab, 8), symtab.size, 8);
+    headers[ELF_SECTION_SYMTAB].sh_link = ELF_SECTION_STRTAB;
+    headers[ELF_SECTION_SYMTAB].sh_entsize = sizeof (Elf64_Sym);
+    elf_section(&headers[ELF_SECTION_STRTAB], &shstrtab, ".strtab", SHT_STRTAB, 0,
+                elf_place(&object, &strtab, 1), strtab.size, 1);
+    elf_section(&headers[ELF_SECTION_NOTE_GNU_STACK], &shstrtab, ".note.GNU-stack", SHT_PROGBITS, 0,
+                object.size, 0, 1);
+
+    /* .shstrtab names itself, so it is placed once all the names are in. */
+    size_t shstrtab_name = elf_string(&shstrtab, ".shstrtab");
+    elf_section(&headers[ELF_SECTION_SHSTRTAB], &shstrtab, "", SHT_STRTAB, 0,
+                elf_place(&object, &shstrtab, 1), shstrtab.size, 1);
+    headers[ELF_SECTION_SHSTRTAB].sh_name = (Elf64_Word) shstrtab_name;
+
+    elf_align(&object, 8);
+
+    Elf64_Ehdr header = {
+        .e_ident = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64, ELFDATA2LSB, EV_CURRENT, ELFOSABI_SYSV },
+        .e_type = ET_REL,
+        .e_machine = EM_X86_64,
+        .e_version = EV_CURRENT,
+        .e_shoff = object.size,
+        .e_ehsize = sizeof (Elf64_Ehdr),
+        .e_shentsize = sizeof (Elf64_Shdr),
+        .e_shnum = ELF_SECTION_COUNT,
+        .e_shstrndx = ELF_SECTION_SHSTRTAB
+    };
+
+    memcpy(object.bytes, &header, sizeof header);
+    elf_emit(&object, headers, sizeof headers);
+
+    if (fwrite(object.bytes, 1, object.size, file) != object.size)
+        fatal_error("could not write the object file");
+
+    for (size_t i = 0; i < as.fixup_count; i++)
+        free(as.fixups[i].label);
+
+    MAP_FOREACH(&as.labels)
+    {
+        free(as.labels.elements[i].value);
+    }
+
+    free(as.fixups);
+    free(as.text.bytes);
+    free(as.data.bytes);
+    free(symtab.bytes);
+    free(strtab.bytes);
+    free(shstrtab.bytes);
+    free(rela.bytes);
+    free(object.bytes);
+    map_free(&as.labels);
+    map_free(&as.globals);
+    return true;
+}
+
+#else
+
+bool asm_elf_write_object(FILE *file, asm_data_t *data, asm_node_t *node)
+{
+    (void) file;
+    (void) data;
+    (void) node;
+    return false;
+}
+
+#endif
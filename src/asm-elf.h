@@ -0,0 +1,28 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_ASM_ELF_H
+#define BLAZESCRIPT_ASM_ELF_H
+
+#include "asm.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Assembler for the x86-64 code that blazec generates. It encodes the
+ * instructions of the tree itself and writes an ELF64 relocatable object,
+ * the same one that as would write for the text asm_print() gives it, so
+ * that compiling a program does not have to start another process.
+ *
+ * Jumps and calls always take a rel32, and memory operands a disp32.
+ * Calls to functions that are not in the tree are left to the linker.
+ * The rest of the tree is resolved here, except for the addresses of
+ * labels, which are still relocations.
+ *
+ * Returns false, without writing anything, on systems other than Linux,
+ * where blazec falls back to as.
+ */
+bool asm_elf_write_object(FILE *file, asm_data_t *data, asm_node_t *node);
+
+#endif /* BLAZESCRIPT_ASM_ELF_H */
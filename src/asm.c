@@ -175,6 +175,21 @@ char *asm_inst_to_str(asm_node_inst_t inst, asm_inst_suffix_t suffix)
         [ASM_INST_POP] = "pop",
         [ASM_INST_RET] = "ret",
         [ASM_INST_SYSCALL] = "syscall",
+        [ASM_INST_IMUL] = "imul",
+        [ASM_INST_CMP] = "cmp",
+        [ASM_INST_JMP] = "jmp",
+        [ASM_INST_JE] = "je",
+        [ASM_INST_JNE] = "jne",
+        [ASM_INST_JL] = "jl",
+        [ASM_INST_JG] = "jg",
+        [ASM_INST_JLE] = "jle",
+        [ASM_INST_JGE] = "jge",
+        [ASM_INST_CMOVE] = "cmove",
+        [ASM_INST_CMOVNE] = "cmovne",
+        [ASM_INST_CMOVL] = "cmovl",
+        [ASM_INST_CMOVG] = "cmovg",
+        [ASM_INST_CMOVLE] = "cmovle",
+        [ASM_INST_CMOVGE] = "cmovge",
     };
 
     if (inst >= (sizeof (translate) / sizeof (translate[0])))
@@ -325,12 +340,19 @@ void asm_print_header(FILE *file, asm_data_t *data)
 
 void asm_data_free(asm_data_t *data)
 {
-    for (size_t i = 0; i < data->data_lbl_count; i++)
+    asm_data_truncate(data, 0);
+    free(data->data);
+}
+
+/* Drops the data pushed after the first count labels. */
+void asm_data_truncate(asm_data_t *data, size_t count)
+{
+    for (size_t i = count; i < data->data_lbl_count; i++)
     {
         free(data->data[i].label);
         free(data->data[i].param);
         free(data->data[i].directive);
     }
 
-    free(data->data);
+    data->data_lbl_count = count;
 }
\ No newline at end of file
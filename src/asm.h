@@ -50,7 +50,22 @@ typedef enum
     ASM_INST_SYSCALL,
     ASM_INST_CALL,
     ASM_INST_ADD,
-    ASM_INST_SUB
+    ASM_INST_SUB,
+    ASM_INST_IMUL,
+    ASM_INST_CMP,
+    ASM_INST_JMP,
+    ASM_INST_JE,
+    ASM_INST_JNE,
+    ASM_INST_JL,
+    ASM_INST_JG,
+    ASM_INST_JLE,
+    ASM_INST_JGE,
+    ASM_INST_CMOVE,
+    ASM_INST_CMOVNE,
+    ASM_INST_CMOVL,
+    ASM_INST_CMOVG,
+    ASM_INST_CMOVLE,
+    ASM_INST_CMOVGE
 } asm_node_inst_t;
 
 typedef enum
@@ -175,6 +190,7 @@ void asm_print(FILE *file, enum blazec_arch arch, asm_node_t *node);
 asm_node_t asm_create_inst_mono_op(asm_node_inst_t inst, asm_inst_suffix_t suffix, asm_node_operand_t operand1);
 void asm_data_push(struct compilation_context *ctx, char *lbl, char *directive, char *param);
 void asm_data_free(asm_data_t *data);
+void asm_data_truncate(asm_data_t *data, size_t count);
 void asm_print_header(FILE *file, asm_data_t *data);
 void asm_push_inst_bin_op(asm_node_t *target, asm_node_inst_t inst, asm_inst_suffix_t suffix, asm_node_operand_t operand1, asm_node_operand_t operand2);
 void asm_push_inst_mono_op(asm_node_t *target, asm_node_inst_t inst, asm_inst_suffix_t suffix, asm_node_operand_t operand1);
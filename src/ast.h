@@ -52,6 +52,7 @@ typedef struct ast_int_lit
 typedef struct ast_str_lit
 {
     char *strval;
+    struct value *value;
 } ast_string_t;
 
 typedef struct ast_binexpr
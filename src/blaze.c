@@ -1,22 +1,102 @@
 #define _GNU_SOURCE
 
+#include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "alloca.h"
+#include "bytecode.h"
+#include "compile-bytecode.h"
+#include "constpool.h"
 #include "eval.h"
 #include "file.h"
 #include "lexer.h"
+#include "log.h"
+#include "opcode.h"
 #include "parser.h"
 #include "utils.h"
 #include "valalloc.h"
 #include "valmap.h"
+#include "vm-context.h"
+
+/*
+ * ENGINE_AUTO runs the program on the bytecode VM when it can be compiled
+ * and falls back to the tree-walking evaluator otherwise.
+ */
+enum blaze_engine
+{
+    ENGINE_TREE,
+    ENGINE_VM,
+    ENGINE_AUTO
+};
+
+static struct option const long_options[] = {
+    { "engine", required_argument, NULL, 'e' },
+    { 0,        0,                 0,    0  }
+};
 
 static struct lex lex;
 static struct parser parser;
+static struct constpool constants;
+static enum blaze_engine engine = ENGINE_TREE;
+
+static void constants_free()
+{
+    constpool_free(&constants);
+}
+
+static enum blaze_engine engine_str_to_type(const char *name)
+{
+    if (strcmp(name, "tree") == 0)
+        return ENGINE_TREE;
+
+    if (strcmp(name, "vm") == 0)
+        return ENGINE_VM;
+
+    if (strcmp(name, "auto") == 0)
+        return ENGINE_AUTO;
+
+    fatal_error("invalid engine '%s' (expected tree, vm or auto)", name);
+    return ENGINE_TREE;
+}
+
+/*
+ * Tries to compile and run the program on the bytecode VM. Returns false
+ * when the program cannot be compiled and the caller should evaluate it
+ * instead.
+ */
+static bool run_bytecode(const ast_node_t *node, int *exit_code)
+{
+    struct bytecode bytecode;
+    char *error = NULL;
+
+    if (!compile_bytecode(node, &constants, &bytecode, &error))
+    {
+        if (engine == ENGINE_VM)
+            fatal_error("cannot run on the bytecode VM: %s", error);
+
+        log_debug("Falling back to the evaluator: %s", error);
+        free(error);
+        return false;
+    }
+
+    struct vm_context vm;
 
-static void process_file(const char *name)
+    execution_init(&vm, &bytecode);
+
+    if (!bytecode_exec(&vm))
+        fatal_error("%s", vm.error);
+
+    *exit_code = vm.exit_code;
+    execution_end(&vm);
+    bytecode_free(&bytecode);
+    return true;
+}
+
+static int process_file(const char *name)
 {
+    int exit_code = 0;
+
     struct filebuf buf = filebuf_init(name);
     filebuf_read(&buf);
     filebuf_close(&buf);
@@ -26,29 +106,64 @@ static void process_file(const char *name)
     blaze_debug__lex_print(&lex);
 #endif
     parser = parser_init_from_lex(&lex);
+    parser_set_constpool(&parser, &constants);
     ast_node_t node = parser_create_ast_node(&parser);
 #ifndef NDEBUG
     blaze_debug__print_ast(&node);
 #endif
-    scope_t *scope = scope_create_global();
-    eval(scope, &node);
-    scope_free(scope);
+
+    if (engine == ENGINE_TREE || !run_bytecode(&node, &exit_code))
+    {
+        scope_t *scope = scope_create_global();
+        eval(scope, &node);
+        scope_free(scope);
+    }
+
     parser_ast_free_inner(&node);
     parser_free(&parser);
     lex_free(&lex);
     filebuf_free(&buf);
+    return exit_code;
+}
+
+static void process_options(int argc, char **argv)
+{
+    int c;
+
+    opterr = 0;
+
+    while ((c = getopt_long(argc, argv, ":e:", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 'e':
+                engine = engine_str_to_type(optarg);
+                break;
+
+            case ':':
+                fatal_error("option '%s' requires an argument", argv[optind - 1]);
+                break;
+
+            default:
+                fatal_error("invalid option '%s'", argv[optind - 1]);
+        }
+    }
 }
 
 int main(int argc, char **argv)
 {
+    process_options(argc, argv);
+
     /* We've temporarily removed the REPL support. */
-    if (argc < 2)
+    if (optind >= argc)
     {
         fatal_error("No input files");
     }
 
+    /* Registered first so that it runs after every value is released. */
+    constants = constpool_create();
+    atexit(&constants_free);
     atexit(&val_alloc_tbl_global_free);
     val_alloc_tbl_global_init();
-    process_file(argv[1]);
-    return 0;
+    return process_file(argv[optind]);
 }
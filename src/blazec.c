@@ -14,6 +14,7 @@
 #include <unistd.h>
 #include <libgen.h>
 #include "arch.h"
+#include "asm-elf.h"
 #include "compile.h"
 #include "file.h"
 #include "lexer.h"
@@ -41,6 +42,7 @@ static struct option const long_options[] = {
     { "compile",     no_argument,       NULL, 'c' },
     { "executable",  no_argument,       NULL, 'x' },
     { "arch",  required_argument,       NULL, 'a' },
+    { "system-assembler", no_argument,  NULL, 'A' },
     { 0,             0,                 0,    0  }
 };
 
@@ -58,6 +60,7 @@ struct blazec_context
     char *infile;
     enum blazec_generation_mode mode;
     enum blazec_arch arch;
+    bool system_assembler;
 };
 
 static void blazec_context_free(struct blazec_context *context)
@@ -90,7 +93,7 @@ static void blazec_process_options(int argc, char **argv, struct blazec_context
     while (true)
     {
         int option_index = 1;
-        c = getopt_long(argc, argv, ":o:SGcxa:", long_options, &option_index);
+        c = getopt_long(argc, argv, ":o:SGcxa:A", long_options, &option_index);
 
         if (c == -1)
             break;
@@ -105,6 +108,10 @@ static void blazec_process_options(int argc, char **argv, struct blazec_context
                 context->arch = arch_str_to_type(optarg);
                 break;
 
+            case 'A':
+                context->system_assembler = true;
+                break;
+
             case 'S':
                 context->mode = GEN_ASM;
                 break;
@@ -149,8 +156,29 @@ static void blazec_write_assembly_file(struct compilation_context *compilation_c
     fclose(file);
 }
 
-static void blazec_write_object_file(struct compilation_context *compilation_context, asm_node_t *node, char *filename)
+/*
+ * Assembles x86-64 code in this process, unless asked to use the system
+ * assembler, which stays as a way to cross-check the object it writes.
+ */
+static void blazec_write_object_file(struct blazec_context *context, struct compilation_context *compilation_context,
+                                     asm_node_t *node, char *filename)
 {
+    if (!context->system_assembler && compilation_context->arch == ARCH_X86_64)
+    {
+        FILE *object = fopen(filename, "wb");
+
+        if (object == NULL)
+            fatal_error("could not open '%s': %s", filename, strerror(errno));
+
+        bool written = asm_elf_write_object(object, &compilation_context->asm_data, node);
+
+        if (fclose(object) != 0)
+            fatal_error("could not write '%s': %s", filename, strerror(errno));
+
+        if (written)
+            return;
+    }
+
     char tmp_file_name[] = "/tmp/blazec-compiled-XXXXXX";
     int fd = mkstemp(tmp_file_name);
     FILE *file = fdopen(fd, "wb+");
@@ -202,7 +230,8 @@ static void blazec_write_object_file(struct compilation_context *compilation_con
     unlink(tmp_file_name);
 }
 
-static void blazec_write_executable_file(struct compilation_context *compilation_context, asm_node_t *node, char *filename)
+static void blazec_write_executable_file(struct blazec_context *context, struct compilation_context *compilation_context,
+                                         asm_node_t *node, char *filename)
 {
     char tmp_file_name[36] = "/tmp/blazec-compiled-obj-XXXXXX";
     int fd = mkstemp(tmp_file_name);
@@ -212,7 +241,7 @@ static void blazec_write_executable_file(struct compilation_context *compilation
     if (_chmod(tmp_file_name, _S_IWRITE | _S_IREAD) == -1) 
         fatal_error("could not set file permissions");
 #endif
-    blazec_write_object_file(compilation_context, node, tmp_file_name);
+    blazec_write_object_file(context, compilation_context, node, tmp_file_name);
 
 #ifndef BLAZE_WINDOWS
     pid_t pid = fork();
@@ -284,10 +313,10 @@ static void blazec_compile_file(struct blazec_context *context)
             blazec_write_assembly_file(&compilation_context, &asm_node, context->outfile);
             break;
         case GEN_OBJ:
-            blazec_write_object_file(&compilation_context, &asm_node, context->outfile);
+            blazec_write_object_file(context, &compilation_context, &asm_node, context->outfile);
             break;
         case GEN_LINK_EXEC:
-            blazec_write_executable_file(&compilation_context, &asm_node, context->outfile);
+            blazec_write_executable_file(context, &compilation_context, &asm_node, context->outfile);
             break;
         case GEN_ASM_STDOUT:
             blazec_write_assembly(&compilation_context, &asm_node, stdout);
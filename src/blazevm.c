@@ -3,36 +3,264 @@
 */
 
 #include "bytecode.h"
+#include "bytecode-file.h"
+#include "bytecode-verify.h"
+#include "compile-bytecode.h"
+#include "constpool.h"
 #include "disassemble.h"
 #include "file.h"
+#include "lexer.h"
 #include "opcode.h"
+#include "parser.h"
 #include "utils.h"
+#include "vm-context.h"
+#include "vm-profile.h"
+#include "vm-recorder.h"
+#include "vm-snapshot.h"
+#include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct option const long_options[] = {
+    { "output",     required_argument, NULL, 'o' },
+    { "quickening", no_argument,       NULL, 'q' },
+    { "jit",        no_argument,       NULL, 'j' },
+    { "perf-map",   no_argument,       NULL, 'p' },
+    { "heap-size",  required_argument, NULL, 'h' },
+    { "disassemble", no_argument,      NULL, 'd' },
+    { "record",     optional_argument, NULL, 'r' },
+    { "profile",    no_argument,       NULL, 'P' },
+    { 0,            0,                 0,    0  }
+};
+
+/* Set by -q: disassemble the program after it ran, with quickening counters. */
+static bool show_quickening = false;
+
+/* Set by -d: disassemble the program before running it. */
+static bool show_disassembly = false;
+
+/* Set by --record: how many instructions the flight recorder keeps, if any. */
+static size_t record_size = 0;
+
+/* Set by --profile: count what the program runs, and report it when it stops. */
+static bool profile = false;
+
+/* Set by --jit and --perf-map; see struct vm_context. */
+static bool use_jit = false;
+static bool write_perf_map = false;
+
+/* Set by --heap-size: the most memory the VM heap may grow to, in bytes. */
+static size_t heap_limit = VM_HEAP_DEFAULT_LIMIT;
+
+static _Noreturn void execute(struct bytecode *bytecode, bool report_halt)
+{
+    struct vm_context vm;
+    char *error = NULL;
+
+    execution_init(&vm, bytecode);
+    vm.jit = use_jit;
+    vm.perf_map = write_perf_map;
+    vm.heap.limit = heap_limit;
+
+    if (record_size > 0)
+        vm.recorder = vm_recorder_create(record_size);
+
+    if (profile)
+        vm.profile = vm_profile_create(bytecode->size);
+
+    if (!vm_snapshot_restore(&vm, &error))
+        fatal_error("cannot resume the snapshot: %s", error);
+
+    if (show_disassembly)
+        disassemble(stdout, bytecode);
+
+    bool ok = bytecode_exec(&vm);
+
+    if (vm.profile != NULL)
+        vm_profile_report(vm.profile, bytecode, stderr);
+
+    if (!ok)
+        fatal_error("%s", vm.error);
+
+    if (report_halt)
+        puts("System halted");
+
+    if (show_quickening)
+        disassemble_run(stderr, &vm);
+
+    uint8_t exit_code = vm.exit_code;
+
+    execution_end(&vm);
+    bytecode_free(bytecode);
+    exit(exit_code);
+}
 
 static _Noreturn void process_file(const char *filepath)
 {
     struct bytecode bytecode;
+    char *error = NULL;
     struct filebuf filebuf = filebuf_init(filepath);
     filebuf_read(&filebuf);
     filebuf_close(&filebuf);
     bytecode = bytecode_init_from_filebuf(&filebuf);
     filebuf_free(&filebuf);
-    disassemble(stdout, &bytecode);
 
-    execution_init();
+    if (!bytecode_verify(&bytecode, &error))
+        fatal_error("%s: %s", filepath, error);
+
+    execute(&bytecode, true);
+}
+
+/*
+ * Compiles a blaze script to bytecode. The constant pool is deliberately
+ * never freed since the bytecode refers to its strings.
+ */
+static struct bytecode compile_script(const char *filepath)
+{
+    static struct constpool constants;
+    struct bytecode bytecode;
+    char *error = NULL;
+    struct filebuf filebuf = filebuf_init(filepath);
+    filebuf_read(&filebuf);
+    filebuf_close(&filebuf);
+
+    struct lex lex = lex_init((char *) filepath, filebuf.content);
+    lex_analyze(&lex);
+
+    struct parser parser = parser_init_from_lex(&lex);
+    constants = constpool_create();
+    parser_set_constpool(&parser, &constants);
+
+    ast_node_t node = parser_create_ast_node(&parser);
+
+    if (!compile_bytecode(&node, &constants, &bytecode, &error))
+        fatal_error("cannot compile '%s': %s", filepath, error);
+
+    parser_ast_free_inner(&node);
+    parser_free(&parser);
+    lex_free(&lex);
+    filebuf_free(&filebuf);
+    return bytecode;
+}
+
+static _Noreturn void process_script(const char *filepath)
+{
+    struct bytecode bytecode = compile_script(filepath);
+    execute(&bytecode, false);
+}
+
+/* Saves a compiled script so that it can be run later without compiling. */
+static _Noreturn void process_output(const char *filepath, const char *output)
+{
+    struct bytecode bytecode = compile_script(filepath);
+    char *error = NULL;
+
+    if (!bytecode_file_write(&bytecode, output, &error))
+        fatal_error("%s", error);
 
-    if (!bytecode_exec(&bytecode))
+    bytecode_free(&bytecode);
+    exit(0);
+}
+
+/* Runs a program saved with -o; it behaves exactly like the script did. */
+static _Noreturn void process_container(const char *filepath)
+{
+    static struct constpool constants;
+    struct bytecode bytecode;
+    char *error = NULL;
+
+    constants = constpool_create();
+
+    if (!bytecode_file_load(filepath, &constants, &bytecode, &error))
+        fatal_error("%s: %s", filepath, error);
+
+    execute(&bytecode, false);
+}
+
+static bool is_script(const char *filepath)
+{
+    size_t length = strlen(filepath);
+    return length > 3 && strcmp(filepath + length - 3, ".bl") == 0;
+}
+
+/* Returns the file given with -o, if any, and sets the other flags. */
+static const char *process_options(int argc, char **argv)
+{
+    const char *output = NULL;
+    int c;
+
+    opterr = 0;
+
+    while ((c = getopt_long(argc, argv, ":o:qd", long_options, NULL)) != -1)
     {
-        execution_end();
-        bytecode_free(&bytecode);
-        fatal_error("%s", bytecode_error);
-        free(bytecode_error);
-        exit(-1);
+        switch (c)
+        {
+            case 'o':
+                output = optarg;
+                break;
+
+            case 'q':
+                show_quickening = true;
+                break;
+
+            case 'd':
+                show_disassembly = true;
+                break;
+
+            case 'r':
+            {
+                char *end = NULL;
+
+                record_size = optarg == NULL ? VM_RECORDER_DEFAULT_SIZE : strtoull(optarg, &end, 10);
+
+                if (optarg != NULL && (end == optarg || *end != '\0' || record_size == 0 || record_size > VM_RECORDER_MAX_SIZE))
+                    fatal_error("invalid flight recorder size '%s'", optarg);
+
+                break;
+            }
+
+            case 'P':
+                profile = true;
+                break;
+
+            case 'j':
+                use_jit = true;
+                break;
+
+            case 'p':
+                use_jit = true;
+                write_perf_map = true;
+                break;
+
+            case 'h':
+            {
+                char *end;
+                unsigned long long size = strtoull(optarg, &end, 10);
+
+                if (*end == 'K' || *end == 'M')
+                    size <<= *end++ == 'K' ? 10 : 20;
+
+                if (end == optarg || *end != '\0')
+                    fatal_error("invalid heap size '%s'", optarg);
+
+                heap_limit = (size_t) size;
+                break;
+            }
+
+            case ':':
+                fatal_error("option '%s' requires an argument", argv[optind - 1]);
+                break;
+
+            default:
+                fatal_error("invalid option '%s'", argv[optind - 1]);
+        }
     }
 
-    execution_end();
-    bytecode_free(&bytecode);
-    exit(bytecode_exit_code);
+    if (profile && record_size > 0)
+        fatal_error("--profile and --record cannot be used together");
+
+    return output;
 }
 
 static bool is_little_endian()
@@ -48,48 +276,26 @@ int main(int argc, char **argv)
     if (!is_little_endian())
         fatal_error("blaze vm can only run on a system with an LE CPU");
 
-    /*
+    const char *output = process_options(argc, argv);
 
-    struct bytecode bytecode = bytecode_init();
-
-    bytecode_push_byte(&bytecode, OP_MOV_IR);
-    bytecode_push_byte(&bytecode, R0);
-    bytecode_push_qword(&bytecode, SYS_PRINT);
-
-    bytecode_push_byte(&bytecode, OP_MOV_IR);
-    bytecode_push_byte(&bytecode, R1);
-    bytecode_push_qword(&bytecode, 0x02);
-
-    bytecode_push_byte(&bytecode, OP_MOV_IR);
-    bytecode_push_byte(&bytecode, R2);
-    char *str = "Hello world!";
-    bytecode_push_qword(&bytecode, (uintptr_t) str);
-    bytecode_push_byte(&bytecode, OP_SYSCALL);
-
-    bytecode_push_byte(&bytecode, OP_MOV_IR);
-    bytecode_push_byte(&bytecode, R2);
-    str = "LMAO!";
-    bytecode_push_qword(&bytecode, (uintptr_t) str);
-
-    bytecode_push_byte(&bytecode, OP_SYSCALL);
-    bytecode_push_byte(&bytecode, OP_HLT);
+    if (optind >= argc)
+       fatal_error("no input file specified");
 
-    disassemble(stdout, &bytecode);
+    const char *filepath = argv[optind];
 
-    if (!bytecode_exec(&bytecode))
+    if (output != NULL)
     {
-        bytecode_free(&bytecode);
-        fatal_error("%s", bytecode_error);
-        free(bytecode_error);
-        exit(-1);
+        if (!is_script(filepath))
+            fatal_error("only blaze scripts can be compiled with -o");
+
+        process_output(filepath, output);
     }
 
-    bytecode_free(&bytecode);
-    exit(bytecode_exit_code);
-     */
-    
-    if (argc < 2)
-       fatal_error("no input file specified");
+    if (is_script(filepath))
+        process_script(filepath);
+
+    if (bytecode_file_probe(filepath))
+        process_container(filepath);
 
-    process_file(argv[1]);
+    process_file(filepath);
 }
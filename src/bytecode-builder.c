@@ -0,0 +1,83 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#include "bytecode-builder.h"
+#include "alloca.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct bytecode_builder bytecode_builder_init()
+{
+    return (struct bytecode_builder) {
+        .bytecode = bytecode_init(),
+        .labels = NULL,
+        .label_count = 0,
+        .fixups = NULL,
+        .fixup_count = 0
+    };
+}
+
+size_t bytecode_builder_label(struct bytecode_builder *builder)
+{
+    builder->labels = xrealloc(builder->labels, sizeof (size_t) * (builder->label_count + 1));
+    builder->labels[builder->label_count] = BYTECODE_LABEL_UNBOUND;
+    return builder->label_count++;
+}
+
+void bytecode_builder_bind(struct bytecode_builder *builder, size_t label)
+{
+    assert(label < builder->label_count && "Invalid label");
+    assert(builder->labels[label] == BYTECODE_LABEL_UNBOUND && "Label bound twice");
+    builder->labels[label] = builder->bytecode.size;
+}
+
+void bytecode_builder_push_label(struct bytecode_builder *builder, size_t label)
+{
+    assert(label < builder->label_count && "Invalid label");
+
+    builder->fixups = xrealloc(builder->fixups, sizeof (struct bytecode_fixup) * (builder->fixup_count + 1));
+    builder->fixups[builder->fixup_count++] = (struct bytecode_fixup) {
+        .offset = builder->bytecode.size,
+        .label = label
+    };
+
+    bytecode_push_dword(&builder->bytecode, 0);
+}
+
+/*
+ * Patches every label reference and hands the finished bytecode over to
+ * the caller. The builder is released.
+ */
+struct bytecode bytecode_builder_finish(struct bytecode_builder *builder)
+{
+    for (size_t i = 0; i < builder->fixup_count; i++)
+    {
+        size_t target = builder->labels[builder->fixups[i].label];
+        uint32_t target_dword = (uint32_t) target;
+
+        assert(target != BYTECODE_LABEL_UNBOUND && "Reference to an unbound label");
+        memcpy(builder->bytecode.bytes + builder->fixups[i].offset, &target_dword, sizeof (uint32_t));
+    }
+
+    struct bytecode bytecode = builder->bytecode;
+
+    builder->bytecode.bytes = NULL;
+    bytecode_builder_free(builder);
+    return bytecode;
+}
+
+void bytecode_builder_free(struct bytecode_builder *builder)
+{
+    if (builder->bytecode.bytes != NULL)
+        bytecode_free(&builder->bytecode);
+
+    free(builder->labels);
+    free(builder->fixups);
+    builder->labels = NULL;
+    builder->fixups = NULL;
+    builder->label_count = 0;
+    builder->fixup_count = 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_BYTECODE_BUILDER_H
+#define BLAZESCRIPT_BYTECODE_BUILDER_H
+
+#include <stddef.h>
+#include "bytecode.h"
+
+#define BYTECODE_LABEL_UNBOUND ((size_t) -1)
+
+struct bytecode_fixup
+{
+    size_t offset;
+    size_t label;
+};
+
+/*
+ * Assembles a bytecode stream whose jump targets may not be known yet.
+ * References to a label are emitted as 32-bit placeholders and patched
+ * with the label's offset from the start of the code when the builder is
+ * finished.
+ */
+struct bytecode_builder
+{
+    struct bytecode bytecode;
+    size_t *labels;
+    size_t label_count;
+    struct bytecode_fixup *fixups;
+    size_t fixup_count;
+};
+
+struct bytecode_builder bytecode_builder_init();
+size_t bytecode_builder_label(struct bytecode_builder *builder);
+void bytecode_builder_bind(struct bytecode_builder *builder, size_t label);
+void bytecode_builder_push_label(struct bytecode_builder *builder, size_t label);
+struct bytecode bytecode_builder_finish(struct bytecode_builder *builder);
+void bytecode_builder_free(struct bytecode_builder *builder);
+
+#endif /* BLAZESCRIPT_BYTECODE_BUILDER_H */
@@ -0,0 +1,385 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#define _GNU_SOURCE
+
+#include "bytecode-file.h"
+#include "bytecode-verify.h"
+#include "opcode.h"
+#include "rcstring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool file_error(char **error, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+
+    if (vasprintf(error, fmt, args) < 0)
+        *error = NULL;
+
+    va_end(args);
+    return false;
+}
+
+bool bytecode_file_probe(const char *path)
+{
+    uint8_t magic[4];
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL)
+        return false;
+
+    bool is_container = fread(magic, 1, sizeof magic, fp) == sizeof magic &&
+                        memcmp(magic, BYTECODE_FILE_MAGIC, sizeof magic) == 0;
+
+    fclose(fp);
+    return is_container;
+}
+
+/* Writes a u8 type or tag, a u32 length and the payload. */
+static void write_entry(FILE *fp, uint64_t prefix, size_t prefix_size, const void *data, uint32_t length)
+{
+    fwrite(&prefix, prefix_size, 1, fp);
+    fwrite(&length, sizeof length, 1, fp);
+    fwrite(data, 1, length, fp);
+}
+
+/*
+ * Makes the superinstructions here rather than in every VM that runs the
+ * file, so that they can all run its code where it is mapped. Returns
+ * whether there were any.
+ */
+static bool write_code(FILE *fp, const struct bytecode *bytecode)
+{
+    bool fused = false;
+
+    for (size_t offset = 0, size; offset < bytecode->size; offset += size)
+    {
+        size = instruction_get_size(bytecode->bytes + offset, bytecode->size - offset);
+
+        if (size == 0 || bytecode->bytes[offset] >= OPCODE_COUNT)
+        {
+            fwrite(bytecode->bytes + offset, 1, bytecode->size - offset, fp);
+            break;
+        }
+
+        opcode_t opcode = instruction_fused_opcode(bytecode->bytes, bytecode->size, offset, true);
+
+        fused |= opcode != opcode_base(opcode);
+        fputc(opcode, fp);
+        fwrite(bytecode->bytes + offset + 1, 1, size - 1, fp);
+    }
+
+    return fused;
+}
+
+bool bytecode_file_write(const struct bytecode *bytecode, const char *path, char **error)
+{
+    return bytecode_file_write_blobs(bytecode, NULL, 0, path, error);
+}
+
+bool bytecode_file_write_blobs(const struct bytecode *bytecode, const struct bytecode_blob *blobs,
+                               size_t blob_count, const char *path, char **error)
+{
+    FILE *fp = fopen(path, "wb");
+
+    if (fp == NULL)
+        return file_error(error, "cannot open '%s' for writing: %s", path, strerror(errno));
+
+    struct bytecode_file_header header = {
+        .version = BYTECODE_FILE_VERSION,
+        .section_count = (uint16_t) (3 + blob_count),
+        .data_size = bytecode->data_size
+    };
+    struct bytecode_section *sections = xcalloc(3 + blob_count, sizeof (struct bytecode_section));
+
+    sections[0] = (struct bytecode_section) { .type = BYTECODE_SECTION_CODE, .count = 0 };
+    sections[1] = (struct bytecode_section) { .type = BYTECODE_SECTION_CONSTANTS, .count = (uint32_t) bytecode->constant_count };
+    sections[2] = (struct bytecode_section) { .type = BYTECODE_SECTION_SYMBOLS, .count = (uint32_t) bytecode->symbol_count };
+
+    memcpy(header.magic, BYTECODE_FILE_MAGIC, sizeof header.magic);
+    fwrite(&header, sizeof header, 1, fp);
+
+    sections[0].offset = (uint64_t) ftell(fp);
+    header.superinstructions = write_code(fp, bytecode) ? superinstructions_id() : 0;
+    sections[0].size = (uint64_t) ftell(fp) - sections[0].offset;
+
+    sections[1].offset = (uint64_t) ftell(fp);
+
+    for (size_t i = 0; i < bytecode->constant_count; i++)
+    {
+        uint64_t value = bytecode->constants[i];
+
+        if (bytecode->constant_types[i] == BYTECODE_CONST_STRING)
+        {
+            string_t *string = (string_t *) value;
+            write_entry(fp, bytecode->constant_types[i], 1, string_flatten(string), (uint32_t) string->length);
+        }
+        else
+            write_entry(fp, bytecode->constant_types[i], 1, &value, sizeof value);
+    }
+
+    sections[1].size = (uint64_t) ftell(fp) - sections[1].offset;
+    sections[2].offset = (uint64_t) ftell(fp);
+
+    for (size_t i = 0; i < bytecode->symbol_count; i++)
+    {
+        const struct bytecode_symbol *symbol = &bytecode->symbols[i];
+        write_entry(fp, symbol->offset, sizeof (uint64_t), symbol->name, (uint32_t) strlen(symbol->name));
+    }
+
+    sections[2].size = (uint64_t) ftell(fp) - sections[2].offset;
+
+    for (size_t i = 0; i < blob_count; i++)
+    {
+        while (ftell(fp) % 8 != 0)
+            fputc(0, fp);
+
+        sections[3 + i] = (struct bytecode_section) {
+            .type = blobs[i].type,
+            .offset = (uint64_t) ftell(fp),
+            .size = blobs[i].size
+        };
+        fwrite(blobs[i].data, 1, blobs[i].size, fp);
+    }
+
+    header.section_table = (uint64_t) ftell(fp);
+    fwrite(sections, sizeof (struct bytecode_section), header.section_count, fp);
+    rewind(fp);
+    fwrite(&header, sizeof header, 1, fp);
+    free(sections);
+
+    bool failed = ferror(fp) != 0;
+
+    if (fclose(fp) != 0 || failed)
+        return file_error(error, "cannot write '%s': %s", path, strerror(errno));
+
+    return true;
+}
+
+/* Reads the u32 length prefix of an entry and checks the payload fits. */
+static bool read_entry(const uint8_t **cursor, const uint8_t *end, size_t prefix_size,
+                       uint64_t *prefix, const uint8_t **data, uint32_t *length)
+{
+    if ((size_t) (end - *cursor) < prefix_size + sizeof (uint32_t))
+        return false;
+
+    *prefix = 0;
+    memcpy(prefix, *cursor, prefix_size);
+    memcpy(length, *cursor + prefix_size, sizeof (uint32_t));
+    *cursor += prefix_size + sizeof (uint32_t);
+
+    if ((size_t) (end - *cursor) < *length)
+        return false;
+
+    *data = *cursor;
+    *cursor += *length;
+    return true;
+}
+
+static bool load_constants(struct bytecode *bytecode, const struct bytecode_section *section,
+                           struct constpool *constants, char **error)
+{
+    const uint8_t *cursor = (const uint8_t *) bytecode->mapping + section->offset;
+    const uint8_t *end = cursor + section->size;
+
+    for (uint32_t i = 0; i < section->count; i++)
+    {
+        uint64_t type, value = 0;
+        const uint8_t *data;
+        uint32_t length;
+
+        if (!read_entry(&cursor, end, 1, &type, &data, &length))
+            return file_error(error, "constant %u is truncated", i);
+
+        switch (type)
+        {
+            case BYTECODE_CONST_STRING:
+                value = (uint64_t) (uintptr_t) constpool_intern_string(constants, (const char *) data, length)->strval;
+                break;
+
+            case BYTECODE_CONST_INT:
+            case BYTECODE_CONST_FLOAT:
+                if (length != sizeof value)
+                    return file_error(error, "constant %u has %u bytes instead of %zu", i, length, sizeof value);
+
+                memcpy(&value, data, sizeof value);
+                break;
+
+            default:
+                return file_error(error, "constant %u has an unknown type 0x%02lx", i, type);
+        }
+
+        bytecode_add_constant(bytecode, type, value);
+    }
+
+    return true;
+}
+
+static bool load_symbols(struct bytecode *bytecode, const struct bytecode_section *section, char **error)
+{
+    const uint8_t *cursor = (const uint8_t *) bytecode->mapping + section->offset;
+    const uint8_t *end = cursor + section->size;
+
+    for (uint32_t i = 0; i < section->count; i++)
+    {
+        uint64_t offset;
+        const uint8_t *data;
+        uint32_t length;
+
+        if (!read_entry(&cursor, end, sizeof offset, &offset, &data, &length))
+            return file_error(error, "symbol %u is truncated", i);
+
+        char *name = strndup((const char *) data, length);
+        bytecode_add_symbol(bytecode, name, offset);
+        free(name);
+    }
+
+    return true;
+}
+
+/* Checks the header and section table and maps the code in place. */
+static bool load_sections(struct bytecode *bytecode, struct constpool *constants, char **error)
+{
+    const uint8_t *file = bytecode->mapping;
+    size_t file_size = bytecode->mapping_size;
+    struct bytecode_file_header header;
+    struct bytecode_section found[BYTECODE_SECTION_SYMBOLS + 1] = { 0 };
+
+    memcpy(&header, file, sizeof header);
+
+    if (memcmp(header.magic, BYTECODE_FILE_MAGIC, sizeof header.magic) != 0)
+        return file_error(error, "not a blaze bytecode file");
+
+    if (header.version != BYTECODE_FILE_VERSION)
+        return file_error(error, "unsupported bytecode version %u (expected %u)", header.version, BYTECODE_FILE_VERSION);
+
+    if (header.superinstructions != 0 && header.superinstructions != superinstructions_id())
+        return file_error(error, "the code has superinstructions of another build of the VM; compile it again");
+
+    if (header.section_table > file_size ||
+        (file_size - header.section_table) / sizeof (struct bytecode_section) < header.section_count)
+        return file_error(error, "section table is out of bounds");
+
+    for (uint16_t i = 0; i < header.section_count; i++)
+    {
+        struct bytecode_section section;
+
+        memcpy(&section, file + header.section_table + i * sizeof section, sizeof section);
+
+        if (section.offset > file_size || file_size - section.offset < section.size)
+            return file_error(error, "section %u is out of bounds", i);
+
+        /* Unknown sections are skipped so that newer tools can add some. */
+        if (section.type < BYTECODE_SECTION_CODE || section.type > BYTECODE_SECTION_SYMBOLS)
+            continue;
+
+        if (found[section.type].type != 0)
+            return file_error(error, "duplicate section of type %u", section.type);
+
+        found[section.type] = section;
+    }
+
+    if (found[BYTECODE_SECTION_CODE].type == 0)
+        return file_error(error, "no code section");
+
+    bytecode->bytes = (uint8_t *) file + found[BYTECODE_SECTION_CODE].offset;
+    bytecode->size = found[BYTECODE_SECTION_CODE].size;
+    bytecode->cap = bytecode->size;
+    bytecode->data_size = header.data_size;
+
+    if (!load_constants(bytecode, &found[BYTECODE_SECTION_CONSTANTS], constants, error) ||
+        !load_symbols(bytecode, &found[BYTECODE_SECTION_SYMBOLS], error))
+        return false;
+
+    return bytecode_verify(bytecode, error);
+}
+
+bool bytecode_file_load(const char *path, struct constpool *constants, struct bytecode *bytecode, char **error)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    *error = NULL;
+
+    if (fd < 0)
+        return file_error(error, "cannot open '%s': %s", path, strerror(errno));
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof (struct bytecode_file_header))
+    {
+        close(fd);
+        return file_error(error, "'%s' is too small to be a bytecode file", path);
+    }
+
+    void *mapping = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+        return file_error(error, "cannot map '%s': %s", path, strerror(errno));
+
+    *bytecode = (struct bytecode) {
+        .mapping = mapping,
+        .mapping_size = (size_t) st.st_size
+    };
+
+    if (!load_sections(bytecode, constants, error))
+    {
+        bytecode_free(bytecode);
+        return false;
+    }
+
+    return true;
+}
+
+const void *bytecode_file_section(const struct bytecode *bytecode, uint32_t type, size_t *size)
+{
+    const uint8_t *file = bytecode->mapping;
+    struct bytecode_file_header header;
+
+    if (file == NULL)
+        return NULL;
+
+    /* load_sections() already checked the header and the bounds of every section. */
+    memcpy(&header, file, sizeof header);
+
+    for (uint16_t i = 0; i < header.section_count; i++)
+    {
+        struct bytecode_section section;
+
+        memcpy(&section, file + header.section_table + i * sizeof section, sizeof section);
+
+        if (section.type == type)
+        {
+            *size = section.size;
+            return file + section.offset;
+        }
+    }
+
+    return NULL;
+}
+
+void *bytecode_file_section_writable(const struct bytecode *bytecode, uint32_t type, size_t *size)
+{
+    uint8_t *section = (uint8_t *) bytecode_file_section(bytecode, type, size);
+
+    if (section == NULL)
+        return NULL;
+
+    uintptr_t page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t) section & ~(page_size - 1);
+
+    if (*size > 0 && mprotect((void *) first, (uintptr_t) section + *size - first, PROT_READ | PROT_WRITE) != 0)
+        return NULL;
+
+    return section;
+}
@@ -0,0 +1,107 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_BYTECODE_FILE_H
+#define BLAZESCRIPT_BYTECODE_FILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bytecode.h"
+#include "constpool.h"
+
+#define BYTECODE_FILE_MAGIC "\x7f" "BLZ"
+/* Version 2 has the compact instruction encoding described in opcode.h. */
+#define BYTECODE_FILE_VERSION 2
+
+/*
+ * Layout of a compiled program on disk. All fields are little-endian and
+ * all offsets are from the start of the file.
+ *
+ *   header | code | constants | symbols | section table
+ *
+ * The code section holds the instructions exactly as the VM runs them, so
+ * it is mapped read-only and executed in place by every process running
+ * the file: quickening is kept aside by each context, and superinstructions
+ * are made when the file is written. Their numbers depend on the table the
+ * VM was built with, so superinstructions in the header is
+ * superinstructions_id() of the writer, or 0 if the code has none, and a
+ * VM with another table refuses the file. Instructions never embed
+ * host addresses: strings are loaded through the constant section and
+ * jump targets are offsets into the code, so no relocation is needed.
+ *
+ * A constant is a one-byte bytecode_const_type_t followed by a u32 length
+ * and the bytes of a string, an i64, or the bits of a double. A symbol is
+ * a u64 code offset followed by a u32 length and the bytes of its name.
+ */
+struct bytecode_file_header
+{
+    uint8_t magic[4];
+    uint16_t version;
+    uint16_t section_count;
+    uint32_t flags;
+    uint32_t superinstructions;
+    uint64_t data_size;
+    uint64_t section_table;
+};
+
+/*
+ * Loading a program only looks at the first three; a snapshot adds the
+ * others (see vm-snapshot.h), which start at multiples of 8 bytes.
+ */
+enum bytecode_section_type
+{
+    BYTECODE_SECTION_CODE = 1,
+    BYTECODE_SECTION_CONSTANTS,
+    BYTECODE_SECTION_SYMBOLS,
+    BYTECODE_SECTION_STATE,
+    BYTECODE_SECTION_STACK,
+    BYTECODE_SECTION_MEMORY,
+    BYTECODE_SECTION_HEAP,
+    BYTECODE_SECTION_HANDLES
+};
+
+struct bytecode_section
+{
+    uint32_t type;
+    uint32_t count;
+    uint64_t offset;
+    uint64_t size;
+};
+
+/* The contents of an extra section to write after the program. */
+struct bytecode_blob
+{
+    uint32_t type;
+    const void *data;
+    size_t size;
+};
+
+bool bytecode_file_probe(const char *path);
+
+/*
+ * Writes a program, with its instructions in the form compilers emit
+ * them (see opcode_generic()) apart from superinstructions, followed by
+ * the given extra sections.
+ */
+bool bytecode_file_write(const struct bytecode *bytecode, const char *path, char **error);
+bool bytecode_file_write_blobs(const struct bytecode *bytecode, const struct bytecode_blob *blobs,
+                               size_t blob_count, const char *path, char **error);
+
+/*
+ * Maps a compiled program into memory and verifies it. String constants
+ * are interned into the given pool, which must outlive the bytecode.
+ */
+bool bytecode_file_load(const char *path, struct constpool *constants, struct bytecode *bytecode, char **error);
+
+/* The first section of a type in a loaded file and its size, or NULL. */
+const void *bytecode_file_section(const struct bytecode *bytecode, uint32_t type, size_t *size);
+
+/*
+ * The same, made writable in the private mapping, or NULL if it cannot
+ * be. The pages it shares with the sections around it become writable
+ * too, but only the ones written stop being shared.
+ */
+void *bytecode_file_section_writable(const struct bytecode *bytecode, uint32_t type, size_t *size);
+
+#endif /* BLAZESCRIPT_BYTECODE_FILE_H */
@@ -0,0 +1,466 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#define _GNU_SOURCE
+
+#include "bytecode-verify.h"
+#include "alloca.h"
+#include "opcode.h"
+#include "register.h"
+#include "vm-vector.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEPTH_UNKNOWN BYTECODE_DEPTH_UNKNOWN
+#define FRAME_NONE BYTECODE_FRAME_NONE
+#define FUNCTION_MAIN BYTECODE_FUNCTION_MAIN
+
+/*
+ * For the instruction at each offset, depths[] is the stack depth in bytes
+ * at which it runs, relative to the frame of the enclosing function, and
+ * functions[] the entry offset of that function. For the main program the
+ * frame starts at the bottom of the stack; for a function it starts right
+ * above the return address, and after enter right above the locals.
+ * frames[] is the number of locals enter reserved, or FRAME_NONE.
+ */
+struct verifier
+{
+    struct bytecode *bytecode;
+    bool *starts;
+    int64_t *depths;
+    size_t *functions;
+    int64_t *frames;
+    size_t *worklist;
+    size_t worklist_size;
+    char *error;
+};
+
+static bool verify_error(struct verifier *v, size_t offset, const char *fmt, ...)
+{
+    char *message = NULL;
+    va_list args;
+
+    va_start(args, fmt);
+
+    if (vasprintf(&message, fmt, args) < 0)
+        message = NULL;
+
+    va_end(args);
+
+    if (asprintf(&v->error, "bytecode verification failed at 0x%08zx: %s", offset, message == NULL ? "" : message) < 0)
+        v->error = NULL;
+
+    free(message);
+    return false;
+}
+
+static uint32_t verify_dword(const struct verifier *v, size_t offset)
+{
+    uint32_t dword;
+    memcpy(&dword, v->bytecode->bytes + offset, sizeof dword);
+    return dword;
+}
+
+/* Finds the jump target operand of an instruction, if it has one. */
+static bool verify_target(const struct verifier *v, size_t offset, size_t *target)
+{
+    operand_info_t info[OPCODE_MAX_OPERANDS];
+    size_t operand_offset = offset + 1;
+
+    opcode_get_operand_info(v->bytecode->bytes[offset], info);
+
+    for (size_t i = 0; i < OPCODE_MAX_OPERANDS; i++)
+    {
+        if (info[i].addrmode == AM_TARGET)
+        {
+            *target = verify_dword(v, operand_offset);
+            return true;
+        }
+
+        operand_offset += info[i].size;
+    }
+
+    return false;
+}
+
+/* Checks that every instruction decodes and that its operands are in range. */
+static bool verify_decode(struct verifier *v)
+{
+    const struct bytecode *bytecode = v->bytecode;
+    size_t size;
+
+    for (size_t offset = 0; offset < bytecode->size; offset += size)
+    {
+        uint8_t opcode = bytecode->bytes[offset];
+
+        if (opcode >= OPCODE_COUNT)
+            return verify_error(v, offset, "invalid opcode 0x%02x", opcode);
+
+        size = instruction_get_size(bytecode->bytes + offset, bytecode->size - offset);
+
+        if (opcode_get_size(opcode) > bytecode->size - offset)
+            return verify_error(v, offset, "%s needs %zu bytes but only %zu are left",
+                                opcode_to_str(opcode), opcode_get_size(opcode), bytecode->size - offset);
+
+        if (size == 0)
+            return verify_error(v, offset, "the constant index of %s is truncated or too large", opcode_to_str(opcode));
+
+        opcode_t first, second;
+
+        if (opcode_get_superinstruction(opcode, &first, &second) &&
+            (size == bytecode->size - offset || bytecode->bytes[offset + size] >= OPCODE_COUNT ||
+             opcode_base(bytecode->bytes[offset + size]) != second))
+            return verify_error(v, offset, "%s is not followed by %s", opcode_to_str(opcode), opcode_to_str(second));
+
+        operand_info_t info[OPCODE_MAX_OPERANDS];
+        size_t operand_offset = offset + 1;
+
+        opcode_get_operand_info(opcode, info);
+
+        for (size_t i = 0; i < OPCODE_MAX_OPERANDS; i++)
+        {
+            if ((info[i].addrmode == AM_REGISTER || info[i].addrmode == AM_REGISTER_MEMORY) &&
+                bytecode->bytes[operand_offset] >= REG_OPERAND_COUNT)
+                return verify_error(v, offset, "operand %zu of %s is not a register: 0x%02x",
+                                    i + 1, opcode_to_str(opcode), bytecode->bytes[operand_offset]);
+
+            if (info[i].addrmode == AM_REGISTER_PAIR &&
+                (REG_PAIR_FIRST(bytecode->bytes[operand_offset]) >= REG_OPERAND_COUNT ||
+                 REG_PAIR_SECOND(bytecode->bytes[operand_offset]) >= REG_OPERAND_COUNT))
+                return verify_error(v, offset, "operand %zu of %s is not a pair of registers: 0x%02x",
+                                    i + 1, opcode_to_str(opcode), bytecode->bytes[operand_offset]);
+
+            if (info[i].addrmode == AM_VECTOR_REGISTER && bytecode->bytes[operand_offset] >= VREG_COUNT)
+                return verify_error(v, offset, "operand %zu of %s is not a vector register: 0x%02x",
+                                    i + 1, opcode_to_str(opcode), bytecode->bytes[operand_offset]);
+
+            if (info[i].addrmode == AM_VECTOR_REGISTER_PAIR &&
+                (REG_PAIR_FIRST(bytecode->bytes[operand_offset]) >= VREG_COUNT ||
+                 REG_PAIR_SECOND(bytecode->bytes[operand_offset]) >= VREG_COUNT))
+                return verify_error(v, offset, "operand %zu of %s is not a pair of vector registers: 0x%02x",
+                                    i + 1, opcode_to_str(opcode), bytecode->bytes[operand_offset]);
+
+            if (info[i].addrmode == AM_MEMORY && verify_dword(v, operand_offset) >= bytecode->data_size)
+                return verify_error(v, offset, "operand %zu of %s addresses memory slot 0x%08x, but there are only %zu",
+                                    i + 1, opcode_to_str(opcode), verify_dword(v, operand_offset), bytecode->data_size);
+
+            if (info[i].addrmode == AM_CONSTANT)
+            {
+                uint32_t index;
+
+                bytecode_read_uleb128(bytecode->bytes + operand_offset, bytecode->size - operand_offset, &index);
+
+                if (index >= bytecode->constant_count)
+                    return verify_error(v, offset, "operand %zu of %s refers to constant 0x%08x, but there are only %zu",
+                                        i + 1, opcode_to_str(opcode), index, bytecode->constant_count);
+            }
+
+            operand_offset += info[i].size;
+        }
+
+        v->starts[offset] = true;
+    }
+
+    /* Jumps on paths that never run are checked too, since the JIT translates them all. */
+    for (size_t offset = 0; offset < bytecode->size; offset++)
+    {
+        size_t target;
+
+        if (!v->starts[offset] || !verify_target(v, offset, &target))
+            continue;
+
+        if (target >= bytecode->size)
+            return verify_error(v, offset, "jump target 0x%08zx is past the end of the code", target);
+
+        if (!v->starts[target])
+            return verify_error(v, offset, "jump target 0x%08zx is not the start of an instruction", target);
+    }
+
+    return true;
+}
+
+/* Records that the instruction at target is reached with the given state. */
+static bool verify_visit(struct verifier *v, size_t from, size_t target, int64_t depth, size_t function, int64_t frame)
+{
+    if (target >= v->bytecode->size)
+        return verify_error(v, from, "execution continues at 0x%08zx, past the end of the code", target);
+
+    if (!v->starts[target])
+        return verify_error(v, from, "jump target 0x%08zx is not the start of an instruction", target);
+
+    if (v->depths[target] == DEPTH_UNKNOWN)
+    {
+        v->depths[target] = depth;
+        v->functions[target] = function;
+        v->frames[target] = frame;
+        v->worklist[v->worklist_size++] = target;
+        return true;
+    }
+
+    if (v->functions[target] != function)
+        return verify_error(v, from, "0x%08zx is reached from two different functions", target);
+
+    if (v->depths[target] != depth)
+        return verify_error(v, from, "0x%08zx is reached with a stack depth of %lld bytes here and %lld bytes elsewhere",
+                            target, (long long) depth, (long long) v->depths[target]);
+
+    if (v->frames[target] != frame)
+        return verify_error(v, from, "0x%08zx is reached both with and without a frame, or with frames of different sizes",
+                            target);
+
+    return true;
+}
+
+/* Returns how many arguments the function at entry takes from its caller. */
+static uint8_t verify_arg_count(const struct verifier *v, size_t entry)
+{
+    if (entry == FUNCTION_MAIN || opcode_base(v->bytecode->bytes[entry]) != OP_ENTER)
+        return 0;
+
+    return v->bytecode->bytes[entry + 5];
+}
+
+/*
+ * Records a function entry point. Functions without arguments are also
+ * valid targets for calls and jumps through a register.
+ */
+static bool verify_entry(struct verifier *v, size_t from, size_t target)
+{
+    if (!verify_visit(v, from, target, 0, target, FRAME_NONE))
+        return false;
+
+    v->bytecode->entries[target] = verify_arg_count(v, target) == 0;
+    return true;
+}
+
+/* Checks that a frame operand names a local or an argument of the current function. */
+static bool verify_frame_access(struct verifier *v, size_t offset, size_t operand_offset, size_t function, int64_t frame)
+{
+    int32_t index = (int32_t) verify_dword(v, operand_offset);
+    int32_t args = verify_arg_count(v, function);
+
+    if (frame == FRAME_NONE)
+        return verify_error(v, offset, "%s accesses a frame before enter", opcode_to_str(v->bytecode->bytes[offset]));
+
+    if ((index >= 0 && index < frame) || (index < 0 && index >= FRAME_ARG_OFFSET(0, args) && index <= -3))
+        return true;
+
+    return verify_error(v, offset, "[%%fp%+d] is neither one of the %lld locals nor one of the %d arguments",
+                        index, (long long) frame, args);
+}
+
+/* Follows every reachable path and tracks the stack depth along it. */
+static bool verify_flow(struct verifier *v)
+{
+    const struct bytecode *bytecode = v->bytecode;
+
+    if (!verify_visit(v, 0, 0, 0, FUNCTION_MAIN, FRAME_NONE))
+        return false;
+
+    /* Named functions may be reached only through a register. */
+    for (size_t i = 0; i < bytecode->symbol_count; i++)
+    {
+        if (!verify_entry(v, bytecode->symbols[i].offset, bytecode->symbols[i].offset))
+            return false;
+    }
+
+    while (v->worklist_size > 0)
+    {
+        size_t offset = v->worklist[--v->worklist_size];
+        /* A superinstruction continues with its second instruction, which is checked on its own. */
+        opcode_t opcode = opcode_base(bytecode->bytes[offset]);
+        int64_t depth = v->depths[offset];
+        size_t function = v->functions[offset];
+        int64_t frame = v->frames[offset];
+        size_t next = offset + instruction_get_size(bytecode->bytes + offset, bytecode->size - offset);
+        size_t target;
+
+        switch (opcode)
+        {
+            case OP_HLT:
+                break;
+
+            case OP_CALL:
+            {
+                target = verify_dword(v, offset + 1);
+
+                if (!verify_entry(v, offset, target))
+                    return false;
+
+                int64_t args = verify_arg_count(v, target);
+
+                if (depth < args * 8)
+                    return verify_error(v, offset, "call to a function taking %lld arguments with only %lld bytes pushed",
+                                        (long long) args, (long long) depth);
+
+                if (!verify_visit(v, offset, next, depth, function, frame))
+                    return false;
+
+                break;
+            }
+
+            /*
+             * ret and jumps through a register leave the function, which
+             * must have popped what it pushed and left its frame.
+             */
+            case OP_RET:
+            case OP_JMP_R:
+                if (function == FUNCTION_MAIN)
+                    return verify_error(v, offset, "%s outside of a function", opcode_to_str(opcode));
+
+                if (frame != FRAME_NONE)
+                    return verify_error(v, offset, "%s without leave", opcode_to_str(opcode));
+
+                if (depth != 0)
+                    return verify_error(v, offset, "%s with %lld bytes still pushed", opcode_to_str(opcode), (long long) depth);
+
+                break;
+
+            case OP_ENTER:
+                if (frame != FRAME_NONE)
+                    return verify_error(v, offset, "enter inside a frame");
+
+                if (depth != 0)
+                    return verify_error(v, offset, "enter with %lld bytes pushed", (long long) depth);
+
+                if (bytecode->bytes[offset + 5] != 0 && offset != function)
+                    return verify_error(v, offset, "enter with arguments must be the first instruction of a function");
+
+                if (!verify_visit(v, offset, next, 0, function, verify_dword(v, offset + 1)))
+                    return false;
+
+                break;
+
+            case OP_LEAVE:
+                if (frame == FRAME_NONE)
+                    return verify_error(v, offset, "leave without enter");
+
+                if (depth != 0)
+                    return verify_error(v, offset, "leave with %lld bytes still pushed", (long long) depth);
+
+                if (!verify_visit(v, offset, next, 0, function, FRAME_NONE))
+                    return false;
+
+                break;
+
+            case OP_LOAD_RF:
+            case OP_STORE_FR:
+                if (!verify_frame_access(v, offset, offset + (opcode == OP_LOAD_RF ? 2 : 1), function, frame) ||
+                    !verify_visit(v, offset, next, depth, function, frame))
+                    return false;
+
+                break;
+
+            /* The stack holds words, so even pushb and popb move it by 8 bytes. */
+            case OP_PUSH_R_B:
+            case OP_PUSH_R_Q:
+            case OP_POP_R_B:
+            case OP_POP_R_Q:
+            {
+                bool push = opcode == OP_PUSH_R_B || opcode == OP_PUSH_R_Q;
+
+                if (!push && depth < 8)
+                    return verify_error(v, offset, "%s with nothing pushed", opcode_to_str(opcode));
+
+                if (!verify_visit(v, offset, next, push ? depth + 8 : depth - 8, function, frame))
+                    return false;
+
+                break;
+            }
+
+            default:
+                if (verify_target(v, offset, &target) && !verify_visit(v, offset, target, depth, function, frame))
+                    return false;
+
+                if (opcode != OP_JMP && !verify_visit(v, offset, next, depth, function, frame))
+                    return false;
+
+                break;
+        }
+    }
+
+    return true;
+}
+
+/* Runs every check, leaving what the verifier found in v for the caller to release. */
+static bool verify_run(struct verifier *v, struct bytecode *bytecode)
+{
+    *v = (struct verifier) {
+        .bytecode = bytecode,
+        .error = NULL
+    };
+
+    bytecode->verified = false;
+    free(bytecode->entries);
+    bytecode->entries = NULL;
+
+    if (bytecode->size == 0)
+        return verify_error(v, 0, "the program is empty");
+
+    v->starts = xcalloc(bytecode->size, sizeof (bool));
+    v->depths = xmalloc(bytecode->size * sizeof (int64_t));
+    v->functions = xmalloc(bytecode->size * sizeof (size_t));
+    v->frames = xmalloc(bytecode->size * sizeof (int64_t));
+    v->worklist = xmalloc(bytecode->size * sizeof (size_t));
+    v->worklist_size = 0;
+    bytecode->entries = xcalloc(bytecode->size, sizeof (bool));
+
+    for (size_t i = 0; i < bytecode->size; i++)
+        v->depths[i] = DEPTH_UNKNOWN;
+
+    bool ok = verify_decode(v) && verify_flow(v);
+
+    bytecode->verified = ok;
+    return ok;
+}
+
+static void verify_release(struct verifier *v)
+{
+    free(v->starts);
+    free(v->depths);
+    free(v->functions);
+    free(v->frames);
+    free(v->worklist);
+}
+
+bool bytecode_verify(struct bytecode *bytecode, char **error)
+{
+    struct verifier v;
+    bool ok = verify_run(&v, bytecode);
+
+    verify_release(&v);
+    *error = v.error;
+    return ok;
+}
+
+struct bytecode_stack_state *bytecode_verify_stack(const struct bytecode *bytecode)
+{
+    /* Runs on a copy, since other contexts may be running the bytecode. */
+    struct bytecode copy = *bytecode;
+    struct verifier v;
+    struct bytecode_stack_state *states = NULL;
+
+    copy.entries = NULL;
+
+    if (verify_run(&v, &copy))
+    {
+        states = xmalloc(bytecode->size * sizeof *states);
+
+        for (size_t i = 0; i < bytecode->size; i++)
+        {
+            states[i] = (struct bytecode_stack_state) {
+                .function = v.functions[i],
+                .depth = v.depths[i],
+                .locals = v.frames[i]
+            };
+        }
+    }
+
+    verify_release(&v);
+    free(copy.entries);
+    free(v.error);
+    return states;
+}
@@ -0,0 +1,64 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_BYTECODE_VERIFY_H
+#define BLAZESCRIPT_BYTECODE_VERIFY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bytecode.h"
+
+/*
+ * Checks a program once before it runs so that the VM does not have to
+ * while it runs:
+ *
+ *  - every instruction has a valid opcode and all of its operand bytes;
+ *  - register operands name a register, memory operands a data slot and
+ *    constant operands an entry of the constant table in a LEB128 number
+ *    that fits in 32 bits;
+ *  - jumps and calls land on the start of an instruction, and a jump
+ *    through a register only leaves a function whose pushes have all been
+ *    popped;
+ *  - execution cannot run past the last instruction;
+ *  - every path reaches each instruction with the same stack depth and
+ *    frame, pops never underflow the current frame and ret only runs in a
+ *    function that has popped what it pushed and left its frame;
+ *  - frame operands name a local reserved by enter or an argument of the
+ *    function, and calls push at least as many arguments as it takes;
+ *  - a superinstruction is followed by the second instruction it runs.
+ *
+ * Call targets and symbols are recorded in bytecode->entries as the only
+ * places calls and jumps through a register may go. On success the
+ * bytecode is marked as verified. Otherwise *error is set
+ * to a message that starts with the offset of the offending instruction.
+ */
+bool bytecode_verify(struct bytecode *bytecode, char **error);
+
+#define BYTECODE_DEPTH_UNKNOWN (-1)
+#define BYTECODE_FRAME_NONE (-1)
+#define BYTECODE_FUNCTION_MAIN SIZE_MAX
+
+/*
+ * What the verifier found about the stack at an instruction: the entry
+ * offset of the function it belongs to, or BYTECODE_FUNCTION_MAIN; the
+ * bytes pushed since the frame of that function started, which is right
+ * above the return address, or above the locals after enter, or
+ * BYTECODE_DEPTH_UNKNOWN if nothing reaches it; and the number of locals
+ * enter reserved, or BYTECODE_FRAME_NONE.
+ */
+struct bytecode_stack_state
+{
+    size_t function;
+    int64_t depth;
+    int64_t locals;
+};
+
+/*
+ * Verifies the bytecode again, without changing it, and returns that
+ * state for every offset of the code, or NULL if it does not verify. The
+ * caller frees the result.
+ */
+struct bytecode_stack_state *bytecode_verify_stack(const struct bytecode *bytecode);
+
+#endif /* BLAZESCRIPT_BYTECODE_VERIFY_H */
@@ -8,13 +8,12 @@
 #include "opcode.h"
 #include "register.h"
 #include "utils.h"
+#include "vm-context.h"
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-
-char *bytecode_error = NULL;
-uint8_t bytecode_exit_code = 0;
+#include <sys/mman.h>
 
 struct bytecode bytecode_init()
 {
@@ -25,7 +24,9 @@ struct bytecode bytecode_init_from_stream(uint8_t *stream, size_t stream_size)
 {
     struct bytecode bytecode = {
         .size = stream_size,
-        .cap = stream_size
+        .cap = stream_size,
+        .data_size = 0,
+        .verified = false
     };
 
     bytecode.bytes = xcalloc(sizeof (uint8_t), stream_size);
@@ -57,42 +58,85 @@ struct bytecode bytecode_init_from_filebuf(struct filebuf *filebuf)
     return bytecode;
 }
 
-static void bytecode_check_realloc(struct bytecode *bytecode)
+static void bytecode_check_realloc(struct bytecode *bytecode, size_t length)
 {
-    if (bytecode->size >= bytecode->cap)
+    assert(bytecode->mapping == NULL && "Mapped bytecode cannot grow");
+    bytecode->verified = false;
+
+    if (bytecode->size + length > bytecode->cap)
     {
-        bytecode->cap += 20;
+        bytecode->cap = (bytecode->cap * 2) + length;
         bytecode->bytes = xrealloc(bytecode->bytes, sizeof (uint8_t) * (bytecode->cap));
     }
 }
 
+/* Returns the index the const instruction uses to load the new constant. */
+size_t bytecode_add_constant(struct bytecode *bytecode, bytecode_const_type_t type, uint64_t value)
+{
+    bytecode->constants = xrealloc(bytecode->constants, sizeof (uint64_t) * (bytecode->constant_count + 1));
+    bytecode->constant_types = xrealloc(bytecode->constant_types, sizeof (uint8_t) * (bytecode->constant_count + 1));
+    bytecode->constants[bytecode->constant_count] = value;
+    bytecode->constant_types[bytecode->constant_count] = type;
+    return bytecode->constant_count++;
+}
+
+void bytecode_add_symbol(struct bytecode *bytecode, const char *name, size_t offset)
+{
+    bytecode->symbols = xrealloc(bytecode->symbols, sizeof (struct bytecode_symbol) * (bytecode->symbol_count + 1));
+    bytecode->symbols[bytecode->symbol_count].name = strdup(name);
+    bytecode->symbols[bytecode->symbol_count].offset = offset;
+    bytecode->symbol_count++;
+}
+
+const char *bytecode_symbol_at(const struct bytecode *bytecode, size_t offset)
+{
+    for (size_t i = 0; i < bytecode->symbol_count; i++)
+    {
+        if (bytecode->symbols[i].offset == offset)
+            return bytecode->symbols[i].name;
+    }
+
+    return NULL;
+}
+
 void bytecode_push_byte(struct bytecode *bytecode, uint8_t byte)
 {
-    bytecode_check_realloc(bytecode);
+    bytecode_check_realloc(bytecode, sizeof (uint8_t));
     bytecode->bytes[bytecode->size++] = byte;
 }
 
 void bytecode_push_word(struct bytecode *bytecode, uint16_t word)
 {
-    bytecode_check_realloc(bytecode);
+    bytecode_check_realloc(bytecode, sizeof (uint16_t));
     memcpy((uint8_t *) (bytecode->bytes + bytecode->size), &word, sizeof (word));
     bytecode->size += sizeof (uint16_t);
 }
 
 void bytecode_push_dword(struct bytecode *bytecode, uint32_t dword)
 {
-    bytecode_check_realloc(bytecode);
+    bytecode_check_realloc(bytecode, sizeof (uint32_t));
     memcpy((uint8_t *) (bytecode->bytes + bytecode->size), &dword, sizeof (dword));
     bytecode->size += sizeof (uint32_t);
 }
 
 void bytecode_push_qword(struct bytecode *bytecode, uint64_t qword)
 {
-    bytecode_check_realloc(bytecode);
+    bytecode_check_realloc(bytecode, sizeof (uint64_t));
     memcpy((uint8_t *) (bytecode->bytes + bytecode->size), &qword, sizeof (qword));
     bytecode->size += sizeof (uint64_t);
 }
 
+void bytecode_push_uleb128(struct bytecode *bytecode, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        bytecode_push_byte(bytecode, (uint8_t) (value | 0x80));
+        value >>= 7;
+    }
+
+    bytecode_push_byte(bytecode, (uint8_t) value);
+}
+
 uint8_t bytecode_get_byte(struct bytecode *bytecode, size_t addr)
 {
     assert(addr < bytecode->size && "Address out of range");
@@ -115,6 +159,28 @@ uint32_t bytecode_get_dword(struct bytecode *bytecode, size_t addr)
     return dword;
 }
 
+size_t bytecode_read_uleb128(const uint8_t *bytes, size_t available, uint32_t *value)
+{
+    uint64_t result = 0;
+
+    for (size_t i = 0; i < available && i < LEB128_MAX_SIZE; i++)
+    {
+        result |= (uint64_t) (bytes[i] & 0x7F) << (7 * i);
+
+        if ((bytes[i] & 0x80) == 0)
+        {
+            if (result > UINT32_MAX)
+                break;
+
+            *value = (uint32_t) result;
+            return i + 1;
+        }
+    }
+
+    *value = UINT32_MAX;
+    return 0;
+}
+
 uint64_t bytecode_get_qword(struct bytecode *bytecode, size_t addr)
 {
     assert((addr + 7) < bytecode->size && "Address out of range");
@@ -125,56 +191,83 @@ uint64_t bytecode_get_qword(struct bytecode *bytecode, size_t addr)
 
 void bytecode_free(struct bytecode *bytecode)
 {
-    free(bytecode->bytes);
+    if (bytecode->mapping != NULL)
+        munmap(bytecode->mapping, bytecode->mapping_size);
+    else
+        free(bytecode->bytes);
+
+    for (size_t i = 0; i < bytecode->symbol_count; i++)
+        free(bytecode->symbols[i].name);
+
+    free(bytecode->constants);
+    free(bytecode->constant_types);
+    free(bytecode->symbols);
+    free(bytecode->entries);
+    bytecode->bytes = NULL;
+    bytecode->entries = NULL;
+    bytecode->mapping = NULL;
+    bytecode->constants = NULL;
+    bytecode->constant_types = NULL;
+    bytecode->symbols = NULL;
+    bytecode->constant_count = 0;
+    bytecode->symbol_count = 0;
     bytecode->size = 0;
 }
 
-bool bytecode_exec(struct bytecode *bytecode)
+bool bytecode_exec(struct vm_context *vm)
 {
-    int i = 0;
-
-    registers[IP] = (uint64_t) bytecode->bytes;
-    registers[IS] = (uint64_t) bytecode->bytes;
+    return execution_run(vm);
+}
 
-    while (registers[IP] != 0)
-    {
-        i++;
+/*
+ * The original dispatch loop, which calls the handler of every instruction
+ * through a function pointer and keeps %ip in the register file of the
+ * context. Kept as the baseline for the dispatch benchmark (see vmbench.c).
+ */
+static bool exec_indirect(struct vm_context *vm)
+{
+    struct bytecode *bytecode = vm->bytecode;
 
-        if (i >= 1000)
-        {
-            fatal_error("Loop exhausted");
-        }
+    vm->registers[IP] = (uint64_t) bytecode->bytes;
+    vm->registers[IS] = (uint64_t) bytecode->bytes;
 
-        uint8_t *ip = (uint8_t *) registers[IP];
+    while (vm->registers[IP] != 0)
+    {
+        uint8_t *ip = (uint8_t *) vm->registers[IP];
 
         if (ip >= (bytecode->bytes + bytecode->size))
         {
-            bytecode_error = strdup("%ip points to a memory address that is out of range");
+            vm->error = strdup("%ip points to a memory address that is out of range");
             return false;
         }
 
         if (*ip == OP_HLT)
-        {
-            puts("System halted");
             return true;
-        }
 
-        uint8_t *result = instruction_exec(*ip, bytecode);
+        uint8_t *result = instruction_exec(vm, *ip);
 
-        if (bytecode_error != NULL)
+        if (vm->error != NULL)
         {
             return false;
         }
 
         if (result == NULL)
         {
-            registers[IP]++;
+            vm->registers[IP]++;
         }
         else
         {
-            registers[IP] = (uint64_t) result;
+            vm->registers[IP] = (uint64_t) result;
         }
     }
 
     return true;
 }
+
+bool bytecode_exec_indirect(struct vm_context *vm)
+{
+    blaze_stack_guard(&vm->stack);
+    bool ok = exec_indirect(vm);
+    blaze_stack_guard(NULL);
+    return ok;
+}
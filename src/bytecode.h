@@ -5,19 +5,74 @@
 #ifndef BLAZESCRIPT_BYTECODE_H
 #define BLAZESCRIPT_BYTECODE_H
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdint.h>
 #include "alloca.h"
 #include "file.h"
 
-#define BYTECODE_INIT { .bytes = xcalloc(10, sizeof (uint8_t)), .size = 0, .cap = 10 };
+#define BYTECODE_INIT { .bytes = xcalloc(10, sizeof (uint8_t)), .size = 0, .cap = 10, .data_size = 0, .verified = false };
 
+typedef enum {
+    BYTECODE_CONST_STRING,
+    BYTECODE_CONST_INT,
+    BYTECODE_CONST_FLOAT,
+    BYTECODE_CONST_TYPE_COUNT
+} bytecode_const_type_t;
+
+/*
+ * What the VM has learnt about a quickenable instruction: how often its
+ * specialized form ran (hits) or fell back to the generic one (misses),
+ * the form it has been seeing lately, and the form it runs as now, or
+ * OP_NO_OP while it runs as itself.
+ */
+struct bytecode_quickening
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint8_t candidate;
+    uint8_t streak;
+    uint8_t deopts;
+    uint8_t form;
+};
+
+/* Names the code at an offset, e.g. the entry of a compiled function. */
+struct bytecode_symbol
+{
+    char *name;
+    size_t offset;
+};
+
+/*
+ * data_size is the number of qword memory slots the program addresses
+ * with load/store instructions. verified is set by bytecode_verify() and
+ * lets the VM skip its runtime checks; appending code clears it. The
+ * verifier also fills entries, which marks the offsets of the functions
+ * that call and jmp through a register may land on.
+ *
+ * constants holds the run-time value of every constant the const
+ * instruction can load, by index: a string_t pointer for strings, the
+ * value itself for integers and the bits of a double for floats. Code
+ * never embeds host addresses, so it can be saved to a file and mapped
+ * back in unchanged. When mapping is set, bytes points into a read-only
+ * mapping of such a file.
+ */
 struct bytecode
 {
     uint8_t *bytes;
     size_t size;
     size_t cap;
+    size_t data_size;
+    bool verified;
+    bool *entries;
+    uint64_t *constants;
+    uint8_t *constant_types;
+    size_t constant_count;
+    struct bytecode_symbol *symbols;
+    size_t symbol_count;
+    void *mapping;
+    size_t mapping_size;
 };
 
 struct bytecode bytecode_init();
@@ -25,19 +80,35 @@ void bytecode_free(struct bytecode *bytecode);
 struct bytecode bytecode_init_from_stream(uint8_t *stream, size_t stream_size);
 struct bytecode bytecode_init_from_filebuf(struct filebuf *filebuf);
 
+size_t bytecode_add_constant(struct bytecode *bytecode, bytecode_const_type_t type, uint64_t value);
+void bytecode_add_symbol(struct bytecode *bytecode, const char *name, size_t offset);
+const char *bytecode_symbol_at(const struct bytecode *bytecode, size_t offset);
+
 void bytecode_push_byte(struct bytecode *bytecode, uint8_t byte);
 void bytecode_push_word(struct bytecode *bytecode, uint16_t word);
 void bytecode_push_dword(struct bytecode *bytecode, uint32_t dword);
 void bytecode_push_qword(struct bytecode *bytecode, uint64_t qword);
+void bytecode_push_uleb128(struct bytecode *bytecode, uint32_t value);
 
 uint8_t bytecode_get_byte(struct bytecode *bytecode, size_t addr);
 uint16_t bytecode_get_word(struct bytecode *bytecode, size_t addr);
 uint32_t bytecode_get_dword(struct bytecode *bytecode, size_t addr);
 uint64_t bytecode_get_qword(struct bytecode *bytecode, size_t addr);
 
-bool bytecode_exec(struct bytecode *bytecode);
+/* Longest LEB128 encoding of a 32-bit number. */
+#define LEB128_MAX_SIZE 5
+
+/*
+ * Decodes an unsigned LEB128 number of at most 32 bits from the first
+ * available bytes and returns how many it took, or 0 if it does not end
+ * there or is too large, in which case *value is UINT32_MAX.
+ */
+size_t bytecode_read_uleb128(const uint8_t *bytes, size_t available, uint32_t *value);
+
+struct vm_context;
 
-extern char *bytecode_error;
-extern uint8_t bytecode_exit_code;
+/* Runs the bytecode of a context set up with execution_init(). */
+bool bytecode_exec(struct vm_context *vm);
+bool bytecode_exec_indirect(struct vm_context *vm);
 
 #endif /* BLAZESCRIPT_BYTECODE_H */
@@ -0,0 +1,1332 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#define _GNU_SOURCE
+
+#include "compile-bytecode.h"
+#include "alloca.h"
+#include "bytecode-builder.h"
+#include "bytecode-verify.h"
+#include "lib.h"
+#include "map.h"
+#include "opcode.h"
+#include "register.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Expression temporaries live on a virtual stack. The first BC_TEMP_COUNT
+ * positions are kept in %r3-%r9 and deeper positions are spilled to memory
+ * slots of the current frame. %r0-%r2 hold syscall arguments and return
+ * values, and are otherwise used as scratch registers.
+ */
+#define BC_TEMP_FIRST R3
+#define BC_TEMP_COUNT ((size_t) (R9 - R3 + 1))
+
+enum bc_type
+{
+    BC_TYPE_INT,
+    BC_TYPE_BOOL,
+    BC_TYPE_NULL,
+    BC_TYPE_STRING,
+    BC_TYPE_ARRAY
+};
+
+/*
+ * Values carry no type information at run time, so every function is
+ * compiled once per combination of argument types it is called with.
+ * While a specialization is being compiled its return type is not known
+ * yet: recursive calls assume an integer, which is checked at the end.
+ */
+struct bc_specialization
+{
+    enum bc_type *param_types;
+    enum bc_type return_type;
+    size_t label;
+    bool compiling;
+    bool recursive;
+};
+
+struct bc_frame;
+
+/*
+ * Where a variable or spilled temporary lives: a memory slot for the main
+ * program, or a word of the frame of the function it belongs to, as an
+ * offset from %fp.
+ */
+struct bc_slot
+{
+    struct bc_frame *frame;
+    int64_t index;
+};
+
+enum bc_symbol_kind
+{
+    BC_SYMBOL_VAR,
+    BC_SYMBOL_FN
+};
+
+struct bc_symbol
+{
+    enum bc_symbol_kind kind;
+    enum bc_type type;
+    struct bc_slot slot;
+    bool is_const;
+    const ast_node_t *fn_node;
+    struct bc_scope *fn_scope;
+    struct bc_specialization **specializations;
+    size_t specialization_count;
+};
+
+struct bc_scope
+{
+    map_t symbols;
+    struct bc_scope *parent;
+};
+
+/*
+ * The main program keeps its variables and spills in memory slots. Each
+ * function specialization keeps them in its call frame instead, so that
+ * recursive calls get their own copies; local_count is the number of
+ * words its enter instruction reserves.
+ */
+struct bc_frame
+{
+    bool is_function;
+    size_t local_count;
+    struct bc_slot *spill_slots;
+    size_t spill_count;
+};
+
+struct bc_compiler
+{
+    struct bytecode_builder builder;
+    struct constpool *constants;
+    map_t constant_indices;
+    struct bc_scope *scope;
+    struct bc_frame *frame;
+    size_t data_size;
+    char *error;
+};
+
+static bool compile_expr(struct bc_compiler *c, const ast_node_t *node, size_t pos, enum bc_type *type);
+static bool compile_statement(struct bc_compiler *c, const ast_node_t *node);
+
+static const char *bc_type_to_str(enum bc_type type)
+{
+    const char *translate[] = {
+        [BC_TYPE_INT] = "INTEGER",
+        [BC_TYPE_BOOL] = "BOOLEAN",
+        [BC_TYPE_NULL] = "NULL",
+        [BC_TYPE_STRING] = "STRING",
+        [BC_TYPE_ARRAY] = "ARRAY",
+    };
+
+    return translate[type];
+}
+
+static syscall_value_type_t bc_type_to_value_type(enum bc_type type)
+{
+    const syscall_value_type_t translate[] = {
+        [BC_TYPE_INT] = VT_INT,
+        [BC_TYPE_BOOL] = VT_BOOL,
+        [BC_TYPE_NULL] = VT_NULL,
+        [BC_TYPE_STRING] = VT_STRING,
+        [BC_TYPE_ARRAY] = VT_ARRAY,
+    };
+
+    return translate[type];
+}
+
+static bool compile_error(struct bc_compiler *c, const ast_node_t *node, const char *fmt, ...)
+{
+    if (c->error != NULL)
+        return false;
+
+    char *message = NULL;
+    va_list args;
+
+    va_start(args, fmt);
+
+    if (vasprintf(&message, fmt, args) < 0)
+        message = NULL;
+
+    va_end(args);
+
+    if (asprintf(&c->error, "%s:%lu:%lu: %s", node->filename == NULL ? "<input>" : node->filename,
+                 node->line_start, node->column_start, message == NULL ? "" : message) < 0)
+        c->error = NULL;
+
+    free(message);
+    return false;
+}
+
+static void emit_op(struct bc_compiler *c, opcode_t opcode)
+{
+    bytecode_push_byte(&c->builder.bytecode, opcode);
+}
+
+/* Uses the shortest form of mov whose immediate sign-extends to imm. */
+static void emit_mov_ir(struct bc_compiler *c, uint8_t reg, uint64_t imm)
+{
+    int64_t value = (int64_t) imm;
+
+    if (value >= INT8_MIN && value <= INT8_MAX)
+    {
+        emit_op(c, OP_MOV_IR8);
+        bytecode_push_byte(&c->builder.bytecode, reg);
+        bytecode_push_byte(&c->builder.bytecode, (uint8_t) value);
+    }
+    else if (value >= INT32_MIN && value <= INT32_MAX)
+    {
+        emit_op(c, OP_MOV_IR32);
+        bytecode_push_byte(&c->builder.bytecode, reg);
+        bytecode_push_dword(&c->builder.bytecode, (uint32_t) value);
+    }
+    else
+    {
+        emit_op(c, OP_MOV_IR);
+        bytecode_push_byte(&c->builder.bytecode, reg);
+        bytecode_push_qword(&c->builder.bytecode, imm);
+    }
+}
+
+/*
+ * Loads an interned string through the constant table rather than as an
+ * immediate, so the code does not depend on where the string lives.
+ */
+static void emit_const(struct bc_compiler *c, uint8_t reg, string_t *string)
+{
+    map_key_t key = {
+        .type = MAP_KEY_INTEGER,
+        .data = (const char *) &string,
+        .length = sizeof string,
+        .hash = 0
+    };
+    map_entry_t *entry = map_get_entry(&c->constant_indices, key);
+    size_t index;
+
+    if (entry != NULL)
+        index = (size_t) (uintptr_t) entry->value - 1;
+    else
+    {
+        index = bytecode_add_constant(&c->builder.bytecode, BYTECODE_CONST_STRING, (uint64_t) (uintptr_t) string);
+        map_set_key(&c->constant_indices, key, (void *) (uintptr_t) (index + 1), NULL, MAP_CREATE);
+    }
+
+    emit_op(c, OP_CONST_RK);
+    bytecode_push_byte(&c->builder.bytecode, reg);
+    bytecode_push_uleb128(&c->builder.bytecode, (uint32_t) index);
+}
+
+static void emit_rr(struct bc_compiler *c, opcode_t opcode, uint8_t reg1, uint8_t reg2)
+{
+    emit_op(c, opcode);
+    bytecode_push_byte(&c->builder.bytecode, REG_PAIR(reg1, reg2));
+}
+
+static void emit_mov_rr(struct bc_compiler *c, uint8_t dest, uint8_t src)
+{
+    if (dest != src)
+        emit_rr(c, OP_MOV_RR, dest, src);
+}
+
+static void emit_r(struct bc_compiler *c, opcode_t opcode, uint8_t reg)
+{
+    emit_op(c, opcode);
+    bytecode_push_byte(&c->builder.bytecode, reg);
+}
+
+static void emit_jump(struct bc_compiler *c, opcode_t opcode, size_t label)
+{
+    emit_op(c, opcode);
+    bytecode_builder_push_label(&c->builder, label);
+}
+
+static void emit_jz(struct bc_compiler *c, uint8_t reg, size_t label)
+{
+    emit_r(c, OP_JZ_R, reg);
+    bytecode_builder_push_label(&c->builder, label);
+}
+
+/* Emits a fused compare-and-branch such as "jlt %a, %b, label". */
+static void emit_branch_rr(struct bc_compiler *c, opcode_t opcode, uint8_t reg1, uint8_t reg2, size_t label)
+{
+    emit_rr(c, opcode, reg1, reg2);
+    bytecode_builder_push_label(&c->builder, label);
+}
+
+static void emit_load(struct bc_compiler *c, uint8_t reg, struct bc_slot slot)
+{
+    emit_r(c, slot.frame->is_function ? OP_LOAD_RF : OP_LOAD_RM, reg);
+    bytecode_push_dword(&c->builder.bytecode, (uint32_t) slot.index);
+}
+
+static void emit_store(struct bc_compiler *c, struct bc_slot slot, uint8_t reg)
+{
+    emit_op(c, slot.frame->is_function ? OP_STORE_FR : OP_STORE_MR);
+    bytecode_push_dword(&c->builder.bytecode, (uint32_t) slot.index);
+    bytecode_push_byte(&c->builder.bytecode, reg);
+}
+
+static void emit_syscall(struct bc_compiler *c, syscall_t syscall)
+{
+    emit_mov_ir(c, R0, syscall);
+    emit_op(c, OP_SYSCALL);
+}
+
+static struct bc_slot slot_alloc(struct bc_compiler *c)
+{
+    struct bc_frame *frame = c->frame;
+
+    return (struct bc_slot) {
+        .frame = frame,
+        .index = (int64_t) (frame->is_function ? frame->local_count++ : c->data_size++)
+    };
+}
+
+static struct bc_slot spill_slot(struct bc_compiler *c, size_t pos)
+{
+    size_t index = pos - BC_TEMP_COUNT;
+
+    while (c->frame->spill_count <= index)
+    {
+        c->frame->spill_slots = xrealloc(c->frame->spill_slots, sizeof (struct bc_slot) * (c->frame->spill_count + 1));
+        c->frame->spill_slots[c->frame->spill_count++] = slot_alloc(c);
+    }
+
+    return c->frame->spill_slots[index];
+}
+
+/* Returns a register holding the temporary at pos, reloading it if spilled. */
+static uint8_t operand_reg(struct bc_compiler *c, size_t pos, uint8_t scratch)
+{
+    if (pos < BC_TEMP_COUNT)
+        return BC_TEMP_FIRST + pos;
+
+    emit_load(c, scratch, spill_slot(c, pos));
+    return scratch;
+}
+
+/* Returns the register an instruction should write the temporary at pos to. */
+static uint8_t result_reg(size_t pos, uint8_t scratch)
+{
+    return pos < BC_TEMP_COUNT ? (uint8_t) (BC_TEMP_FIRST + pos) : scratch;
+}
+
+/* Stores a result written to result_reg() back when the position is spilled. */
+static void result_commit(struct bc_compiler *c, size_t pos, uint8_t reg)
+{
+    if (pos >= BC_TEMP_COUNT)
+        emit_store(c, spill_slot(c, pos), reg);
+}
+
+static void operand_move(struct bc_compiler *c, size_t pos, uint8_t reg)
+{
+    if (pos < BC_TEMP_COUNT)
+        emit_mov_rr(c, reg, BC_TEMP_FIRST + pos);
+    else
+        emit_load(c, reg, spill_slot(c, pos));
+}
+
+static void result_set(struct bc_compiler *c, size_t pos, uint8_t reg)
+{
+    if (pos < BC_TEMP_COUNT)
+        emit_mov_rr(c, BC_TEMP_FIRST + pos, reg);
+    else
+        emit_store(c, spill_slot(c, pos), reg);
+}
+
+static void result_set_imm(struct bc_compiler *c, size_t pos, uint64_t imm)
+{
+    uint8_t reg = result_reg(pos, R1);
+    emit_mov_ir(c, reg, imm);
+    result_commit(c, pos, reg);
+}
+
+static struct bc_scope *bc_scope_create(struct bc_scope *parent)
+{
+    struct bc_scope *scope = xcalloc(1, sizeof (struct bc_scope));
+    scope->symbols = map_create();
+    scope->parent = parent;
+    return scope;
+}
+
+static void bc_scope_free(struct bc_scope *scope)
+{
+    MAP_FOREACH(&scope->symbols)
+    {
+        struct bc_symbol *symbol = scope->symbols.elements[i].value;
+
+        for (size_t j = 0; j < symbol->specialization_count; j++)
+        {
+            free(symbol->specializations[j]->param_types);
+            free(symbol->specializations[j]);
+        }
+
+        free(symbol->specializations);
+        free(symbol);
+    }
+
+    map_free(&scope->symbols);
+    free(scope);
+}
+
+static struct bc_symbol *bc_scope_resolve(struct bc_scope *scope, const char *name)
+{
+    for (; scope != NULL; scope = scope->parent)
+    {
+        struct bc_symbol *symbol = map_get(&scope->symbols, name);
+
+        if (symbol != NULL)
+            return symbol;
+    }
+
+    return NULL;
+}
+
+static bool is_builtin_name(const char *name)
+{
+    for (size_t i = 0; i < (sizeof builtin_functions) / (sizeof builtin_functions[0]); i++)
+    {
+        if (strcmp(builtin_functions[i].name, name) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+/* Mirrors the identifiers that scope_init() and scope_create_global() predefine. */
+static struct bc_symbol *bc_scope_declare(struct bc_compiler *c, const ast_node_t *node, const char *name,
+                                          enum bc_symbol_kind kind)
+{
+    bool is_global = c->scope->parent == NULL;
+
+    if (map_get(&c->scope->symbols, name) != NULL || is_builtin_name(name) ||
+        (is_global && (strcmp(name, "true") == 0 || strcmp(name, "false") == 0 || strcmp(name, "null") == 0)))
+    {
+        compile_error(c, node, "cannot redeclare identifier '%s'", name);
+        return NULL;
+    }
+
+    struct bc_symbol *symbol = xcalloc(1, sizeof (struct bc_symbol));
+    symbol->kind = kind;
+    map_set(&c->scope->symbols, (char *) name, symbol, MAP_CREATE);
+    return symbol;
+}
+
+static bool is_expression(const ast_node_t *node)
+{
+    switch (node->type)
+    {
+        case NODE_INT_LIT:
+        case NODE_STRING:
+        case NODE_IDENTIFIER:
+        case NODE_BINARY_EXPR:
+        case NODE_ASSIGNMENT:
+        case NODE_EXPR_CALL:
+        case NODE_ARRAY_LIT:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/* Locals of a function can only be reached from the frame that owns them. */
+static bool check_slot_access(struct bc_compiler *c, const ast_node_t *node, const struct bc_symbol *symbol)
+{
+    if (symbol->slot.frame->is_function && symbol->slot.frame != c->frame)
+        return compile_error(c, node, "cannot use '%s' of an enclosing function in bytecode yet",
+                             node->identifier->symbol);
+
+    return true;
+}
+
+static bool compile_string(struct bc_compiler *c, const ast_node_t *node, size_t pos, enum bc_type *type)
+{
+    val_t *value = node->string->value;
+
+    if (value == NULL)
+        value = constpool_intern_string(c->constants, node->string->strval, strlen(node->string->strval));
+
+    uint8_t reg = result_reg(pos, R1);
+    emit_const(c, reg, value->strval);
+    result_commit(c, pos, reg);
+    *type = BC_TYPE_STRING;
+    return true;
+}
+
+static bool compile_identifier(struct bc_compiler *c, const ast_node_t *node, size_t pos, enum bc_type *type)
+{
+    const char *name = node->identifier->symbol;
+    struct bc_symbol *symbol = bc_scope_resolve(c->scope, name);
+
+    if (symbol != NULL)
+    {
+        if (symbol->kind == BC_SYMBOL_FN)
+            return compile_error(c, node, "functions cannot be used as values in bytecode yet");
+
+        if (!check_slot_access(c, node, symbol))
+            return false;
+
+        uint8_t reg = result_reg(pos, R1);
+        emit_load(c, reg, symbol->slot);
+        result_commit(c, pos, reg);
+        *type = symbol->type;
+        return true;
+    }
+
+    if (strcmp(name, "true") == 0 || strcmp(name, "false") == 0)
+    {
+        result_set_imm(c, pos, name[0] == 't');
+        *type = BC_TYPE_BOOL;
+        return true;
+    }
+
+    if (strcmp(name, "null") == 0)
+    {
+        result_set_imm(c, pos, 0);
+        *type = BC_TYPE_NULL;
+        return true;
+    }
+
+    return compile_error(c, node, "use of undeclared identifier '%s'", name);
+}
+
+/* Replaces the temporary at pos with its string form, as concatenation does. */
+static void compile_to_string(struct bc_compiler *c, size_t pos, enum bc_type type)
+{
+    if (type == BC_TYPE_STRING)
+        return;
+
+    operand_move(c, pos, R2);
+    emit_mov_ir(c, R1, bc_type_to_value_type(type));
+    emit_syscall(c, SYS_STRING_FROM);
+    result_set(c, pos, R0);
+}
+
+static bool compile_cmp(struct bc_compiler *c, const ast_node_t *node, size_t pos,
+                        enum bc_type left, enum bc_type right)
+{
+    ast_bin_operator_t operator = node->binexpr->operator;
+    bool strict = operator == OP_CMP_EQ_S || operator == OP_CMP_NE_S;
+    bool negate = operator == OP_CMP_NE || operator == OP_CMP_NE_S;
+
+    if (left == BC_TYPE_STRING || right == BC_TYPE_STRING)
+    {
+        if (operator != OP_CMP_EQ && operator != OP_CMP_EQ_S &&
+            operator != OP_CMP_NE && operator != OP_CMP_NE_S)
+            return compile_error(c, node, "unsupported operator '%c' being used with type string", operator);
+
+        /* Strict comparisons of different types are false either way. */
+        if (strict && left != right)
+        {
+            result_set_imm(c, pos, 0);
+            return true;
+        }
+
+        compile_to_string(c, pos, left);
+        compile_to_string(c, pos + 1, right);
+        operand_move(c, pos, R1);
+        operand_move(c, pos + 1, R2);
+        emit_syscall(c, SYS_STRING_EQUALS);
+
+        if (negate)
+        {
+            emit_mov_ir(c, R1, 0);
+            emit_rr(c, OP_EQ_RR, R0, R1);
+        }
+
+        result_set(c, pos, R0);
+        return true;
+    }
+
+    if (strict && left != right)
+    {
+        result_set_imm(c, pos, 0);
+        return true;
+    }
+
+    opcode_t opcode;
+
+    switch (operator)
+    {
+        case OP_CMP_LT:
+            opcode = OP_LT_RR;
+            break;
+
+        case OP_CMP_GT:
+            opcode = OP_GT_RR;
+            break;
+
+        case OP_CMP_GE:
+            opcode = OP_GE_RR;
+            break;
+
+        case OP_CMP_LE:
+            opcode = OP_LE_RR;
+            break;
+
+        case OP_CMP_EQ:
+        case OP_CMP_EQ_S:
+            opcode = OP_EQ_RR;
+            break;
+
+        case OP_CMP_NE:
+        case OP_CMP_NE_S:
+            opcode = OP_NE_RR;
+            break;
+
+        default:
+            return compile_error(c, node, "unsupported comparison operator '%c' (%d)", operator, operator);
+    }
+
+    uint8_t reg1 = operand_reg(c, pos, R1);
+    uint8_t reg2 = operand_reg(c, pos + 1, R2);
+    emit_rr(c, opcode, reg1, reg2);
+    result_commit(c, pos, reg1);
+    return true;
+}
+
+static bool compile_binexpr(struct bc_compiler *c, const ast_node_t *node, size_t pos, enum bc_type *type)
+{
+    ast_bin_operator_t operator = node->binexpr->operator;
+    enum bc_type left, right;
+
+    if (!compile_expr(c, node->binexpr->left, pos, &left) ||
+        !compile_expr(c, node->binexpr->right, pos + 1, &right))
+        return false;
+
+    if (left == BC_TYPE_ARRAY || right == BC_TYPE_ARRAY)
+        return compile_error(c, node, "unsupported binary operation (lhs: %s, rhs: %s)",
+                             bc_type_to_str(left), bc_type_to_str(right));
+
+    if (operator >= OP_CMP_LT && operator <= OP_CMP_NE_S)
+    {
+        *type = BC_TYPE_BOOL;
+        return compile_cmp(c, node, pos, left, right);
+    }
+
+    if (left == BC_TYPE_INT && right == BC_TYPE_INT)
+    {
+        opcode_t opcode;
+
+        switch (operator)
+        {
+            case OP_PLUS:
+                opcode = OP_ADD_RR;
+                break;
+
+            case OP_MINUS:
+                opcode = OP_SUB_RR;
+                break;
+
+            case OP_TIMES:
+                opcode = OP_MUL_RR;
+                break;
+
+            case OP_MODULUS:
+                opcode = OP_MOD_RR;
+                break;
+
+            case OP_DIVIDE:
+                return compile_error(c, node, "division produces a float, which bytecode does not support yet");
+
+            default:
+                return compile_error(c, node, "unsupported int operator '%c' (%d)", operator, operator);
+        }
+
+        uint8_t reg1 = operand_reg(c, pos, R1);
+        uint8_t reg2 = operand_reg(c, pos + 1, R2);
+        emit_rr(c, opcode, reg1, reg2);
+        result_commit(c, pos, reg1);
+        *type = BC_TYPE_INT;
+        return true;
+    }
+
+    if ((left == BC_TYPE_STRING || right == BC_TYPE_STRING) && operator == OP_PLUS)
+    {
+        compile_to_string(c, pos, left);
+        compile_to_string(c, pos + 1, right);
+        operand_move(c, pos, R1);
+        operand_move(c, pos + 1, R2);
+        emit_syscall(c, SYS_STRING_CONCAT);
+        result_set(c, pos, R0);
+        *type = BC_TYPE_STRING;
+        return true;
+    }
+
+    return compile_error(c, node, "unsupported binary operation (lhs: %s, rhs: %s)",
+                         bc_type_to_str(left), bc_type_to_str(right));
+}
+
+static bool compile_assignment(struct bc_compiler *c, const ast_node_t *node, size_t pos, enum bc_type *type)
+{
+    const ast_node_t *assignee = node->assignment_expr->assignee;
+    const char *name = assignee->identifier->symbol;
+    struct bc_symbol *symbol = bc_scope_resolve(c->scope, name);
+
+    if (symbol == NULL || symbol->kind != BC_SYMBOL_VAR)
+        return compile_error(c, assignee, "use of undeclared identifier '%s'", name);
+
+    if (symbol->is_const)
+        return compile_error(c, assignee, "cannot assign to constant '%s'", name);
+
+    if (!check_slot_access(c, assignee, symbol))
+        return false;
+
+    if (!compile_expr(c, node->assignment_expr->value, pos, type))
+        return false;
+
+    if (*type != symbol->type)
+        return compile_error(c, node, "cannot change the type of '%s' from %s to %s in bytecode",
+                             name, bc_type_to_str(symbol->type), bc_type_to_str(*type));
+
+    emit_store(c, symbol->slot, operand_reg(c, pos, R1));
+    return true;
+}
+
+static bool compile_args(struct bc_compiler *c, const ast_node_t *node, size_t pos, enum bc_type *types)
+{
+    for (size_t i = 0; i < node->fn_call->argc; i++)
+    {
+        if (!compile_expr(c, &node->fn_call->args[i], pos + i, &types[i]))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Elements are boxed with their types, since the array does not keep them
+ * and printing it needs them. array_set takes the box in %r3, which is the
+ * first temporary, so that is saved around the syscall.
+ */
+static bool compile_array_lit(struct bc_compiler *c, const ast_node_t *node, size_t pos, enum bc_type *type)
+{
+    const vector_t *elements = node->array_lit->elements;
+
+    emit_mov_ir(c, R1, elements->length);
+    emit_syscall(c, SYS_ARRAY_NEW);
+    result_set(c, pos, R0);
+
+    for (size_t i = 0; i < elements->length; i++)
+    {
+        enum bc_type element_type;
+
+        if (!compile_expr(c, elements->data[i], pos + 1, &element_type))
+            return false;
+
+        operand_move(c, pos + 1, R2);
+        emit_mov_ir(c, R1, bc_type_to_value_type(element_type));
+        emit_syscall(c, SYS_BOX);
+
+        emit_r(c, OP_PUSH_R_Q, BC_TEMP_FIRST);
+        operand_move(c, pos, R1);
+        emit_mov_rr(c, BC_TEMP_FIRST, R0);
+        emit_mov_ir(c, R2, i);
+        emit_syscall(c, SYS_ARRAY_SET);
+        emit_r(c, OP_POP_R_Q, BC_TEMP_FIRST);
+    }
+
+    *type = BC_TYPE_ARRAY;
+    return true;
+}
+
+static void emit_write_char(struct bc_compiler *c, char character)
+{
+    emit_mov_ir(c, R1, VT_CHAR);
+    emit_mov_ir(c, R2, (uint64_t) character);
+    emit_syscall(c, SYS_WRITE);
+}
+
+static bool compile_print(struct bc_compiler *c, const ast_node_t *node, size_t pos, bool newline)
+{
+    size_t argc = node->fn_call->argc;
+
+    if (argc == 0)
+        return compile_error(c, node, "function println() requires at least 1 argument to be passed");
+
+    enum bc_type *types = xcalloc(argc, sizeof (enum bc_type));
+
+    if (!compile_args(c, node, pos, types))
+    {
+        free(types);
+        return false;
+    }
+
+    for (size_t i = 0; i < argc; i++)
+    {
+        operand_move(c, pos + i, R2);
+        emit_mov_ir(c, R1, bc_type_to_value_type(types[i]));
+        emit_syscall(c, SYS_WRITE);
+
+        if (i != argc - 1)
+            emit_write_char(c, ' ');
+    }
+
+    if (newline)
+        emit_write_char(c, '\n');
+
+    free(types);
+    result_set_imm(c, pos, 0);
+    return true;
+}
+
+static bool compile_exit(struct bc_compiler *c, const ast_node_t *node, size_t pos)
+{
+    size_t argc = node->fn_call->argc;
+    enum bc_type *types = xcalloc(argc == 0 ? 1 : argc, sizeof (enum bc_type));
+
+    if (!compile_args(c, node, pos, types))
+    {
+        free(types);
+        return false;
+    }
+
+    if (argc >= 1 && types[0] != BC_TYPE_INT)
+    {
+        free(types);
+        return compile_error(c, node, "#1 argument passed to function exit() must be an integer");
+    }
+
+    free(types);
+
+    if (argc >= 1)
+        operand_move(c, pos, R1);
+    else
+        emit_mov_ir(c, R1, 0);
+
+    emit_syscall(c, SYS_EXIT);
+    emit_op(c, OP_HLT);
+    result_set_imm(c, pos, 0);
+    return true;
+}
+
+/*
+ * Evaluates the statements of a function body and leaves the value of the
+ * last one in %r0, which is what a call returns.
+ */
+static bool compile_body(struct bc_compiler *c, const ast_node_t *body, size_t size, enum bc_type *type)
+{
+    *type = BC_TYPE_NULL;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        if (i == size - 1 && is_expression(&body[i]))
+        {
+            if (!compile_expr(c, &body[i], 0, type))
+                return false;
+
+            operand_move(c, 0, R0);
+            return true;
+        }
+
+        if (!compile_statement(c, &body[i]))
+            return false;
+    }
+
+    emit_mov_ir(c, R0, 0);
+    return true;
+}
+
+/* Names the entry of a specialization after the function and its argument types. */
+static void add_specialization_symbol(struct bc_compiler *c, const ast_fn_decl_t *fn_decl, const enum bc_type *types)
+{
+    size_t length = strlen(fn_decl->identifier->symbol) + 3;
+
+    for (size_t i = 0; i < fn_decl->param_count; i++)
+        length += strlen(bc_type_to_str(types[i])) + 2;
+
+    char *name = xmalloc(length);
+    char *end = name + sprintf(name, "%s(", fn_decl->identifier->symbol);
+
+    for (size_t i = 0; i < fn_decl->param_count; i++)
+        end += sprintf(end, "%s%s", i == 0 ? "" : ", ", bc_type_to_str(types[i]));
+
+    strcpy(end, ")");
+    bytecode_add_symbol(&c->builder.bytecode, name, c->builder.bytecode.size);
+    free(name);
+}
+
+/*
+ * Emits the body of a function for one set of argument types. The code is
+ * placed inline, behind a jump, at the call site that first needs it.
+ */
+static struct bc_specialization *compile_specialization(struct bc_compiler *c, struct bc_symbol *symbol,
+                                                        const ast_node_t *node, const enum bc_type *types)
+{
+    const ast_fn_decl_t *fn_decl = symbol->fn_node->fn_decl;
+
+    if (fn_decl->param_count > UINT8_MAX)
+    {
+        compile_error(c, node, "function '%s' has more than %d parameters", fn_decl->identifier->symbol, UINT8_MAX);
+        return NULL;
+    }
+
+    struct bc_specialization *spec = xcalloc(1, sizeof (struct bc_specialization));
+    size_t skip = bytecode_builder_label(&c->builder);
+
+    spec->param_types = xcalloc(fn_decl->param_count + 1, sizeof (enum bc_type));
+    spec->return_type = BC_TYPE_INT;
+    spec->label = bytecode_builder_label(&c->builder);
+    spec->compiling = true;
+
+    symbol->specializations = xrealloc(symbol->specializations,
+                                       sizeof (struct bc_specialization *) * (symbol->specialization_count + 1));
+    symbol->specializations[symbol->specialization_count++] = spec;
+
+    emit_jump(c, OP_JMP, skip);
+    bytecode_builder_bind(&c->builder, spec->label);
+    add_specialization_symbol(c, fn_decl, types);
+
+    /* The number of locals is patched in once the body is compiled. */
+    size_t enter = c->builder.bytecode.size;
+    emit_op(c, OP_ENTER);
+    bytecode_push_dword(&c->builder.bytecode, 0);
+    bytecode_push_byte(&c->builder.bytecode, (uint8_t) fn_decl->param_count);
+
+    struct bc_scope *saved_scope = c->scope;
+    struct bc_frame *saved_frame = c->frame;
+    struct bc_frame frame = { .is_function = true };
+    enum bc_type return_type = BC_TYPE_NULL;
+    bool ok = true;
+
+    c->frame = &frame;
+    c->scope = bc_scope_create(symbol->fn_scope);
+
+    for (size_t i = 0; i < fn_decl->param_count && ok; i++)
+    {
+        struct bc_symbol *param = bc_scope_declare(c, symbol->fn_node, fn_decl->param_names[i], BC_SYMBOL_VAR);
+
+        if (param == NULL)
+        {
+            ok = false;
+            break;
+        }
+
+        spec->param_types[i] = types[i];
+        param->type = types[i];
+        param->slot = (struct bc_slot) { &frame, FRAME_ARG_OFFSET(i, fn_decl->param_count) };
+        param->is_const = true;
+    }
+
+    ok = ok && compile_body(c, fn_decl->body, fn_decl->size, &return_type);
+    emit_op(c, OP_LEAVE);
+    emit_op(c, OP_RET);
+
+    uint32_t local_count = (uint32_t) frame.local_count;
+    memcpy(c->builder.bytecode.bytes + enter + 1, &local_count, sizeof local_count);
+
+    bc_scope_free(c->scope);
+    free(frame.spill_slots);
+    c->scope = saved_scope;
+    c->frame = saved_frame;
+
+    bytecode_builder_bind(&c->builder, skip);
+    spec->compiling = false;
+
+    if (ok && spec->recursive && return_type != spec->return_type)
+    {
+        compile_error(c, node, "cannot infer the return type of recursive function '%s' (it returns %s)",
+                      fn_decl->identifier->symbol, bc_type_to_str(return_type));
+        return NULL;
+    }
+
+    spec->return_type = return_type;
+    return ok ? spec : NULL;
+}
+
+static struct bc_specialization *find_specialization(struct bc_symbol *symbol, const enum bc_type *types, size_t argc)
+{
+    for (size_t i = 0; i < symbol->specialization_count; i++)
+    {
+        if (argc == 0 || memcmp(symbol->specializations[i]->param_types, types, sizeof (enum bc_type) * argc) == 0)
+            return symbol->specializations[i];
+    }
+
+    return NULL;
+}
+
+static bool compile_user_call(struct bc_compiler *c, const ast_node_t *node, struct bc_symbol *symbol,
+                              size_t pos, enum bc_type *type)
+{
+    const char *name = node->fn_call->identifier->symbol;
+    size_t argc = node->fn_call->argc;
+    size_t param_count = symbol->fn_node->fn_decl->param_count;
+
+    if (argc != param_count)
+        return compile_error(c, node, "function '%s' requires %lu arguments, but %lu were passed",
+                             name, param_count, argc);
+
+    enum bc_type *types = xcalloc(argc == 0 ? 1 : argc, sizeof (enum bc_type));
+
+    if (!compile_args(c, node, pos, types))
+    {
+        free(types);
+        return false;
+    }
+
+    struct bc_specialization *spec = find_specialization(symbol, types, argc);
+
+    if (spec == NULL)
+        spec = compile_specialization(c, symbol, node, types);
+    else if (spec->compiling)
+        spec->recursive = true;
+
+    free(types);
+
+    if (spec == NULL)
+        return false;
+
+    /* The callee uses the same temporaries, so the live ones are saved. */
+    size_t live = pos < BC_TEMP_COUNT ? pos : BC_TEMP_COUNT;
+
+    for (size_t i = 0; i < live; i++)
+        emit_r(c, OP_PUSH_R_Q, BC_TEMP_FIRST + i);
+
+    for (size_t i = 0; i < argc; i++)
+        emit_r(c, OP_PUSH_R_Q, operand_reg(c, pos + i, R1));
+
+    emit_jump(c, OP_CALL, spec->label);
+
+    for (size_t i = 0; i < argc; i++)
+        emit_r(c, OP_POP_R_Q, R1);
+
+    for (size_t i = live; i-- > 0;)
+        emit_r(c, OP_POP_R_Q, BC_TEMP_FIRST + i);
+
+    result_set(c, pos, R0);
+    *type = spec->return_type;
+    return true;
+}
+
+static bool compile_call(struct bc_compiler *c, const ast_node_t *node, size_t pos, enum bc_type *type)
+{
+    const char *name = node->fn_call->identifier->symbol;
+    struct bc_symbol *symbol = bc_scope_resolve(c->scope, name);
+
+    if (symbol != NULL)
+    {
+        if (symbol->kind != BC_SYMBOL_FN)
+            return compile_error(c, node, "'%s' is not a function", name);
+
+        return compile_user_call(c, node, symbol, pos, type);
+    }
+
+    *type = BC_TYPE_NULL;
+
+    if (strcmp(name, "println") == 0 || strcmp(name, "print") == 0)
+        return compile_print(c, node, pos, strcmp(name, "println") == 0);
+
+    if (strcmp(name, "exit") == 0)
+        return compile_exit(c, node, pos);
+
+    if (is_builtin_name(name))
+        return compile_error(c, node, "built-in function '%s' is not supported in bytecode yet", name);
+
+    return compile_error(c, node, "undefined function '%s'", name);
+}
+
+static bool compile_expr(struct bc_compiler *c, const ast_node_t *node, size_t pos, enum bc_type *type)
+{
+    switch (node->type)
+    {
+        case NODE_INT_LIT:
+            result_set_imm(c, pos, (uint64_t) node->integer->intval);
+            *type = BC_TYPE_INT;
+            return true;
+
+        case NODE_STRING:
+            return compile_string(c, node, pos, type);
+
+        case NODE_IDENTIFIER:
+            return compile_identifier(c, node, pos, type);
+
+        case NODE_BINARY_EXPR:
+            return compile_binexpr(c, node, pos, type);
+
+        case NODE_ASSIGNMENT:
+            return compile_assignment(c, node, pos, type);
+
+        case NODE_EXPR_CALL:
+            return compile_call(c, node, pos, type);
+
+        case NODE_ARRAY_LIT:
+            return compile_array_lit(c, node, pos, type);
+
+        default:
+            if (!compile_statement(c, node))
+                return false;
+
+            result_set_imm(c, pos, 0);
+            *type = BC_TYPE_NULL;
+            return true;
+    }
+}
+
+static bool compile_var_decl(struct bc_compiler *c, const ast_node_t *node)
+{
+    enum bc_type type = BC_TYPE_NULL;
+
+    if (node->var_decl->value == NULL)
+        result_set_imm(c, 0, 0);
+    else if (!compile_expr(c, node->var_decl->value, 0, &type))
+        return false;
+
+    struct bc_symbol *symbol = bc_scope_declare(c, node, node->var_decl->name, BC_SYMBOL_VAR);
+
+    if (symbol == NULL)
+        return false;
+
+    symbol->type = type;
+    symbol->slot = slot_alloc(c);
+    symbol->is_const = node->var_decl->is_const;
+    emit_store(c, symbol->slot, operand_reg(c, 0, R1));
+    return true;
+}
+
+static bool compile_fn_decl(struct bc_compiler *c, const ast_node_t *node)
+{
+    struct bc_symbol *symbol = bc_scope_declare(c, node, node->fn_decl->identifier->symbol, BC_SYMBOL_FN);
+
+    if (symbol == NULL)
+        return false;
+
+    symbol->fn_node = node;
+    symbol->fn_scope = c->scope;
+    return true;
+}
+
+static bool compile_statements(struct bc_compiler *c, const ast_node_t *nodes, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (!compile_statement(c, &nodes[i]))
+            return false;
+    }
+
+    return true;
+}
+
+static bool compile_block(struct bc_compiler *c, const ast_node_t *node)
+{
+    c->scope = bc_scope_create(c->scope);
+
+    bool ok = compile_statements(c, node->block->children, node->block->size);
+    struct bc_scope *scope = c->scope;
+
+    c->scope = scope->parent;
+    bc_scope_free(scope);
+    return ok;
+}
+
+static bool compile_if_stmt(struct bc_compiler *c, const ast_node_t *node)
+{
+    enum bc_type type;
+    size_t else_label = bytecode_builder_label(&c->builder);
+    size_t end_label = bytecode_builder_label(&c->builder);
+
+    if (!compile_expr(c, node->if_stmt->condition, 0, &type))
+        return false;
+
+    /* Strings and arrays are always truthy and null never is. */
+    if (type == BC_TYPE_NULL)
+        emit_jump(c, OP_JMP, else_label);
+    else if (type != BC_TYPE_STRING && type != BC_TYPE_ARRAY)
+        emit_jz(c, operand_reg(c, 0, R1), else_label);
+
+    if (!compile_statement(c, node->if_stmt->if_block))
+        return false;
+
+    if (node->if_stmt->else_block != NULL)
+    {
+        emit_jump(c, OP_JMP, end_label);
+        bytecode_builder_bind(&c->builder, else_label);
+
+        if (!compile_statement(c, node->if_stmt->else_block))
+            return false;
+
+        bytecode_builder_bind(&c->builder, end_label);
+    }
+    else
+    {
+        bytecode_builder_bind(&c->builder, else_label);
+        bytecode_builder_bind(&c->builder, end_label);
+    }
+
+    return true;
+}
+
+/*
+ * An integer count runs the body that many times. A boolean one is
+ * evaluated once: false skips the loop and true repeats it forever.
+ */
+static bool compile_loop_stmt(struct bc_compiler *c, const ast_node_t *node)
+{
+    const ast_loop_stmt_t *loop = node->loop_stmt;
+    enum bc_type type = BC_TYPE_BOOL;
+    size_t top = bytecode_builder_label(&c->builder);
+    size_t end = bytecode_builder_label(&c->builder);
+    struct bc_slot counter = slot_alloc(c);
+    struct bc_slot limit = slot_alloc(c);
+
+    if (loop->iter_count == NULL)
+        result_set_imm(c, 0, 1);
+    else if (!compile_expr(c, loop->iter_count, 0, &type))
+        return false;
+
+    if (type != BC_TYPE_INT && type != BC_TYPE_BOOL)
+        return compile_error(c, node, "type '%s' is not iterable", bc_type_to_str(type));
+
+    uint8_t reg = operand_reg(c, 0, R1);
+
+    if (type == BC_TYPE_INT)
+    {
+        size_t ok = bytecode_builder_label(&c->builder);
+        char *message = NULL;
+
+        if (asprintf(&message, "%s:%lu:%lu: the iteration count must not be a negative number",
+                     node->filename == NULL ? "<input>" : node->filename,
+                     node->line_start, node->column_start) < 0)
+            return compile_error(c, node, "out of memory");
+
+        val_t *message_val = constpool_intern_string(c->constants, message, strlen(message));
+        free(message);
+
+        emit_store(c, limit, reg);
+        emit_mov_ir(c, R2, 0);
+        emit_branch_rr(c, OP_JGE_RR, reg, R2, ok);
+        emit_const(c, R1, message_val->strval);
+        emit_syscall(c, SYS_ERROR);
+        bytecode_builder_bind(&c->builder, ok);
+    }
+    else
+        emit_jz(c, reg, end);
+
+    emit_mov_ir(c, R1, 0);
+    emit_store(c, counter, R1);
+    bytecode_builder_bind(&c->builder, top);
+
+    if (type == BC_TYPE_INT)
+    {
+        emit_load(c, R1, counter);
+        emit_load(c, R2, limit);
+        emit_branch_rr(c, OP_JGE_RR, R1, R2, end);
+    }
+
+    c->scope = bc_scope_create(c->scope);
+
+    bool ok = true;
+
+    if (loop->iter_varname != NULL)
+    {
+        struct bc_symbol *symbol = bc_scope_declare(c, node, loop->iter_varname, BC_SYMBOL_VAR);
+
+        if (symbol == NULL)
+            ok = false;
+        else
+        {
+            symbol->type = BC_TYPE_INT;
+            symbol->slot = counter;
+            symbol->is_const = true;
+        }
+    }
+
+    if (ok)
+    {
+        if (loop->body->type == NODE_BLOCK)
+            ok = compile_statements(c, loop->body->block->children, loop->body->block->size);
+        else
+            ok = compile_statement(c, loop->body);
+    }
+
+    struct bc_scope *scope = c->scope;
+    c->scope = scope->parent;
+    bc_scope_free(scope);
+
+    if (!ok)
+        return false;
+
+    emit_load(c, R1, counter);
+    emit_mov_ir(c, R2, 1);
+    emit_rr(c, OP_ADD_RR, R1, R2);
+    emit_store(c, counter, R1);
+    emit_jump(c, OP_JMP, top);
+    bytecode_builder_bind(&c->builder, end);
+    return true;
+}
+
+static bool compile_statement(struct bc_compiler *c, const ast_node_t *node)
+{
+    enum bc_type type;
+
+    switch (node->type)
+    {
+        case NODE_VAR_DECL:
+            return compile_var_decl(c, node);
+
+        case NODE_FN_DECL:
+            return compile_fn_decl(c, node);
+
+        case NODE_BLOCK:
+            return compile_block(c, node);
+
+        case NODE_IF_STMT:
+            return compile_if_stmt(c, node);
+
+        case NODE_LOOP_STMT:
+            return compile_loop_stmt(c, node);
+
+        default:
+            if (is_expression(node))
+                return compile_expr(c, node, 0, &type);
+
+            return compile_error(c, node, "unsupported AST node");
+    }
+}
+
+bool compile_bytecode(const ast_node_t *root, struct constpool *constants, struct bytecode *bytecode, char **error)
+{
+    struct bc_frame frame = { .is_function = false };
+    struct bc_compiler compiler = {
+        .builder = bytecode_builder_init(),
+        .constants = constants,
+        .constant_indices = map_create(),
+        .scope = bc_scope_create(NULL),
+        .frame = &frame,
+        .data_size = 0,
+        .error = NULL
+    };
+
+    bool ok = compile_statements(&compiler, root->root->nodes, root->root->size);
+
+    bc_scope_free(compiler.scope);
+    map_free(&compiler.constant_indices);
+    free(frame.spill_slots);
+
+    if (!ok)
+    {
+        bytecode_builder_free(&compiler.builder);
+        *error = compiler.error;
+        return false;
+    }
+
+    emit_op(&compiler, OP_HLT);
+    *bytecode = bytecode_builder_finish(&compiler.builder);
+    bytecode->data_size = compiler.data_size;
+
+    /* Should never fail; if it does, the code generator has a bug. */
+    if (!bytecode_verify(bytecode, error))
+    {
+        bytecode_free(bytecode);
+        return false;
+    }
+
+    return true;
+}
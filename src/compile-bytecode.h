@@ -0,0 +1,23 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_COMPILE_BYTECODE_H
+#define BLAZESCRIPT_COMPILE_BYTECODE_H
+
+#include <stdbool.h>
+#include "ast.h"
+#include "bytecode.h"
+#include "constpool.h"
+
+/*
+ * Compiles a parsed program into bytecode for the blaze VM. String
+ * constants are taken from (or interned into) the given constant pool and
+ * are referenced by address, so the pool must outlive the bytecode.
+ *
+ * Returns false and sets *error when the program uses something the VM
+ * cannot run yet; the caller can fall back to the tree-walking evaluator.
+ */
+bool compile_bytecode(const ast_node_t *root, struct constpool *constants, struct bytecode *bytecode, char **error);
+
+#endif /* BLAZESCRIPT_COMPILE_BYTECODE_H */
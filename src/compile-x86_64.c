@@ -5,12 +5,15 @@
 #define _GNU_SOURCE
 
 #include "compile-x86_64.h"
+#include "alloca.h"
 #include "compile.h"
 #include "log.h"
+#include "map.h"
 #include "utils.h"
 #include "include/lib.h"
 #include <assert.h>
-#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 
 #define RSP REGISTER_X64(RSP)
@@ -23,165 +26,1338 @@
 #define R8 REGISTER_X64(R8)
 #define R9 REGISTER_X64(R9)
 
+#define SLOT(offset) REGISTER_OFFSET((offset), ASM_INTEL_RBP)
+
 static struct builtin_function_def const builtin_function_defs[] = {
-    { "println", "libblaze_fn_println", true }
+    { "println", "libblaze_fn_println", true },
+    { "print", "libblaze_fn_print", true },
+    { "exit", "libblaze_fn_exit", true }
 };
 static size_t builtin_function_def_count = sizeof (builtin_function_defs) / sizeof (builtin_function_defs[0]);
 static uint64_t lbl_count = 0;
 
-static asm_node_t x86_64_compile_call_expr(struct compilation_context *context, ast_node_t *node);
-static asm_node_t x86_64_compile_expr(struct compilation_context *context, ast_node_t *node)
+static asm_node_register_t const arg_registers[] = {
+    ASM_INTEL_RDI, ASM_INTEL_RSI, ASM_INTEL_RDX, ASM_INTEL_RCX, ASM_INTEL_R8, ASM_INTEL_R9
+};
+#define ARG_REGISTER_COUNT (sizeof (arg_registers) / sizeof (arg_registers[0]))
+
+/*
+ * What an expression leaves in %rax. An int or a bool that inference has
+ * proven to be one is a machine word. Anything else is a val_t object of
+ * the runtime library: either a value of its own, which is freed once it
+ * has been used, or one that a variable (or the runtime, for null, true
+ * and false) holds on to. A variable owns its value, so a borrowed value
+ * is copied before it is stored anywhere.
+ */
+enum x86_64_value
 {
-    asm_node_t asm_node = asm_create_inst_array();
+    X86_64_VALUE_OWNED,
+    X86_64_VALUE_BORROWED,
+    X86_64_VALUE_INT,
+    X86_64_VALUE_BOOL
+};
 
-    switch (node->type)
+/*
+ * What inference found a variable, a parameter or the result of a
+ * function to be: an int or a bool, which it keeps as a machine word, or
+ * a boxed value, for anything else or for something that can be more
+ * than one of them. NONE means nothing is known yet.
+ */
+enum x86_64_type
+{
+    X86_64_TYPE_NONE,
+    X86_64_TYPE_INT,
+    X86_64_TYPE_BOOL,
+    X86_64_TYPE_BOXED
+};
+
+/*
+ * A function keeps its variables, parameters and temporaries in words
+ * below %rbp. Slots are taken and given back like a stack, and the frame
+ * is made as large as the most that were in use at once.
+ */
+struct x86_64_frame
+{
+    size_t slot_count;
+    size_t max_slot_count;
+};
+
+/*
+ * A function is compiled once per combination of argument types it is
+ * called with, so that ints and bools can be passed and returned as
+ * machine words. While a specialization is being compiled, recursive
+ * calls assume the return type that the previous pass found, or an int.
+ */
+struct x86_64_specialization
+{
+    enum x86_64_type *param_types;
+    enum x86_64_type return_type;
+    char *label;
+    bool compiling;
+    bool recursive;
+};
+
+enum x86_64_symbol_kind
+{
+    X86_64_SYMBOL_VAR,
+    X86_64_SYMBOL_FN
+};
+
+struct x86_64_symbol
+{
+    enum x86_64_symbol_kind kind;
+    struct x86_64_frame *frame;
+    int64_t offset;
+    enum x86_64_type type;
+    const ast_node_t *decl;
+    bool is_const;
+    bool owned;
+    const ast_node_t *fn_node;
+    struct x86_64_scope *fn_scope;
+    struct x86_64_specialization **specializations;
+    size_t specialization_count;
+};
+
+struct x86_64_scope
+{
+    map_t symbols;
+    struct x86_64_scope *parent;
+    size_t slot_count;
+};
+
+/*
+ * types holds what inference has found so far, by declaration: the type
+ * of each variable, and the return type of each specialization. The
+ * program is compiled again for as long as a pass finds that a type was
+ * wider than the code it generated assumed, which ends because types only
+ * ever get wider.
+ */
+struct x86_64_codegen
+{
+    struct compilation_context *context;
+    struct x86_64_scope *scope;
+    struct x86_64_frame *frame;
+    asm_node_t functions;
+    map_t *types;
+    bool changed;
+};
+
+/* The operands of a binary expression, as x86_64_compile_operands() leaves them. */
+struct x86_64_operands
+{
+    enum x86_64_value left;
+    enum x86_64_value right;
+    asm_node_operand_t right_operand;
+    int64_t left_slot;
+    int64_t right_slot;
+};
+
+static enum x86_64_value x86_64_compile_expr(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node);
+static void x86_64_compile_statement(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node);
+
+static void x86_64_error(const ast_node_t *node, const char *fmt, ...)
+{
+    va_list args;
+    char *message = NULL;
+
+    va_start(args, fmt);
+
+    if (vasprintf(&message, fmt, args) < 0)
+        message = NULL;
+
+    va_end(args);
+    fatal_error("%s:%lu:%lu: %s", node->filename == NULL ? "<input>" : node->filename,
+                node->line_start, node->column_start, message == NULL ? fmt : message);
+    free(message);
+    exit(EXIT_FAILURE);
+}
+
+static char *x86_64_label_create(void)
+{
+    char *label = NULL;
+    asprintf(&label, ".L%lu", lbl_count++);
+    return label;
+}
+
+static void x86_64_emit_label(asm_node_t *code, char *label)
+{
+    asm_node_children_push(&code->array_children, &code->array_size, & (asm_node_t) {
+        .type = ASM_LABEL,
+        .label_name = strdup(label)
+    });
+}
+
+static void x86_64_emit_call(asm_node_t *code, const char *name)
+{
+    asm_push_inst_mono_op(code, ASM_INST_CALL, ASM_SUF_QWORD, IDENTIFIER(name));
+}
+
+static void x86_64_emit_jump(asm_node_t *code, asm_node_inst_t inst, const char *label)
+{
+    asm_push_inst_mono_op(code, inst, ASM_SUF_NONE, IDENTIFIER(label));
+}
+
+static void x86_64_emit_load(asm_node_t *code, int64_t offset, asm_node_operand_t reg)
+{
+    asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, SLOT(offset), reg);
+}
+
+static void x86_64_emit_store(asm_node_t *code, asm_node_operand_t reg, int64_t offset)
+{
+    asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, reg, SLOT(offset));
+}
+
+/* Puts a string in the data section and returns its label. */
+static const char *x86_64_data_string(struct compilation_context *context, const char *str)
+{
+    char *label = NULL;
+    char *string = NULL;
+    size_t size = 0;
+    FILE *stream = open_memstream(&string, &size);
+
+    asprintf(&label, ".DL%lu", lbl_count++);
+    fputc('"', stream);
+
+    for (const char *c = str; *c != 0; c++)
     {
-        case NODE_INT_LIT:
+        if (*c == '"' || *c == '\\')
+            fprintf(stream, "\\%c", *c);
+        else if ((unsigned char) *c < ' ' || (unsigned char) *c >= 0x7f)
+            fprintf(stream, "\\%03o", (unsigned char) *c);
+        else
+            fputc(*c, stream);
+    }
+
+    fputc('"', stream);
+    fclose(stream);
+    asm_data_push(context, label, strdup("string"), string);
+    return label;
+}
+
+/* Where node is in the source, for the messages of the runtime library. */
+static const char *x86_64_data_where(struct x86_64_codegen *gen, const ast_node_t *node)
+{
+    char *where = NULL;
+    asprintf(&where, "%s:%lu:%lu", node->filename == NULL ? "<input>" : node->filename,
+             node->line_start, node->column_start);
+
+    const char *label = x86_64_data_string(gen->context, where);
+    free(where);
+    return label;
+}
+
+static int64_t x86_64_slot_alloc(struct x86_64_codegen *gen)
+{
+    struct x86_64_frame *frame = gen->frame;
+
+    if (++frame->slot_count > frame->max_slot_count)
+        frame->max_slot_count = frame->slot_count;
+
+    return -8 * (int64_t) frame->slot_count;
+}
+
+static enum x86_64_type x86_64_type_join(enum x86_64_type a, enum x86_64_type b)
+{
+    if (a == X86_64_TYPE_NONE || a == b)
+        return b;
+
+    return b == X86_64_TYPE_NONE ? a : X86_64_TYPE_BOXED;
+}
+
+static enum x86_64_type x86_64_type_of(enum x86_64_value value)
+{
+    return value == X86_64_VALUE_INT ? X86_64_TYPE_INT :
+           value == X86_64_VALUE_BOOL ? X86_64_TYPE_BOOL : X86_64_TYPE_BOXED;
+}
+
+static enum x86_64_value x86_64_type_value(enum x86_64_type type)
+{
+    return type == X86_64_TYPE_INT ? X86_64_VALUE_INT :
+           type == X86_64_TYPE_BOOL ? X86_64_VALUE_BOOL : X86_64_VALUE_OWNED;
+}
+
+static bool x86_64_is_unboxed(enum x86_64_value value)
+{
+    return value == X86_64_VALUE_INT || value == X86_64_VALUE_BOOL;
+}
+
+/* Names a declaration in the table of types, with the argument types of a specialization, if any. */
+static char *x86_64_type_key(const ast_node_t *node, const enum x86_64_type *types, size_t count)
+{
+    char *key = xmalloc(2 * sizeof (void *) + count + 8);
+    int length = sprintf(key, "%p", (const void *) node);
+
+    for (size_t i = 0; i < count; i++)
+        key[length++] = (char) ('0' + types[i]);
+
+    key[length] = 0;
+    return key;
+}
+
+static enum x86_64_type x86_64_type_lookup(struct x86_64_codegen *gen, const char *key)
+{
+    return (enum x86_64_type) (uintptr_t) map_get(gen->types, key);
+}
+
+/*
+ * Widens what the table says about key to include type. That invalidates
+ * the code of this pass if it was generated for something narrower.
+ */
+static enum x86_64_type x86_64_type_widen(struct x86_64_codegen *gen, const char *key, enum x86_64_type type)
+{
+    enum x86_64_type old = x86_64_type_lookup(gen, key);
+    enum x86_64_type new = x86_64_type_join(old, type);
+
+    if (new != old)
+    {
+        map_set(gen->types, (char *) key, (void *) (uintptr_t) new, MAP_CREATE | MAP_OVERWRITE);
+        gen->changed = gen->changed || old != X86_64_TYPE_NONE;
+    }
+
+    return new;
+}
+
+/* Turns a machine word in %rax into a value: a new int, or the shared true or false. */
+static enum x86_64_value x86_64_emit_box(asm_node_t *code, enum x86_64_value value)
+{
+    if (!x86_64_is_unboxed(value))
+        return value;
+
+    asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, RAX, RDI);
+    x86_64_emit_call(code, value == X86_64_VALUE_INT ? "libblaze_val_create_intval" : "libblaze_val_boolean");
+    return value == X86_64_VALUE_INT ? X86_64_VALUE_OWNED : X86_64_VALUE_BORROWED;
+}
+
+/* Makes the value in %rax a boxed one of its own. */
+static void x86_64_emit_own(asm_node_t *code, enum x86_64_value value)
+{
+    if (x86_64_emit_box(code, value) == X86_64_VALUE_OWNED)
+        return;
+
+    asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, RAX, RDI);
+    x86_64_emit_call(code, "libblaze_val_copy");
+}
+
+/* Frees the value in the slot at offset if it is one of its own. */
+static void x86_64_emit_release(asm_node_t *code, enum x86_64_value value, int64_t offset)
+{
+    if (value != X86_64_VALUE_OWNED)
+        return;
+
+    x86_64_emit_load(code, offset, RDI);
+    x86_64_emit_call(code, "libblaze_val_free");
+}
+
+static struct x86_64_scope *x86_64_scope_create(struct x86_64_codegen *gen)
+{
+    struct x86_64_scope *scope = xcalloc(1, sizeof (struct x86_64_scope));
+    scope->symbols = map_create();
+    scope->parent = gen->scope;
+    scope->slot_count = gen->frame->slot_count;
+    gen->scope = scope;
+    return scope;
+}
+
+/* Frees the variables of the innermost scope and gives their slots back. */
+static void x86_64_scope_exit(struct x86_64_codegen *gen, asm_node_t *code)
+{
+    struct x86_64_scope *scope = gen->scope;
+
+    MAP_FOREACH(&scope->symbols)
+    {
+        struct x86_64_symbol *symbol = scope->symbols.elements[i].value;
+
+        if (symbol->kind == X86_64_SYMBOL_VAR && symbol->owned)
+            x86_64_emit_release(code, X86_64_VALUE_OWNED, symbol->offset);
+    }
+
+    MAP_FOREACH(&scope->symbols)
+    {
+        struct x86_64_symbol *symbol = scope->symbols.elements[i].value;
+
+        for (size_t j = 0; j < symbol->specialization_count; j++)
         {
-            asm_push_inst_bin_op(&asm_node, ASM_INST_MOV, ASM_SUF_QWORD,
-                                 IMM64(node->integer->intval), REGISTER_X64(RDI));
-            asm_push_inst_mono_op(&asm_node, ASM_INST_CALL, ASM_SUF_QWORD,
-                                  IDENTIFIER("libblaze_val_create_intval"));
+            free(symbol->specializations[j]->param_types);
+            free(symbol->specializations[j]->label);
+            free(symbol->specializations[j]);
         }
-        break;
 
-        case NODE_STRING:
-        {
-            char *label = NULL;
-            asprintf(&label, ".DL%lu", lbl_count++);
-            char *string = strdup("\"");
-            size_t len = 1;
+        free(symbol->specializations);
+        free(symbol);
+    }
+
+    gen->frame->slot_count = scope->slot_count;
+    gen->scope = scope->parent;
+    map_free(&scope->symbols);
+    free(scope);
+}
+
+static struct x86_64_symbol *x86_64_scope_resolve(struct x86_64_scope *scope, const char *name)
+{
+    for (; scope != NULL; scope = scope->parent)
+    {
+        struct x86_64_symbol *symbol = map_get(&scope->symbols, name);
+
+        if (symbol != NULL)
+            return symbol;
+    }
+
+    return NULL;
+}
+
+static struct x86_64_symbol *x86_64_scope_declare(struct x86_64_codegen *gen, const ast_node_t *node,
+                                                  const char *name, enum x86_64_symbol_kind kind)
+{
+    if (map_get(&gen->scope->symbols, name) != NULL)
+        x86_64_error(node, "cannot redeclare identifier '%s'", name);
+
+    for (size_t i = 0; i < builtin_function_def_count; i++)
+    {
+        if (strcmp(builtin_function_defs[i].name, name) == 0)
+            x86_64_error(node, "cannot redeclare identifier '%s'", name);
+    }
 
-            for (size_t i = 0; i < strlen(node->string->strval); i++)
+    struct x86_64_symbol *symbol = xcalloc(1, sizeof (struct x86_64_symbol));
+    symbol->kind = kind;
+    symbol->frame = gen->frame;
+    map_set(&gen->scope->symbols, (char *) name, symbol, MAP_CREATE);
+    return symbol;
+}
+
+static struct x86_64_symbol *x86_64_resolve_var(struct x86_64_codegen *gen, const ast_node_t *node, const char *name)
+{
+    struct x86_64_symbol *symbol = x86_64_scope_resolve(gen->scope, name);
+
+    if (symbol == NULL)
+        return NULL;
+
+    if (symbol->kind == X86_64_SYMBOL_FN)
+        x86_64_error(node, "functions cannot be used as values in native code yet");
+
+    if (symbol->frame != gen->frame)
+        x86_64_error(node, "cannot use '%s' of an enclosing function in native code yet", name);
+
+    return symbol;
+}
+
+static bool x86_64_has_assignment(const ast_node_t *node)
+{
+    switch (node->type)
+    {
+        case NODE_ASSIGNMENT:
+            return true;
+
+        case NODE_BINARY_EXPR:
+            return x86_64_has_assignment(node->binexpr->left) || x86_64_has_assignment(node->binexpr->right);
+
+        case NODE_EXPR_CALL:
+            for (size_t i = 0; i < node->fn_call->argc; i++)
             {
-                const char c = node->string->strval[i];
-
-                if (c == '"')
-                {
-                    len += 2;
-                    string = xrealloc(string, len);
-                    string[len - 2] = '\\';
-                }
-                else
-                    string = xrealloc(string, ++len);
-
-                string[len - 1] = c;
+                if (x86_64_has_assignment(&node->fn_call->args[i]))
+                    return true;
             }
 
-            len += 2;
-            string = xrealloc(string, len);
-            string[len - 2] = '"';
-            string[len - 1] = 0;
+            return false;
 
-            asm_data_push(context, label, strdup("string"), string);
-            asm_push_inst_bin_op(&asm_node, ASM_INST_MOV, ASM_SUF_QWORD,
-                                 IMM_LBL(label), REGISTER_X64(RDI));
-            asm_push_inst_mono_op(&asm_node, ASM_INST_CALL, ASM_SUF_QWORD,
-                                  IDENTIFIER("libblaze_val_create_strval"));
-        }
-        break;
+        case NODE_ARRAY_LIT:
+            VECTOR_FOREACH(node->array_lit->elements)
+            {
+                if (x86_64_has_assignment(node->array_lit->elements->data[i]))
+                    return true;
+            }
+
+            return false;
 
         default:
-            fatal_error("complex expressions aren't supported yet");
+            return false;
     }
+}
 
-    return asm_node;
+static enum x86_64_value x86_64_compile_identifier(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
+{
+    const char *name = node->identifier->symbol;
+    struct x86_64_symbol *symbol = x86_64_resolve_var(gen, node, name);
+
+    if (symbol != NULL)
+    {
+        x86_64_emit_load(code, symbol->offset, RAX);
+        return symbol->type == X86_64_TYPE_BOXED ? X86_64_VALUE_BORROWED : x86_64_type_value(symbol->type);
+    }
+
+    if (strcmp(name, "true") == 0 || strcmp(name, "false") == 0)
+    {
+        asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM64(name[0] == 't'), RAX);
+        return X86_64_VALUE_BOOL;
+    }
+
+    if (strcmp(name, "null") == 0)
+    {
+        asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM_LBL("libblaze_val_null"), RAX);
+        return X86_64_VALUE_BORROWED;
+    }
+
+    x86_64_error(node, "use of undeclared identifier '%s'", name);
+    return X86_64_VALUE_BORROWED;
 }
 
-static void x86_64_compile_call_expr_args_load(struct compilation_context *context, size_t argc, asm_node_t *asm_node, size_t stack_argc_ptr, bool variadic)
+/*
+ * An operand that an instruction can take as it is, without compiling it
+ * into %rax first: a small int literal, true or false, or an int or bool
+ * variable.
+ */
+static bool x86_64_simple_operand(struct x86_64_codegen *gen, const ast_node_t *node,
+                                  asm_node_operand_t *operand, enum x86_64_value *value)
 {
-    for (size_t i = 0; i < argc; i++)
+    if (node->type == NODE_INT_LIT && node->integer->intval >= INT32_MIN && node->integer->intval <= INT32_MAX)
+    {
+        *operand = IMM64(node->integer->intval);
+        *value = X86_64_VALUE_INT;
+        return true;
+    }
+
+    if (node->type != NODE_IDENTIFIER)
+        return false;
+
+    const char *name = node->identifier->symbol;
+    struct x86_64_symbol *symbol = x86_64_scope_resolve(gen->scope, name);
+
+    if (symbol == NULL && (strcmp(name, "true") == 0 || strcmp(name, "false") == 0))
+    {
+        *operand = IMM64(name[0] == 't');
+        *value = X86_64_VALUE_BOOL;
+        return true;
+    }
+
+    if (symbol == NULL || symbol->kind != X86_64_SYMBOL_VAR || symbol->frame != gen->frame ||
+        symbol->type == X86_64_TYPE_BOXED)
+        return false;
+
+    *operand = SLOT(symbol->offset);
+    *value = x86_64_type_value(symbol->type);
+    return true;
+}
+
+/*
+ * Compiles both operands of a binary expression. If both are machine
+ * words, the left one is left in %rax and the right one in right_operand;
+ * otherwise both are boxed and left in their slots. Returns whether they
+ * are machine words.
+ */
+static bool x86_64_compile_operands(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node,
+                                    struct x86_64_operands *operands)
+{
+    operands->left = x86_64_compile_expr(gen, code, node->binexpr->left);
+
+    if (x86_64_is_unboxed(operands->left) &&
+        x86_64_simple_operand(gen, node->binexpr->right, &operands->right_operand, &operands->right))
+        return true;
+
+    /* The right operand could assign a new value to the variable the left one borrows. */
+    if (operands->left == X86_64_VALUE_BORROWED && x86_64_has_assignment(node->binexpr->right))
+    {
+        x86_64_emit_own(code, operands->left);
+        operands->left = X86_64_VALUE_OWNED;
+    }
+
+    operands->left_slot = x86_64_slot_alloc(gen);
+    x86_64_emit_store(code, RAX, operands->left_slot);
+    operands->right = x86_64_compile_expr(gen, code, node->binexpr->right);
+
+    if (x86_64_is_unboxed(operands->left) && x86_64_is_unboxed(operands->right))
+    {
+        asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, RAX, RCX);
+        x86_64_emit_load(code, operands->left_slot, RAX);
+        operands->right_operand = RCX;
+        return true;
+    }
+
+    operands->right_slot = x86_64_slot_alloc(gen);
+    operands->right = x86_64_emit_box(code, operands->right);
+    x86_64_emit_store(code, RAX, operands->right_slot);
+    x86_64_emit_load(code, operands->left_slot, RAX);
+    operands->left = x86_64_emit_box(code, operands->left);
+    x86_64_emit_store(code, RAX, operands->left_slot);
+    return false;
+}
+
+/* Calls fn of the runtime library with the operator and the boxed operands, then frees them. */
+static void x86_64_emit_binary_call(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node,
+                                    struct x86_64_operands *operands, const char *fn)
+{
+    asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM64(node->binexpr->operator), RDI);
+    x86_64_emit_load(code, operands->left_slot, RSI);
+    x86_64_emit_load(code, operands->right_slot, RDX);
+    asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM_LBL(x86_64_data_where(gen, node)), RCX);
+    x86_64_emit_call(code, fn);
+
+    if (operands->left == X86_64_VALUE_OWNED || operands->right == X86_64_VALUE_OWNED)
     {
-        if (i <= 5)
+        int64_t result_slot = x86_64_slot_alloc(gen);
+
+        x86_64_emit_store(code, RAX, result_slot);
+        x86_64_emit_release(code, operands->left, operands->left_slot);
+        x86_64_emit_release(code, operands->right, operands->right_slot);
+        x86_64_emit_load(code, result_slot, RAX);
+    }
+}
+
+static bool x86_64_is_comparison(ast_bin_operator_t operator)
+{
+    return operator >= OP_CMP_LT && operator <= OP_CMP_NE_S;
+}
+
+static const struct
+{
+    ast_bin_operator_t operator;
+    asm_node_inst_t jump_if_false;
+    asm_node_inst_t move_if_true;
+} x86_64_comparisons[] = {
+    { OP_CMP_LT, ASM_INST_JGE, ASM_INST_CMOVL },
+    { OP_CMP_GT, ASM_INST_JLE, ASM_INST_CMOVG },
+    { OP_CMP_LE, ASM_INST_JG, ASM_INST_CMOVLE },
+    { OP_CMP_GE, ASM_INST_JL, ASM_INST_CMOVGE },
+    { OP_CMP_EQ, ASM_INST_JNE, ASM_INST_CMOVE },
+    { OP_CMP_EQ_S, ASM_INST_JNE, ASM_INST_CMOVE },
+    { OP_CMP_NE, ASM_INST_JE, ASM_INST_CMOVNE },
+    { OP_CMP_NE_S, ASM_INST_JE, ASM_INST_CMOVNE },
+};
+
+/*
+ * Compiles a comparison. Machine words are compared with a cmp, and then
+ * this returns the index of the operator in x86_64_comparisons, for the
+ * caller to branch on or to turn into a bool. Otherwise it leaves the
+ * bool in %rax and returns -1.
+ */
+static int x86_64_compile_compare(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
+{
+    ast_bin_operator_t operator = node->binexpr->operator;
+    size_t mark = gen->frame->slot_count;
+    struct x86_64_operands operands;
+    int comparison = -1;
+
+    if (!x86_64_compile_operands(gen, code, node, &operands))
+        x86_64_emit_binary_call(gen, code, node, &operands, "libblaze_val_compare");
+    else if ((operator == OP_CMP_EQ_S || operator == OP_CMP_NE_S) && operands.left != operands.right)
+    {
+        /* Strict comparisons of an int and a bool are false either way. */
+        asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM64(0), RAX);
+    }
+    else
+    {
+        for (size_t i = 0; i < sizeof (x86_64_comparisons) / sizeof (x86_64_comparisons[0]); i++)
         {
-            asm_node_operand_t operand;
-
-            if (i == 0)
-                operand = RDI;
-            else if (i == 1)
-                operand = RSI;
-            else if (i == 2)
-                operand = RDX;
-            else if (i == 3)
-                operand = RCX;
-            else if (i == 4)
-                operand = R8;
-            else if (i == 5)
-                operand = R9;
-
-            asm_push_inst_bin_op(asm_node, ASM_INST_MOV, ASM_SUF_QWORD, REGISTER_OFFSET(-8 * (i + 1), ASM_INTEL_RBP), operand);
+            if (x86_64_comparisons[i].operator == operator)
+                comparison = (int) i;
         }
+
+        if (comparison < 0)
+            x86_64_error(node, "unsupported comparison operator '%c' (%d)", operator, operator);
+
+        asm_push_inst_bin_op(code, ASM_INST_CMP, ASM_SUF_QWORD, operands.right_operand, RAX);
     }
+
+    gen->frame->slot_count = mark;
+    return comparison;
 }
 
-static void x86_64_compile_call_expr_args(struct compilation_context *context, size_t argc, ast_node_t *args, asm_node_t *asm_node, size_t *stack_argc_ptr, bool variadic)
+static enum x86_64_value x86_64_compile_binexpr(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
 {
-    if (variadic)
+    ast_bin_operator_t operator = node->binexpr->operator;
+
+    if (x86_64_is_comparison(operator))
     {
-        asm_push_inst_bin_op(asm_node, ASM_INST_MOV, ASM_SUF_QWORD,
-                             IMM64(argc), RDI);
-        asm_push_inst_mono_op(asm_node, ASM_INST_PUSH, ASM_SUF_QWORD, RDI);
+        int comparison = x86_64_compile_compare(gen, code, node);
+
+        if (comparison >= 0)
+        {
+            /* Neither mov changes the flags that the cmp set. */
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM64(0), RAX);
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM64(1), RDX);
+            asm_push_inst_bin_op(code, x86_64_comparisons[comparison].move_if_true, ASM_SUF_NONE, RDX, RAX);
+        }
+
+        return X86_64_VALUE_BOOL;
     }
 
-    size_t stack_argc = 0;
+    size_t mark = gen->frame->slot_count;
+    struct x86_64_operands operands;
+    enum x86_64_value value = X86_64_VALUE_OWNED;
 
-    for (size_t i = 0, c = variadic ? 1 : 0; i < argc; i++, c++)
+    if (x86_64_compile_operands(gen, code, node, &operands) &&
+        operands.left == X86_64_VALUE_INT && operands.right == X86_64_VALUE_INT &&
+        (operator == OP_PLUS || operator == OP_MINUS || operator == OP_TIMES || operator == OP_MODULUS))
     {
-        ast_node_t arg = args[i];
-        asm_node_t instructions = x86_64_compile_expr(context, &arg);
-        asm_node_children_push(&asm_node->array_children, &asm_node->array_size, &instructions);
-        asm_push_inst_mono_op(asm_node, ASM_INST_PUSH, ASM_SUF_QWORD, RAX);
+        if (operator == OP_MODULUS)
+        {
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, operands.right_operand, RSI);
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, RAX, RDI);
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM_LBL(x86_64_data_where(gen, node)), RDX);
+            x86_64_emit_call(code, "libblaze_int_mod");
+        }
+        else
+            asm_push_inst_bin_op(code, operator == OP_PLUS ? ASM_INST_ADD : operator == OP_MINUS ? ASM_INST_SUB : ASM_INST_IMUL,
+                                 ASM_SUF_QWORD, operands.right_operand, RAX);
 
-        if (c > 5)
-            stack_argc++;
+        value = X86_64_VALUE_INT;
     }
+    else
+    {
+        /* Machine words that the runtime library has to deal with after all. */
+        if (x86_64_is_unboxed(operands.left))
+        {
+            operands.left_slot = x86_64_slot_alloc(gen);
+            operands.right_slot = x86_64_slot_alloc(gen);
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, operands.right_operand, RDX);
+            x86_64_emit_store(code, RDX, operands.right_slot);
+            operands.left = x86_64_emit_box(code, operands.left);
+            x86_64_emit_store(code, RAX, operands.left_slot);
+            x86_64_emit_load(code, operands.right_slot, RAX);
+            operands.right = x86_64_emit_box(code, operands.right);
+            x86_64_emit_store(code, RAX, operands.right_slot);
+        }
+
+        x86_64_emit_binary_call(gen, code, node, &operands, "libblaze_val_binary");
+    }
+
+    gen->frame->slot_count = mark;
+    return value;
+}
+
+/*
+ * Stores into an int or bool variable as a machine word. A value of any
+ * other type means inference assumed too narrow a type for the variable:
+ * it is widened, and the code of this pass is thrown away.
+ */
+static enum x86_64_value x86_64_compile_assignment(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
+{
+    const ast_node_t *assignee = node->assignment_expr->assignee;
+
+    if (assignee->type != NODE_IDENTIFIER)
+        x86_64_error(assignee, "only variables can be assigned to");
+
+    const char *name = assignee->identifier->symbol;
+    struct x86_64_symbol *symbol = x86_64_resolve_var(gen, assignee, name);
+
+    if (symbol == NULL)
+        x86_64_error(assignee, "use of undeclared identifier '%s'", name);
+
+    if (symbol->is_const)
+        x86_64_error(assignee, "cannot assign to constant '%s'", name);
+
+    size_t mark = gen->frame->slot_count;
+    enum x86_64_value value = x86_64_compile_expr(gen, code, node->assignment_expr->value);
+
+    if (symbol->type != X86_64_TYPE_BOXED)
+    {
+        if (x86_64_type_of(value) == symbol->type)
+            x86_64_emit_store(code, RAX, symbol->offset);
+        else
+        {
+            char *key = x86_64_type_key(symbol->decl, NULL, 0);
+            x86_64_type_widen(gen, key, x86_64_type_of(value));
+            free(key);
+        }
+
+        gen->frame->slot_count = mark;
+        return value;
+    }
+
+    x86_64_emit_own(code, value);
+
+    int64_t value_slot = x86_64_slot_alloc(gen);
+    x86_64_emit_store(code, RAX, value_slot);
+    x86_64_emit_release(code, X86_64_VALUE_OWNED, symbol->offset);
+    x86_64_emit_load(code, value_slot, RAX);
+    x86_64_emit_store(code, RAX, symbol->offset);
+    gen->frame->slot_count = mark;
+    return X86_64_VALUE_BORROWED;
+}
+
+static enum x86_64_value x86_64_compile_array_lit(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
+{
+    vector_t *elements = node->array_lit->elements;
+    size_t mark = gen->frame->slot_count;
+    int64_t array_slot = x86_64_slot_alloc(gen);
+
+    asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM64(elements->length), RDI);
+    x86_64_emit_call(code, "libblaze_val_create_array");
+    x86_64_emit_store(code, RAX, array_slot);
+
+    VECTOR_FOREACH(elements)
+    {
+        x86_64_emit_own(code, x86_64_compile_expr(gen, code, elements->data[i]));
+        asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, RAX, RDX);
+        asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM64(i), RSI);
+        x86_64_emit_load(code, array_slot, RDI);
+        x86_64_emit_call(code, "libblaze_val_array_set");
+    }
+
+    x86_64_emit_load(code, array_slot, RAX);
+    gen->frame->slot_count = mark;
+    return X86_64_VALUE_OWNED;
+}
 
-    *stack_argc_ptr = stack_argc;
+/*
+ * Compiles the arguments of a call into slots of their own. Built-ins
+ * take values, so box is set for them; user functions take ints and
+ * bools as machine words.
+ */
+static void x86_64_compile_args(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node, bool box,
+                                int64_t *slots, enum x86_64_value *values)
+{
+    for (size_t i = 0; i < node->fn_call->argc; i++)
+    {
+        values[i] = x86_64_compile_expr(gen, code, &node->fn_call->args[i]);
+
+        if (box)
+            values[i] = x86_64_emit_box(code, values[i]);
+
+        slots[i] = x86_64_slot_alloc(gen);
+        x86_64_emit_store(code, RAX, slots[i]);
+    }
 }
 
-static void x86_64_compile_call_expr_free_values(asm_node_t *asm_node, size_t argc, bool variadic)
+/*
+ * Calls target with the arguments in slots, as the System V ABI passes
+ * them: the first six in registers and the rest on the stack. A variadic
+ * built-in takes the number of values first. The callee only borrows the
+ * arguments; the caller frees them once it returns.
+ */
+static void x86_64_emit_call_args(struct x86_64_codegen *gen, asm_node_t *code, size_t argc, const int64_t *slots,
+                                  const enum x86_64_value *values, const char *target, bool variadic)
 {
-    for (size_t i = variadic ? 1 : 0; i < argc; i++)
+    size_t first = variadic ? 1 : 0;
+    size_t total = argc + first;
+    bool owned = false;
+
+    for (size_t i = 0; i < argc; i++)
+        owned = owned || values[i] == X86_64_VALUE_OWNED;
+
+    size_t stack_count = total > ARG_REGISTER_COUNT ? total - ARG_REGISTER_COUNT : 0;
+    size_t padding = stack_count % 2;
+
+    if (padding != 0)
+        asm_push_inst_bin_op(code, ASM_INST_SUB, ASM_SUF_QWORD, IMM64(8), RSP);
+
+    for (size_t i = total; i-- > ARG_REGISTER_COUNT;)
+        asm_push_inst_mono_op(code, ASM_INST_PUSH, ASM_SUF_QWORD, SLOT(slots[i - first]));
+
+    for (size_t i = 0; i < total && i < ARG_REGISTER_COUNT; i++)
     {
-        asm_push_inst_mono_op(asm_node, ASM_INST_POP, ASM_SUF_QWORD, RDI);
-        asm_push_inst_mono_op(asm_node, ASM_INST_CALL, ASM_SUF_QWORD, IDENTIFIER("libblaze_val_free"));
+        if (variadic && i == 0)
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM64(argc), REGISTER(arg_registers[i]));
+        else
+            x86_64_emit_load(code, slots[i - first], REGISTER(arg_registers[i]));
     }
 
+    /* Variadic callees read the number of vector registers used from %al. */
     if (variadic)
-        asm_push_inst_bin_op(asm_node, ASM_INST_ADD, ASM_SUF_QWORD, IMM64(8), RSP);
+        asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM64(0), RAX);
+
+    x86_64_emit_call(code, target);
+
+    if (stack_count != 0)
+        asm_push_inst_bin_op(code, ASM_INST_ADD, ASM_SUF_QWORD, IMM64(8 * (stack_count + padding)), RSP);
+
+    if (owned)
+    {
+        int64_t result_slot = x86_64_slot_alloc(gen);
+
+        x86_64_emit_store(code, RAX, result_slot);
+
+        for (size_t i = 0; i < argc; i++)
+            x86_64_emit_release(code, values[i], slots[i]);
+
+        x86_64_emit_load(code, result_slot, RAX);
+    }
 }
 
-static asm_node_t x86_64_compile_call_expr(struct compilation_context *context, ast_node_t *node)
+static void x86_64_compile_specialization(struct x86_64_codegen *gen, struct x86_64_symbol *symbol,
+                                          struct x86_64_specialization *spec);
+
+/* The specialization of a function for the types of the arguments, compiled the first time it is called. */
+static struct x86_64_specialization *x86_64_specialize(struct x86_64_codegen *gen, struct x86_64_symbol *symbol,
+                                                       const enum x86_64_type *types)
+{
+    size_t param_count = symbol->fn_node->fn_decl->param_count;
+
+    for (size_t i = 0; i < symbol->specialization_count; i++)
+    {
+        if (param_count == 0 || memcmp(symbol->specializations[i]->param_types, types,
+                                       param_count * sizeof (enum x86_64_type)) == 0)
+            return symbol->specializations[i];
+    }
+
+    struct x86_64_specialization *spec = xcalloc(1, sizeof (struct x86_64_specialization));
+    char *key = x86_64_type_key(symbol->fn_node, types, param_count);
+
+    spec->param_types = xcalloc(param_count + 1, sizeof (enum x86_64_type));
+    memcpy(spec->param_types, types, param_count * sizeof (enum x86_64_type));
+    spec->return_type = x86_64_type_lookup(gen, key);
+    asprintf(&spec->label, "blaze.%s.%lu", symbol->fn_node->fn_decl->identifier->symbol, lbl_count++);
+    free(key);
+
+    symbol->specializations = xrealloc(symbol->specializations,
+                                       (symbol->specialization_count + 1) * sizeof (struct x86_64_specialization *));
+    symbol->specializations[symbol->specialization_count++] = spec;
+    x86_64_compile_specialization(gen, symbol, spec);
+    return spec;
+}
+
+static enum x86_64_value x86_64_compile_call_expr(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
 {
     assert(node->type == NODE_EXPR_CALL);
-    assert(node->fn_call->argc < 3);
 
+    const char *name = node->fn_call->identifier->symbol;
+    struct x86_64_symbol *symbol = x86_64_scope_resolve(gen->scope, name);
     size_t argc = node->fn_call->argc;
-    size_t stack_args = 0;
-    asm_node_t asm_node = asm_create_inst_array();
+    size_t mark = gen->frame->slot_count;
+    int64_t *slots = xcalloc(argc + 1, sizeof (int64_t));
+    enum x86_64_value *values = xcalloc(argc + 1, sizeof (enum x86_64_value));
+    enum x86_64_value value = X86_64_VALUE_BORROWED;
 
-    bool found = false;
+    if (symbol != NULL)
+    {
+        if (symbol->kind != X86_64_SYMBOL_FN)
+            x86_64_error(node, "'%s' is not a function", name);
 
-    for (size_t i = 0; i < builtin_function_def_count; i++)
+        if (argc != symbol->fn_node->fn_decl->param_count)
+            x86_64_error(node, "function '%s' requires %lu arguments, but %lu were passed",
+                         name, symbol->fn_node->fn_decl->param_count, argc);
+
+        enum x86_64_type *types = xcalloc(argc + 1, sizeof (enum x86_64_type));
+
+        x86_64_compile_args(gen, code, node, false, slots, values);
+
+        for (size_t i = 0; i < argc; i++)
+            types[i] = x86_64_type_of(values[i]);
+
+        struct x86_64_specialization *spec = x86_64_specialize(gen, symbol, types);
+
+        /* A recursive call returns what the previous pass found, or else an int until proven otherwise. */
+        if (spec->compiling)
+        {
+            spec->recursive = true;
+
+            if (spec->return_type == X86_64_TYPE_NONE)
+                spec->return_type = X86_64_TYPE_INT;
+        }
+
+        x86_64_emit_call_args(gen, code, argc, slots, values, spec->label, false);
+        value = x86_64_type_value(spec->return_type);
+        free(types);
+    }
+    else
+    {
+        size_t i = 0;
+
+        while (i < builtin_function_def_count && strcmp(builtin_function_defs[i].name, name) != 0)
+            i++;
+
+        if (i == builtin_function_def_count)
+            x86_64_error(node, "call to undefined function '%s()'", name);
+
+        /* The same message as the interpreter and the VM give, for print() too. */
+        if (argc == 0 && (strcmp(name, "println") == 0 || strcmp(name, "print") == 0))
+            x86_64_error(node, "function println() requires at least 1 argument to be passed");
+
+        x86_64_compile_args(gen, code, node, true, slots, values);
+        x86_64_emit_call_args(gen, code, argc, slots, values, builtin_function_defs[i].actual_name,
+                              builtin_function_defs[i].variadic);
+        asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM_LBL("libblaze_val_null"), RAX);
+    }
+
+    free(slots);
+    free(values);
+    gen->frame->slot_count = mark;
+    return value;
+}
+
+static enum x86_64_value x86_64_compile_expr(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
+{
+    switch (node->type)
+    {
+        case NODE_INT_LIT:
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM64(node->integer->intval), RAX);
+            return X86_64_VALUE_INT;
+
+        case NODE_STRING:
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD,
+                                 IMM_LBL(x86_64_data_string(gen->context, node->string->strval)), RDI);
+            x86_64_emit_call(code, "libblaze_val_create_strval");
+            return X86_64_VALUE_OWNED;
+
+        case NODE_IDENTIFIER:
+            return x86_64_compile_identifier(gen, code, node);
+
+        case NODE_BINARY_EXPR:
+            return x86_64_compile_binexpr(gen, code, node);
+
+        case NODE_ASSIGNMENT:
+            return x86_64_compile_assignment(gen, code, node);
+
+        case NODE_EXPR_CALL:
+            return x86_64_compile_call_expr(gen, code, node);
+
+        case NODE_ARRAY_LIT:
+            return x86_64_compile_array_lit(gen, code, node);
+
+        default:
+            x86_64_compile_statement(gen, code, node);
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM_LBL("libblaze_val_null"), RAX);
+            return X86_64_VALUE_BORROWED;
+    }
+}
+
+static bool x86_64_is_expression(const ast_node_t *node)
+{
+    switch (node->type)
+    {
+        case NODE_INT_LIT:
+        case NODE_STRING:
+        case NODE_IDENTIFIER:
+        case NODE_BINARY_EXPR:
+        case NODE_ASSIGNMENT:
+        case NODE_EXPR_CALL:
+        case NODE_ARRAY_LIT:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+static void x86_64_compile_var_decl(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
+{
+    if (node->var_decl->value == NULL)
+        asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM_LBL("libblaze_val_null"), RAX);
+
+    enum x86_64_value value = node->var_decl->value == NULL ? X86_64_VALUE_BORROWED :
+        x86_64_compile_expr(gen, code, node->var_decl->value);
+    char *key = x86_64_type_key(node, NULL, 0);
+    enum x86_64_type type = x86_64_type_widen(gen, key, x86_64_type_of(value));
+
+    free(key);
+
+    if (type == X86_64_TYPE_BOXED)
+        x86_64_emit_own(code, value);
+
+    struct x86_64_symbol *symbol = x86_64_scope_declare(gen, node, node->var_decl->name, X86_64_SYMBOL_VAR);
+    symbol->offset = x86_64_slot_alloc(gen);
+    symbol->type = type;
+    symbol->decl = node;
+    symbol->is_const = node->var_decl->is_const;
+    symbol->owned = type == X86_64_TYPE_BOXED;
+    x86_64_emit_store(code, RAX, symbol->offset);
+}
+
+static void x86_64_emit_prologue(asm_node_t *code, const char *label, struct x86_64_frame *frame)
+{
+    /* The frame keeps %rsp aligned to 16 bytes for the calls the body makes. */
+    size_t size = (frame->max_slot_count * 8 + 15) & ~(size_t) 15;
+
+    x86_64_emit_label(code, (char *) label);
+    asm_push_inst_mono_op(code, ASM_INST_PUSH, ASM_SUF_QWORD, RBP);
+    asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, RSP, RBP);
+
+    if (size != 0)
+        asm_push_inst_bin_op(code, ASM_INST_SUB, ASM_SUF_QWORD, IMM64(size), RSP);
+}
+
+static void x86_64_emit_epilogue(asm_node_t *code)
+{
+    asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, RBP, RSP);
+    asm_push_inst_mono_op(code, ASM_INST_POP, ASM_SUF_QWORD, RBP);
+    asm_push_inst_no_op(code, ASM_INST_RET, ASM_SUF_QWORD);
+}
+
+/*
+ * A function is compiled where it is first called, once for each set of
+ * argument types, into code of its own that goes after main. A call
+ * returns the value of the last statement of the body, if that is an
+ * expression, or else null.
+ */
+static void x86_64_compile_fn_decl(struct x86_64_codegen *gen, const ast_node_t *node)
+{
+    struct x86_64_symbol *symbol = x86_64_scope_declare(gen, node, node->fn_decl->identifier->symbol,
+                                                        X86_64_SYMBOL_FN);
+
+    symbol->fn_node = node;
+    symbol->fn_scope = gen->scope;
+}
+
+static void x86_64_compile_specialization(struct x86_64_codegen *gen, struct x86_64_symbol *symbol,
+                                          struct x86_64_specialization *spec)
+{
+    const ast_node_t *node = symbol->fn_node;
+    const ast_fn_decl_t *fn_decl = node->fn_decl;
+    struct x86_64_scope *saved_scope = gen->scope;
+    struct x86_64_frame *saved_frame = gen->frame;
+    struct x86_64_frame frame = { 0 };
+    asm_node_t body = asm_create_inst_array();
+    asm_node_t function = asm_create_inst_array();
+    enum x86_64_value value = X86_64_VALUE_BORROWED;
+
+    spec->compiling = true;
+    gen->scope = symbol->fn_scope;
+    gen->frame = &frame;
+    x86_64_scope_create(gen);
+
+    for (size_t i = 0; i < fn_decl->param_count; i++)
     {
-        if (strcmp(builtin_function_defs[i].name, node->fn_call->identifier->symbol) == 0)
+        struct x86_64_symbol *param = x86_64_scope_declare(gen, node, fn_decl->param_names[i], X86_64_SYMBOL_VAR);
+        param->type = spec->param_types[i];
+        param->is_const = true;
+
+        if (i < ARG_REGISTER_COUNT)
         {
-            found = true;
-            x86_64_compile_call_expr_args(context, argc, node->fn_call->args, &asm_node, &stack_args, builtin_function_defs[i].variadic);
-            x86_64_compile_call_expr_args_load(context, argc + 1, &asm_node, stack_args, builtin_function_defs[i].variadic);
-            asm_push_inst_mono_op(&asm_node, ASM_INST_CALL, ASM_SUF_QWORD, IDENTIFIER(builtin_function_defs->actual_name));
-             x86_64_compile_call_expr_free_values(&asm_node, argc + 1, builtin_function_defs[i].variadic);
-            break;
+            param->offset = x86_64_slot_alloc(gen);
+            x86_64_emit_store(&body, REGISTER(arg_registers[i]), param->offset);
         }
+        else
+            param->offset = 16 + 8 * (int64_t) (i - ARG_REGISTER_COUNT);
     }
 
-    if (!found)
-        fatal_error("call to undefined function '%s()'", node->fn_call->identifier->symbol);
+    for (size_t i = 0; i < fn_decl->size; i++)
+    {
+        if (i == fn_decl->size - 1 && x86_64_is_expression(&fn_decl->body[i]))
+            value = x86_64_compile_expr(gen, &body, &fn_decl->body[i]);
+        else
+            x86_64_compile_statement(gen, &body, &fn_decl->body[i]);
+    }
 
-    if (stack_args > 0)
-        asm_push_inst_bin_op(&asm_node, ASM_INST_ADD, ASM_SUF_QWORD, IMM64(8 * stack_args), RSP);
+    if (fn_decl->size == 0 || !x86_64_is_expression(&fn_decl->body[fn_decl->size - 1]))
+        asm_push_inst_bin_op(&body, ASM_INST_MOV, ASM_SUF_QWORD, IMM_LBL("libblaze_val_null"), RAX);
 
-    return asm_node;
+    /* Recursive calls in the body were compiled for the type assumed so far. */
+    char *key = x86_64_type_key(node, spec->param_types, fn_decl->param_count);
+    enum x86_64_type type = x86_64_type_join(spec->return_type, x86_64_type_of(value));
+
+    x86_64_type_widen(gen, key, type);
+    gen->changed = gen->changed || (spec->recursive && type != spec->return_type);
+    spec->return_type = type;
+    free(key);
+
+    if (type == X86_64_TYPE_BOXED)
+        x86_64_emit_own(&body, value);
+
+    int64_t result_slot = x86_64_slot_alloc(gen);
+    x86_64_emit_store(&body, RAX, result_slot);
+    x86_64_scope_exit(gen, &body);
+    x86_64_emit_load(&body, result_slot, RAX);
+    x86_64_emit_epilogue(&body);
+
+    x86_64_emit_prologue(&function, spec->label, &frame);
+    asm_node_children_push(&function.array_children, &function.array_size, &body);
+    asm_node_children_push(&gen->functions.array_children, &gen->functions.array_size, &function);
+    gen->scope = saved_scope;
+    gen->frame = saved_frame;
+    spec->compiling = false;
+}
+
+/* Compiles a branch or a loop body in a scope of its own, even when it is not a block. */
+static void x86_64_compile_scoped(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
+{
+    x86_64_scope_create(gen);
+
+    if (node->type == NODE_BLOCK)
+    {
+        for (size_t i = 0; i < node->block->size; i++)
+            x86_64_compile_statement(gen, code, &node->block->children[i]);
+    }
+    else
+        x86_64_compile_statement(gen, code, node);
+
+    x86_64_scope_exit(gen, code);
+}
+
+/*
+ * Compiles a condition and returns the jump to take to the false branch:
+ * a comparison of machine words is branched on directly, and anything
+ * else is made 0 or 1 and compared to 0.
+ */
+static asm_node_inst_t x86_64_compile_condition(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
+{
+    if (node->type == NODE_BINARY_EXPR && x86_64_is_comparison(node->binexpr->operator))
+    {
+        int comparison = x86_64_compile_compare(gen, code, node);
+
+        if (comparison >= 0)
+            return x86_64_comparisons[comparison].jump_if_false;
+
+        asm_push_inst_bin_op(code, ASM_INST_CMP, ASM_SUF_QWORD, IMM64(0), RAX);
+        return ASM_INST_JE;
+    }
+
+    size_t mark = gen->frame->slot_count;
+    enum x86_64_value value = x86_64_compile_expr(gen, code, node);
+
+    if (!x86_64_is_unboxed(value))
+    {
+        int64_t value_slot = x86_64_slot_alloc(gen);
+        int64_t truthy_slot = x86_64_slot_alloc(gen);
+
+        if (value == X86_64_VALUE_OWNED)
+            x86_64_emit_store(code, RAX, value_slot);
+
+        asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, RAX, RDI);
+        x86_64_emit_call(code, "libblaze_val_truthy");
+
+        if (value == X86_64_VALUE_OWNED)
+        {
+            x86_64_emit_store(code, RAX, truthy_slot);
+            x86_64_emit_release(code, value, value_slot);
+            x86_64_emit_load(code, truthy_slot, RAX);
+        }
+    }
+
+    asm_push_inst_bin_op(code, ASM_INST_CMP, ASM_SUF_QWORD, IMM64(0), RAX);
+    gen->frame->slot_count = mark;
+    return ASM_INST_JE;
+}
+
+static void x86_64_compile_if_stmt(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
+{
+    char *else_label = x86_64_label_create();
+    char *end_label = x86_64_label_create();
+
+    x86_64_emit_jump(code, x86_64_compile_condition(gen, code, node->if_stmt->condition), else_label);
+    x86_64_compile_scoped(gen, code, node->if_stmt->if_block);
+
+    if (node->if_stmt->else_block != NULL)
+    {
+        x86_64_emit_jump(code, ASM_INST_JMP, end_label);
+        x86_64_emit_label(code, else_label);
+        x86_64_compile_scoped(gen, code, node->if_stmt->else_block);
+        x86_64_emit_label(code, end_label);
+    }
+    else
+        x86_64_emit_label(code, else_label);
+
+    free(else_label);
+    free(end_label);
+}
+
+/*
+ * The runtime library turns the count into the number of iterations,
+ * which is as many as there are integers for true. The counter is a
+ * machine word, and it is the loop variable as well.
+ */
+static void x86_64_compile_loop_stmt(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
+{
+    const ast_loop_stmt_t *loop = node->loop_stmt;
+    size_t mark = gen->frame->slot_count;
+    int64_t counter_slot = x86_64_slot_alloc(gen);
+    int64_t limit_slot = x86_64_slot_alloc(gen);
+    char *top_label = x86_64_label_create();
+    char *end_label = x86_64_label_create();
+
+    if (loop->iter_count == NULL)
+        asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM64(INT64_MAX), RAX);
+    else
+    {
+        size_t count_mark = gen->frame->slot_count;
+        enum x86_64_value value = x86_64_compile_expr(gen, code, loop->iter_count);
+        int64_t value_slot = x86_64_slot_alloc(gen);
+
+        if (value == X86_64_VALUE_INT)
+        {
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, RAX, RDI);
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM_LBL(x86_64_data_where(gen, node)), RSI);
+            x86_64_emit_call(code, "libblaze_int_iter_count");
+        }
+        else
+        {
+            value = x86_64_emit_box(code, value);
+
+            if (value == X86_64_VALUE_OWNED)
+                x86_64_emit_store(code, RAX, value_slot);
+
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, RAX, RDI);
+            asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM_LBL(x86_64_data_where(gen, node)), RSI);
+            x86_64_emit_call(code, "libblaze_val_iter_count");
+
+            if (value == X86_64_VALUE_OWNED)
+            {
+                x86_64_emit_store(code, RAX, limit_slot);
+                x86_64_emit_release(code, value, value_slot);
+                x86_64_emit_load(code, limit_slot, RAX);
+            }
+        }
+
+        gen->frame->slot_count = count_mark;
+    }
+
+    x86_64_emit_store(code, RAX, limit_slot);
+    asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, IMM64(0), SLOT(counter_slot));
+    x86_64_emit_label(code, top_label);
+    x86_64_emit_load(code, counter_slot, RAX);
+    asm_push_inst_bin_op(code, ASM_INST_CMP, ASM_SUF_QWORD, SLOT(limit_slot), RAX);
+    x86_64_emit_jump(code, ASM_INST_JGE, end_label);
+
+    x86_64_scope_create(gen);
+
+    if (loop->iter_varname != NULL)
+    {
+        struct x86_64_symbol *symbol = x86_64_scope_declare(gen, node, loop->iter_varname, X86_64_SYMBOL_VAR);
+
+        symbol->offset = counter_slot;
+        symbol->type = X86_64_TYPE_INT;
+        symbol->is_const = true;
+    }
+
+    x86_64_compile_scoped(gen, code, loop->body);
+    x86_64_scope_exit(gen, code);
+
+    asm_push_inst_bin_op(code, ASM_INST_ADD, ASM_SUF_QWORD, IMM64(1), SLOT(counter_slot));
+    x86_64_emit_jump(code, ASM_INST_JMP, top_label);
+    x86_64_emit_label(code, end_label);
+
+    free(top_label);
+    free(end_label);
+    gen->frame->slot_count = mark;
+}
+
+static void x86_64_compile_statement(struct x86_64_codegen *gen, asm_node_t *code, const ast_node_t *node)
+{
+    switch (node->type)
+    {
+        case NODE_VAR_DECL:
+            x86_64_compile_var_decl(gen, code, node);
+            break;
+
+        case NODE_FN_DECL:
+            x86_64_compile_fn_decl(gen, node);
+            break;
+
+        case NODE_BLOCK:
+            x86_64_compile_scoped(gen, code, node);
+            break;
+
+        case NODE_IF_STMT:
+            x86_64_compile_if_stmt(gen, code, node);
+            break;
+
+        case NODE_LOOP_STMT:
+            x86_64_compile_loop_stmt(gen, code, node);
+            break;
+
+        default:
+            if (!x86_64_is_expression(node))
+                x86_64_error(node, "unsupported AST node");
+
+            size_t mark = gen->frame->slot_count;
+            enum x86_64_value value = x86_64_compile_expr(gen, code, node);
+
+            if (value == X86_64_VALUE_OWNED)
+            {
+                asm_push_inst_bin_op(code, ASM_INST_MOV, ASM_SUF_QWORD, RAX, RDI);
+                x86_64_emit_call(code, "libblaze_val_free");
+            }
+
+            gen->frame->slot_count = mark;
+            break;
+    }
 }
 
 static void x86_64_compile_root_start(asm_node_t *asm_node)
@@ -201,41 +1377,54 @@ static void x86_64_compile_root_start(asm_node_t *asm_node)
     asm_push_inst_mono_op(asm_node, ASM_INST_CALL, ASM_SUF_QWORD, IDENTIFIER("exit"));
 }
 
-static void x86_64_setup_frame(asm_node_t *asm_node)
-{
-    asm_push_inst_mono_op(asm_node, ASM_INST_PUSH, ASM_SUF_QWORD, RBP);
-    asm_push_inst_bin_op(asm_node, ASM_INST_MOV, ASM_SUF_QWORD, RSP, RBP);
-}
-
-static void x86_64_restore_frame(asm_node_t *asm_node)
-{
-    asm_push_inst_mono_op(asm_node, ASM_INST_POP, ASM_SUF_QWORD, RBP);
-}
-
+/*
+ * Compiles the program for as long as a pass finds that inference
+ * assumed too narrow a type somewhere. Each pass starts over with what
+ * the ones before it found, and throws away the code and the data it
+ * generated if it has to be redone.
+ */
 static asm_node_t x86_64_compile_root(struct compilation_context *context, ast_node_t *node)
 {
-    asm_node_t asm_node = asm_node_create(ASM_ROOT);
-    asm_node_children_init(&asm_node.root_children, &asm_node.root_size);
+    map_t types = map_create();
+    size_t data_count = context->asm_data.data_lbl_count;
+    asm_node_t asm_node = asm_node_empty();
+    struct x86_64_codegen gen = {
+        .context = context,
+        .types = &types
+    };
 
-    x86_64_compile_root_start(&asm_node);
+    do
+    {
+        asm_node_t body = asm_create_inst_array();
+        asm_node_t main = asm_create_inst_array();
+        struct x86_64_frame frame = { 0 };
 
-    asm_node_children_push(&asm_node.root_children, &asm_node.root_size, & (asm_node_t) {
-        .type = ASM_LABEL,
-        .label_name = strdup("main")
-    });
+        asm_node_free_inner(&asm_node);
+        asm_data_truncate(&context->asm_data, data_count);
+        asm_node = asm_node_create(ASM_ROOT);
+        gen.scope = NULL;
+        gen.frame = &frame;
+        gen.functions = asm_create_inst_array();
+        gen.changed = false;
 
-    x86_64_setup_frame(&asm_node);
+        asm_node_children_init(&asm_node.root_children, &asm_node.root_size);
+        x86_64_compile_root_start(&asm_node);
+        x86_64_scope_create(&gen);
 
-    for (size_t i = 0; i < node->root->size; i++)
-    {
-        asm_node_t ret = x86_64_compile(context, &node->root->nodes[i]);
+        for (size_t i = 0; i < node->root->size; i++)
+            x86_64_compile_statement(&gen, &body, &node->root->nodes[i]);
 
-        if (ret.type != ASM_EMPTY)
-            asm_node_children_push(&asm_node.root_children, &asm_node.root_size, &ret);
+        x86_64_scope_exit(&gen, &body);
+        x86_64_emit_epilogue(&body);
+
+        x86_64_emit_prologue(&main, "main", &frame);
+        asm_node_children_push(&main.array_children, &main.array_size, &body);
+        asm_node_children_push(&asm_node.root_children, &asm_node.root_size, &main);
+        asm_node_children_push(&asm_node.root_children, &asm_node.root_size, &gen.functions);
     }
+    while (gen.changed);
 
-    x86_64_restore_frame(&asm_node);
-    asm_push_inst_no_op(&asm_node, ASM_INST_RET, ASM_SUF_QWORD);
+    map_free(&types);
     return asm_node;
 }
 
@@ -246,9 +1435,6 @@ asm_node_t x86_64_compile(struct compilation_context *context, ast_node_t *node)
         case NODE_ROOT:
             return x86_64_compile_root(context, node);
 
-        case NODE_EXPR_CALL:
-            return x86_64_compile_call_expr(context, node);
-
         default:
             fatal_error("invalid or unsupported AST type");
     }
@@ -0,0 +1,52 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#include "constpool.h"
+#include "alloca.h"
+#include "rcstring.h"
+#include <stdlib.h>
+
+struct constpool constpool_create()
+{
+    return (struct constpool) {
+        .strings = map_create()
+    };
+}
+
+val_t *constpool_intern_string(struct constpool *pool, const char *data, size_t length)
+{
+    map_key_t key = {
+        .type = MAP_KEY_STRING,
+        .data = data,
+        .length = length
+    };
+
+    map_entry_t *entry = map_get_entry(&pool->strings, key);
+
+    if (entry != NULL)
+        return entry->value;
+
+    val_t *val = xcalloc(1, sizeof (val_t));
+
+    val->type = VAL_STRING;
+    val->nofree = true;
+    val->self_ptr = val;
+    val->strval = string_create(data, length);
+    val->strval->refcount = STRING_IMMORTAL;
+
+    map_set_key(&pool->strings, key, val, NULL, MAP_CREATE);
+    return val;
+}
+
+void constpool_free(struct constpool *pool)
+{
+    MAP_FOREACH(&pool->strings)
+    {
+        val_t *val = pool->strings.elements[i].value;
+        string_free(val->strval);
+        free(val);
+    }
+
+    map_free(&pool->strings);
+}
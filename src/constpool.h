@@ -0,0 +1,26 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_CONSTPOOL_H
+#define BLAZESCRIPT_CONSTPOOL_H
+
+#include "datatype.h"
+#include "map.h"
+#include <stddef.h>
+
+/*
+ * Per-program pool of constant values built by the parser. Values in the
+ * pool are immortal: they are never freed by the evaluator, and identical
+ * string literals share a single value.
+ */
+struct constpool
+{
+    map_t strings;
+};
+
+struct constpool constpool_create();
+val_t *constpool_intern_string(struct constpool *pool, const char *data, size_t length);
+void constpool_free(struct constpool *pool);
+
+#endif /* BLAZESCRIPT_CONSTPOOL_H */
@@ -81,6 +81,11 @@ val_t val_create(val_type_t type)
             val.arrval = vector_init();
             break;
 
+        case VAL_MAP:
+            val.mapval = xmalloc(sizeof *(val.mapval));
+            *val.mapval = map_create();
+            break;
+
         case VAL_NULL:
         case VAL_INTEGER:
         case VAL_FLOAT:
@@ -113,7 +118,7 @@ val_t *val_copy_deep(val_t *orig)
             break;
 
         case VAL_STRING:
-            val->strval = strdup(orig->strval);
+            val->strval = string_ref(orig->strval);
             break;
 
         case VAL_BOOLEAN:
@@ -152,6 +157,27 @@ val_t *val_copy_deep(val_t *orig)
 
             break;
 
+        case VAL_ARRAY:
+            for (size_t i = 0; i < orig->arrval->length; i++)
+                vector_push(val->arrval, val_copy_deep(orig->arrval->data[i]));
+
+            break;
+
+        case VAL_MAP:
+            MAP_FOREACH(orig->mapval)
+            {
+                map_entry_t *entry = &orig->mapval->elements[i];
+                map_key_t key = {
+                    .type = entry->key_type,
+                    .data = entry->key,
+                    .length = entry->key_length
+                };
+
+                map_set_key(val->mapval, key, val_copy_deep(entry->value), NULL, MAP_CREATE);
+            }
+
+            break;
+
         case VAL_NULL:
             val->type = VAL_NULL;
             break;
@@ -177,7 +203,7 @@ void val_free_force_no_root(val_t *val)
     {
         case VAL_STRING:
             log_debug("Freeing string: %p", val);
-            free(val->strval);
+            string_unref(val->strval);
             val->strval = NULL;
             break;
 
@@ -186,6 +212,12 @@ void val_free_force_no_root(val_t *val)
             val->arrval = NULL;
             break;
 
+        case VAL_MAP:
+            map_free(val->mapval);
+            free(val->mapval);
+            val->mapval = NULL;
+            break;
+
         case VAL_FUNCTION:
             if (val->fnval->type == FN_USER_CUSTOM)
             {
@@ -229,3 +261,44 @@ void val_free(val_t *val)
 
     val_free_force(val);
 }
+
+bool val_to_map_key(const val_t *val, map_key_t *key)
+{
+    switch (val->type)
+    {
+        case VAL_INTEGER:
+            key->type = MAP_KEY_INTEGER;
+            key->data = (const char *) &val->intval;
+            key->length = sizeof (val->intval);
+            key->hash = 0;
+            return true;
+
+        case VAL_STRING:
+            key->type = MAP_KEY_STRING;
+            key->data = string_flatten(val->strval);
+            key->length = val->strval->length;
+            key->hash = string_hash(val->strval);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+val_t val_from_map_key(const map_entry_t *entry)
+{
+    val_t val;
+
+    if (entry->key_type == MAP_KEY_INTEGER)
+    {
+        val = val_create(VAL_INTEGER);
+        memcpy(&val.intval, entry->key, sizeof (val.intval));
+    }
+    else
+    {
+        val = val_create(VAL_STRING);
+        val.strval = string_create(entry->key, entry->key_length);
+    }
+
+    return val;
+}
@@ -6,9 +6,12 @@
 #define BLAZESCRIPT_DATATYPE_H
 
 #include "ast.h"
+#include "map.h"
+#include "rcstring.h"
 #include "vector.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 
 struct scope;
 
@@ -20,7 +23,8 @@ typedef enum {
     VAL_OBJECT,
     VAL_NULL,
     VAL_BOOLEAN,
-    VAL_ARRAY
+    VAL_ARRAY,
+    VAL_MAP
 } val_type_t;
 
 typedef struct {
@@ -52,16 +56,18 @@ typedef struct value {
     union {
         long long int intval;
         long double floatval;
-        char *strval;
+        string_t *strval;
         bool boolval;
         val_function_t *fnval;
         vector_t *arrval;
+        map_t *mapval;
     };
 } val_t;
 
 void val_free(val_t *val);
 void print_val(val_t *val);
 void print_val_internal(val_t *val, bool quote_strings);
+void fprint_val_internal(FILE *fp, val_t *val, bool quote_strings);
 const char *val_type_to_str(val_type_t type);
 val_t val_create(val_type_t type);
 val_t *val_create_heap(val_type_t type);
@@ -74,6 +80,8 @@ val_t *val_copy(val_t *value);
 void val_alloc_tbl_global_init();
 void val_alloc_tbl_global_free();
 void val_free_force_no_root(val_t *val);
+bool val_to_map_key(const val_t *val, map_key_t *key);
+val_t val_from_map_key(const map_entry_t *entry);
 
 extern struct val_alloc_tbl val_alloc_tbl;
 
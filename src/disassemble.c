@@ -5,11 +5,37 @@
 #include "disassemble.h"
 #include "bytecode.h"
 #include "opcode.h"
+#include "rcstring.h"
 #include "register.h"
+#include "vm-context.h"
+#include "vm-vector.h"
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
 
+static void disassemble_register(FILE *__restrict__ fp, uint8_t id, const char *format)
+{
+    if (is_valid_register_id(id))
+        fprintf(fp, format, register_id_to_str(id));
+    else
+        fprintf(fp, "(bad register 0x%02x)", id);
+}
+
+static void disassemble_vector_register(FILE *__restrict__ fp, uint8_t id)
+{
+    if (id < VREG_COUNT)
+        fprintf(fp, "%%v%u", id);
+    else
+        fprintf(fp, "(bad vector register 0x%02x)", id);
+}
+
+static uint32_t disassemble_uleb128(struct bytecode *bytecode, size_t i)
+{
+    uint32_t value;
+    bytecode_read_uleb128(bytecode->bytes + i, bytecode->size - i, &value);
+    return value;
+}
+
 void disassemble_operand(FILE *__restrict__ fp, struct bytecode *bytecode, size_t size, addressing_mode_t mode, size_t i)
 {
     assert(mode != AM_NONE);
@@ -17,7 +43,81 @@ void disassemble_operand(FILE *__restrict__ fp, struct bytecode *bytecode, size_
     if (mode == AM_REGISTER)
     {
         assert(size == 1);
-        fprintf(fp, "%%%s", register_id_to_str(bytecode_get_byte(bytecode, i)));
+        disassemble_register(fp, bytecode_get_byte(bytecode, i), "%%%s");
+        return;
+    }
+
+    if (mode == AM_REGISTER_MEMORY)
+    {
+        assert(size == 1);
+        disassemble_register(fp, bytecode_get_byte(bytecode, i), "[%%%s]");
+        return;
+    }
+
+    if (mode == AM_REGISTER_PAIR)
+    {
+        assert(size == 1);
+        disassemble_register(fp, REG_PAIR_FIRST(bytecode_get_byte(bytecode, i)), "%%%s");
+        fprintf(fp, ", ");
+        disassemble_register(fp, REG_PAIR_SECOND(bytecode_get_byte(bytecode, i)), "%%%s");
+        return;
+    }
+
+    if (mode == AM_VECTOR_REGISTER)
+    {
+        assert(size == 1);
+        disassemble_vector_register(fp, bytecode_get_byte(bytecode, i));
+        return;
+    }
+
+    if (mode == AM_VECTOR_REGISTER_PAIR)
+    {
+        assert(size == 1);
+        disassemble_vector_register(fp, REG_PAIR_FIRST(bytecode_get_byte(bytecode, i)));
+        fprintf(fp, ", ");
+        disassemble_vector_register(fp, REG_PAIR_SECOND(bytecode_get_byte(bytecode, i)));
+        return;
+    }
+
+    if (mode == AM_FRAME)
+    {
+        assert(size == 4);
+        fprintf(fp, "[%%fp%+d]", (int32_t) bytecode_get_dword(bytecode, i));
+        return;
+    }
+
+    if (mode == AM_TARGET)
+    {
+        assert(size == 4);
+        uint32_t target = bytecode_get_dword(bytecode, i);
+        const char *symbol = bytecode_symbol_at(bytecode, target);
+
+        fprintf(fp, "0x%08x", target);
+
+        if (symbol != NULL)
+            fprintf(fp, " <%s>", symbol);
+
+        return;
+    }
+
+    if (mode == AM_MEMORY)
+    {
+        assert(size == 4);
+        fprintf(fp, "[0x%08x]", bytecode_get_dword(bytecode, i));
+        return;
+    }
+
+    if (mode == AM_CONSTANT)
+    {
+        fprintf(fp, "#%u", disassemble_uleb128(bytecode, i));
+        return;
+    }
+
+    /* Shown as the 64-bit value they load, like the immediate of the long mov. */
+    if (mode == AM_SIGNED_IMMEDIATE)
+    {
+        int64_t value = size == 1 ? (int8_t) bytecode_get_byte(bytecode, i) : (int32_t) bytecode_get_dword(bytecode, i);
+        fprintf(fp, "0x%016lx", (uint64_t) value);
         return;
     }
 
@@ -44,69 +144,155 @@ void disassemble_operand(FILE *__restrict__ fp, struct bytecode *bytecode, size_
     }
 }
 
-void disassemble(FILE *__restrict__ fp, struct bytecode *bytecode)
+/* Shows the value of a constant operand as a trailing comment. */
+static void disassemble_constant(FILE *__restrict__ fp, struct bytecode *bytecode, uint32_t index)
+{
+    if (index >= bytecode->constant_count)
+        return;
+
+    uint64_t value = bytecode->constants[index];
+
+    switch (bytecode->constant_types[index])
+    {
+        case BYTECODE_CONST_STRING:
+        {
+            string_t *string = (string_t *) value;
+            fprintf(fp, "    ; \"%.*s\"", (int) string->length, string_flatten(string));
+            break;
+        }
+
+        case BYTECODE_CONST_INT:
+            fprintf(fp, "    ; %ld", (int64_t) value);
+            break;
+
+        case BYTECODE_CONST_FLOAT:
+        {
+            double number;
+            memcpy(&number, &value, sizeof number);
+            fprintf(fp, "    ; %g", number);
+            break;
+        }
+    }
+}
+
+/* Shows how a quickened instruction fared, once the program has run. */
+static void disassemble_quickening(FILE *__restrict__ fp, const struct bytecode_quickening *site)
+{
+    if (site->hits == 0 && site->misses == 0)
+        return;
+
+    fprintf(fp, "    ; %u hits, %u misses", site->hits, site->misses);
+}
+
+/*
+ * Operands are the same in every copy of the code, so only the opcodes
+ * are read from code, and a quickened site shows the form it runs as.
+ */
+static void disassemble_code(FILE *__restrict__ fp, struct bytecode *bytecode, const uint8_t *code,
+                             const struct bytecode_quickening *quickening, const uint64_t *hits)
 {
     const size_t spaces = 10;
+    size_t inst_size;
 
-    for (size_t i = 0; i < bytecode->size; i++)
+    for (size_t i = 0; i < bytecode->size; i += inst_size)
     {
-        opcode_t opcode = bytecode->bytes[i];
-        size_t inst_size = opcode_get_size(opcode);
-        operand_info_t info[2];
-        opcode_get_operand_info(opcode, info);
-        const char *opcode_str = opcode_to_str(opcode);
+        opcode_t opcode = quickening != NULL && quickening[i].form != OP_NO_OP ? quickening[i].form : code[i];
+        const char *symbol = bytecode_symbol_at(bytecode, i);
+        bool valid = opcode < OPCODE_COUNT;
+
+        size_t full_size = valid ? instruction_get_size(code + i, bytecode->size - i) : 1;
+
+        inst_size = full_size != 0 ? full_size : opcode_get_size(opcode);
+
+        if (inst_size > bytecode->size - i)
+            inst_size = bytecode->size - i;
+
+        if (symbol != NULL)
+            fprintf(fp, "<%s>:\n", symbol);
+
+        if (hits != NULL && hits[i] != 0)
+            fprintf(fp, "%12lu", hits[i]);
+        else if (hits != NULL)
+            fprintf(fp, "%12s", "");
 
         fprintf(fp, " %08lx:  ",
-               (uint64_t) &bytecode->bytes[i]);
+               (uint64_t) &code[i]);
 
-        if (inst_size > 0)
+        for (size_t a = 0; a < inst_size; a++)
         {
-            for (size_t a = 0; a < inst_size; a++)
-            {
-                fprintf(fp, "%02x ", bytecode->bytes[i + a]);
-            }
-
-            for (size_t s = (inst_size * 3) - 1; s < 35; s++)
-            {
-                printf(" ");
-            }
+            fprintf(fp, "%02x ", code[i + a]);
         }
 
-        fprintf(fp, "%s", opcode_str);
+        for (size_t s = (inst_size * 3) - 1; s < 35; s++)
+        {
+            fprintf(fp, " ");
+        }
 
-        if (inst_size < 2)
+        if (!valid)
         {
-            fprintf(fp, "\n");
+            fprintf(fp, "(bad)\n");
             continue;
         }
-        else
+
+        if (full_size == 0)
         {
-             for (size_t s = strlen(opcode_str); s < spaces; s++)
-             {
-                 printf(" ");
-             }
+            fprintf(fp, "(truncated)\n");
+            break;
         }
 
-        i++;
+        const char *opcode_str = opcode_to_str(opcode);
+        operand_info_t info[OPCODE_MAX_OPERANDS];
+        size_t operand = i + 1;
+        int64_t constant = -1;
+
+        opcode_get_operand_info(opcode, info);
+        fprintf(fp, "%s", opcode_str);
 
-        if (info[0].size > 0)
+        for (size_t n = 0; n < OPCODE_MAX_OPERANDS && info[n].size > 0; n++)
         {
-            disassemble_operand(fp, bytecode, info[0].size, info[0].addrmode, i);
+            if (n == 0)
+            {
+                for (size_t s = strlen(opcode_str); s < spaces; s++)
+                {
+                    fprintf(fp, " ");
+                }
 
-            while (info[0].size --> 0)
-                i++;
-        }
+                /* Superinstruction mnemonics can be longer than the column. */
+                if (strlen(opcode_str) >= spaces)
+                    fprintf(fp, " ");
+            }
+            else
+                fprintf(fp, ", ");
 
-        if (info[1].size > 0)
-        {
-            fprintf(fp, ", ");
-            disassemble_operand(fp, bytecode, info[1].size, info[1].addrmode, i);
+            disassemble_operand(fp, bytecode, info[n].size, info[n].addrmode, operand);
+
+            if (info[n].addrmode == AM_CONSTANT)
+                constant = disassemble_uleb128(bytecode, operand);
 
-            while (info[1].size --> 0)
-                i++;
+            operand += info[n].size;
         }
 
-        i--;
+        if (constant >= 0)
+            disassemble_constant(fp, bytecode, (uint32_t) constant);
+
+        if (quickening != NULL)
+            disassemble_quickening(fp, &quickening[i]);
+
         fprintf(fp, "\n");
     }
 }
+
+void disassemble(FILE *__restrict__ fp, struct bytecode *bytecode)
+{
+    disassemble_code(fp, bytecode, bytecode->bytes, NULL, NULL);
+}
+
+void disassemble_annotated(FILE *__restrict__ fp, struct bytecode *bytecode, const uint64_t *hits)
+{
+    disassemble_code(fp, bytecode, bytecode->bytes, NULL, hits);
+}
+
+void disassemble_run(FILE *__restrict__ fp, const struct vm_context *vm)
+{
+    disassemble_code(fp, vm->bytecode, vm->code != NULL ? vm->code : vm->bytecode->bytes, vm->quickening, NULL);
+}
@@ -10,4 +10,12 @@
 
 void disassemble(FILE *__restrict__ fp, struct bytecode *bytecode);
 
+/* Disassembles with a column of how often each instruction ran, from hits[offset]. */
+void disassemble_annotated(FILE *__restrict__ fp, struct bytecode *bytecode, const uint64_t *hits);
+
+struct vm_context;
+
+/* Disassembles the code a context ran as it ran it, with how its quickened instructions fared. */
+void disassemble_run(FILE *__restrict__ fp, const struct vm_context *vm);
+
 #endif /* BLAZESCRIPT_DISASSEMBLE_H */
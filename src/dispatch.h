@@ -0,0 +1,802 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+/*
+ * Body of the VM dispatch loop. This file has no include guard on purpose:
+ * opcode.c includes it once per variant, with VM_RUN_NAME set to the name
+ * of the function to define and VM_CHECKED set to 1 for the variant that
+ * validates register ids, jump targets and memory slots as it runs, or 0
+ * for the variant used on bytecode that passed bytecode_verify().
+ * VM_RECORDED set to 1 makes it feed every instruction it dispatches to
+ * the flight recorder of the context (see vm-recorder.h), and VM_PROFILED
+ * set to 1 makes it count them in the profile of the context (see
+ * vm-profile.h).
+ */
+
+#if !defined(VM_RUN_NAME) || !defined(VM_CHECKED) || !defined(VM_RECORDED) || !defined(VM_PROFILED)
+#error "VM_RUN_NAME, VM_CHECKED, VM_RECORDED and VM_PROFILED must be defined before including dispatch.h"
+#endif
+
+static bool VM_RUN_NAME(struct vm_context *vm)
+{
+    struct bytecode *const bytecode = vm->bytecode;
+    uint64_t *const memory = vm->memory;
+    uint8_t *const start = vm->code;
+    uint8_t *const end = vm->code + bytecode->size;
+    uint8_t *ip = start + vm->entry;
+    uint64_t regs[REG_COUNT];
+    vm_vector_t *const vectors = vm->vectors;
+    const struct vm_vector_ops *const vector = vm_vector_ops();
+    uint8_t reg1, reg2;
+    uint32_t operand;
+
+    memcpy(regs, vm->registers, sizeof regs);
+    regs[IS] = (uint64_t) start;
+
+#define VM_SYNC_OUT() (regs[IP] = (uint64_t) ip, memcpy(vm->registers, regs, sizeof regs))
+#define VM_SYNC_IN() memcpy(regs, vm->registers, sizeof regs)
+#if VM_RECORDED
+    /* Kept in locals, since stores to the records could otherwise be to any of them. */
+    struct vm_recorder *const recorder = vm->recorder;
+    struct vm_record *const records = recorder->records;
+    const size_t record_mask = recorder->mask;
+    const uint64_t *const stack_base = vm->stack.base;
+    uint64_t record_count = recorder->count;
+
+#define VM_RECORD() do { \
+        vm_recorder_record(&records[record_count & record_mask], (uint32_t) (ip - start), *ip, \
+                           regs[R0], regs[R1], regs[R2], (uint32_t) ((const uint64_t *) regs[SP] - stack_base)); \
+        recorder->count = ++record_count; \
+    } while (0)
+#else
+#define VM_RECORD() ((void) 0)
+#endif
+#if VM_PROFILED
+    struct vm_profile *const profile = vm->profile;
+    uint64_t *const opcode_counts = profile->opcodes;
+    uint64_t *const offset_counts = profile->offsets;
+    uint64_t profile_tick = 0, sample_start = 0;
+    opcode_t sample_opcode = 0;
+
+/* A sample runs from the dispatch of the instruction to that of the next one. */
+#define VM_PROFILE() do { \
+        if (sample_start != 0) \
+        { \
+            profile->ticks[sample_opcode] += vm_profile_clock() - sample_start; \
+            profile->samples[sample_opcode]++; \
+            sample_start = 0; \
+        } \
+        opcode_counts[*ip]++; \
+        offset_counts[ip - start]++; \
+        if ((++profile_tick & (VM_PROFILE_SAMPLE_PERIOD - 1)) == 0) \
+        { \
+            sample_opcode = *ip; \
+            sample_start = vm_profile_clock(); \
+        } \
+    } while (0)
+#else
+#define VM_PROFILE() ((void) 0)
+#endif
+#if VM_CHECKED
+#define VM_CHECK_REG(id) do { if ((id) >= REG_OPERAND_COUNT) { reg1 = (id); goto invalid_register; } } while (0)
+#define VM_CHECK_VREG(id) do { if ((id) >= VREG_COUNT) { reg1 = (id); goto invalid_vector_register; } } while (0)
+#define VM_CHECK_TARGET(target) do { if ((target) >= bytecode->size) { operand = (target); goto invalid_target; } } while (0)
+#define VM_CHECK_MEMORY(slot) do { if (!validate_memory(vm, (slot))) goto fail; } while (0)
+#define VM_CHECK_CONSTANT(index) do { if (!validate_constant(vm, (index))) goto fail; } while (0)
+#define VM_CHECK_INDIRECT(target) VM_CHECK_TARGET(target)
+#define VM_CHECK_FRAME(address) do { if (!validate_frame(vm, (address), regs[SP])) goto fail; } while (0)
+#define VM_CHECK_FRAME_POINTER() do { if ((uint64_t *) regs[FP] < vm->stack.base || regs[FP] > regs[SP]) { vm->error = strdup("Invalid frame pointer"); goto fail; } } while (0)
+#define VM_CHECK_RETURN(target) do { if ((target) < start || (target) >= end) { operand = (uint32_t) ((target) - start); goto invalid_target; } } while (0)
+/* Superinstructions only come from verified code; see execution_code() in opcode.c. */
+#define VM_CHECK_SECOND(opcode) do { if (*ip >= OPCODE_COUNT || opcode_base(*ip) != (opcode)) goto invalid_opcode; } while (0)
+#else
+#define VM_CHECK_REG(id) ((void) 0)
+#define VM_CHECK_VREG(id) ((void) 0)
+#define VM_CHECK_TARGET(target) ((void) 0)
+#define VM_CHECK_MEMORY(slot) ((void) 0)
+#define VM_CHECK_CONSTANT(index) ((void) 0)
+#define VM_CHECK_FRAME(address) ((void) 0)
+#define VM_CHECK_FRAME_POINTER() ((void) 0)
+#define VM_CHECK_RETURN(target) ((void) 0)
+#define VM_CHECK_SECOND(opcode) ((void) 0)
+/*
+ * Register-held targets are not known to the verifier, so even verified
+ * code checks them against the entry points it found.
+ */
+#define VM_CHECK_INDIRECT(target) do { if ((target) >= bytecode->size || !bytecode->entries[(target)]) { operand = (uint32_t) (target); goto invalid_target; } } while (0)
+#endif
+
+/*
+ * Bodies of the instructions superinstructions can be made of (see
+ * FUSABLE_OPCODE_TABLE in opcode.h). Each runs one instruction and leaves
+ * ip at the next one to run, without dispatching, so that a
+ * superinstruction can run two of them in a row.
+ */
+#define VM_BINARY_RR(expr)                                                   \
+    {                                                                        \
+        reg1 = REG_PAIR_FIRST(ip[1]);                                        \
+        reg2 = REG_PAIR_SECOND(ip[1]);                                       \
+        VM_CHECK_REG(reg1);                                                  \
+        VM_CHECK_REG(reg2);                                                  \
+                                                                             \
+        int64_t a = (int64_t) regs[reg1];                                    \
+        int64_t b = (int64_t) regs[reg2];                                    \
+        (void) a;                                                            \
+        regs[reg1] = (uint64_t) (expr);                                      \
+        ip += 2;                                                             \
+    }
+
+/* Jumps to the target at ip + offset if taken, or skips size bytes. */
+#define VM_BRANCH(taken, offset, size)                                       \
+    if (taken)                                                               \
+    {                                                                        \
+        operand = vm_read_dword(ip + (offset));                              \
+        VM_CHECK_TARGET(operand);                                            \
+        ip = start + operand;                                                \
+    }                                                                        \
+    else                                                                     \
+        ip += (size);
+
+#define VM_JCC_RR(expr)                                                      \
+    {                                                                        \
+        reg1 = REG_PAIR_FIRST(ip[1]);                                        \
+        reg2 = REG_PAIR_SECOND(ip[1]);                                       \
+        VM_CHECK_REG(reg1);                                                  \
+        VM_CHECK_REG(reg2);                                                  \
+                                                                             \
+        int64_t a = (int64_t) regs[reg1];                                    \
+        int64_t b = (int64_t) regs[reg2];                                    \
+        VM_BRANCH(expr, 2, 6)                                                \
+    }
+
+#define VM_BODY_MOV_IR                                                       \
+    {                                                                        \
+        reg1 = ip[1];                                                        \
+        VM_CHECK_REG(reg1);                                                  \
+        regs[reg1] = vm_read_qword(ip + 2);                                  \
+        ip += 10;                                                            \
+    }
+
+#define VM_BODY_MOV_IR8                                                      \
+    {                                                                        \
+        reg1 = ip[1];                                                        \
+        VM_CHECK_REG(reg1);                                                  \
+        regs[reg1] = (uint64_t) (int64_t) (int8_t) ip[2];                    \
+        ip += 3;                                                             \
+    }
+
+#define VM_BODY_MOV_IR32                                                     \
+    {                                                                        \
+        reg1 = ip[1];                                                        \
+        VM_CHECK_REG(reg1);                                                  \
+        regs[reg1] = (uint64_t) (int64_t) (int32_t) vm_read_dword(ip + 2);   \
+        ip += 6;                                                             \
+    }
+
+#define VM_BODY_MOV_RR VM_BINARY_RR(b)
+#define VM_BODY_ADD_RR VM_BINARY_RR(a + b)
+#define VM_BODY_SUB_RR VM_BINARY_RR(a - b)
+#define VM_BODY_MUL_RR VM_BINARY_RR(a * b)
+#define VM_BODY_EQ_RR VM_BINARY_RR(a == b)
+#define VM_BODY_NE_RR VM_BINARY_RR(a != b)
+#define VM_BODY_LT_RR VM_BINARY_RR(a < b)
+#define VM_BODY_LE_RR VM_BINARY_RR(a <= b)
+#define VM_BODY_GT_RR VM_BINARY_RR(a > b)
+#define VM_BODY_GE_RR VM_BINARY_RR(a >= b)
+
+#define VM_BODY_PUSH_R_Q                                                     \
+    {                                                                        \
+        reg1 = ip[1];                                                        \
+        VM_CHECK_REG(reg1);                                                  \
+        blaze_stack_push(&regs[SP], regs[reg1]);                             \
+        ip += 2;                                                             \
+    }
+
+#define VM_BODY_POP_R_Q                                                      \
+    {                                                                        \
+        reg1 = ip[1];                                                        \
+        VM_CHECK_REG(reg1);                                                  \
+        regs[reg1] = blaze_stack_pop(&regs[SP]);                             \
+        ip += 2;                                                             \
+    }
+
+#define VM_BODY_LOAD_RM                                                      \
+    {                                                                        \
+        reg1 = ip[1];                                                        \
+        operand = vm_read_dword(ip + 2);                                     \
+        VM_CHECK_REG(reg1);                                                  \
+        VM_CHECK_MEMORY(operand);                                            \
+        regs[reg1] = memory[operand];                                        \
+        ip += 6;                                                             \
+    }
+
+#define VM_BODY_STORE_MR                                                     \
+    {                                                                        \
+        operand = vm_read_dword(ip + 1);                                     \
+        reg1 = ip[5];                                                        \
+        VM_CHECK_REG(reg1);                                                  \
+        VM_CHECK_MEMORY(operand);                                            \
+        memory[operand] = regs[reg1];                                        \
+        ip += 6;                                                             \
+    }
+
+#define VM_BODY_CONST_RK                                                     \
+    {                                                                        \
+        reg1 = ip[1];                                                        \
+        size_t length = vm_read_uleb128(ip + 2, &operand);                   \
+        VM_CHECK_REG(reg1);                                                  \
+        VM_CHECK_CONSTANT(operand);                                          \
+        regs[reg1] = vm->constants[operand];                                 \
+        ip += 2 + length;                                                    \
+    }
+
+#define VM_BODY_ENTER                                                        \
+    {                                                                        \
+        operand = vm_read_dword(ip + 1);                                     \
+                                                                             \
+        if (!validate_enter(vm, operand, regs[SP]))                              \
+            goto fail;                                                       \
+                                                                             \
+        blaze_stack_push(&regs[SP], regs[FP]);                               \
+        regs[FP] = regs[SP];                                                 \
+        regs[SP] += operand * sizeof (uint64_t);                             \
+        ip += 6;                                                             \
+    }
+
+#define VM_BODY_LEAVE                                                        \
+    {                                                                        \
+        regs[SP] = regs[FP];                                                 \
+        regs[FP] = blaze_stack_pop(&regs[SP]);                               \
+        VM_CHECK_FRAME_POINTER();                                            \
+        ip++;                                                                \
+    }
+
+#define VM_BODY_LOAD_RF                                                      \
+    {                                                                        \
+        reg1 = ip[1];                                                        \
+        uint64_t *address = (uint64_t *) regs[FP] + (int32_t) vm_read_dword(ip + 2); \
+        VM_CHECK_REG(reg1);                                                  \
+        VM_CHECK_FRAME(address);                                             \
+        regs[reg1] = *address;                                               \
+        ip += 6;                                                             \
+    }
+
+#define VM_BODY_STORE_FR                                                     \
+    {                                                                        \
+        uint64_t *address = (uint64_t *) regs[FP] + (int32_t) vm_read_dword(ip + 1); \
+        reg1 = ip[5];                                                        \
+        VM_CHECK_REG(reg1);                                                  \
+        VM_CHECK_FRAME(address);                                             \
+        *address = regs[reg1];                                               \
+        ip += 6;                                                             \
+    }
+
+#define VM_BODY_JMP                                                          \
+    {                                                                        \
+        operand = vm_read_dword(ip + 1);                                     \
+        VM_CHECK_TARGET(operand);                                            \
+        ip = start + operand;                                                \
+    }
+
+#define VM_BODY_JZ_R                                                         \
+    {                                                                        \
+        reg1 = ip[1];                                                        \
+        VM_CHECK_REG(reg1);                                                  \
+        VM_BRANCH(regs[reg1] == 0, 2, 6)                                     \
+    }
+
+#define VM_BODY_JNZ_R                                                        \
+    {                                                                        \
+        reg1 = ip[1];                                                        \
+        VM_CHECK_REG(reg1);                                                  \
+        VM_BRANCH(regs[reg1] != 0, 2, 6)                                     \
+    }
+
+#define VM_BODY_JEQ_RR VM_JCC_RR(a == b)
+#define VM_BODY_JNE_RR VM_JCC_RR(a != b)
+#define VM_BODY_JLT_RR VM_JCC_RR(a < b)
+#define VM_BODY_JLE_RR VM_JCC_RR(a <= b)
+#define VM_BODY_JGT_RR VM_JCC_RR(a > b)
+#define VM_BODY_JGE_RR VM_JCC_RR(a >= b)
+
+#define VM_BODY_CALL                                                         \
+    {                                                                        \
+        operand = vm_read_dword(ip + 1);                                     \
+        VM_CHECK_TARGET(operand);                                            \
+        blaze_stack_push(&regs[SP], (uint64_t) (ip + 5));                    \
+        ip = start + operand;                                                \
+    }
+
+#define VM_BODY_RET                                                          \
+    {                                                                        \
+        uint8_t *target = (uint8_t *) blaze_stack_pop(&regs[SP]);            \
+        VM_CHECK_RETURN(target);                                             \
+        ip = target;                                                         \
+    }
+
+#define VM_BODY_TARGET(op)                                                   \
+    VM_TARGET(OP_##op)                                                       \
+    {                                                                        \
+        VM_BODY_##op                                                         \
+        VM_NEXT();                                                           \
+    }
+
+#define VM_SUPERINSTRUCTION(first, second, mnemonic)                         \
+    VM_TARGET(SUPERINSTRUCTION_OPCODE(first, second))                        \
+    {                                                                        \
+        VM_BODY_##first                                                      \
+        VM_CHECK_SECOND(OP_##second);                                        \
+        VM_BODY_##second                                                     \
+        VM_NEXT();                                                           \
+    }
+
+/* Reached from syscall through quick_ labels, or from the opcode in raw code. */
+#define VM_QUICK_SYSCALL(op, guard, body)                                    \
+    VM_TARGET(op)                                                            \
+    quick_##op:                                                              \
+    {                                                                        \
+        if (!(guard))                                                        \
+        {                                                                    \
+            quicken_deopt(vm, (size_t) (ip - start));                        \
+            goto syscall_generic;                                            \
+        }                                                                    \
+                                                                             \
+        quicken_site(vm, (size_t) (ip - start))->hits++;                     \
+        body;                                                                \
+                                                                             \
+        if (vm->error != NULL)                                               \
+            goto fail;                                                       \
+                                                                             \
+        ip++;                                                                \
+        VM_NEXT();                                                           \
+    }
+
+/* Expands op first, so that it can be SUPERINSTRUCTION_OPCODE(). */
+#define VM_LABEL_(op) target_##op
+#define VM_LABEL(op) VM_LABEL_(op)
+
+#ifdef VM_COMPUTED_GOTO
+    /*
+     * Filled in at compile time rather than on the first run, so that
+     * threads starting their contexts at once do not race to fill it. The
+     * range initializer is overridden on purpose.
+     */
+#define VM_DISPATCH_ENTRY(op, handler, mnemonic, ...) [op] = &&VM_LABEL(op),
+#define VM_DISPATCH_SUPERINSTRUCTION(first, second, mnemonic) \
+    [SUPERINSTRUCTION_OPCODE(first, second)] = &&VM_LABEL(SUPERINSTRUCTION_OPCODE(first, second)),
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+    static const void *const dispatch_table[256] = {
+        [0 ... 255] = &&invalid_opcode,
+        OPCODE_TABLE(VM_DISPATCH_ENTRY)
+        SUPERINSTRUCTION_TABLE(VM_DISPATCH_SUPERINSTRUCTION)
+    };
+#pragma GCC diagnostic pop
+#undef VM_DISPATCH_ENTRY
+#undef VM_DISPATCH_SUPERINSTRUCTION
+
+#define VM_TARGET(op) VM_LABEL(op):
+#define VM_NEXT() do { VM_RECORD(); VM_PROFILE(); goto *dispatch_table[*ip]; } while (0)
+
+    VM_NEXT();
+#else
+#define VM_TARGET(op) case op:
+#define VM_NEXT() goto dispatch
+
+dispatch:
+    VM_RECORD();
+    VM_PROFILE();
+
+    switch (*ip)
+    {
+#endif
+    VM_TARGET(OP_NO_OP)
+    {
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_HLT)
+    {
+        VM_SYNC_OUT();
+        return true;
+    }
+
+    /* Instructions with a VM_BODY_ macro, then the superinstructions made of them. */
+    FUSABLE_OPCODE_TABLE(VM_BODY_TARGET)
+    FUSABLE_BRANCH_OPCODE_TABLE(VM_BODY_TARGET)
+    SUPERINSTRUCTION_TABLE(VM_SUPERINSTRUCTION)
+
+    VM_TARGET(OP_MOD_RR)
+    {
+        reg1 = REG_PAIR_FIRST(ip[1]);
+        reg2 = REG_PAIR_SECOND(ip[1]);
+        VM_CHECK_REG(reg1);
+        VM_CHECK_REG(reg2);
+
+        if (regs[reg2] == 0)
+        {
+            vm->error = strdup("Division by zero");
+            goto fail;
+        }
+
+        regs[reg1] = vm_mod((int64_t) regs[reg1], (int64_t) regs[reg2]);
+        ip += 2;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_DIV_RR)
+    {
+        reg1 = REG_PAIR_FIRST(ip[1]);
+        reg2 = REG_PAIR_SECOND(ip[1]);
+        VM_CHECK_REG(reg1);
+        VM_CHECK_REG(reg2);
+
+        if (regs[reg2] == 0)
+        {
+            vm->error = strdup("Division by zero");
+            goto fail;
+        }
+
+        regs[reg1] = vm_div((int64_t) regs[reg1], (int64_t) regs[reg2]);
+        ip += 2;
+        VM_NEXT();
+    }
+
+#define VM_QUICK_CASE(op, handler, mnemonic, ...) case op: goto quick_##op;
+
+    /* A site runs the form its context quickened it to, if any; see quicken_observe(). */
+    VM_TARGET(OP_SYSCALL)
+    {
+        if (vm->quickening != NULL)
+        {
+            switch (vm->quickening[ip - start].form)
+            {
+                QUICKENED_OPCODE_TABLE(VM_QUICK_CASE)
+
+                default:
+                    break;
+            }
+        }
+    }
+    syscall_generic:
+    {
+        opcode_t form = quicken_syscall_form(regs[R0], regs[R1]);
+
+        VM_SYNC_OUT();
+        OPCODE_HANDLER_REF(syscall)(vm, ip);
+        VM_SYNC_IN();
+
+        if (vm->error != NULL)
+            goto fail;
+
+        quicken_observe(vm, (size_t) (ip - start), form);
+        ip++;
+        VM_NEXT();
+    }
+
+    /*
+     * These work on the local registers, so they need no VM_SYNC_OUT(),
+     * except around allocations: the collector finds its roots in the
+     * registers of the context.
+     */
+    VM_QUICK_SYSCALL(OP_SYSCALL_WRITE_CHAR, regs[R0] == SYS_WRITE && regs[R1] == VT_CHAR,
+                     vm_file_putc(&vm->io.files[VM_STDOUT], (char) regs[R2]))
+    VM_QUICK_SYSCALL(OP_SYSCALL_WRITE_INT, regs[R0] == SYS_WRITE && regs[R1] == VT_INT,
+                     syscall_write_value(vm, VT_INT, regs[R2]))
+    VM_QUICK_SYSCALL(OP_SYSCALL_WRITE_STRING, regs[R0] == SYS_WRITE && regs[R1] == VT_STRING,
+                     syscall_write_value(vm, VT_STRING, regs[R2]))
+    VM_QUICK_SYSCALL(OP_SYSCALL_STRING_FROM_INT, regs[R0] == SYS_STRING_FROM && regs[R1] == VT_INT,
+                     (VM_SYNC_OUT(), regs[R0] = syscall_string_from(vm, VT_INT, regs[R2])))
+    VM_QUICK_SYSCALL(OP_SYSCALL_STRING_CONCAT, regs[R0] == SYS_STRING_CONCAT,
+                     (VM_SYNC_OUT(), regs[R0] = syscall_string_concat(vm, regs[R1], regs[R2])))
+    VM_QUICK_SYSCALL(OP_SYSCALL_STRING_EQUALS, regs[R0] == SYS_STRING_EQUALS,
+                     regs[R0] = syscall_string_equals(vm, regs[R1], regs[R2]))
+
+    VM_TARGET(OP_REGDUMP)
+    {
+        VM_SYNC_OUT();
+        OPCODE_HANDLER_REF(regdump)(vm, ip);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_STACK_DMP)
+    {
+        VM_SYNC_OUT();
+        OPCODE_HANDLER_REF(stackdmp)(vm, ip);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_PUSH_R_B)
+    {
+        reg1 = ip[1];
+        VM_CHECK_REG(reg1);
+        blaze_stack_push(&regs[SP], regs[reg1] & 0xFF);
+        ip += 2;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_POP_R_B)
+    {
+        reg1 = ip[1];
+        VM_CHECK_REG(reg1);
+        regs[reg1] = blaze_stack_pop(&regs[SP]) & 0xFF;
+        ip += 2;
+        VM_NEXT();
+    }
+
+
+    VM_TARGET(OP_JMP_R)
+    {
+        reg1 = ip[1];
+        VM_CHECK_REG(reg1);
+        VM_CHECK_INDIRECT(regs[reg1]);
+        ip = start + regs[reg1];
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_CALL_R)
+    {
+        reg1 = ip[1];
+        VM_CHECK_REG(reg1);
+        VM_CHECK_INDIRECT(regs[reg1]);
+        blaze_stack_push(&regs[SP], (uint64_t) (ip + 2));
+        ip = start + regs[reg1];
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_LOAD_RR)
+    {
+        reg1 = ip[1];
+        reg2 = ip[2];
+        VM_CHECK_REG(reg1);
+        VM_CHECK_REG(reg2);
+
+        /* The address comes from a register, so it is checked every time. */
+        if (!validate_memory(vm, regs[reg2]))
+            goto fail;
+
+        regs[reg1] = memory[regs[reg2]];
+        ip += 3;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_STORE_RR)
+    {
+        reg1 = ip[1];
+        reg2 = ip[2];
+        VM_CHECK_REG(reg1);
+        VM_CHECK_REG(reg2);
+
+        if (!validate_memory(vm, regs[reg1]))
+            goto fail;
+
+        memory[regs[reg1]] = regs[reg2];
+        ip += 3;
+        VM_NEXT();
+    }
+
+    /* Like load_rr, the vector instructions on memory check their slots every time. */
+    VM_TARGET(OP_VLOAD)
+    {
+        reg1 = ip[1];
+        reg2 = ip[2];
+        VM_CHECK_VREG(reg1);
+        VM_CHECK_REG(reg2);
+
+        if (!validate_vector_memory(vm, regs[reg2]))
+            goto fail;
+
+        memcpy(&vectors[reg1], memory + regs[reg2], sizeof (vm_vector_t));
+        ip += 3;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_VSTORE)
+    {
+        reg1 = ip[1];
+        reg2 = ip[2];
+        VM_CHECK_REG(reg1);
+        VM_CHECK_VREG(reg2);
+
+        if (!validate_vector_memory(vm, regs[reg1]))
+            goto fail;
+
+        memcpy(memory + regs[reg1], &vectors[reg2], sizeof (vm_vector_t));
+        ip += 3;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_VSPLAT)
+    {
+        reg1 = ip[1];
+        reg2 = ip[2];
+        VM_CHECK_VREG(reg1);
+        VM_CHECK_REG(reg2);
+
+        for (size_t i = 0; i < VM_VECTOR_LANES; i++)
+            vectors[reg1].lanes[i] = regs[reg2];
+
+        ip += 3;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_VADD)
+    VM_TARGET(OP_VSUB)
+    VM_TARGET(OP_VMUL)
+    VM_TARGET(OP_VADDF)
+    VM_TARGET(OP_VSUBF)
+    VM_TARGET(OP_VMULF)
+    VM_TARGET(OP_VCMPEQ)
+    VM_TARGET(OP_VCMPLT)
+    VM_TARGET(OP_VCMPLTF)
+    VM_TARGET(OP_VAND)
+    {
+        reg1 = REG_PAIR_FIRST(ip[1]);
+        reg2 = REG_PAIR_SECOND(ip[1]);
+        VM_CHECK_VREG(reg1);
+        VM_CHECK_VREG(reg2);
+        vector->binary[*ip - OP_VADD](&vectors[reg1], &vectors[reg2]);
+        ip += 2;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_VBLEND)
+    {
+        reg1 = REG_PAIR_FIRST(ip[1]);
+        reg2 = REG_PAIR_SECOND(ip[1]);
+        VM_CHECK_VREG(reg1);
+        VM_CHECK_VREG(reg2);
+        VM_CHECK_VREG(ip[2]);
+        vector->blend(&vectors[reg1], &vectors[reg2], &vectors[ip[2]]);
+        ip += 3;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_VSTOREM)
+    {
+        reg1 = ip[1];
+        reg2 = ip[2];
+        VM_CHECK_REG(reg1);
+        VM_CHECK_VREG(reg2);
+        VM_CHECK_VREG(ip[3]);
+
+        if (!validate_vector_memory(vm, regs[reg1]))
+            goto fail;
+
+        vector->store_masked(memory + regs[reg1], &vectors[reg2], &vectors[ip[3]]);
+        ip += 4;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_VSUM)
+    {
+        reg1 = ip[1];
+        reg2 = ip[2];
+        VM_CHECK_REG(reg1);
+        VM_CHECK_VREG(reg2);
+        regs[reg1] = vector->sum(&vectors[reg2]);
+        ip += 3;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_VSUMF)
+    {
+        reg1 = ip[1];
+        reg2 = ip[2];
+        VM_CHECK_REG(reg1);
+        VM_CHECK_VREG(reg2);
+        regs[reg1] = vector->sumf(&vectors[reg2]);
+        ip += 3;
+        VM_NEXT();
+    }
+
+    VM_TARGET(OP_VMAX)
+    {
+        reg1 = ip[1];
+        reg2 = ip[2];
+        VM_CHECK_REG(reg1);
+        VM_CHECK_VREG(reg2);
+        regs[reg1] = vector->max(&vectors[reg2]);
+        ip += 3;
+        VM_NEXT();
+    }
+
+#ifndef VM_COMPUTED_GOTO
+    default:
+        goto invalid_opcode;
+    }
+#endif
+
+invalid_opcode:
+    if (ip >= end)
+    {
+        vm->error = strdup("%ip points to a memory address that is out of range");
+        goto fail;
+    }
+
+    vm->error = xmalloc(22);
+    sprintf(vm->error, "Invalid opcode: 0x%02x", *ip);
+    goto fail;
+
+#if VM_CHECKED
+invalid_register:
+    validate_register(vm, reg1);
+    goto fail;
+
+invalid_vector_register:
+    validate_vector_register(vm, reg1);
+    goto fail;
+#endif
+
+invalid_target:
+    vm->error = xmalloc(40);
+    sprintf(vm->error, "Jump target out of range: 0x%08x", operand);
+    goto fail;
+
+fail:
+    VM_SYNC_OUT();
+    return false;
+
+#undef VM_SYNC_OUT
+#undef VM_SYNC_IN
+#undef VM_RECORD
+#undef VM_PROFILE
+#undef VM_CHECK_REG
+#undef VM_CHECK_VREG
+#undef VM_CHECK_TARGET
+#undef VM_CHECK_MEMORY
+#undef VM_CHECK_CONSTANT
+#undef VM_CHECK_INDIRECT
+#undef VM_CHECK_FRAME
+#undef VM_CHECK_FRAME_POINTER
+#undef VM_CHECK_RETURN
+#undef VM_CHECK_SECOND
+#undef VM_BINARY_RR
+#undef VM_BRANCH
+#undef VM_JCC_RR
+#undef VM_BODY_MOV_IR
+#undef VM_BODY_MOV_IR8
+#undef VM_BODY_MOV_IR32
+#undef VM_BODY_MOV_RR
+#undef VM_BODY_ADD_RR
+#undef VM_BODY_SUB_RR
+#undef VM_BODY_MUL_RR
+#undef VM_BODY_EQ_RR
+#undef VM_BODY_NE_RR
+#undef VM_BODY_LT_RR
+#undef VM_BODY_LE_RR
+#undef VM_BODY_GT_RR
+#undef VM_BODY_GE_RR
+#undef VM_BODY_PUSH_R_Q
+#undef VM_BODY_POP_R_Q
+#undef VM_BODY_LOAD_RM
+#undef VM_BODY_STORE_MR
+#undef VM_BODY_CONST_RK
+#undef VM_BODY_ENTER
+#undef VM_BODY_LEAVE
+#undef VM_BODY_LOAD_RF
+#undef VM_BODY_STORE_FR
+#undef VM_BODY_JMP
+#undef VM_BODY_JZ_R
+#undef VM_BODY_JNZ_R
+#undef VM_BODY_JEQ_RR
+#undef VM_BODY_JNE_RR
+#undef VM_BODY_JLT_RR
+#undef VM_BODY_JLE_RR
+#undef VM_BODY_JGT_RR
+#undef VM_BODY_JGE_RR
+#undef VM_BODY_CALL
+#undef VM_BODY_RET
+#undef VM_BODY_TARGET
+#undef VM_SUPERINSTRUCTION
+#undef VM_QUICK_SYSCALL
+#undef VM_QUICK_CASE
+#undef VM_LABEL_
+#undef VM_LABEL
+#undef VM_TARGET
+#undef VM_NEXT
+}
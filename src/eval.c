@@ -398,8 +398,11 @@ val_t eval_int(scope_t *scope, const ast_node_t *node)
 
 val_t eval_string(scope_t *scope, const ast_node_t *node)
 {
+    if (node->string->value != NULL)
+        return *node->string->value;
+
     val_t *val = val_create_heap(VAL_STRING);
-    val->strval = strdup(node->string->strval);
+    val->strval = string_create_cstr(node->string->strval);
     return *val;
 }
 
@@ -417,85 +420,124 @@ static long long int val_to_int(val_t *val)
     return 1;
 }
 
-static char *val_stringify(val_t *val)
+/*
+ * Returns the textual form of a string operand without allocating.
+ * Integers are formatted into the caller-provided buffer. Values that have
+ * no textual form yield NULL.
+ */
+static const char *eval_string_operand(const val_t *val, char *buf, size_t bufsize, size_t *length)
 {
-    char *string = NULL;
-    val_type_t type = val->type;
-
-    if (type == VAL_STRING)
-        string = strdup(val->strval);
-    else if (type == VAL_INTEGER)
-        asprintf(&string, "%lld", val->intval);
-    else if (type == VAL_BOOLEAN)
-        string = strdup(val->boolval ? "true" : "false");
-    else if (type == VAL_NULL)
-        string = strdup("null");
-
-    return string;
+    switch (val->type)
+    {
+        case VAL_STRING:
+            *length = val->strval->length;
+            return string_flatten(val->strval);
+
+        case VAL_INTEGER:
+            *length = (size_t) snprintf(buf, bufsize, "%lld", val->intval);
+            return buf;
+
+        case VAL_BOOLEAN:
+            *length = val->boolval ? 4 : 5;
+            return val->boolval ? "true" : "false";
+
+        case VAL_NULL:
+            *length = 4;
+            return "null";
+
+        default:
+            return NULL;
+    }
 }
 
-static val_t eval_concat(val_t *left, val_t *right, const ast_node_t *node)
+/*
+ * Strings are concatenated as ropes, so the other operand only needs to be
+ * turned into a (short) string of its own when it is not one already.
+ */
+static string_t *eval_concat_string(const val_t *val, const ast_node_t *node)
 {
-    val_t *val = val_init_heap(VAL_STRING);
-    val_type_t ltype = left->type;
-    val_type_t rtype = right->type;
-
-    val->type = VAL_STRING;
-    val->strval = NULL;
-
-    if (ltype == VAL_STRING && rtype == VAL_STRING)
-        asprintf(&val->strval, "%s%s",
-                 left->strval, right->strval);
-    else if (ltype == VAL_STRING && rtype == VAL_INTEGER)
-        asprintf(&val->strval, "%s%lld",
-                 left->strval, right->intval);
-    else if (ltype == VAL_INTEGER && rtype == VAL_STRING)
-        asprintf(&val->strval, "%lld%s",
-                 left->intval, right->strval);
-    else if (ltype == VAL_STRING && rtype == VAL_BOOLEAN)
-        asprintf(&val->strval, "%s%s",
-                 left->strval, right->boolval ? "true" : "false");
-    else if (ltype == VAL_BOOLEAN && rtype == VAL_STRING)
-        asprintf(&val->strval, "%s%s",
-                 left->boolval ? "true" : "false", right->strval);
-    else if (ltype == VAL_NULL && rtype == VAL_STRING)
-        asprintf(&val->strval, "null%s", right->strval);
-    else if (ltype == VAL_STRING && rtype == VAL_NULL)
-        asprintf(&val->strval, "%snull", left->strval);
-    else
+    if (val->type == VAL_STRING)
+        return string_ref(val->strval);
+
+    char buf[32];
+    size_t length = 0;
+    const char *str = eval_string_operand(val, buf, sizeof buf, &length);
+
+    if (str == NULL)
         RUNTIME_ERROR(node->binexpr->left->filename,
                       node->binexpr->left->line_start,
                       node->binexpr->left->column_start,
                       "cannot use operator '%c' with type string",
                       '+');
+
+    return string_create(str, length);
+}
+
+static val_t eval_concat(val_t *left, val_t *right, const ast_node_t *node)
+{
+    string_t *left_str = eval_concat_string(left, node);
+    string_t *right_str = eval_concat_string(right, node);
+
+    val_t *val = val_create_heap(VAL_STRING);
+
+    /* A left operand formatted just now is not shared, so a short result is appended to it in place. */
+    if (left_str->refcount == 1 && left_str->length + right_str->length < STRING_ROPE_MIN_LENGTH)
+        val->strval = string_append(left_str, string_flatten(right_str), right_str->length);
+    else
+    {
+        val->strval = string_concat_strings(left_str, right_str);
+        string_unref(left_str);
+    }
+
+    string_unref(right_str);
     return *val;
 }
 
+/*
+ * Compares two operands by their textual form. Two strings are compared by
+ * identity, length and contents; only a mixed comparison formats the other
+ * operand, into a stack buffer.
+ */
+static bool eval_string_equals(const val_t *left, const val_t *right)
+{
+    if (left->type == VAL_STRING && right->type == VAL_STRING)
+        return string_equals(left->strval, right->strval);
+
+    char left_buf[32], right_buf[32];
+    size_t left_length = 0, right_length = 0;
+    const char *left_str = eval_string_operand(left, left_buf, sizeof left_buf, &left_length);
+    const char *right_str = eval_string_operand(right, right_buf, sizeof right_buf, &right_length);
+
+    if (left_str == NULL || right_str == NULL)
+        return false;
+
+    return left_length == right_length && memcmp(left_str, right_str, left_length) == 0;
+}
+
 static val_t eval_binexp_string(ast_bin_operator_t operator, val_t *left, val_t *right, const ast_node_t *node)
 {
     if (operator == OP_PLUS)
         return eval_concat(left, right, node);
 
     val_t val = val_create(VAL_BOOLEAN);
-    const char *left_str = val_stringify(left);
-    const char *right_str = val_stringify(right);
+    bool equal = eval_string_equals(left, right);
 
     switch (operator)
     {
         case OP_CMP_EQ:
-            val.boolval = strcmp(left_str, right_str) == 0;
+            val.boolval = equal;
             break;
 
         case OP_CMP_EQ_S:
-            val.boolval = strcmp(left_str, right_str) == 0 && left->type == right->type;
+            val.boolval = equal && left->type == right->type;
             break;
 
         case OP_CMP_NE:
-            val.boolval = strcmp(left_str, right_str) != 0;
+            val.boolval = !equal;
             break;
 
         case OP_CMP_NE_S:
-            val.boolval = strcmp(left_str, right_str) != 0 && left->type == right->type;
+            val.boolval = !equal && left->type == right->type;
             break;
 
         default:
@@ -680,7 +722,8 @@ const char *val_type_to_str(val_type_t type)
         [VAL_FUNCTION] = "FUNCTION",
         [VAL_NULL] = "NULL",
         [VAL_OBJECT] = "OBJECT",
-        [VAL_ARRAY] = "ARRAY"
+        [VAL_ARRAY] = "ARRAY",
+        [VAL_MAP] = "MAP"
     };
 
     size_t length = sizeof (translate) / sizeof (const char *);
@@ -0,0 +1,879 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#define _GNU_SOURCE
+
+#include "jit.h"
+#include "bytecode.h"
+#include "opcode.h"
+#include "register.h"
+#include "utils.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Layout of the generated code:
+ *
+ *   entry      saves the callee-saved registers, loads the VM registers
+ *              and jumps to the first instruction
+ *   epilogue   restores them and returns %eax
+ *   exits      store the VM registers back and return 1 (hlt) or 0,
+ *              after setting vm->error for the errors found in native code
+ *   body       the instructions, in bytecode order
+ *
+ * Return addresses on the VM stack stay bytecode addresses, as in the
+ * interpreter, so ret looks up the native code of its target in a table
+ * indexed by code offset.
+ */
+struct jit
+{
+    uint8_t *code;
+    size_t code_size;
+    void **targets;
+    int (*entry)(void *start);
+};
+
+enum
+{
+    X86_RAX, X86_RCX, X86_RDX, X86_RBX, X86_RSP, X86_RBP, X86_RSI, X86_RDI,
+    X86_R8, X86_R9, X86_R10, X86_R11, X86_R12, X86_R13, X86_R14, X86_R15
+};
+
+/* Condition codes, as in the low nibble of jcc and setcc. */
+enum
+{
+    X86_CC_B = 0x2, X86_CC_AE = 0x3, X86_CC_E = 0x4, X86_CC_NE = 0x5,
+    X86_CC_L = 0xC, X86_CC_GE = 0xD, X86_CC_LE = 0xE, X86_CC_G = 0xF
+};
+
+/*
+ * Where each VM register lives. %rax and %rdx are scratch (and what idiv
+ * needs), %rbp is the frame pointer perf unwinds through, and %ip and %is
+ * only exist in the bytecode.
+ */
+static const uint8_t vm_registers[] = { R0, R1, R2, R3, R4, R5, R6, R7, R8, R9, SP, FP };
+static const uint8_t host_registers[REG_COUNT] = {
+    [R0] = X86_RBX, [R1] = X86_R14, [R2] = X86_R15, [R3] = X86_RCX,
+    [R4] = X86_RSI, [R5] = X86_RDI, [R6] = X86_R8, [R7] = X86_R9,
+    [R8] = X86_R10, [R9] = X86_R11, [SP] = X86_R12, [FP] = X86_R13
+};
+
+#define HOST(reg) host_registers[(reg)]
+#define VM_REGISTER_COUNT (sizeof (vm_registers) / sizeof (vm_registers[0]))
+
+/* A rel32 at code offset at that must reach the instruction at a bytecode offset. */
+struct jit_fixup
+{
+    size_t at;
+    size_t target;
+};
+
+struct jit_compiler
+{
+    struct vm_context *vm;
+    struct bytecode *bytecode;
+    uint8_t *code;
+    size_t size;
+    size_t cap;
+    size_t *native;
+    struct jit_fixup *fixups;
+    size_t fixup_count;
+    size_t fixup_cap;
+    size_t epilogue;
+    size_t exit_ok;
+    size_t exit_fail;
+    size_t error_division;
+    size_t error_overflow;
+    size_t error_target;
+    size_t body;
+    void **targets;
+};
+
+#define JIT_NO_CODE SIZE_MAX
+
+static void emit_byte(struct jit_compiler *c, uint8_t byte)
+{
+    if (c->size == c->cap)
+    {
+        c->cap = c->cap == 0 ? 4096 : c->cap * 2;
+        c->code = xrealloc(c->code, c->cap);
+    }
+
+    c->code[c->size++] = byte;
+}
+
+static void emit_dword(struct jit_compiler *c, uint32_t dword)
+{
+    for (size_t i = 0; i < sizeof dword; i++)
+        emit_byte(c, (uint8_t) (dword >> (i * 8)));
+}
+
+static void emit_qword(struct jit_compiler *c, uint64_t qword)
+{
+    emit_dword(c, (uint32_t) qword);
+    emit_dword(c, (uint32_t) (qword >> 32));
+}
+
+static void patch_rel32(struct jit_compiler *c, size_t at, size_t destination)
+{
+    int32_t rel = (int32_t) ((int64_t) destination - (int64_t) (at + 4));
+    memcpy(c->code + at, &rel, sizeof rel);
+}
+
+/* A REX prefix for a 64-bit operation, or for 32-bit ones on %r8-%r15. */
+static void x86_rex(struct jit_compiler *c, bool wide, uint8_t reg, uint8_t base)
+{
+    uint8_t rex = 0x40 | (wide ? 0x08 : 0) | ((reg >> 3) << 2) | (base >> 3);
+
+    if (rex != 0x40)
+        emit_byte(c, rex);
+}
+
+static void x86_modrm_reg(struct jit_compiler *c, uint8_t reg, uint8_t rm)
+{
+    emit_byte(c, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* [base + disp32]; %rsp and %r12 need a SIB byte as a base. */
+static void x86_modrm_mem(struct jit_compiler *c, uint8_t reg, uint8_t base, int32_t disp)
+{
+    emit_byte(c, 0x80 | (reg & 7) << 3 | (base & 7));
+
+    if ((base & 7) == X86_RSP)
+        emit_byte(c, 0x24);
+
+    emit_dword(c, (uint32_t) disp);
+}
+
+static void x86_mov_imm(struct jit_compiler *c, uint8_t reg, uint64_t value)
+{
+    if (value <= UINT32_MAX)
+    {
+        /* Writing the low half zeroes the rest. */
+        x86_rex(c, false, 0, reg);
+        emit_byte(c, 0xB8 + (reg & 7));
+        emit_dword(c, (uint32_t) value);
+    }
+    else if ((int64_t) value == (int32_t) value)
+    {
+        x86_rex(c, true, 0, reg);
+        emit_byte(c, 0xC7);
+        x86_modrm_reg(c, 0, reg);
+        emit_dword(c, (uint32_t) value);
+    }
+    else
+    {
+        x86_rex(c, true, 0, reg);
+        emit_byte(c, 0xB8 + (reg & 7));
+        emit_qword(c, value);
+    }
+}
+
+/* An instruction of the form "op r/m64, r64", e.g. mov, add, sub, cmp or test. */
+static void x86_rr(struct jit_compiler *c, uint8_t opcode, uint8_t dst, uint8_t src)
+{
+    x86_rex(c, true, src, dst);
+    emit_byte(c, opcode);
+    x86_modrm_reg(c, src, dst);
+}
+
+#define X86_ADD 0x01
+#define X86_SUB 0x29
+#define X86_CMP 0x39
+#define X86_TEST 0x85
+#define X86_MOV 0x89
+
+static void x86_imul(struct jit_compiler *c, uint8_t dst, uint8_t src)
+{
+    x86_rex(c, true, dst, src);
+    emit_byte(c, 0x0F);
+    emit_byte(c, 0xAF);
+    x86_modrm_reg(c, dst, src);
+}
+
+/* add, sub or cmp with an immediate, selected by the /digit of opcode 0x81. */
+static void x86_alu_imm(struct jit_compiler *c, uint8_t digit, uint8_t reg, int32_t imm)
+{
+    x86_rex(c, true, 0, reg);
+
+    if (imm == (int8_t) imm)
+    {
+        emit_byte(c, 0x83);
+        x86_modrm_reg(c, digit, reg);
+        emit_byte(c, (uint8_t) imm);
+    }
+    else
+    {
+        emit_byte(c, 0x81);
+        x86_modrm_reg(c, digit, reg);
+        emit_dword(c, (uint32_t) imm);
+    }
+}
+
+#define X86_DIGIT_ADD 0
+#define X86_DIGIT_SUB 5
+#define X86_DIGIT_CMP 7
+
+static void x86_load(struct jit_compiler *c, uint8_t dst, uint8_t base, int32_t disp)
+{
+    x86_rex(c, true, dst, base);
+    emit_byte(c, 0x8B);
+    x86_modrm_mem(c, dst, base, disp);
+}
+
+static void x86_store(struct jit_compiler *c, uint8_t base, int32_t disp, uint8_t src)
+{
+    x86_rex(c, true, src, base);
+    emit_byte(c, 0x89);
+    x86_modrm_mem(c, src, base, disp);
+}
+
+/* Sets dst to 1 if the condition holds and to 0 otherwise. */
+static void x86_setcc(struct jit_compiler *c, uint8_t cc, uint8_t dst)
+{
+    emit_byte(c, 0x0F);
+    emit_byte(c, 0x90 | cc);
+    x86_modrm_reg(c, 0, X86_RAX);
+    x86_rex(c, true, dst, X86_RAX);
+    emit_byte(c, 0x0F);
+    emit_byte(c, 0xB6);
+    x86_modrm_reg(c, dst, X86_RAX);
+}
+
+static void x86_call(struct jit_compiler *c, const void *function)
+{
+    x86_mov_imm(c, X86_RAX, (uint64_t) (uintptr_t) function);
+    emit_byte(c, 0xFF);
+    emit_byte(c, 0xD0);
+}
+
+/* Jumps to code already emitted, or to a bytecode offset once it has been. */
+static void x86_jmp_native(struct jit_compiler *c, size_t destination)
+{
+    emit_byte(c, 0xE9);
+    emit_dword(c, 0);
+    patch_rel32(c, c->size - 4, destination);
+}
+
+static void x86_jcc_native(struct jit_compiler *c, uint8_t cc, size_t destination)
+{
+    emit_byte(c, 0x0F);
+    emit_byte(c, 0x80 | cc);
+    emit_dword(c, 0);
+    patch_rel32(c, c->size - 4, destination);
+}
+
+static void add_fixup(struct jit_compiler *c, size_t target)
+{
+    if (c->fixup_count == c->fixup_cap)
+    {
+        c->fixup_cap = c->fixup_cap == 0 ? 64 : c->fixup_cap * 2;
+        c->fixups = xrealloc(c->fixups, c->fixup_cap * sizeof (struct jit_fixup));
+    }
+
+    c->fixups[c->fixup_count++] = (struct jit_fixup) { c->size - 4, target };
+}
+
+static void x86_jmp(struct jit_compiler *c, size_t target)
+{
+    emit_byte(c, 0xE9);
+    emit_dword(c, 0);
+    add_fixup(c, target);
+}
+
+static void x86_jcc(struct jit_compiler *c, uint8_t cc, size_t target)
+{
+    emit_byte(c, 0x0F);
+    emit_byte(c, 0x80 | cc);
+    emit_dword(c, 0);
+    add_fixup(c, target);
+}
+
+/* A forward jump within the code of one instruction; see patch_here(). */
+static size_t x86_jcc_forward(struct jit_compiler *c, uint8_t cc)
+{
+    x86_jcc_native(c, cc, c->size);
+    return c->size - 4;
+}
+
+static size_t x86_jmp_forward(struct jit_compiler *c)
+{
+    x86_jmp_native(c, c->size);
+    return c->size - 4;
+}
+
+static void patch_here(struct jit_compiler *c, size_t at)
+{
+    patch_rel32(c, at, c->size);
+}
+
+static void jit_store_registers(struct jit_compiler *c)
+{
+    x86_mov_imm(c, X86_RAX, (uint64_t) (uintptr_t) c->vm->registers);
+
+    for (size_t i = 0; i < VM_REGISTER_COUNT; i++)
+        x86_store(c, X86_RAX, vm_registers[i] * sizeof (uint64_t), HOST(vm_registers[i]));
+}
+
+static void jit_load_registers(struct jit_compiler *c)
+{
+    x86_mov_imm(c, X86_RAX, (uint64_t) (uintptr_t) c->vm->registers);
+
+    for (size_t i = 0; i < VM_REGISTER_COUNT; i++)
+        x86_load(c, HOST(vm_registers[i]), X86_RAX, vm_registers[i] * sizeof (uint64_t));
+}
+
+/* Called from native code, with the VM registers stored in the context. */
+static void jit_error(struct vm_context *vm, const char *message)
+{
+    vm->error = strdup(message);
+}
+
+/* The vector registers live in the context, so their instructions are left to C whole. */
+#define JIT_HANDLER_CASE(opcode, handler, mnemonic, a, b, c) case opcode:
+
+/* Runs the handler of an instruction the JIT leaves to C, such as syscall. */
+static bool jit_handler(struct vm_context *vm, uint8_t *ip)
+{
+    vm->registers[IP] = (uint64_t) ip;
+    instruction_exec(vm, *ip);
+    return vm->error == NULL;
+}
+
+static size_t emit_error_exit(struct jit_compiler *c, const char *message)
+{
+    size_t start = c->size;
+
+    jit_store_registers(c);
+    x86_mov_imm(c, X86_RDI, (uint64_t) (uintptr_t) c->vm);
+    x86_mov_imm(c, X86_RSI, (uint64_t) (uintptr_t) message);
+    x86_call(c, jit_error);
+    x86_jmp_native(c, c->exit_fail);
+    return start;
+}
+
+static void emit_entry(struct jit_compiler *c)
+{
+    static const uint8_t prologue[] = {
+        0x55,                   /* push %rbp */
+        0x48, 0x89, 0xE5,       /* mov %rsp, %rbp */
+        0x53,                   /* push %rbx */
+        0x41, 0x54,             /* push %r12 */
+        0x41, 0x55,             /* push %r13 */
+        0x41, 0x56,             /* push %r14 */
+        0x41, 0x57,             /* push %r15 */
+        0x48, 0x83, 0xEC, 0x08  /* sub $8, %rsp, to keep calls aligned */
+    };
+    static const uint8_t epilogue[] = {
+        0x48, 0x83, 0xC4, 0x08, /* add $8, %rsp */
+        0x41, 0x5F,             /* pop %r15 */
+        0x41, 0x5E,             /* pop %r14 */
+        0x41, 0x5D,             /* pop %r13 */
+        0x41, 0x5C,             /* pop %r12 */
+        0x5B,                   /* pop %rbx */
+        0x5D,                   /* pop %rbp */
+        0xC3                    /* ret */
+    };
+
+    for (size_t i = 0; i < sizeof prologue; i++)
+        emit_byte(c, prologue[i]);
+
+    /* The native code of the instruction to start at comes in %rdi, which holds %r5. */
+    x86_rr(c, X86_MOV, X86_RDX, X86_RDI);
+    jit_load_registers(c);
+    emit_byte(c, 0xFF);
+    emit_byte(c, 0xE2);                 /* jmp *%rdx */
+
+    c->epilogue = c->size;
+
+    for (size_t i = 0; i < sizeof epilogue; i++)
+        emit_byte(c, epilogue[i]);
+
+    c->exit_fail = c->size;
+    x86_mov_imm(c, X86_RAX, 0);
+    x86_jmp_native(c, c->epilogue);
+
+    c->exit_ok = c->size;
+    jit_store_registers(c);
+    x86_mov_imm(c, X86_RAX, 1);
+    x86_jmp_native(c, c->epilogue);
+
+    c->error_division = emit_error_exit(c, "Division by zero");
+    c->error_overflow = emit_error_exit(c, "VM stack overflow");
+    c->error_target = emit_error_exit(c, "Jump target out of range");
+}
+
+/* div and mod; INT64_MIN / -1 wraps around like vm_div() in opcode.c. */
+static void emit_division(struct jit_compiler *c, uint8_t a, uint8_t b, bool remainder)
+{
+    x86_rr(c, X86_TEST, b, b);
+    x86_jcc_native(c, X86_CC_E, c->error_division);
+    x86_alu_imm(c, X86_DIGIT_CMP, b, -1);
+
+    size_t divide = x86_jcc_forward(c, X86_CC_NE);
+
+    if (remainder)
+        x86_mov_imm(c, a, 0);
+    else
+    {
+        x86_rex(c, true, 0, a);
+        emit_byte(c, 0xF7);
+        x86_modrm_reg(c, 3, a);         /* neg a */
+    }
+
+    size_t done = x86_jmp_forward(c);
+
+    patch_here(c, divide);
+    x86_rr(c, X86_MOV, X86_RAX, a);
+    emit_byte(c, 0x48);
+    emit_byte(c, 0x99);                 /* cqo */
+    x86_rex(c, true, 0, b);
+    emit_byte(c, 0xF7);
+    x86_modrm_reg(c, 7, b);             /* idiv b */
+    x86_rr(c, X86_MOV, a, remainder ? X86_RDX : X86_RAX);
+    patch_here(c, done);
+}
+
+/* Pushes and pops a register on the VM stack, which %r12 points into. */
+static void emit_push(struct jit_compiler *c, uint8_t reg)
+{
+    x86_store(c, HOST(SP), 0, reg);
+    x86_alu_imm(c, X86_DIGIT_ADD, HOST(SP), sizeof (uint64_t));
+}
+
+static void emit_pop(struct jit_compiler *c, uint8_t reg)
+{
+    x86_alu_imm(c, X86_DIGIT_SUB, HOST(SP), sizeof (uint64_t));
+    x86_load(c, reg, HOST(SP), 0);
+}
+
+static void emit_handler_call(struct jit_compiler *c, uint8_t *ip)
+{
+    jit_store_registers(c);
+    x86_mov_imm(c, X86_RDI, (uint64_t) (uintptr_t) c->vm);
+    x86_mov_imm(c, X86_RSI, (uint64_t) (uintptr_t) ip);
+    x86_call(c, jit_handler);
+    emit_byte(c, 0x84);
+    emit_byte(c, 0xC0);                 /* test %al, %al */
+    x86_jcc_native(c, X86_CC_E, c->exit_fail);
+    jit_load_registers(c);
+}
+
+/* Looks the bytecode address in %rax up in the table of native targets. */
+static void emit_ret(struct jit_compiler *c)
+{
+    emit_pop(c, X86_RAX);
+    x86_mov_imm(c, X86_RDX, (uint64_t) (uintptr_t) c->vm->code);
+    x86_rr(c, X86_SUB, X86_RAX, X86_RDX);
+    x86_mov_imm(c, X86_RDX, c->bytecode->size);
+    x86_rr(c, X86_CMP, X86_RAX, X86_RDX);
+    x86_jcc_native(c, X86_CC_AE, c->error_target);
+    x86_mov_imm(c, X86_RDX, (uint64_t) (uintptr_t) c->targets);
+
+    static const uint8_t lookup[] = {
+        0x48, 0x8B, 0x04, 0xC2, /* mov (%rdx,%rax,8), %rax */
+        0x48, 0x85, 0xC0        /* test %rax, %rax */
+    };
+
+    for (size_t i = 0; i < sizeof lookup; i++)
+        emit_byte(c, lookup[i]);
+
+    x86_jcc_native(c, X86_CC_E, c->error_target);
+    emit_byte(c, 0xFF);
+    emit_byte(c, 0xE0);                 /* jmp *%rax */
+}
+
+static uint32_t read_dword(const uint8_t *ptr)
+{
+    uint32_t dword;
+    memcpy(&dword, ptr, sizeof dword);
+    return dword;
+}
+
+static bool frame_displacement(const uint8_t *ptr, int32_t *disp)
+{
+    int64_t bytes = (int64_t) (int32_t) read_dword(ptr) * (int64_t) sizeof (uint64_t);
+
+    *disp = (int32_t) bytes;
+    return bytes == *disp;
+}
+
+/* Translates one instruction, or returns false if the JIT does not handle it. */
+static bool emit_instruction(struct jit_compiler *c, uint8_t *ip, size_t offset, size_t size)
+{
+    uint8_t *start = c->vm->code;
+    /* Only meaningful for instructions with a register pair, but always in range. */
+    uint8_t pair = size > 1 ? ip[1] : 0;
+    uint8_t a = HOST(REG_PAIR_FIRST(pair) % REG_COUNT), b = HOST(REG_PAIR_SECOND(pair) % REG_COUNT);
+    int32_t disp;
+
+    switch (opcode_base(*ip))
+    {
+        case OP_NO_OP:
+            return true;
+
+        case OP_HLT:
+            x86_jmp_native(c, c->exit_ok);
+            return true;
+
+        case OP_MOV_IR:
+        {
+            uint64_t value;
+            memcpy(&value, ip + 2, sizeof value);
+            x86_mov_imm(c, HOST(ip[1]), value);
+            return true;
+        }
+
+        case OP_MOV_IR8:
+            x86_mov_imm(c, HOST(ip[1]), (uint64_t) (int64_t) (int8_t) ip[2]);
+            return true;
+
+        case OP_MOV_IR32:
+            x86_mov_imm(c, HOST(ip[1]), (uint64_t) (int64_t) (int32_t) read_dword(ip + 2));
+            return true;
+
+        case OP_MOV_RR:
+            x86_rr(c, X86_MOV, a, b);
+            return true;
+
+        case OP_ADD_RR:
+            x86_rr(c, X86_ADD, a, b);
+            return true;
+
+        case OP_SUB_RR:
+            x86_rr(c, X86_SUB, a, b);
+            return true;
+
+        case OP_MUL_RR:
+            x86_imul(c, a, b);
+            return true;
+
+        case OP_DIV_RR:
+        case OP_MOD_RR:
+            emit_division(c, a, b, opcode_base(*ip) == OP_MOD_RR);
+            return true;
+
+        case OP_EQ_RR: x86_rr(c, X86_CMP, a, b); x86_setcc(c, X86_CC_E, a); return true;
+        case OP_NE_RR: x86_rr(c, X86_CMP, a, b); x86_setcc(c, X86_CC_NE, a); return true;
+        case OP_LT_RR: x86_rr(c, X86_CMP, a, b); x86_setcc(c, X86_CC_L, a); return true;
+        case OP_LE_RR: x86_rr(c, X86_CMP, a, b); x86_setcc(c, X86_CC_LE, a); return true;
+        case OP_GT_RR: x86_rr(c, X86_CMP, a, b); x86_setcc(c, X86_CC_G, a); return true;
+        case OP_GE_RR: x86_rr(c, X86_CMP, a, b); x86_setcc(c, X86_CC_GE, a); return true;
+
+        case OP_JMP:
+            x86_jmp(c, read_dword(ip + 1));
+            return true;
+
+        case OP_JZ_R:
+        case OP_JNZ_R:
+            x86_rr(c, X86_TEST, HOST(ip[1]), HOST(ip[1]));
+            x86_jcc(c, opcode_base(*ip) == OP_JZ_R ? X86_CC_E : X86_CC_NE, read_dword(ip + 2));
+            return true;
+
+        case OP_JEQ_RR: x86_rr(c, X86_CMP, a, b); x86_jcc(c, X86_CC_E, read_dword(ip + 2)); return true;
+        case OP_JNE_RR: x86_rr(c, X86_CMP, a, b); x86_jcc(c, X86_CC_NE, read_dword(ip + 2)); return true;
+        case OP_JLT_RR: x86_rr(c, X86_CMP, a, b); x86_jcc(c, X86_CC_L, read_dword(ip + 2)); return true;
+        case OP_JLE_RR: x86_rr(c, X86_CMP, a, b); x86_jcc(c, X86_CC_LE, read_dword(ip + 2)); return true;
+        case OP_JGT_RR: x86_rr(c, X86_CMP, a, b); x86_jcc(c, X86_CC_G, read_dword(ip + 2)); return true;
+        case OP_JGE_RR: x86_rr(c, X86_CMP, a, b); x86_jcc(c, X86_CC_GE, read_dword(ip + 2)); return true;
+
+        case OP_CALL:
+            x86_mov_imm(c, X86_RAX, (uint64_t) (uintptr_t) (start + offset + size));
+            emit_push(c, X86_RAX);
+            x86_jmp(c, read_dword(ip + 1));
+            return true;
+
+        case OP_RET:
+            emit_ret(c);
+            return true;
+
+        case OP_PUSH_R_Q:
+            emit_push(c, HOST(ip[1]));
+            return true;
+
+        case OP_POP_R_Q:
+            emit_pop(c, HOST(ip[1]));
+            return true;
+
+        case OP_ENTER:
+        {
+            uint64_t bytes = (uint64_t) read_dword(ip + 1) * sizeof (uint64_t);
+
+            /* The locals and the saved %fp must fit below the limit, as in validate_enter(). */
+            if (bytes > INT32_MAX)
+            {
+                x86_jmp_native(c, c->error_overflow);
+                return true;
+            }
+
+            x86_rr(c, X86_MOV, X86_RAX, HOST(SP));
+            x86_alu_imm(c, X86_DIGIT_ADD, X86_RAX, (int32_t) bytes);
+            x86_mov_imm(c, X86_RDX, (uint64_t) (uintptr_t) c->vm->stack.limit);
+            x86_rr(c, X86_CMP, X86_RAX, X86_RDX);
+            x86_jcc_native(c, X86_CC_AE, c->error_overflow);
+            emit_push(c, HOST(FP));
+            x86_rr(c, X86_MOV, HOST(FP), HOST(SP));
+
+            if (bytes != 0)
+                x86_alu_imm(c, X86_DIGIT_ADD, HOST(SP), (int32_t) bytes);
+
+            return true;
+        }
+
+        case OP_LEAVE:
+            x86_rr(c, X86_MOV, HOST(SP), HOST(FP));
+            emit_pop(c, HOST(FP));
+            return true;
+
+        case OP_LOAD_RF:
+            if (!frame_displacement(ip + 2, &disp))
+                return false;
+
+            x86_load(c, HOST(ip[1]), HOST(FP), disp);
+            return true;
+
+        case OP_STORE_FR:
+            if (!frame_displacement(ip + 1, &disp))
+                return false;
+
+            x86_store(c, HOST(FP), disp, HOST(ip[5]));
+            return true;
+
+        case OP_LOAD_RM:
+            x86_mov_imm(c, X86_RAX, (uint64_t) (uintptr_t) &c->vm->memory[read_dword(ip + 2)]);
+            x86_load(c, HOST(ip[1]), X86_RAX, 0);
+            return true;
+
+        case OP_STORE_MR:
+            x86_mov_imm(c, X86_RAX, (uint64_t) (uintptr_t) &c->vm->memory[read_dword(ip + 1)]);
+            x86_store(c, X86_RAX, 0, HOST(ip[5]));
+            return true;
+
+        case OP_CONST_RK:
+        {
+            uint32_t index;
+            bytecode_read_uleb128(ip + 2, size - 2, &index);
+            x86_mov_imm(c, HOST(ip[1]), c->vm->constants[index]);
+            return true;
+        }
+
+        case OP_SYSCALL:
+        case OP_SYSCALL_WRITE_CHAR:
+        case OP_SYSCALL_WRITE_INT:
+        case OP_SYSCALL_WRITE_STRING:
+        case OP_SYSCALL_STRING_FROM_INT:
+        case OP_SYSCALL_STRING_CONCAT:
+        case OP_SYSCALL_STRING_EQUALS:
+        case OP_REGDUMP:
+        case OP_STACK_DMP:
+        VECTOR_OPCODE_TABLE(JIT_HANDLER_CASE)
+            emit_handler_call(c, ip);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/*
+ * Names the code of each function the program has a symbol for, and the
+ * code up to the first one as main; perf shows the rest as addresses.
+ */
+static void write_perf_map(const struct jit_compiler *c, const uint8_t *code)
+{
+    const struct bytecode *bytecode = c->bytecode;
+    char path[64];
+
+    snprintf(path, sizeof path, "/tmp/perf-%d.map", (int) getpid());
+
+    FILE *fp = fopen(path, "a");
+
+    if (fp == NULL)
+        return;
+
+    fprintf(fp, "%lx %zx blaze-jit:entry\n", (uintptr_t) code, c->body);
+
+    size_t first = bytecode->size;
+
+    for (size_t i = 0; i < bytecode->symbol_count; i++)
+    {
+        if (bytecode->symbols[i].offset < first)
+            first = bytecode->symbols[i].offset;
+    }
+
+    if (first > 0)
+    {
+        size_t end = first < bytecode->size ? c->native[first] : c->size;
+        fprintf(fp, "%lx %zx blaze-jit:main\n", (uintptr_t) (code + c->body), end - c->body);
+    }
+
+    for (size_t i = 0; i < bytecode->symbol_count; i++)
+    {
+        size_t offset = bytecode->symbols[i].offset;
+        size_t next = bytecode->size;
+
+        if (offset >= bytecode->size || c->native[offset] == JIT_NO_CODE)
+            continue;
+
+        for (size_t j = 0; j < bytecode->symbol_count; j++)
+        {
+            if (bytecode->symbols[j].offset > offset && bytecode->symbols[j].offset < next)
+                next = bytecode->symbols[j].offset;
+        }
+
+        /* Functions are compiled inline, behind a jump, and end with their ret. */
+        for (size_t at = offset, size; at < next; at += size)
+        {
+            size = instruction_get_size(bytecode->bytes + at, bytecode->size - at);
+
+            if (opcode_base(bytecode->bytes[at]) == OP_RET)
+            {
+                next = at + size;
+                break;
+            }
+        }
+
+        size_t end = next < bytecode->size ? c->native[next] : c->size;
+        fprintf(fp, "%lx %zx blaze-jit:%s\n", (uintptr_t) (code + c->native[offset]),
+                end - c->native[offset], bytecode->symbols[i].name);
+    }
+
+    fclose(fp);
+}
+
+static void compiler_free(struct jit_compiler *c)
+{
+    free(c->code);
+    free(c->native);
+    free(c->fixups);
+}
+
+struct jit *jit_compile(struct vm_context *vm)
+{
+    struct bytecode *bytecode = vm->bytecode;
+    struct jit_compiler c = {
+        .vm = vm,
+        .bytecode = bytecode,
+        .native = xmalloc(bytecode->size * sizeof (size_t)),
+        .targets = xcalloc(bytecode->size, sizeof (void *))
+    };
+
+    if (!bytecode->verified)
+    {
+        compiler_free(&c);
+        free(c.targets);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < bytecode->size; i++)
+        c.native[i] = JIT_NO_CODE;
+
+    emit_entry(&c);
+    c.body = c.size;
+
+    for (size_t offset = 0, size; offset < bytecode->size; offset += size)
+    {
+        size = instruction_get_size(vm->code + offset, bytecode->size - offset);
+        c.native[offset] = c.size;
+
+        if (!emit_instruction(&c, vm->code + offset, offset, size))
+        {
+            compiler_free(&c);
+            free(c.targets);
+            return NULL;
+        }
+    }
+
+    /* The verifier made sure that every target is an instruction. */
+    for (size_t i = 0; i < c.fixup_count; i++)
+        patch_rel32(&c, c.fixups[i].at, c.native[c.fixups[i].target]);
+
+    /* Written while writable, then made executable and never both. */
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    size_t code_size = (c.size + page_size - 1) / page_size * page_size;
+    uint8_t *code = mmap(NULL, code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (code == MAP_FAILED)
+    {
+        compiler_free(&c);
+        free(c.targets);
+        return NULL;
+    }
+
+    memcpy(code, c.code, c.size);
+
+    if (mprotect(code, code_size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(code, code_size);
+        compiler_free(&c);
+        free(c.targets);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < bytecode->size; i++)
+    {
+        if (c.native[i] != JIT_NO_CODE)
+            c.targets[i] = code + c.native[i];
+    }
+
+    if (vm->perf_map)
+        write_perf_map(&c, code);
+
+    struct jit *jit = xmalloc(sizeof (struct jit));
+
+    *jit = (struct jit) {
+        .code = code,
+        .code_size = code_size,
+        .targets = c.targets
+    };
+
+    /* Calling data as a function is not ISO C, but POSIX requires it to work. */
+    memcpy(&jit->entry, &code, sizeof code);
+    compiler_free(&c);
+    return jit;
+}
+
+bool jit_run(struct vm_context *vm, struct jit *jit)
+{
+    return jit->entry(jit->targets[vm->entry]) != 0;
+}
+
+void jit_free(struct jit *jit)
+{
+    if (jit == NULL)
+        return;
+
+    munmap(jit->code, jit->code_size);
+    free(jit->targets);
+    free(jit);
+}
+
+#else
+
+struct jit *jit_compile(struct vm_context *vm)
+{
+    (void) vm;
+    return NULL;
+}
+
+bool jit_run(struct vm_context *vm, struct jit *jit)
+{
+    (void) vm;
+    (void) jit;
+    return false;
+}
+
+void jit_free(struct jit *jit)
+{
+    (void) jit;
+}
+
+#endif
@@ -0,0 +1,34 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_JIT_H
+#define BLAZESCRIPT_JIT_H
+
+#include <stdbool.h>
+#include "vm-context.h"
+
+/*
+ * Baseline JIT for x86-64 Linux. It translates verified bytecode into
+ * native code one instruction at a time, with the VM registers kept in
+ * host registers, and calls back into the handlers in opcode.c for
+ * syscalls and the dump instructions. Nothing is optimized across
+ * instructions; what it saves is the decoding and dispatch.
+ *
+ * Instructions that take a jump target or memory slot from a register
+ * are not translated: a program that uses one runs on the interpreter
+ * instead, as does every program on other systems.
+ */
+struct jit;
+
+/*
+ * Translates the program of a context, or returns NULL if it cannot. The
+ * code refers to the memory, constants and code (see execution_code() in
+ * opcode.h) of that context, so it only runs there. With vm->perf_map set, it is described in /tmp/perf-PID.map
+ * for perf.
+ */
+struct jit *jit_compile(struct vm_context *vm);
+bool jit_run(struct vm_context *vm, struct jit *jit);
+void jit_free(struct jit *jit);
+
+#endif /* BLAZESCRIPT_JIT_H */
@@ -4,170 +4,227 @@
 
 #include "map.h"
 #include "alloca.h"
+#include "rcstring.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define VALMAP_DEFAULT_SIZE 4096
-#define FNV_OFFSET_BASIS 0xcbf29ce484222325UL
-#define FNV_PRIME 0x100000001b3UL
+#define MAP_KEY_TYPE_MIX 0x9e3779b97f4a7c15UL
 
-static size_t hash_key(size_t capacity, const char *key)
+/*
+ * String keys hash exactly like string_hash() so that callers holding a
+ * string with a cached hash can pass it along in the key.
+ */
+static uint64_t hash_key(map_key_t key)
 {
-    uint64_t hash = FNV_OFFSET_BASIS;
+    uint64_t hash = key.hash != 0 ? key.hash : string_hash_bytes(key.data, key.length);
+    return hash ^ ((uint64_t) key.type * MAP_KEY_TYPE_MIX);
+}
 
-    for (size_t i = 0; i < strlen(key); i++)
-    {
-        hash ^= key[i];
-        hash *= FNV_PRIME;
-    }
+static inline map_key_t map_string_key(const char *key)
+{
+    return (map_key_t) {
+        .type = MAP_KEY_STRING,
+        .data = key,
+        .length = strlen(key)
+    };
+}
 
-    return (size_t) (hash & (uint64_t)(capacity - 1));
+static void map_init_index(map_t *map, size_t capacity)
+{
+    map->capacity = capacity;
+    map->index = xmalloc(sizeof (size_t) * capacity);
+    map->elements = xrealloc(map->elements, sizeof (map_entry_t) * capacity);
+
+    for (size_t i = 0; i < capacity; i++)
+        map->index[i] = MAP_SLOT_EMPTY;
 }
 
 map_t map_create()
 {
-    return (map_t) {
-        .capacity = MAP_INIT_SIZE,
+    map_t map = {
         .size = 0,
-        .elements = xcalloc(sizeof (map_entry_t), MAP_INIT_SIZE)
+        .entry_count = 0,
+        .elements = NULL
     };
+
+    map_init_index(&map, MAP_INIT_SIZE);
+    return map;
 }
 
-static void map_realloc(map_t *map, size_t new_capacity)
+static size_t map_find_slot(map_t *map, map_key_t key, uint64_t hash)
 {
-    map_entry_t *old_array = map->elements;
-    size_t old_capacity = map->capacity;
-
-    map->elements = xcalloc(1, new_capacity);
-    map->capacity = new_capacity;
+    size_t mask = map->capacity - 1;
+    size_t slot = (size_t) (hash & mask);
 
-    for (size_t i = 0; i < old_capacity; i++)
+    while (map->index[slot] != MAP_SLOT_EMPTY)
     {
-        if (old_array[i].key != NULL)
+        if (map->index[slot] != MAP_SLOT_DELETED)
         {
-            map_set(map, old_array[i].key, old_array[i].value, MAP_CREATE | MAP_OVERWRITE);
-            free(old_array[i].key);
+            map_entry_t *entry = &map->elements[map->index[slot]];
+
+            if (entry->hash == hash && entry->key_type == key.type &&
+                entry->key_length == key.length &&
+                memcmp(entry->key, key.data, key.length) == 0)
+                return slot;
         }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+/*
+ * Rebuilds the index table and squeezes out deleted entries. The table only
+ * grows when most of the used entries are still alive; otherwise reclaiming
+ * the holes is enough.
+ */
+static void map_realloc(map_t *map, size_t new_capacity)
+{
+    size_t live = 0;
+
+    for (size_t i = 0; i < map->entry_count; i++)
+    {
+        if (map->elements[i].key != NULL)
+            map->elements[live++] = map->elements[i];
     }
 
-    free(old_array);
+    free(map->index);
+    map_init_index(map, new_capacity);
+    map->entry_count = live;
+
+    for (size_t i = 0; i < live; i++)
+    {
+        size_t slot = (size_t) (map->elements[i].hash & (new_capacity - 1));
+
+        while (map->index[slot] != MAP_SLOT_EMPTY)
+            slot = (slot + 1) & (new_capacity - 1);
+
+        map->index[slot] = i;
+    }
 }
 
 static void map_check_realloc(map_t *map)
 {
-    if ((((long double) (map->size)) * 1.25) >= map->capacity)
+    if ((((long double) (map->entry_count + 1)) * 1.25) >= map->capacity)
     {
-        map_realloc(map, map->capacity * 2);
+        map_realloc(map, map->size * 2 >= map->entry_count ? map->capacity * 2 : map->capacity);
     }
 }
 
-static const char *valmap_set_entry(map_entry_t *array,
-    size_t capacity, const char *key, void *value, size_t *element_count,
-    void **old_element,
-    unsigned int flags, unsigned int *result_flags)
+unsigned int map_set_key(map_t *map, map_key_t key, void *value, void **old_element, unsigned int flags)
 {
-    size_t index = hash_key(capacity, key);
+    unsigned int result = 0;
+    uint64_t hash = hash_key(key);
+    size_t slot = map_find_slot(map, key, hash);
 
-    while (array[index].key != NULL)
+    if (map->index[slot] != MAP_SLOT_EMPTY)
     {
-        if (strcmp(array[index].key, key) == 0)
+        map_entry_t *entry = &map->elements[map->index[slot]];
+
+        if ((flags & MAP_OVERWRITE) != MAP_OVERWRITE)
+            return result | MAP_RESULT_NOT_OVERWRITTEN;
+
+        if (old_element != NULL)
+            *old_element = entry->value;
+
+        if ((flags & MAP_FREE_ON_OVERWRITE) == MAP_FREE_ON_OVERWRITE)
         {
-            if ((flags & MAP_OVERWRITE) == MAP_OVERWRITE)
-            {
-                if (old_element != NULL)
-                {
-                    *old_element = array[index].value;
-                }
-
-                if ((flags & MAP_FREE_ON_OVERWRITE) == MAP_FREE_ON_OVERWRITE)
-                {
-                    if (result_flags != NULL)
-                        *result_flags |= MAP_RESULT_FREED_ON_OVERWRITE;
-
-                    free(array[index].value);
-                }
-
-                array[index].value = value;
-                return array[index].key;
-            }
-            else
-            {
-                if (result_flags != NULL)
-                    *result_flags |= MAP_RESULT_NOT_OVERWRITTEN;
-                return NULL;
-            }
+            result |= MAP_RESULT_FREED_ON_OVERWRITE;
+            free(entry->value);
         }
 
-        index++;
-
-        if (index >= capacity)
-            index = 0;
+        entry->value = value;
+        return result;
     }
 
-    if ((flags & MAP_CREATE) == MAP_CREATE)
-    {
-        array[index].key = strdup(key);
-        array[index].value = value;
+    if ((flags & MAP_CREATE) != MAP_CREATE)
+        return result | MAP_RESULT_NOT_CREATED;
 
-        if (element_count != NULL)
-            (*element_count)++;
+    map_check_realloc(map);
+    slot = map_find_slot(map, key, hash);
 
-        return array[index].key;
-    }
+    map_entry_t *entry = &map->elements[map->entry_count];
 
-    if (result_flags != NULL)
-        *result_flags |= MAP_RESULT_NOT_CREATED;
+    entry->key = xmalloc(key.length + 1);
+    memcpy(entry->key, key.data, key.length);
+    entry->key[key.length] = 0;
+    entry->key_length = key.length;
+    entry->key_type = key.type;
+    entry->hash = hash;
+    entry->value = value;
 
-    return NULL;
+    map->index[slot] = map->entry_count++;
+    map->size++;
+    return result;
 }
 
 unsigned int map_set(map_t *map, char *key, void *value, unsigned int flags)
 {
-    unsigned int result = 0;
-    map_check_realloc(map);
-    valmap_set_entry(map->elements, map->capacity, key, value, &map->size, NULL, flags, &result);
-    return result;
+    return map_set_key(map, map_string_key(key), value, NULL, flags);
 }
 
 unsigned int map_set_ret(map_t *map, char *key, void *value, void **old_element, unsigned int flags)
 {
-    unsigned int result = 0;
-    map_check_realloc(map);
-    valmap_set_entry(map->elements, map->capacity, key, value, &map->size, old_element, flags, &result);
-    return result;
+    return map_set_key(map, map_string_key(key), value, old_element, flags);
+}
+
+map_entry_t *map_get_entry(map_t *map, map_key_t key)
+{
+    size_t slot = map_find_slot(map, key, hash_key(key));
+
+    if (map->index[slot] == MAP_SLOT_EMPTY)
+        return NULL;
+
+    return &map->elements[map->index[slot]];
 }
 
 void *map_get(map_t *map, const char *key)
 {
-    size_t index = hash_key(map->capacity, key);
+    map_entry_t *entry = map_get_entry(map, map_string_key(key));
+    return entry == NULL ? NULL : entry->value;
+}
 
-    while (map->elements[index].key != NULL)
-    {
-        if (strcmp(map->elements[index].key, key) == 0)
-        {
-            return map->elements[index].value;
-        }
+bool map_delete_key(map_t *map, map_key_t key, void **old_element)
+{
+    size_t slot = map_find_slot(map, key, hash_key(key));
 
-        index++;
+    if (map->index[slot] == MAP_SLOT_EMPTY)
+        return false;
 
-        if (index >= map->capacity)
-            index = 0;
-    }
+    map_entry_t *entry = &map->elements[map->index[slot]];
+
+    if (old_element != NULL)
+        *old_element = entry->value;
 
-    return NULL;
+    free(entry->key);
+    entry->key = NULL;
+    entry->value = NULL;
+    map->index[slot] = MAP_SLOT_DELETED;
+    map->size--;
+    return true;
+}
+
+bool map_delete(map_t *map, const char *key, void **old_element)
+{
+    return map_delete_key(map, map_string_key(key), old_element);
 }
 
 void map_print(map_t *map)
 {
     printf("Map (%zu) {%s", map->size, map->size > 0 ? "\n" : "");
 
-    for (size_t i = 0; i < map->capacity; i++)
+    MAP_FOREACH(map)
     {
-        if (map->elements[i].key != NULL)
+        if (map->elements[i].key_type == MAP_KEY_INTEGER)
         {
-            printf("    \"%s\" (%zu) => %p\n", map->elements[i].key, i, map->elements[i].value);
+            long long int intkey;
+            memcpy(&intkey, map->elements[i].key, sizeof intkey);
+            printf("    %lld (%zu) => %p\n", intkey, i, map->elements[i].value);
         }
+        else
+            printf("    \"%s\" (%zu) => %p\n", map->elements[i].key, i, map->elements[i].value);
     }
 
     printf("}\n");
@@ -175,5 +232,15 @@ void map_print(map_t *map)
 
 void map_free(map_t *map)
 {
+    MAP_FOREACH(map)
+    {
+        free(map->elements[i].key);
+    }
+
     free(map->elements);
-}
\ No newline at end of file
+    free(map->index);
+    map->elements = NULL;
+    map->index = NULL;
+    map->size = 0;
+    map->entry_count = 0;
+}
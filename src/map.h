@@ -5,10 +5,21 @@
 #ifndef BLAZESCRIPT_MAP_H
 #define BLAZESCRIPT_MAP_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-#define MAP_INIT_SIZE 4096
+#define MAP_INIT_SIZE 16
+#define MAP_SLOT_EMPTY ((size_t) -1)
+#define MAP_SLOT_DELETED ((size_t) -2)
+
+/*
+ * Iterates over the live entries of a map in insertion order. Deleted
+ * entries leave a hole (key == NULL) until the next rehash.
+ */
+#define MAP_FOREACH(map) \
+    for (size_t i = 0; i < (map)->entry_count; i++) \
+        if ((map)->elements[i].key != NULL)
 
 enum map_set_flags {
     MAP_OVERWRITE = 0b00001,
@@ -22,14 +33,36 @@ enum map_set_result_flags {
     MAP_RESULT_FREED_ON_OVERWRITE = 0b00100
 };
 
+enum map_key_type {
+    MAP_KEY_STRING,
+    MAP_KEY_INTEGER
+};
+
+/* A hash of 0 means the map has to compute it from the key bytes. */
+typedef struct {
+    enum map_key_type type;
+    const char *data;
+    size_t length;
+    uint64_t hash;
+} map_key_t;
+
 typedef struct {
     char *key;
+    size_t key_length;
+    enum map_key_type key_type;
+    uint64_t hash;
     void *value;
 } map_entry_t;
 
+/*
+ * The map keeps its entries in a dense, insertion-ordered array and uses
+ * a separate open-addressing table of entry indexes for lookups.
+ */
 typedef struct {
     size_t capacity;
     size_t size;
+    size_t entry_count;
+    size_t *index;
     map_entry_t *elements;
 } map_t;
 
@@ -39,5 +72,10 @@ void map_print(map_t *map);
 void map_free(map_t *map);
 void *map_get(map_t *map, const char *key);
 unsigned int map_set_ret(map_t *map, char *key, void *value, void **old_element, unsigned int flags);
+bool map_delete(map_t *map, const char *key, void **old_element);
+
+unsigned int map_set_key(map_t *map, map_key_t key, void *value, void **old_element, unsigned int flags);
+map_entry_t *map_get_entry(map_t *map, map_key_t key);
+bool map_delete_key(map_t *map, map_key_t key, void **old_element);
 
 #endif /* BLAZESCRIPT_MAP_H */
@@ -4,157 +4,351 @@
 
 #include "opcode.h"
 #include "bytecode.h"
+#include "datatype.h"
+#include "jit.h"
+#include "rcstring.h"
 #include "register.h"
 #include "stack.h"
+#include "utils.h"
+#include "vm-context.h"
+#include "vm-profile.h"
+#include "vm-recorder.h"
+#include "vm-snapshot.h"
+#include "vm-vector.h"
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
-#define STACK_SIZE 4096
+/* Reserved, not committed: pages are only backed once recursion reaches them. */
+#define STACK_SIZE (64 * 1024 * 1024)
 #define OPCODE_HANDLER_REF(inst) blazevm__opcode_handler__##inst
-#define OPCODE_HANDLER(inst) uint8_t *blazevm__opcode_handler__##inst(struct bytecode *bytecode, uint8_t *ip)
-
-OPCODE_HANDLER(mov_ir);
-OPCODE_HANDLER(add_rr);
-OPCODE_HANDLER(regdump);
-OPCODE_HANDLER(stackdmp);
-OPCODE_HANDLER(syscall);
-OPCODE_HANDLER(push_r_b);
-OPCODE_HANDLER(pop_r_b);
-
-static const size_t opcode_operand_sizes_lut[OPCODE_COUNT][2] = {
-    [OP_NO_OP] = {0, 0},
-    [OP_HLT] = {0, 0},
-    [OP_MOV_IR] = {1, 8},
-    [OP_ADD_RR] = {1, 1},
-    [OP_SYSCALL] = {0, 0},
-    [OP_REGDUMP] = {0, 0},
-    [OP_STACK_DMP] = {0, 0},
-    [OP_PUSH_R_B] = {1, 0},
-    [OP_POP_R_B] = {1, 0},
-};
+#define OPCODE_HANDLER(inst) uint8_t *blazevm__opcode_handler__##inst(struct vm_context *vm, uint8_t *ip)
+
+#define OPCODE_HANDLER_DECL(opcode, handler, mnemonic, a, b, c) OPCODE_HANDLER(handler);
+OPCODE_TABLE(OPCODE_HANDLER_DECL)
 
-static const addressing_mode_t opcode_operand_addrmode_lut[OPCODE_COUNT][2] = {
-    [OP_HLT] = {AM_NONE, AM_NONE},
-    [OP_NO_OP] = {AM_NONE, AM_NONE},
-    [OP_MOV_IR] = {AM_REGISTER, AM_IMMEDIATE},
-    [OP_ADD_RR] = {AM_REGISTER, AM_REGISTER},
-    [OP_SYSCALL] = {AM_NONE, AM_NONE},
-    [OP_REGDUMP] = {AM_NONE, AM_NONE},
-    [OP_STACK_DMP] = {AM_NONE, AM_NONE},
-    [OP_PUSH_R_B] = {AM_REGISTER, AM_NONE},
-    [OP_POP_R_B] = {AM_REGISTER, AM_NONE},
+/* Superinstructions take their operands from parts[0]. */
+struct opcode_info
+{
+    const char *mnemonic;
+    operand_info_t operands[OPCODE_MAX_OPERANDS];
+    bool superinstruction;
+    opcode_t parts[2];
 };
 
-static const char *opcode_to_str_lut[] = {
-    [OP_NO_OP] = "noop",
-    [OP_HLT] = "hlt",
-    [OP_MOV_IR] = "mov",
-    [OP_ADD_RR] = "add",
-    [OP_SYSCALL] = "syscall",
-    [OP_REGDUMP] = "regdump",
-    [OP_STACK_DMP] = "stackdmp",
-    [OP_PUSH_R_B] = "pushb",
-    [OP_POP_R_B] = "popb",
+#define OPCODE_INFO_ENTRY(opcode, handler, mnemonic, a, b, c) \
+    [opcode] = { mnemonic, { OPERAND_##a, OPERAND_##b, OPERAND_##c }, false, { opcode, opcode } },
+#define SUPERINSTRUCTION_INFO_ENTRY(first, second, mnemonic) \
+    [SUPERINSTRUCTION_OPCODE(first, second)] = { mnemonic, { OPERAND_NONE }, true, { OP_##first, OP_##second } },
+
+static const struct opcode_info opcode_info_lut[OPCODE_COUNT] = {
+    OPCODE_TABLE(OPCODE_INFO_ENTRY)
+    SUPERINSTRUCTION_TABLE(SUPERINSTRUCTION_INFO_ENTRY)
 };
 
-static uint8_t *((*handlers_lut[])(struct bytecode *bytecode, uint8_t *ip)) = {
-    [OP_NO_OP] = NULL,
-    [OP_HLT] = NULL,
-    [OP_MOV_IR] = OPCODE_HANDLER_REF(mov_ir),
-    [OP_ADD_RR] = OPCODE_HANDLER_REF(add_rr),
-    [OP_SYSCALL] = OPCODE_HANDLER_REF(syscall),
-    [OP_REGDUMP] = OPCODE_HANDLER_REF(regdump),
-    [OP_STACK_DMP] = OPCODE_HANDLER_REF(stackdmp),
-    [OP_PUSH_R_B] = OPCODE_HANDLER_REF(push_r_b),
-    [OP_POP_R_B] = OPCODE_HANDLER_REF(pop_r_b),
+#define OPCODE_HANDLER_ENTRY(opcode, handler, mnemonic, a, b, c) [opcode] = OPCODE_HANDLER_REF(handler),
+
+static uint8_t *((*handlers_lut[])(struct vm_context *vm, uint8_t *ip)) = {
+    OPCODE_TABLE(OPCODE_HANDLER_ENTRY)
 };
 
-static blaze_stack_t stack;
+opcode_t opcode_base(opcode_t opcode)
+{
+    assert(opcode < OPCODE_COUNT && "Invalid opcode");
+    return opcode_info_lut[opcode].parts[0];
+}
+
+#define QUICKENED_OPCODE_CASE(opcode, handler, mnemonic, a, b, c) case opcode:
+
+opcode_t opcode_generic(opcode_t opcode)
+{
+    switch (opcode_base(opcode))
+    {
+        QUICKENED_OPCODE_TABLE(QUICKENED_OPCODE_CASE)
+            return OP_SYSCALL;
+
+        default:
+            return opcode_base(opcode);
+    }
+}
+
+bool opcode_get_superinstruction(opcode_t opcode, opcode_t *first, opcode_t *second)
+{
+    if (opcode >= OPCODE_COUNT || !opcode_info_lut[opcode].superinstruction)
+        return false;
+
+    *first = opcode_info_lut[opcode].parts[0];
+    *second = opcode_info_lut[opcode].parts[1];
+    return true;
+}
 
 size_t opcode_get_size(opcode_t opcode)
 {
-    if ((sizeof (opcode_operand_sizes_lut) / sizeof (opcode_operand_sizes_lut[0])) <= opcode)
+    if (opcode >= OPCODE_COUNT)
         return 1;
 
-    size_t size = (opcode_operand_sizes_lut[opcode][0] +
-                  opcode_operand_sizes_lut[opcode][1]) + 1;
+    opcode = opcode_base(opcode);
+    size_t size = 1;
+
+    for (size_t i = 0; i < OPCODE_MAX_OPERANDS; i++)
+        size += opcode_info_lut[opcode].operands[i].size;
 
-    return size < 1 ? 1 : size;
+    return size;
 }
 
-void opcode_get_operand_info(opcode_t opcode, operand_info_t info[2])
+size_t instruction_get_size(const uint8_t *ip, size_t available)
 {
-    assert(opcode < (sizeof (opcode_operand_sizes_lut) / sizeof (opcode_operand_sizes_lut[0])) && "Invalid opcode");
-    const size_t *ptr_sizes = (const size_t *) *(opcode_operand_sizes_lut + opcode);
-    addressing_mode_t *ptr_addrmodes = (addressing_mode_t *) *(opcode_operand_addrmode_lut + opcode);
+    if (available == 0)
+        return 0;
 
-    operand_info_t info1 = {
-        .size = ptr_sizes[0],
-        .addrmode = ptr_addrmodes[0]
-    };
+    opcode_t opcode = *ip;
+    size_t size = opcode_get_size(opcode);
 
-    operand_info_t info2 = {
-        .size = ptr_sizes[1],
-        .addrmode = ptr_addrmodes[1]
-    };
+    if (size > available)
+        return 0;
+
+    if (opcode >= OPCODE_COUNT)
+        return size;
+
+    /* A constant index is the last operand, and at least one byte long. */
+    for (size_t i = 0; i < OPCODE_MAX_OPERANDS; i++)
+    {
+        if (opcode_info_lut[opcode_base(opcode)].operands[i].addrmode == AM_CONSTANT)
+        {
+            uint32_t index;
+            size_t length = bytecode_read_uleb128(ip + size - 1, available - (size - 1), &index);
+
+            return length == 0 ? 0 : size - 1 + length;
+        }
+    }
+
+    return size;
+}
 
-    info[0] = info1;
-    info[1] = info2;
+void opcode_get_operand_info(opcode_t opcode, operand_info_t info[OPCODE_MAX_OPERANDS])
+{
+    opcode = opcode_base(opcode);
+    memcpy(info, opcode_info_lut[opcode].operands, sizeof (opcode_info_lut[opcode].operands));
 }
 
 const char *opcode_to_str(opcode_t opcode)
 {
-    assert(opcode < (sizeof (opcode_to_str_lut) / sizeof (opcode_to_str_lut[0])) && "Invalid opcode");
-    return opcode_to_str_lut[opcode];
+    assert(opcode < OPCODE_COUNT && "Invalid opcode");
+    return opcode_info_lut[opcode].mnemonic;
 }
 
-uint8_t *instruction_exec(opcode_t opcode, struct bytecode *bytecode)
+uint8_t *instruction_exec(struct vm_context *vm, opcode_t opcode)
 {
-    if (opcode >= (sizeof (handlers_lut) / sizeof (handlers_lut[0])))
+    if (opcode >= OPCODE_COUNT)
     {
-        bytecode_error = xmalloc(22);
-        sprintf(bytecode_error, "Invalid opcode: 0x%02x", opcode);
+        vm->error = xmalloc(22);
+        sprintf(vm->error, "Invalid opcode: 0x%02x", opcode);
         return NULL;
     }
 
-    if (handlers_lut[opcode] == NULL)
-        return NULL;
+    /* The second instruction of a superinstruction runs on its own afterwards. */
+    return handlers_lut[opcode_base(opcode)](vm, (uint8_t *) vm->registers[IP]);
+}
+
+bool validate_register(struct vm_context *vm, register_type_t id)
+{
+    if (id >= REG_OPERAND_COUNT)
+    {
+        vm->error = xmalloc(25);
+        sprintf(vm->error, "Invalid register: 0x%02x", id);
+        return false;
+    }
+
+    return true;
+}
+
+bool validate_memory(struct vm_context *vm, uint64_t slot)
+{
+    if (slot >= vm->memory_size)
+    {
+        vm->error = xmalloc(48);
+        sprintf(vm->error, "Invalid memory address: 0x%08lx", slot);
+        return false;
+    }
+
+    return true;
+}
+
+static bool validate_vector_register(struct vm_context *vm, uint8_t id)
+{
+    if (id >= VREG_COUNT)
+    {
+        vm->error = xmalloc(32);
+        sprintf(vm->error, "Invalid vector register: 0x%02x", id);
+        return false;
+    }
+
+    return true;
+}
+
+/* Vector instructions reach the slot and the three after it. */
+static bool validate_vector_memory(struct vm_context *vm, uint64_t slot)
+{
+    if (vm->memory_size < VM_VECTOR_LANES || slot > vm->memory_size - VM_VECTOR_LANES)
+    {
+        vm->error = xmalloc(48);
+        sprintf(vm->error, "Invalid memory address: 0x%08lx", slot);
+        return false;
+    }
+
+    return true;
+}
+
+/* Checks that a frame access lands between the bottom and the top of the stack. */
+static bool validate_frame(struct vm_context *vm, const uint64_t *address, uint64_t sp)
+{
+    if (address < vm->stack.base || address >= (const uint64_t *) sp)
+    {
+        vm->error = strdup("Frame access out of range");
+        return false;
+    }
+
+    return true;
+}
+
+/* enter moves %sp past the locals at once, so it cannot rely on the guard page. */
+static bool validate_enter(struct vm_context *vm, uint32_t locals, uint64_t sp)
+{
+    if (locals >= (size_t) (vm->stack.limit - (uint64_t *) sp))
+    {
+        vm->error = strdup("VM stack overflow");
+        return false;
+    }
 
-    return handlers_lut[opcode](bytecode, (uint8_t *) registers[IP]);
+    return true;
 }
 
-bool validate_register(struct bytecode *bytecode, register_type_t id)
+bool validate_constant(struct vm_context *vm, uint32_t index)
 {
-    if (!is_valid_register_id(id))
+    if (index >= vm->bytecode->constant_count)
     {
-        bytecode_error = xmalloc(25);
-        sprintf(bytecode_error, "Invalid register: 0x%02x", id);
+        vm->error = xmalloc(40);
+        sprintf(vm->error, "Invalid constant index: 0x%08x", index);
         return false;
     }
 
     return true;
 }
 
-void execution_init()
+/* Everything the program can reach objects through; see vm_heap_roots_t. */
+static void execution_heap_roots(struct vm_heap *heap)
+{
+    struct vm_context *vm = (struct vm_context *) ((char *) heap - offsetof(struct vm_context, heap));
+
+    vm_heap_mark(heap, vm->registers, REG_OPERAND_COUNT);
+    vm_heap_mark(heap, (uint64_t *) vm->vectors, VREG_COUNT * VM_VECTOR_LANES);
+    vm_heap_mark(heap, vm->stack.base, (size_t) ((uint64_t *) vm->registers[SP] - vm->stack.base));
+    vm_heap_mark(heap, vm->memory, vm->memory_size);
+}
+
+void execution_init(struct vm_context *vm, struct bytecode *bytecode)
+{
+    *vm = (struct vm_context) {
+        .stack = blaze_stack_create(STACK_SIZE),
+        .memory_size = bytecode->data_size,
+        .bytecode = bytecode,
+        .superinstructions = true
+    };
+
+    vm_io_init(&vm->io);
+
+    vm->registers[SP] = (uint64_t) vm->stack.base;
+    vm->registers[FP] = (uint64_t) vm->stack.base;
+    vm->memory = xcalloc(vm->memory_size == 0 ? 1 : vm->memory_size, sizeof (uint64_t));
+    vm->constants = xcalloc(bytecode->constant_count == 0 ? 1 : bytecode->constant_count, sizeof (uint64_t));
+    vm_heap_init(&vm->heap, execution_heap_roots);
+
+    /* String constants are copied into the heap once, and never collected. */
+    for (size_t i = 0; i < bytecode->constant_count; i++)
+    {
+        string_t *string = (string_t *) bytecode->constants[i];
+
+        if (bytecode->constant_types[i] != BYTECODE_CONST_STRING)
+            vm->constants[i] = bytecode->constants[i];
+        else if ((vm->constants[i] = vm_heap_string(&vm->heap, string_flatten(string), string->length)) == 0)
+            fatal_error("the string constants do not fit in the VM heap");
+    }
+
+    vm_heap_pin(&vm->heap);
+}
+
+void execution_end(struct vm_context *vm)
+{
+    jit_free(vm->native);
+    vm_recorder_free(vm->recorder);
+    vm_profile_free(vm->profile);
+    vm_io_free(&vm->io);
+    vm_heap_free(&vm->heap);
+    free(vm->constants);
+    blaze_stack_free(&vm->stack);
+    free(vm->memory);
+    free(vm->error);
+    free(vm->quickening);
+
+    if (vm->code != vm->bytecode->bytes)
+        free(vm->code);
+
+    vm->code = NULL;
+    vm->quickening = NULL;
+    vm->memory = NULL;
+    vm->constants = NULL;
+    vm->recorder = NULL;
+    vm->profile = NULL;
+    vm->memory_size = 0;
+    vm->error = NULL;
+    vm->native = NULL;
+}
+
+/*
+ * Signed division and remainder. INT64_MIN / -1 overflows, which is
+ * undefined behaviour in C and traps on x86, so it wraps around instead.
+ */
+static inline uint64_t vm_div(int64_t a, int64_t b)
+{
+    return b == -1 ? (uint64_t) 0 - (uint64_t) a : (uint64_t) (a / b);
+}
+
+static inline uint64_t vm_mod(int64_t a, int64_t b)
+{
+    return b == -1 ? 0 : (uint64_t) (a % b);
+}
+
+static inline uint32_t operand_dword(struct vm_context *vm, uint8_t *ip)
+{
+    return bytecode_get_dword(vm->bytecode, (size_t) (ip - vm->registers[IS]));
+}
+
+OPCODE_HANDLER(noop)
 {
-    stack = blaze_stack_create(STACK_SIZE);
+    (void) vm;
+    (void) ip;
+    return NULL;
 }
 
-void execution_end()
-{ blaze_stack_free(&stack);
+/* Never called: the dispatch loops stop before running hlt. */
+OPCODE_HANDLER(hlt)
+{
+    (void) vm;
+    (void) ip;
+    return NULL;
 }
 
 OPCODE_HANDLER(push_r_b)
 {
     const uint8_t reg_id = *++ip;
 
-    if (!validate_register(bytecode, reg_id))
+    if (!validate_register(vm, reg_id))
         return NULL;
 
-    blaze_stack_push_byte(&stack, registers[reg_id] & 0xFF);
+    blaze_stack_push(&vm->registers[SP], vm->registers[reg_id] & 0xFF);
     return ++ip;
 }
 
@@ -162,10 +356,10 @@ OPCODE_HANDLER(pop_r_b)
 {
     const uint8_t reg_id = *++ip;
 
-    if (!validate_register(bytecode, reg_id))
+    if (!validate_register(vm, reg_id))
         return NULL;
 
-    registers[reg_id] = blaze_stack_pop_byte(&stack);
+    vm->registers[reg_id] = blaze_stack_pop(&vm->registers[SP]) & 0xFF;
     return ++ip;
 }
 
@@ -173,108 +367,1225 @@ OPCODE_HANDLER(mov_ir)
 {
     const uint8_t reg_id = *++ip;
 
-    if (!validate_register(bytecode, reg_id))
+    if (!validate_register(vm, reg_id))
         return NULL;
 
-    registers[reg_id] = bytecode_get_qword(bytecode, (size_t) (ip + 1 - registers[IS]));
+    vm->registers[reg_id] = bytecode_get_qword(vm->bytecode, (size_t) (ip + 1 - vm->registers[IS]));
     ip += 9;
     return ip;
 }
 
+OPCODE_HANDLER(mov_ir8)
+{
+    const uint8_t reg_id = *++ip;
+
+    if (!validate_register(vm, reg_id))
+        return NULL;
+
+    vm->registers[reg_id] = (uint64_t) (int64_t) (int8_t) *++ip;
+    return ++ip;
+}
+
+OPCODE_HANDLER(mov_ir32)
+{
+    const uint8_t reg_id = *++ip;
+
+    if (!validate_register(vm, reg_id))
+        return NULL;
+
+    vm->registers[reg_id] = (uint64_t) (int64_t) (int32_t) operand_dword(vm, ip + 1);
+    return ip + 5;
+}
+
 OPCODE_HANDLER(add_rr)
 {
-    const uint8_t reg1_id = *++ip;
-    const uint8_t reg2_id = *++ip;
+    const uint8_t pair = *++ip;
+    const uint8_t reg1_id = REG_PAIR_FIRST(pair);
+    const uint8_t reg2_id = REG_PAIR_SECOND(pair);
 
-    if (!validate_register(bytecode, reg1_id) ||
-        !validate_register(bytecode, reg2_id))
+    if (!validate_register(vm, reg1_id) ||
+        !validate_register(vm, reg2_id))
         return NULL;
 
-    registers[reg1_id] += registers[reg2_id];
+    vm->registers[reg1_id] += vm->registers[reg2_id];
     return ++ip;
 }
 
-OPCODE_HANDLER(regdump)
+/*
+ * Defines a handler for an instruction of the form "op %a, %b" that stores
+ * the result in %a. Both operands are treated as signed integers.
+ */
+#define OPCODE_HANDLER_RR(inst, expr)                                        \
+    OPCODE_HANDLER(inst)                                                     \
+    {                                                                        \
+        const uint8_t pair = *++ip;                                          \
+        const uint8_t reg1_id = REG_PAIR_FIRST(pair);                        \
+        const uint8_t reg2_id = REG_PAIR_SECOND(pair);                       \
+                                                                             \
+        if (!validate_register(vm, reg1_id) ||                         \
+            !validate_register(vm, reg2_id))                           \
+            return NULL;                                                     \
+                                                                             \
+        int64_t a = (int64_t) vm->registers[reg1_id];                            \
+        int64_t b = (int64_t) vm->registers[reg2_id];                            \
+        (void) a;                                                            \
+        vm->registers[reg1_id] = (uint64_t) (expr);                              \
+        return ++ip;                                                         \
+    }
+
+OPCODE_HANDLER_RR(mov_rr, b)
+OPCODE_HANDLER_RR(sub_rr, a - b)
+OPCODE_HANDLER_RR(mul_rr, a * b)
+OPCODE_HANDLER_RR(eq_rr, a == b)
+OPCODE_HANDLER_RR(ne_rr, a != b)
+OPCODE_HANDLER_RR(lt_rr, a < b)
+OPCODE_HANDLER_RR(le_rr, a <= b)
+OPCODE_HANDLER_RR(gt_rr, a > b)
+OPCODE_HANDLER_RR(ge_rr, a >= b)
+
+OPCODE_HANDLER(mod_rr)
 {
-    puts("\n*** regdump:\n");
-    for (size_t i = 0; i < REG_COUNT; i++)
+    const uint8_t pair = *++ip;
+    const uint8_t reg1_id = REG_PAIR_FIRST(pair);
+    const uint8_t reg2_id = REG_PAIR_SECOND(pair);
+
+    if (!validate_register(vm, reg1_id) ||
+        !validate_register(vm, reg2_id))
+        return NULL;
+
+    if (vm->registers[reg2_id] == 0)
     {
-        printf("\033[1;34m%%%s\033[0m     \033[1;32m0x%016lx\033[0m\n",
-               register_id_to_str(i),
-               registers[i]);
+        vm->error = strdup("Division by zero");
+        return NULL;
     }
 
-    return NULL;
+    vm->registers[reg1_id] = vm_mod((int64_t) vm->registers[reg1_id], (int64_t) vm->registers[reg2_id]);
+    return ++ip;
 }
 
-OPCODE_HANDLER(stackdmp)
+OPCODE_HANDLER(div_rr)
 {
-    puts("\n*** stack dump:\n");
+    const uint8_t pair = *++ip;
+    const uint8_t reg1_id = REG_PAIR_FIRST(pair);
+    const uint8_t reg2_id = REG_PAIR_SECOND(pair);
+
+    if (!validate_register(vm, reg1_id) ||
+        !validate_register(vm, reg2_id))
+        return NULL;
 
-    for (size_t i = (stack.index < 10 ? 0 : (stack.index - 10)), c = 0; c < stack.size && c < 10; c++, i++)
+    if (vm->registers[reg2_id] == 0)
     {
-        printf("%s\033[1;34m[%zu]\033[0m:     \033[1;32m0x%02x\033[0m\n",
-               stack.index == i ? " => " : "    ",
-               i,
-               stack.bytes[i]);
+        vm->error = strdup("Division by zero");
+        return NULL;
     }
 
-    return NULL;
+    vm->registers[reg1_id] = vm_div((int64_t) vm->registers[reg1_id], (int64_t) vm->registers[reg2_id]);
+    return ++ip;
 }
 
-OPCODE_HANDLER(syscall)
+OPCODE_HANDLER(jmp)
+{
+    return (uint8_t *) vm->registers[IS] + operand_dword(vm, ip + 1);
+}
+
+OPCODE_HANDLER(jz_r)
 {
-    uint64_t r0 = registers[R0];
+    const uint8_t reg_id = *++ip;
 
-    switch (r0)
+    if (!validate_register(vm, reg_id))
+        return NULL;
+
+    if (vm->registers[reg_id] == 0)
+        return (uint8_t *) vm->registers[IS] + operand_dword(vm, ip + 1);
+
+    return ip + 5;
+}
+
+OPCODE_HANDLER(jnz_r)
+{
+    const uint8_t reg_id = *++ip;
+
+    if (!validate_register(vm, reg_id))
+        return NULL;
+
+    if (vm->registers[reg_id] != 0)
+        return (uint8_t *) vm->registers[IS] + operand_dword(vm, ip + 1);
+
+    return ip + 5;
+}
+
+/* Defines a handler for "jcc %a, %b, target", comparing signed integers. */
+#define OPCODE_HANDLER_JCC_RR(inst, expr)                                    \
+    OPCODE_HANDLER(inst)                                                     \
+    {                                                                        \
+        const uint8_t pair = *++ip;                                          \
+        const uint8_t reg1_id = REG_PAIR_FIRST(pair);                        \
+        const uint8_t reg2_id = REG_PAIR_SECOND(pair);                       \
+                                                                             \
+        if (!validate_register(vm, reg1_id) ||                         \
+            !validate_register(vm, reg2_id))                           \
+            return NULL;                                                     \
+                                                                             \
+        int64_t a = (int64_t) vm->registers[reg1_id];                            \
+        int64_t b = (int64_t) vm->registers[reg2_id];                            \
+                                                                             \
+        if (expr)                                                            \
+            return (uint8_t *) vm->registers[IS] + operand_dword(vm, ip + 1); \
+                                                                             \
+        return ip + 5;                                                       \
+    }
+
+OPCODE_HANDLER_JCC_RR(jeq_rr, a == b)
+OPCODE_HANDLER_JCC_RR(jne_rr, a != b)
+OPCODE_HANDLER_JCC_RR(jlt_rr, a < b)
+OPCODE_HANDLER_JCC_RR(jle_rr, a <= b)
+OPCODE_HANDLER_JCC_RR(jgt_rr, a > b)
+OPCODE_HANDLER_JCC_RR(jge_rr, a >= b)
+
+static bool validate_indirect_target(struct vm_context *vm, uint64_t target)
+{
+    if (target >= vm->bytecode->size)
     {
-        case SYS_EXIT:
-        {
-            uint64_t r1 = registers[R1];
-            bytecode_exit_code = r1;
-            break;
-        }
+        vm->error = xmalloc(48);
+        sprintf(vm->error, "Jump target out of range: 0x%08lx", target);
+        return false;
+    }
 
-        case SYS_REGDUMP:
-        {
-            OPCODE_HANDLER_REF(regdump)(bytecode, ip);
-            break;
-        }
+    return true;
+}
 
-        case SYS_STACK_DUMP:
-        {
-            OPCODE_HANDLER_REF(stackdmp)(bytecode, ip);
-            break;
-        }
+OPCODE_HANDLER(jmp_r)
+{
+    const uint8_t reg_id = *++ip;
 
-        case SYS_PRINT:
-        {
-            uint64_t r1 = registers[R1];
-            uint64_t r2 = registers[R2];
-
-            if (r1 == 0x00)
-                printf("%llu\n", r2);
-            else if (r1 == 0x01)
-                printf("%p\n", (uint8_t *) r2);
-            else if (r1 == 0x02)
-                printf("%s\n", (char *) r2);
-            else if (r1 == 0x03)
-                printf("%c\n", (char) r2);
-            else
-            {
-                bytecode_error = xmalloc(35);
-                sprintf(bytecode_error, "Invalid value type: 0x%02lx", r1);
-                return NULL;
-            }
-            
-            break;
-        }
+    if (!validate_register(vm, reg_id) || !validate_indirect_target(vm, vm->registers[reg_id]))
+        return NULL;
 
-        default:
-            bytecode_error = xmalloc(30);
-            sprintf(bytecode_error, "Invalid syscall: 0x%02lx", r0);
-            return NULL;
+    return (uint8_t *) vm->registers[IS] + vm->registers[reg_id];
+}
+
+OPCODE_HANDLER(call_r)
+{
+    const uint8_t reg_id = *++ip;
+
+    if (!validate_register(vm, reg_id) || !validate_indirect_target(vm, vm->registers[reg_id]))
+        return NULL;
+
+    blaze_stack_push(&vm->registers[SP], (uint64_t) (ip + 1));
+    return (uint8_t *) vm->registers[IS] + vm->registers[reg_id];
+}
+
+OPCODE_HANDLER(call)
+{
+    blaze_stack_push(&vm->registers[SP], (uint64_t) (ip + 5));
+    return (uint8_t *) vm->registers[IS] + operand_dword(vm, ip + 1);
+}
+
+OPCODE_HANDLER(ret)
+{
+    (void) ip;
+    return (uint8_t *) blaze_stack_pop(&vm->registers[SP]);
+}
+
+OPCODE_HANDLER(push_r_q)
+{
+    const uint8_t reg_id = *++ip;
+
+    if (!validate_register(vm, reg_id))
+        return NULL;
+
+    blaze_stack_push(&vm->registers[SP], vm->registers[reg_id]);
+    return ++ip;
+}
+
+OPCODE_HANDLER(pop_r_q)
+{
+    const uint8_t reg_id = *++ip;
+
+    if (!validate_register(vm, reg_id))
+        return NULL;
+
+    vm->registers[reg_id] = blaze_stack_pop(&vm->registers[SP]);
+    return ++ip;
+}
+
+OPCODE_HANDLER(enter)
+{
+    const uint32_t locals = operand_dword(vm, ip + 1);
+
+    if (!validate_enter(vm, locals, vm->registers[SP]))
+        return NULL;
+
+    blaze_stack_push(&vm->registers[SP], vm->registers[FP]);
+    vm->registers[FP] = vm->registers[SP];
+    vm->registers[SP] += locals * sizeof (uint64_t);
+    return ip + 6;
+}
+
+OPCODE_HANDLER(leave)
+{
+    vm->registers[SP] = vm->registers[FP];
+    vm->registers[FP] = blaze_stack_pop(&vm->registers[SP]);
+
+    if ((uint64_t *) vm->registers[FP] < vm->stack.base || vm->registers[FP] > vm->registers[SP])
+    {
+        vm->error = strdup("Invalid frame pointer");
+        return NULL;
     }
 
-    return NULL;
+    return ip + 1;
+}
+
+OPCODE_HANDLER(load_rf)
+{
+    const uint8_t reg_id = *++ip;
+    uint64_t *address = (uint64_t *) vm->registers[FP] + (int32_t) operand_dword(vm, ip + 1);
+
+    if (!validate_register(vm, reg_id) || !validate_frame(vm, address, vm->registers[SP]))
+        return NULL;
+
+    vm->registers[reg_id] = *address;
+    return ip + 5;
+}
+
+OPCODE_HANDLER(store_fr)
+{
+    uint64_t *address = (uint64_t *) vm->registers[FP] + (int32_t) operand_dword(vm, ip + 1);
+    const uint8_t reg_id = *(ip + 5);
+
+    if (!validate_register(vm, reg_id) || !validate_frame(vm, address, vm->registers[SP]))
+        return NULL;
+
+    *address = vm->registers[reg_id];
+    return ip + 6;
+}
+
+OPCODE_HANDLER(load_rm)
+{
+    const uint8_t reg_id = *++ip;
+    const uint32_t slot = operand_dword(vm, ip + 1);
+
+    if (!validate_register(vm, reg_id) || !validate_memory(vm, slot))
+        return NULL;
+
+    vm->registers[reg_id] = vm->memory[slot];
+    return ip + 5;
+}
+
+OPCODE_HANDLER(store_mr)
+{
+    const uint32_t slot = operand_dword(vm, ip + 1);
+    const uint8_t reg_id = *(ip + 5);
+
+    if (!validate_register(vm, reg_id) || !validate_memory(vm, slot))
+        return NULL;
+
+    vm->memory[slot] = vm->registers[reg_id];
+    return ip + 6;
+}
+
+OPCODE_HANDLER(load_rr)
+{
+    const uint8_t reg1_id = *++ip;
+    const uint8_t reg2_id = *++ip;
+
+    if (!validate_register(vm, reg1_id) || !validate_register(vm, reg2_id) ||
+        !validate_memory(vm, vm->registers[reg2_id]))
+        return NULL;
+
+    vm->registers[reg1_id] = vm->memory[vm->registers[reg2_id]];
+    return ++ip;
+}
+
+OPCODE_HANDLER(store_rr)
+{
+    const uint8_t reg1_id = *++ip;
+    const uint8_t reg2_id = *++ip;
+
+    if (!validate_register(vm, reg1_id) || !validate_register(vm, reg2_id) ||
+        !validate_memory(vm, vm->registers[reg1_id]))
+        return NULL;
+
+    vm->memory[vm->registers[reg1_id]] = vm->registers[reg2_id];
+    return ++ip;
+}
+
+OPCODE_HANDLER(const_rk)
+{
+    const uint8_t reg_id = *++ip;
+    uint32_t index;
+    size_t length = bytecode_read_uleb128(ip + 1, (uint8_t *) vm->registers[IS] + vm->bytecode->size - (ip + 1), &index);
+
+    if (!validate_register(vm, reg_id) || !validate_constant(vm, index))
+        return NULL;
+
+    vm->registers[reg_id] = vm->constants[index];
+    return ip + 1 + length;
+}
+
+OPCODE_HANDLER(vload)
+{
+    const uint8_t vreg = ip[1], reg_id = ip[2];
+
+    if (!validate_vector_register(vm, vreg) || !validate_register(vm, reg_id) ||
+        !validate_vector_memory(vm, vm->registers[reg_id]))
+        return NULL;
+
+    memcpy(&vm->vectors[vreg], vm->memory + vm->registers[reg_id], sizeof (vm_vector_t));
+    return ip + 3;
+}
+
+OPCODE_HANDLER(vstore)
+{
+    const uint8_t reg_id = ip[1], vreg = ip[2];
+
+    if (!validate_register(vm, reg_id) || !validate_vector_register(vm, vreg) ||
+        !validate_vector_memory(vm, vm->registers[reg_id]))
+        return NULL;
+
+    memcpy(vm->memory + vm->registers[reg_id], &vm->vectors[vreg], sizeof (vm_vector_t));
+    return ip + 3;
+}
+
+OPCODE_HANDLER(vsplat)
+{
+    const uint8_t vreg = ip[1], reg_id = ip[2];
+
+    if (!validate_vector_register(vm, vreg) || !validate_register(vm, reg_id))
+        return NULL;
+
+    for (size_t i = 0; i < VM_VECTOR_LANES; i++)
+        vm->vectors[vreg].lanes[i] = vm->registers[reg_id];
+
+    return ip + 3;
+}
+
+OPCODE_HANDLER(vbinary)
+{
+    const uint8_t vreg1 = REG_PAIR_FIRST(ip[1]), vreg2 = REG_PAIR_SECOND(ip[1]);
+
+    if (!validate_vector_register(vm, vreg1) || !validate_vector_register(vm, vreg2))
+        return NULL;
+
+    vm_vector_ops()->binary[*ip - OP_VADD](&vm->vectors[vreg1], &vm->vectors[vreg2]);
+    return ip + 2;
+}
+
+OPCODE_HANDLER(vblend)
+{
+    const uint8_t vreg1 = REG_PAIR_FIRST(ip[1]), vreg2 = REG_PAIR_SECOND(ip[1]), mask = ip[2];
+
+    if (!validate_vector_register(vm, vreg1) || !validate_vector_register(vm, vreg2) ||
+        !validate_vector_register(vm, mask))
+        return NULL;
+
+    vm_vector_ops()->blend(&vm->vectors[vreg1], &vm->vectors[vreg2], &vm->vectors[mask]);
+    return ip + 3;
+}
+
+OPCODE_HANDLER(vstorem)
+{
+    const uint8_t reg_id = ip[1], vreg = ip[2], mask = ip[3];
+
+    if (!validate_register(vm, reg_id) || !validate_vector_register(vm, vreg) ||
+        !validate_vector_register(vm, mask) || !validate_vector_memory(vm, vm->registers[reg_id]))
+        return NULL;
+
+    vm_vector_ops()->store_masked(vm->memory + vm->registers[reg_id], &vm->vectors[vreg], &vm->vectors[mask]);
+    return ip + 4;
+}
+
+OPCODE_HANDLER(vreduce)
+{
+    const uint8_t reg_id = ip[1], vreg = ip[2];
+    const struct vm_vector_ops *ops = vm_vector_ops();
+
+    if (!validate_register(vm, reg_id) || !validate_vector_register(vm, vreg))
+        return NULL;
+
+    uint64_t (*reduce)(const vm_vector_t *) = *ip == OP_VSUM ? ops->sum : *ip == OP_VSUMF ? ops->sumf : ops->max;
+
+    vm->registers[reg_id] = reduce(&vm->vectors[vreg]);
+    return ip + 3;
+}
+
+OPCODE_HANDLER(regdump)
+{
+    struct vm_file *out = &vm->io.files[VM_STDOUT];
+
+    (void) ip;
+    vm_file_printf(out, "\n*** regdump:\n\n");
+
+    for (size_t i = 0; i < REG_COUNT; i++)
+    {
+        vm_file_printf(out, "\033[1;34m%%%s\033[0m     \033[1;32m0x%016lx\033[0m\n",
+                register_id_to_str(i),
+                vm->registers[i]);
+    }
+
+    return NULL;
+}
+
+OPCODE_HANDLER(stackdmp)
+{
+    const uint64_t *sp = (const uint64_t *) vm->registers[SP];
+    const uint64_t *fp = (const uint64_t *) vm->registers[FP];
+    struct vm_file *out = &vm->io.files[VM_STDOUT];
+
+    (void) ip;
+    vm_file_printf(out, "\n*** stack dump:\n\n");
+
+    for (const uint64_t *word = sp - 10 < vm->stack.base ? vm->stack.base : sp - 10; word < sp; word++)
+    {
+        vm_file_printf(out, "%s\033[1;34m[%zu]\033[0m:     \033[1;32m0x%016lx\033[0m\n",
+                word == fp ? " fp " : "    ",
+                (size_t) (word - vm->stack.base),
+                *word);
+    }
+
+    return NULL;
+}
+
+static void syscall_heap_exhausted(struct vm_context *vm)
+{
+    vm->error = strdup("VM heap exhausted");
+}
+
+/* The bytes of a string; fails the program if value is not one. */
+static const char *syscall_string(struct vm_context *vm, uint64_t value, size_t *length)
+{
+    const char *data = vm_heap_string_data(&vm->heap, value, length);
+
+    if (data == NULL)
+    {
+        vm->error = xmalloc(48);
+        sprintf(vm->error, "Not a string: 0x%016lx", value);
+    }
+
+    return data;
+}
+
+static struct vm_object *syscall_object(struct vm_context *vm, uint64_t value, enum vm_object_type type);
+static bool syscall_write_array(struct vm_context *vm, uint64_t value);
+
+/*
+ * Writes a value to the output of the context the same way the print()
+ * built-in does; the colours are those of fprint_val_internal().
+ */
+static bool syscall_write_value(struct vm_context *vm, uint64_t type, uint64_t value)
+{
+    struct vm_file *out = &vm->io.files[VM_STDOUT];
+
+    switch (type)
+    {
+        case VT_UINT:
+            vm_file_printf(out, "%lu", value);
+            break;
+
+        case VT_CHAR:
+            vm_file_putc(out, (char) value);
+            break;
+
+        case VT_STRING:
+        {
+            size_t length;
+            const char *data = syscall_string(vm, value, &length);
+
+            if (data == NULL)
+                return false;
+
+            vm_file_write(out, data, length);
+            break;
+        }
+
+        case VT_INT:
+            vm_file_write(out, "\033[1;33m", 7);
+            vm_file_write_int(out, (int64_t) value);
+            vm_file_write(out, "\033[0m", 4);
+            break;
+
+        case VT_BOOL:
+            vm_file_printf(out, "\033[36m%s\033[0m", value != 0 ? "true" : "false");
+            break;
+
+        case VT_NULL:
+            vm_file_printf(out, "\033[2mnull\033[0m");
+            break;
+
+        case VT_ARRAY:
+            return syscall_write_array(vm, value);
+
+        default:
+            vm->error = xmalloc(35);
+            sprintf(vm->error, "Invalid value type: 0x%02lx", type);
+            return false;
+    }
+
+    return true;
+}
+
+/* Writes an array of boxes, quoting the strings in it as print() does. */
+static bool syscall_write_array(struct vm_context *vm, uint64_t value)
+{
+    struct vm_file *out = &vm->io.files[VM_STDOUT];
+    struct vm_object *array = syscall_object(vm, value, VM_OBJECT_ARRAY);
+
+    if (array == NULL)
+        return false;
+
+    vm_file_printf(out, "\033[34mArray (%lu)\033[0m [", array->length);
+
+    for (uint64_t i = 0; i < array->length; i++)
+    {
+        struct vm_object *box = syscall_object(vm, array->data[i], VM_OBJECT_BOX);
+
+        if (box == NULL)
+            return false;
+
+        if (box->length == VT_STRING)
+            vm_file_write(out, "\033[32m\"", 6);
+
+        if (!syscall_write_value(vm, box->length, box->data[0]))
+            return false;
+
+        if (box->length == VT_STRING)
+            vm_file_write(out, "\"\033[0m", 5);
+
+        if (i != array->length - 1)
+            vm_file_write(out, ", ", 2);
+    }
+
+    vm_file_putc(out, ']');
+    return true;
+}
+
+/* Makes a string of a value, as print() would show it; 0 if it cannot. */
+static uint64_t syscall_string_from(struct vm_context *vm, uint64_t type, uint64_t value)
+{
+    char buf[32];
+    size_t length;
+    uint64_t string;
+
+    switch (type)
+    {
+        case VT_STRING:
+            return syscall_string(vm, value, &length) == NULL ? 0 : value;
+
+        case VT_INT:
+            string = vm_heap_string(&vm->heap, buf, (size_t) snprintf(buf, sizeof buf, "%lld", (long long int) value));
+            break;
+
+        case VT_BOOL:
+            string = value ? vm_heap_string(&vm->heap, "true", 4) : vm_heap_string(&vm->heap, "false", 5);
+            break;
+
+        case VT_NULL:
+            string = vm_heap_string(&vm->heap, "null", 4);
+            break;
+
+        default:
+            vm->error = xmalloc(35);
+            sprintf(vm->error, "Invalid value type: 0x%02lx", type);
+            return 0;
+    }
+
+    if (string == 0)
+        syscall_heap_exhausted(vm);
+
+    return string;
+}
+
+static uint64_t syscall_string_concat(struct vm_context *vm, uint64_t left, uint64_t right)
+{
+    size_t length;
+
+    if (syscall_string(vm, left, &length) == NULL || syscall_string(vm, right, &length) == NULL)
+        return 0;
+
+    uint64_t string = vm_heap_concat(&vm->heap, left, right);
+    if (string == 0)
+        syscall_heap_exhausted(vm);
+
+    return string;
+}
+
+static uint64_t syscall_string_equals(struct vm_context *vm, uint64_t a, uint64_t b)
+{
+    size_t a_length, b_length;
+    const char *a_data = syscall_string(vm, a, &a_length);
+    const char *b_data = syscall_string(vm, b, &b_length);
+
+    if (a_data == NULL || b_data == NULL)
+        return 0;
+
+    return a_length == b_length && memcmp(a_data, b_data, a_length) == 0;
+}
+
+/* The object of a handle if it has this type; otherwise fails the program. */
+static struct vm_object *syscall_object(struct vm_context *vm, uint64_t value, enum vm_object_type type)
+{
+    struct vm_object *object = vm_heap_get(&vm->heap, value);
+
+    if (object == NULL || object->type != type)
+    {
+        vm->error = xmalloc(64);
+        sprintf(vm->error, "Not %s: 0x%016lx", type == VM_OBJECT_ARRAY ? "an array" : "a box", value);
+        return NULL;
+    }
+
+    return object;
+}
+
+/* Runs one of the syscalls described in opcode.h that work on arrays and boxes. */
+static bool syscall_heap(struct vm_context *vm, uint64_t r0)
+{
+    uint64_t r1 = vm->registers[R1], r2 = vm->registers[R2], r3 = vm->registers[R3];
+    struct vm_object *object;
+    size_t length;
+
+    switch (r0)
+    {
+        case SYS_ARRAY_NEW:
+            vm->registers[R0] = r1 > vm->heap.limit / sizeof (uint64_t) ? 0 :
+                                vm_heap_alloc(&vm->heap, VM_OBJECT_ARRAY, r1, r1 * sizeof (uint64_t));
+
+            if (vm->registers[R0] == 0)
+            {
+                syscall_heap_exhausted(vm);
+                return false;
+            }
+
+            return true;
+
+        case SYS_ARRAY_GET:
+        case SYS_ARRAY_SET:
+            if ((object = syscall_object(vm, r1, VM_OBJECT_ARRAY)) == NULL)
+                return false;
+
+            if (r2 >= object->length)
+            {
+                vm->error = xmalloc(64);
+                sprintf(vm->error, "Array index out of range: %lu of %lu", r2, object->length);
+                return false;
+            }
+
+            if (r0 == SYS_ARRAY_GET)
+                vm->registers[R0] = object->data[r2];
+            else
+                object->data[r2] = r3;
+
+            return true;
+
+        case SYS_LENGTH:
+            if (vm_heap_string_data(&vm->heap, r1, &length) != NULL)
+                vm->registers[R0] = length;
+            else if ((object = syscall_object(vm, r1, VM_OBJECT_ARRAY)) != NULL)
+                vm->registers[R0] = object->length;
+            else
+                return false;
+
+            return true;
+
+        case SYS_BOX:
+            if ((vm->registers[R0] = vm_heap_alloc(&vm->heap, VM_OBJECT_BOX, r1, sizeof (uint64_t))) == 0)
+            {
+                syscall_heap_exhausted(vm);
+                return false;
+            }
+
+            vm_heap_get(&vm->heap, vm->registers[R0])->data[0] = r2;
+            return true;
+
+        case SYS_UNBOX:
+            if ((object = syscall_object(vm, r1, VM_OBJECT_BOX)) == NULL)
+                return false;
+
+            vm->registers[R0] = object->data[0];
+            vm->registers[R1] = object->length;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/* The bytes of data memory from address on, or NULL if size of them are not all there. */
+static uint8_t *syscall_buffer(struct vm_context *vm, uint64_t address, uint64_t size)
+{
+    uint64_t memory_bytes = vm->memory_size * sizeof (uint64_t);
+
+    if (address > memory_bytes || size > memory_bytes - address)
+    {
+        vm->error = xmalloc(64);
+        sprintf(vm->error, "Buffer out of range: 0x%lx bytes at 0x%lx", size, address);
+        return NULL;
+    }
+
+    return (uint8_t *) vm->memory + address;
+}
+
+/* Runs one of the syscalls described in opcode.h that work on descriptors. */
+static bool syscall_io(struct vm_context *vm, uint64_t r0)
+{
+    uint64_t r1 = vm->registers[R1], r2 = vm->registers[R2], r3 = vm->registers[R3];
+    struct vm_file *file = r0 == SYS_OPEN || r0 == SYS_CLOSE ? NULL : vm_io_get(&vm->io, r1);
+    uint8_t *buffer = NULL;
+    int64_t result = -1;
+
+    if (r0 != SYS_CLOSE && (buffer = syscall_buffer(vm, r0 == SYS_OPEN ? r1 : r2, r0 == SYS_OPEN ? r2 : r3)) == NULL)
+        return false;
+
+    switch (r0)
+    {
+        case SYS_OPEN:
+        {
+            char *path = strndup((char *) buffer, r2);
+            result = vm_io_open(&vm->io, path, r3);
+            free(path);
+            break;
+        }
+
+        case SYS_CLOSE:
+            result = vm_io_close(&vm->io, r1) ? 0 : -1;
+            break;
+
+        case SYS_READ_LINE:
+        case SYS_READ_BLOCK:
+            if (file == NULL)
+                break;
+
+            /* Whoever reads the input has to see the prompt first. */
+            if (r1 == VM_STDIN)
+                vm_io_flush(&vm->io);
+
+            result = r0 == SYS_READ_LINE ? vm_file_read_line(file, buffer, r3) : vm_file_read_block(file, buffer, r3);
+            break;
+
+        case SYS_WRITE_BLOCK:
+            if (file != NULL && vm_file_write(file, buffer, r3))
+                result = (int64_t) r3;
+
+            break;
+    }
+
+    vm->registers[R0] = (uint64_t) result;
+    return true;
+}
+
+OPCODE_HANDLER(syscall)
+{
+    uint64_t r0 = vm->registers[R0];
+
+    switch (r0)
+    {
+        case SYS_EXIT:
+        {
+            uint64_t r1 = vm->registers[R1];
+            vm->exit_code = r1;
+            break;
+        }
+
+        case SYS_REGDUMP:
+        {
+            OPCODE_HANDLER_REF(regdump)(vm, ip);
+            break;
+        }
+
+        case SYS_STACK_DUMP:
+        {
+            OPCODE_HANDLER_REF(stackdmp)(vm, ip);
+            break;
+        }
+
+        case SYS_PRINT:
+        case SYS_WRITE:
+        {
+            if (!syscall_write_value(vm, vm->registers[R1], vm->registers[R2]))
+                return NULL;
+
+            if (r0 == SYS_PRINT)
+                vm_file_putc(&vm->io.files[VM_STDOUT], '\n');
+
+            break;
+        }
+
+        case SYS_STRING_FROM:
+            vm->registers[R0] = syscall_string_from(vm, vm->registers[R1], vm->registers[R2]);
+            break;
+
+        case SYS_STRING_CONCAT:
+            vm->registers[R0] = syscall_string_concat(vm, vm->registers[R1], vm->registers[R2]);
+            break;
+
+        case SYS_STRING_EQUALS:
+            vm->registers[R0] = syscall_string_equals(vm, vm->registers[R1], vm->registers[R2]);
+            break;
+
+        case SYS_ERROR:
+        {
+            size_t length;
+            const char *message = syscall_string(vm, vm->registers[R1], &length);
+
+            if (message != NULL)
+                vm->error = strndup(message, length);
+
+            return NULL;
+        }
+
+        case SYS_OPEN:
+        case SYS_CLOSE:
+        case SYS_READ_LINE:
+        case SYS_READ_BLOCK:
+        case SYS_WRITE_BLOCK:
+            syscall_io(vm, r0);
+            break;
+
+        case SYS_ARRAY_NEW:
+        case SYS_ARRAY_GET:
+        case SYS_ARRAY_SET:
+        case SYS_LENGTH:
+        case SYS_BOX:
+        case SYS_UNBOX:
+            syscall_heap(vm, r0);
+            break;
+
+        case SYS_SNAPSHOT:
+        {
+            uint8_t *buffer = syscall_buffer(vm, vm->registers[R1], vm->registers[R2]);
+            char *path, *error = NULL;
+
+            if (buffer == NULL)
+                return NULL;
+
+            path = strndup((char *) buffer, vm->registers[R2]);
+            vm->registers[R0] = vm_snapshot_write(vm, path, &error) ? 0 : (uint64_t) -1;
+            free(path);
+            free(error);
+            break;
+        }
+
+        default:
+            vm->error = xmalloc(30);
+            sprintf(vm->error, "Invalid syscall: 0x%02lx", r0);
+            return NULL;
+    }
+
+    return NULL;
+}
+
+/*
+ * Quickening. A generic instruction that keeps doing the same thing, such
+ * as a syscall that writes an integer every time, runs as a specialized
+ * form after QUICKEN_THRESHOLD runs in a row. The form is kept in the
+ * quickening table of the context rather than written into the code,
+ * which stays shared; the generic instruction looks it up and jumps to
+ * it. The specialized form guards on its assumption and turns back into
+ * the generic one when it fails; a site that has been deoptimized
+ * QUICKEN_MAX_DEOPTS times stays generic.
+ */
+#define QUICKEN_THRESHOLD 4
+#define QUICKEN_MAX_DEOPTS 4
+
+/* Returns the specialized form of a syscall with these arguments, or OP_SYSCALL. */
+static opcode_t quicken_syscall_form(uint64_t r0, uint64_t r1)
+{
+    switch (r0)
+    {
+        case SYS_WRITE:
+            if (r1 == VT_CHAR)
+                return OP_SYSCALL_WRITE_CHAR;
+
+            if (r1 == VT_INT)
+                return OP_SYSCALL_WRITE_INT;
+
+            return r1 == VT_STRING ? OP_SYSCALL_WRITE_STRING : OP_SYSCALL;
+
+        case SYS_STRING_FROM:
+            return r1 == VT_INT ? OP_SYSCALL_STRING_FROM_INT : OP_SYSCALL;
+
+        case SYS_STRING_CONCAT:
+            return OP_SYSCALL_STRING_CONCAT;
+
+        case SYS_STRING_EQUALS:
+            return OP_SYSCALL_STRING_EQUALS;
+
+        default:
+            return OP_SYSCALL;
+    }
+}
+
+static struct bytecode_quickening *quicken_site(struct vm_context *vm, size_t offset)
+{
+    if (vm->quickening == NULL)
+        vm->quickening = xcalloc(vm->bytecode->size, sizeof (struct bytecode_quickening));
+
+    return &vm->quickening[offset];
+}
+
+/* Called after the generic instruction at offset ran in a way that form would cover. */
+static void quicken_observe(struct vm_context *vm, size_t offset, opcode_t form)
+{
+    if (form == OP_SYSCALL)
+        return;
+
+    struct bytecode_quickening *site = quicken_site(vm, offset);
+
+    if (site->deopts >= QUICKEN_MAX_DEOPTS)
+        return;
+
+    if (site->candidate != form)
+    {
+        site->candidate = form;
+        site->streak = 0;
+    }
+
+    if (++site->streak >= QUICKEN_THRESHOLD)
+    {
+        site->form = form;
+        site->streak = 0;
+    }
+}
+
+/* Called when the guard of a specialized instruction fails. */
+static void quicken_deopt(struct vm_context *vm, size_t offset)
+{
+    struct bytecode_quickening *site = quicken_site(vm, offset);
+
+    site->misses++;
+    site->deopts++;
+    site->form = OP_NO_OP;
+}
+
+/*
+ * Direct-threaded dispatch loop. Every instruction body jumps straight to
+ * the body of the next one through a table of label addresses (a GNU C
+ * extension), so there is no central loop, no handler call and no write of
+ * %ip to memory per instruction. Compilers without computed goto get the
+ * same bodies as a switch.
+ *
+ * %ip and the register file are kept in locals while the program runs and
+ * are only written back to the context around the instructions that read
+ * them there (syscall, regdump, stackdmp) and when execution stops. Running off the end of the code is caught by padding it with
+ * invalid opcodes instead of checking %ip before every instruction.
+ *
+ * The loop itself lives in dispatch.h and is instantiated twice: bytecode
+ * that went through bytecode_verify() runs without the per-instruction
+ * register, jump target and memory checks.
+ */
+#if defined(__GNUC__) && !defined(BLAZEVM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+/* Longest instruction, so that a truncated one still ends in the padding. */
+#define VM_CODE_PADDING 16
+#define VM_PADDING_BYTE 0xFF
+
+static inline uint32_t vm_read_dword(const uint8_t *ptr)
+{
+    uint32_t dword;
+    memcpy(&dword, ptr, sizeof dword);
+    return dword;
+}
+
+static inline uint64_t vm_read_qword(const uint8_t *ptr)
+{
+    uint64_t qword;
+    memcpy(&qword, ptr, sizeof qword);
+    return qword;
+}
+
+/*
+ * Decodes a constant index and returns its length. Verified code only has
+ * well-formed ones; in other code a malformed one reads as UINT32_MAX,
+ * which the constant check rejects, and the padding keeps it in bounds.
+ */
+static inline size_t vm_read_uleb128(const uint8_t *ptr, uint32_t *value)
+{
+    if (ptr[0] < 0x80)
+    {
+        *value = ptr[0];
+        return 1;
+    }
+
+    size_t length = bytecode_read_uleb128(ptr, LEB128_MAX_SIZE, value);
+    return length == 0 ? LEB128_MAX_SIZE : length;
+}
+
+
+#define VM_RUN_NAME execution_run_checked
+#define VM_CHECKED 1
+#define VM_RECORDED 0
+#define VM_PROFILED 0
+#include "dispatch.h"
+#undef VM_RUN_NAME
+#undef VM_CHECKED
+#undef VM_RECORDED
+#undef VM_PROFILED
+
+#define VM_RUN_NAME execution_run_unchecked
+#define VM_CHECKED 0
+#define VM_RECORDED 0
+#define VM_PROFILED 0
+#include "dispatch.h"
+#undef VM_RUN_NAME
+#undef VM_CHECKED
+#undef VM_RECORDED
+#undef VM_PROFILED
+
+#define VM_RUN_NAME execution_run_recorded
+#define VM_CHECKED 0
+#define VM_RECORDED 1
+#define VM_PROFILED 0
+#include "dispatch.h"
+#undef VM_RUN_NAME
+#undef VM_CHECKED
+#undef VM_RECORDED
+#undef VM_PROFILED
+
+#define VM_RUN_NAME execution_run_profiled
+#define VM_CHECKED 0
+#define VM_RECORDED 0
+#define VM_PROFILED 1
+#include "dispatch.h"
+#undef VM_RUN_NAME
+#undef VM_CHECKED
+#undef VM_RECORDED
+#undef VM_PROFILED
+
+_Static_assert(OP_VAND - OP_VADD == VM_VECTOR_AND - VM_VECTOR_ADD &&
+               OP_VAND - OP_VADD + 1 == VM_VECTOR_BINARY_COUNT, "the lane-wise opcodes follow vm_vector_binary_t");
+
+/* Opcodes are bytes, and the padding byte must stay an invalid opcode. */
+_Static_assert(OPCODE_COUNT <= VM_PADDING_BYTE, "too many opcodes and superinstructions");
+_Static_assert(REG_OPERAND_COUNT <= 16, "register pairs hold each register in a nibble");
+
+#define SUPERINSTRUCTION_FUSE_ENTRY(first, second, mnemonic) \
+    [OP_##first][OP_##second] = SUPERINSTRUCTION_OPCODE(first, second),
+
+/* The superinstruction for each pair of instructions, or OP_NO_OP. */
+static const uint8_t superinstruction_lut[OPCODE_COUNT][OPCODE_COUNT] = {
+    SUPERINSTRUCTION_TABLE(SUPERINSTRUCTION_FUSE_ENTRY)
+};
+
+/*
+ * Every instruction that the second instruction of a superinstruction
+ * follows is that superinstruction. Pairs may overlap: in "a b c" both a+b
+ * and b+c are made, and a jump to b runs b+c. The superinstructions behave
+ * the same as the pairs, so verified code stays verified.
+ */
+opcode_t instruction_fused_opcode(const uint8_t *code, size_t size, size_t offset, bool fuse)
+{
+    opcode_t opcode = code[offset];
+    size_t next = offset + instruction_get_size(code + offset, size - offset);
+
+    if (opcode >= OPCODE_COUNT || next == offset)
+        return opcode;
+
+    opcode = opcode_generic(opcode);
+
+    if (!fuse || next >= size || code[next] >= OPCODE_COUNT)
+        return opcode;
+
+    uint8_t fused = superinstruction_lut[opcode][opcode_generic(code[next])];
+    return fused != OP_NO_OP ? fused : opcode;
+}
+
+#define SUPERINSTRUCTION_ID_ENTRY(first, second, mnemonic)                         \
+    id = (id ^ SUPERINSTRUCTION_OPCODE(first, second)) * 16777619u;                \
+    id = (id ^ OP_##first) * 16777619u;                                            \
+    id = (id ^ OP_##second) * 16777619u;
+
+/* FNV-1a over the number and parts of every superinstruction. */
+uint32_t superinstructions_id(void)
+{
+    uint32_t id = 2166136261u;
+
+    SUPERINSTRUCTION_TABLE(SUPERINSTRUCTION_ID_ENTRY)
+    return id != 0 ? id : 1;
+}
+
+#undef SUPERINSTRUCTION_ID_ENTRY
+
+/*
+ * Superinstructions are only made of verified code, and recorded runs go
+ * without them, so that every instruction is recorded. Files are written
+ * with them (see bytecode-file.h), so running one from a file usually
+ * needs no copy.
+ */
+uint8_t *execution_code(struct vm_context *vm)
+{
+    struct bytecode *bytecode = vm->bytecode;
+    bool fuse = vm->superinstructions && vm->recorder == NULL;
+
+    if (vm->code != NULL)
+        return vm->code;
+
+    if (!bytecode->verified)
+    {
+        vm->code = xmalloc(bytecode->size + VM_CODE_PADDING);
+        memcpy(vm->code, bytecode->bytes, bytecode->size);
+        memset(vm->code + bytecode->size, VM_PADDING_BYTE, VM_CODE_PADDING);
+        return vm->code;
+    }
+
+    vm->code = bytecode->bytes;
+
+    for (size_t offset = 0; offset < bytecode->size; offset += instruction_get_size(bytecode->bytes + offset, bytecode->size - offset))
+    {
+        opcode_t opcode = instruction_fused_opcode(bytecode->bytes, bytecode->size, offset, fuse);
+
+        if (opcode == bytecode->bytes[offset])
+            continue;
+
+        if (vm->code == bytecode->bytes)
+        {
+            vm->code = xmalloc(bytecode->size);
+            memcpy(vm->code, bytecode->bytes, bytecode->size);
+        }
+
+        vm->code[offset] = opcode;
+    }
+
+    return vm->code;
+}
+
+/*
+ * Unverified code runs from a padded copy, so that it cannot run off its
+ * end; verified code cannot, so it usually runs where it is, which is what
+ * allows executing code mapped from a file. The stack is guarded for the
+ * thread running the program, and only while it runs.
+ */
+bool execution_run(struct vm_context *vm)
+{
+    struct bytecode *bytecode = vm->bytecode;
+    uint8_t *code = execution_code(vm);
+    bool ok;
+
+    /* The program writes to the same files as the host's stdio. */
+    fflush(NULL);
+    blaze_stack_guard(&vm->stack);
+
+    if (bytecode->verified && vm->jit && vm->recorder == NULL && vm->profile == NULL && (vm->native != NULL || (vm->native = jit_compile(vm)) != NULL))
+    {
+        vm->registers[IS] = (uint64_t) code;
+        ok = jit_run(vm, vm->native);
+    }
+    else if (bytecode->verified && vm->recorder != NULL)
+    {
+        vm_recorder_watch(vm->recorder, bytecode);
+        ok = execution_run_recorded(vm);
+        vm_recorder_watch(NULL, NULL);
+
+        /* After what the program printed, which led up to it. */
+        if (!ok && vm_io_flush(&vm->io))
+            vm_recorder_dump(vm->recorder, bytecode, STDERR_FILENO);
+    }
+    else if (bytecode->verified)
+        ok = vm->profile != NULL ? execution_run_profiled(vm) : execution_run_unchecked(vm);
+    else
+        ok = execution_run_checked(vm);
+
+    blaze_stack_guard(NULL);
+    vm_io_flush(&vm->io);
+    return ok;
 }
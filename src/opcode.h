@@ -8,33 +8,309 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "bytecode.h"
+#include "vm-context.h"
+#include "superinstructions.h"
+
+/*
+ * The instruction set. Every other description of it is generated from
+ * this table: the opcode enum, the operand and mnemonic lookup tables, the
+ * handler table, the labels of the dispatch loop, the verifier's operand
+ * checks and the disassembler. Opcodes are numbered in table order, so new
+ * instructions go at the end to keep saved bytecode valid.
+ *
+ * Each row gives the opcode, the name of its handler, its mnemonic and up
+ * to three operands (see the OPERAND_ macros below). Encodings changed in
+ * version 2 of the bytecode file format: instructions on two registers
+ * pack them into one byte, constant indices are LEB128 numbers and small
+ * immediates have their own forms of mov.
+ */
+#define OPCODE_TABLE(X)                                                          \
+    X(OP_NO_OP,     noop,     "noop",    NONE,     NONE,    NONE)                \
+    X(OP_HLT,       hlt,      "hlt",     NONE,     NONE,    NONE)                \
+    X(OP_MOV_IR,    mov_ir,   "mov",     REG,      IMM64,   NONE)                \
+    X(OP_ADD_RR,    add_rr,   "add",     REG_PAIR, NONE,    NONE)                \
+    X(OP_SYSCALL,   syscall,  "syscall", NONE,     NONE,    NONE)                \
+    X(OP_REGDUMP,   regdump,  "regdump", NONE,     NONE,    NONE)                \
+    X(OP_PUSH_R_B,  push_r_b, "pushb",   REG,      NONE,    NONE)                \
+    X(OP_POP_R_B,   pop_r_b,  "popb",    REG,      NONE,    NONE)                \
+    X(OP_STACK_DMP, stackdmp, "stackdmp",NONE,     NONE,    NONE)                \
+    X(OP_MOV_RR,    mov_rr,   "mov",     REG_PAIR, NONE,    NONE)                \
+    X(OP_SUB_RR,    sub_rr,   "sub",     REG_PAIR, NONE,    NONE)                \
+    X(OP_MUL_RR,    mul_rr,   "mul",     REG_PAIR, NONE,    NONE)                \
+    X(OP_MOD_RR,    mod_rr,   "mod",     REG_PAIR, NONE,    NONE)                \
+    X(OP_EQ_RR,     eq_rr,    "eq",      REG_PAIR, NONE,    NONE)                \
+    X(OP_NE_RR,     ne_rr,    "ne",      REG_PAIR, NONE,    NONE)                \
+    X(OP_LT_RR,     lt_rr,    "lt",      REG_PAIR, NONE,    NONE)                \
+    X(OP_LE_RR,     le_rr,    "le",      REG_PAIR, NONE,    NONE)                \
+    X(OP_GT_RR,     gt_rr,    "gt",      REG_PAIR, NONE,    NONE)                \
+    X(OP_GE_RR,     ge_rr,    "ge",      REG_PAIR, NONE,    NONE)                \
+    X(OP_JMP,       jmp,      "jmp",     TARGET,   NONE,    NONE)                \
+    X(OP_JZ_R,      jz_r,     "jz",      REG,      TARGET,  NONE)                \
+    X(OP_CALL,      call,     "call",    TARGET,   NONE,    NONE)                \
+    X(OP_RET,       ret,      "ret",     NONE,     NONE,    NONE)                \
+    X(OP_PUSH_R_Q,  push_r_q, "pushq",   REG,      NONE,    NONE)                \
+    X(OP_POP_R_Q,   pop_r_q,  "popq",    REG,      NONE,    NONE)                \
+    X(OP_LOAD_RM,   load_rm,  "load",    REG,      MEM,     NONE)                \
+    X(OP_STORE_MR,  store_mr, "store",   MEM,      REG,     NONE)                \
+    X(OP_CONST_RK,  const_rk, "const",   REG,      CONST,   NONE)                \
+    X(OP_DIV_RR,    div_rr,   "div",     REG_PAIR, NONE,    NONE)                \
+    X(OP_JNZ_R,     jnz_r,    "jnz",     REG,      TARGET,  NONE)                \
+    X(OP_JEQ_RR,    jeq_rr,   "jeq",     REG_PAIR, TARGET,  NONE)                \
+    X(OP_JNE_RR,    jne_rr,   "jne",     REG_PAIR, TARGET,  NONE)                \
+    X(OP_JLT_RR,    jlt_rr,   "jlt",     REG_PAIR, TARGET,  NONE)                \
+    X(OP_JLE_RR,    jle_rr,   "jle",     REG_PAIR, TARGET,  NONE)                \
+    X(OP_JGT_RR,    jgt_rr,   "jgt",     REG_PAIR, TARGET,  NONE)                \
+    X(OP_JGE_RR,    jge_rr,   "jge",     REG_PAIR, TARGET,  NONE)                \
+    X(OP_JMP_R,     jmp_r,    "jmp",     REG,      NONE,    NONE)                \
+    X(OP_CALL_R,    call_r,   "call",    REG,      NONE,    NONE)                \
+    X(OP_LOAD_RR,   load_rr,  "load",    REG,      REG_MEM, NONE)                \
+    X(OP_STORE_RR,  store_rr, "store",   REG_MEM,  REG,     NONE)                \
+    X(OP_ENTER,     enter,    "enter",   IMM32,    IMM8,    NONE)                \
+    X(OP_LEAVE,     leave,    "leave",   NONE,     NONE,    NONE)                \
+    X(OP_LOAD_RF,   load_rf,  "load",    REG,      FRAME,   NONE)                \
+    X(OP_STORE_FR,  store_fr, "store",   FRAME,    REG,     NONE)                \
+    X(OP_MOV_IR8,   mov_ir8,  "mov",     REG,      SIMM8,   NONE)                \
+    X(OP_MOV_IR32,  mov_ir32, "mov",     REG,      SIMM32,  NONE)                \
+    VECTOR_OPCODE_TABLE(X)                                                       \
+    QUICKENED_OPCODE_TABLE(X)
+
+/*
+ * Instructions on the vector registers (see vm-vector.h). vload and
+ * vstore move the four memory slots from the one a register holds, and
+ * vsplat copies a register to every lane. The lane-wise instructions set
+ * their first operand to the first op the second, like add does, in the
+ * order of vm_vector_binary_t; the ones ending in f treat the lanes as
+ * doubles. vblend copies the lanes of its second operand that its third
+ * selects, vstorem stores the lanes of its second operand that its third
+ * selects, and vsum, vsumf and vmax reduce a vector to a register.
+ */
+#define VECTOR_OPCODE_TABLE(X)                                                   \
+    X(OP_VLOAD,     vload,    "vload",   VREG,     REG_MEM, NONE)                \
+    X(OP_VSTORE,    vstore,   "vstore",  REG_MEM,  VREG,    NONE)                \
+    X(OP_VSPLAT,    vsplat,   "vsplat",  VREG,     REG,     NONE)                \
+    X(OP_VADD,      vbinary,  "vadd",    VREG_PAIR, NONE,   NONE)                \
+    X(OP_VSUB,      vbinary,  "vsub",    VREG_PAIR, NONE,   NONE)                \
+    X(OP_VMUL,      vbinary,  "vmul",    VREG_PAIR, NONE,   NONE)                \
+    X(OP_VADDF,     vbinary,  "vaddf",   VREG_PAIR, NONE,   NONE)                \
+    X(OP_VSUBF,     vbinary,  "vsubf",   VREG_PAIR, NONE,   NONE)                \
+    X(OP_VMULF,     vbinary,  "vmulf",   VREG_PAIR, NONE,   NONE)                \
+    X(OP_VCMPEQ,    vbinary,  "vcmpeq",  VREG_PAIR, NONE,   NONE)                \
+    X(OP_VCMPLT,    vbinary,  "vcmplt",  VREG_PAIR, NONE,   NONE)                \
+    X(OP_VCMPLTF,   vbinary,  "vcmpltf", VREG_PAIR, NONE,   NONE)                \
+    X(OP_VAND,      vbinary,  "vand",    VREG_PAIR, NONE,   NONE)                \
+    X(OP_VBLEND,    vblend,   "vblend",  VREG_PAIR, VREG,   NONE)                \
+    X(OP_VSTOREM,   vstorem,  "vstorem", REG_MEM,  VREG,    VREG)                \
+    X(OP_VSUM,      vreduce,  "vsum",    REG,      VREG,    NONE)                \
+    X(OP_VSUMF,     vreduce,  "vsumf",   REG,      VREG,    NONE)                \
+    X(OP_VMAX,      vreduce,  "vmax",    REG,      VREG,    NONE)
+
+/*
+ * Forms of syscall specialized for one syscall and value type, which the
+ * VM rewrites a syscall into once it has seen it make the same call a few
+ * times in a row. Each checks %r0 (and %r1 if it matters) and turns back
+ * into a plain syscall when they differ. Compilers never emit these.
+ */
+#define QUICKENED_OPCODE_TABLE(X)                                                          \
+    X(OP_SYSCALL_WRITE_CHAR,   syscall, "syscall.write.char", NONE, NONE, NONE)            \
+    X(OP_SYSCALL_WRITE_INT,    syscall, "syscall.write.int",  NONE, NONE, NONE)            \
+    X(OP_SYSCALL_WRITE_STRING, syscall, "syscall.write.str",  NONE, NONE, NONE)            \
+    X(OP_SYSCALL_STRING_FROM_INT, syscall, "syscall.strfrom.int", NONE, NONE, NONE)        \
+    X(OP_SYSCALL_STRING_CONCAT, syscall, "syscall.concat",    NONE, NONE, NONE)            \
+    X(OP_SYSCALL_STRING_EQUALS, syscall, "syscall.streq",     NONE, NONE, NONE)
+
+/*
+ * Instructions that superinstructions can be made of; dispatch.h has a
+ * VM_BODY_ macro for each. A superinstruction stands for two instructions
+ * that follow each other, so the first one must always continue with the
+ * next: branches can only come second.
+ */
+#define FUSABLE_OPCODE_TABLE(X)                                                  \
+    X(MOV_IR) X(MOV_IR8) X(MOV_IR32) X(MOV_RR)                                     \
+    X(ADD_RR) X(SUB_RR) X(MUL_RR)                                                  \
+    X(EQ_RR) X(NE_RR) X(LT_RR) X(LE_RR) X(GT_RR) X(GE_RR)                          \
+    X(PUSH_R_Q) X(POP_R_Q) X(LOAD_RM) X(STORE_MR) X(CONST_RK)                      \
+    X(ENTER) X(LEAVE) X(LOAD_RF) X(STORE_FR)
+
+#define FUSABLE_BRANCH_OPCODE_TABLE(X)                                           \
+    X(JMP) X(JZ_R) X(JNZ_R) X(JEQ_RR) X(JNE_RR) X(JLT_RR) X(JLE_RR)                \
+    X(JGT_RR) X(JGE_RR) X(CALL) X(RET)
+
+/*
+ * Superinstructions come from SUPERINSTRUCTION_TABLE in superinstructions.h,
+ * which "make superinstructions" generates from the pairs of instructions
+ * the benchmarks run most often. Each row names the two instructions,
+ * without their OP_ prefix, and gives a mnemonic.
+ *
+ * A superinstruction only replaces the opcode byte of the first
+ * instruction: it has the size and operands of the first one, and the
+ * second one stays where it was, so no offset changes and jumps to the
+ * second one still work. Running it runs both with a single dispatch.
+ * They are numbered after the instruction set and change with the table,
+ * so a file written with them names the table it used (see
+ * bytecode-file.h).
+ */
+#define SUPERINSTRUCTION_OPCODE(first, second) OP_##first##__##second
+
+#define OPCODE_MAX_OPERANDS 3
+
+/*
+ * Operand kinds used in OPCODE_TABLE, as { size in bytes, addressing mode }.
+ * Constant indices are unsigned LEB128 numbers, so their size is the least
+ * they take; they must be the last operand, which keeps every other one at
+ * a fixed offset.
+ */
+#define OPERAND_NONE     { 0, AM_NONE }
+#define OPERAND_REG      { 1, AM_REGISTER }
+#define OPERAND_REG_MEM  { 1, AM_REGISTER_MEMORY }
+#define OPERAND_REG_PAIR { 1, AM_REGISTER_PAIR }
+#define OPERAND_IMM8     { 1, AM_IMMEDIATE }
+#define OPERAND_IMM32    { 4, AM_IMMEDIATE }
+#define OPERAND_IMM64    { 8, AM_IMMEDIATE }
+#define OPERAND_SIMM8    { 1, AM_SIGNED_IMMEDIATE }
+#define OPERAND_SIMM32   { 4, AM_SIGNED_IMMEDIATE }
+#define OPERAND_MEM      { 4, AM_MEMORY }
+#define OPERAND_CONST    { 1, AM_CONSTANT }
+#define OPERAND_TARGET   { 4, AM_TARGET }
+#define OPERAND_FRAME    { 4, AM_FRAME }
+#define OPERAND_VREG     { 1, AM_VECTOR_REGISTER }
+#define OPERAND_VREG_PAIR { 1, AM_VECTOR_REGISTER_PAIR }
+
+/* A register pair holds the first register in its high nibble. */
+#define REG_PAIR(first, second) ((uint8_t) ((first) << 4 | (second)))
+#define REG_PAIR_FIRST(pair) ((uint8_t) ((pair) >> 4))
+#define REG_PAIR_SECOND(pair) ((uint8_t) ((pair) & 0x0F))
+
+#define OPCODE_ENUM_ENTRY(opcode, handler, mnemonic, a, b, c) opcode,
+#define SUPERINSTRUCTION_ENUM_ENTRY(first, second, mnemonic) SUPERINSTRUCTION_OPCODE(first, second),
 
 typedef enum {
-    OP_NO_OP,
-    OP_HLT,
-    OP_MOV_IR,
-    OP_ADD_RR,
-    OP_SYSCALL,
-    OP_REGDUMP,
-    OP_PUSH_R_B,
-    OP_POP_R_B,
-    OP_STACK_DMP,
+    OPCODE_TABLE(OPCODE_ENUM_ENTRY)
+    SUPERINSTRUCTION_TABLE(SUPERINSTRUCTION_ENUM_ENTRY)
     OPCODE_COUNT
 } opcode_t;
 
+/*
+ * AM_MEMORY operands are a memory slot number, AM_REGISTER_MEMORY ones a
+ * register holding the slot number, AM_CONSTANT ones an index into the
+ * constant table, AM_TARGET ones an offset into the code and AM_FRAME
+ * ones a signed offset in words from %fp. AM_REGISTER_PAIR operands are
+ * two registers in one byte, and AM_SIGNED_IMMEDIATE ones are sign-extended
+ * to 64 bits. AM_VECTOR_REGISTER and AM_VECTOR_REGISTER_PAIR operands
+ * are the same for vector registers.
+ */
 typedef enum {
     AM_NONE,
     AM_IMMEDIATE,
-    AM_REGISTER
+    AM_REGISTER,
+    AM_MEMORY,
+    AM_CONSTANT,
+    AM_TARGET,
+    AM_REGISTER_MEMORY,
+    AM_FRAME,
+    AM_REGISTER_PAIR,
+    AM_SIGNED_IMMEDIATE,
+    AM_VECTOR_REGISTER,
+    AM_VECTOR_REGISTER_PAIR
 } addressing_mode_t;
 
+/*
+ * Call frames. A caller pushes the arguments and calls; the callee starts
+ * with "enter locals, args", which pushes %fp, points %fp at the next word
+ * and reserves the locals. leave undoes it before ret:
+ *
+ *   [%fp-args-2] ... [%fp-3]   arguments, first to last
+ *   [%fp-2]                    return address
+ *   [%fp-1]                    caller's %fp
+ *   [%fp] ... [%fp+locals-1]   locals, then anything pushed
+ *
+ * The caller pops the arguments after the call.
+ */
+#define FRAME_ARG_OFFSET(index, args) ((int32_t) (index) - (int32_t) (args) - 2)
+
 typedef enum {
     SYS_EXIT,
     SYS_REGDUMP,
     SYS_STACK_DUMP,
     SYS_PRINT,
+    SYS_WRITE,
+    SYS_STRING_FROM,
+    SYS_STRING_CONCAT,
+    SYS_STRING_EQUALS,
+    SYS_ERROR,
+    SYS_OPEN,
+    SYS_CLOSE,
+    SYS_READ_LINE,
+    SYS_READ_BLOCK,
+    SYS_WRITE_BLOCK,
+    SYS_ARRAY_NEW,
+    SYS_ARRAY_GET,
+    SYS_ARRAY_SET,
+    SYS_LENGTH,
+    SYS_BOX,
+    SYS_UNBOX,
+    SYS_SNAPSHOT,
 } syscall_t;
 
+/*
+ * Strings, arrays and boxes are objects in the heap of the context (see
+ * vm-heap.h), and values refer to them by handle. The string syscalls
+ * take and return handles, and so does the const instruction for string
+ * constants. Arrays and boxes have syscalls of their own:
+ *
+ *   array_new    %r1 length; returns an array of zeros
+ *   array_get    %r1 array, %r2 index; returns the element
+ *   array_set    %r1 array, %r2 index, %r3 value
+ *   length       %r1 string or array; returns its length
+ *   box          %r1 type (VT_*), %r2 value; returns the box
+ *   unbox        %r1 box; returns the value, and its type in %r1
+ *
+ * Using a handle of the wrong kind, an index out of range or more memory
+ * than the heap may grow to stops the program.
+ */
+
+/*
+ * snapshot (%r1 address and %r2 length of a path) saves the program and
+ * everything it has built to a file that blazevm can run instead (see
+ * vm-snapshot.h). It returns 0 once the file is written, or -1, and that
+ * run carries on as usual; running the file resumes right after the
+ * syscall with 1 in %r0.
+ */
+
+/*
+ * The I/O syscalls work on descriptors (see vm-io.h) and on buffers in the
+ * data memory of the program, given as a byte address and a length:
+ *
+ *   open         %r1 address and %r2 length of the path, %r3 mode
+ *   close        %r1 descriptor
+ *   read_line    %r1 descriptor, %r2 address, %r3 size
+ *   read_block   %r1 descriptor, %r2 address, %r3 size
+ *   write_block  %r1 descriptor, %r2 address, %r3 length
+ *
+ * Each returns in %r0 a descriptor, a number of bytes or 0, or -1 on
+ * errors; a buffer outside the memory stops the program instead.
+ */
+typedef enum {
+    OPEN_READ,
+    OPEN_WRITE,
+    OPEN_APPEND,
+} syscall_open_mode_t;
+
+/*
+ * Value types understood by the print, write and string syscalls (%r1).
+ * 1 and 2 were host pointers and C strings, which bytecode can no longer
+ * hold; they are invalid now, like any other unknown type. Only write
+ * takes arrays, whose elements must be boxes so that it knows their types.
+ */
+typedef enum {
+    VT_UINT,
+    VT_CHAR = 3,
+    VT_INT,
+    VT_BOOL,
+    VT_NULL,
+    VT_STRING,
+    VT_ARRAY,
+} syscall_value_type_t;
+
 typedef struct {
     size_t size;
     addressing_mode_t addrmode;
@@ -42,10 +318,51 @@ typedef struct {
 
 const char *opcode_to_str(opcode_t opcode);
 size_t opcode_get_size(opcode_t opcode);
-void opcode_get_operand_info(opcode_t opcode, operand_info_t info[2]);
-uint8_t *instruction_exec(opcode_t opcode, struct bytecode *bytecode);
 
-void execution_init();
-void execution_end();
+/*
+ * The size of the instruction at ip, of which only available bytes are
+ * there, or 0 if it does not fit or its constant index is malformed.
+ * opcode_get_size() is the least size of any instruction with the opcode.
+ */
+size_t instruction_get_size(const uint8_t *ip, size_t available);
+void opcode_get_operand_info(opcode_t opcode, operand_info_t info[OPCODE_MAX_OPERANDS]);
+uint8_t *instruction_exec(struct vm_context *vm, opcode_t opcode);
+
+/* The first instruction of a superinstruction, or the opcode itself. */
+opcode_t opcode_base(opcode_t opcode);
+
+/* What a compiler would have emitted: opcode_base(), with quickened forms turned back into syscall. */
+opcode_t opcode_generic(opcode_t opcode);
+bool opcode_get_superinstruction(opcode_t opcode, opcode_t *first, opcode_t *second);
+
+/*
+ * The opcode the instruction at offset runs as: its generic one, made the
+ * superinstruction with the instruction after it if fuse is set and there
+ * is one. Bytes that are not an instruction are left as they are.
+ */
+opcode_t instruction_fused_opcode(const uint8_t *code, size_t size, size_t offset, bool fuse);
+
+/* Identifies SUPERINSTRUCTION_TABLE, so that code fused with another one is not run. Never 0. */
+uint32_t superinstructions_id(void);
+
+/*
+ * Runs a program in a context of its own (see vm-context.h): init sets up
+ * its stack and memory, run executes it on the calling thread, and end
+ * frees them along with the error. Contexts only share the bytecode, which
+ * none of them writes, so each thread may run one.
+ */
+void execution_init(struct vm_context *vm, struct bytecode *bytecode);
+bool execution_run(struct vm_context *vm);
+void execution_end(struct vm_context *vm);
+
+/*
+ * The code a context runs, chosen the first time it is asked for, so the
+ * host must have set superinstructions and the recorder by then. Verified
+ * code runs where it is, even from a read-only mapping, unless its
+ * superinstructions differ from what the context wants; unverified code
+ * is padded with invalid opcodes. Either way the context gets a copy of
+ * its own, and the bytecode is never written.
+ */
+uint8_t *execution_code(struct vm_context *vm);
 
 #endif /* BLAZESCRIPT_OPCODE_H */
@@ -46,6 +46,7 @@ struct parser parser_init()
     parser.tokens = NULL;
     parser.filename = NULL;
     parser.filebuf = NULL;
+    parser.constants = NULL;
     return parser;
 }
 
@@ -70,6 +71,15 @@ void parser_set_filename(struct parser *parser, const char *filename)
     parser->filename = strdup(filename);
 }
 
+/*
+ * When a constant pool is set, string literals are interned into it while
+ * parsing and the evaluator hands out the pooled values directly.
+ */
+void parser_set_constpool(struct parser *parser, struct constpool *constants)
+{
+    parser->constants = constants;
+}
+
 static inline struct lex_token parser_at(struct parser *parser)
 {
     assert(parser->index < parser->token_count && "No more token to return");
@@ -155,6 +165,7 @@ ast_node_t *parser_ast_deep_copy(ast_node_t *node)
         case NODE_STRING:
             copy->string = xcalloc(1, sizeof(ast_string_t));
             copy->string->strval = strdup(node->string->strval);
+            copy->string->value = node->string->value;
             break;
 
         case NODE_INT_LIT:
@@ -780,6 +791,8 @@ static ast_node_t parser_parse_primary_expr(struct parser *parser)
             string.column_end = token.column_end;
 
             string.string->strval = strdup(token.value);
+            string.string->value = parser->constants == NULL ? NULL :
+                constpool_intern_string(parser->constants, token.value, strlen(token.value));
 
             return string;
         }
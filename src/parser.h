@@ -6,6 +6,7 @@
 #define BLAZESCRIPT_PARSER_H
 
 #include "ast.h"
+#include "constpool.h"
 #include "lexer.h"
 
 struct parser
@@ -15,6 +16,7 @@ struct parser
     struct lex_token *tokens;
     char *filename;
     char *filebuf;
+    struct constpool *constants;
 };
 
 struct parser parser_init();
@@ -24,6 +26,7 @@ ast_node_t parser_create_ast_node(struct parser *parser);
 void parser_ast_free(ast_node_t *node);
 void parser_set_tokens(struct parser *parser, struct lex_token *tokens, size_t count);
 void parser_set_filename(struct parser *parser, const char *filename);
+void parser_set_constpool(struct parser *parser, struct constpool *constants);
 ast_node_t *parser_ast_deep_copy(ast_node_t *node);
 void parser_ast_free_inner(ast_node_t *node);
 
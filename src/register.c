@@ -9,8 +9,6 @@
 #include <stdint.h>
 #include <stdio.h>
 
-uint64_t registers[REG_COUNT];
-
 static const char *register_id_to_str_lut[] = {
     [R0] = "r0",
     [R1] = "r1",
@@ -24,6 +22,8 @@ static const char *register_id_to_str_lut[] = {
     [R9] = "r9",
     [IP] = "ip",
     [IS] = "is",
+    [SP] = "sp",
+    [FP] = "fp",
 };
 
 bool is_valid_register_id(register_type_t id)
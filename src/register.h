@@ -21,12 +21,18 @@ typedef enum {
     R9,
     IP,
     IS,
+    SP,
+    FP,
     REG_COUNT
 } register_type_t;
 
+/*
+ * Registers an instruction may name as an operand. %sp and %fp are only
+ * changed by push, pop, call, ret, enter and leave.
+ */
+#define REG_OPERAND_COUNT SP
+
 const char *register_id_to_str(register_type_t id);
 bool is_valid_register_id(register_type_t id);
 
-extern uint64_t registers[REG_COUNT];
-
 #endif /* BLAZESCRIPT_REGISTER_H */
@@ -3,48 +3,99 @@
  */
 
 #include "stack.h"
-#include "alloca.h"
 #include "utils.h"
+#include <signal.h>
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
-blaze_stack_t blaze_stack_create(size_t initial_size)
-{
-    blaze_stack_t stack = {
-        .size = initial_size,
-        .bytes = xcalloc(1, initial_size),
-        .index = 0
-    };
+#define STACK_FAULT_PREFIX "\033[1;31mfatal\033[0m \033[1;31merror:\033[0m "
 
-    return stack;
+/* Faults are delivered to the thread that caused them, which may only run one VM at a time. */
+static _Thread_local const blaze_stack_t *guarded_stack;
+
+static void stack_fault_report(const char *message)
+{
+    /* Only async-signal-safe calls from here on. */
+    write(STDERR_FILENO, STACK_FAULT_PREFIX, sizeof STACK_FAULT_PREFIX - 1);
+    write(STDERR_FILENO, message, strlen(message));
+    _exit(EXIT_FAILURE);
 }
 
-static void stack_check_realloc(blaze_stack_t *stack)
+static void stack_fault_handler(int signal, siginfo_t *info, void *context)
 {
-    if (stack->index >= stack->size)
+    const blaze_stack_t *stack = guarded_stack;
+    const uint8_t *address = info->si_addr;
+    (void) context;
+
+    if (stack != NULL && address >= (const uint8_t *) stack->mapping)
     {
-        stack->size += 50;
-        stack->bytes = xrealloc(stack->bytes, sizeof (uint8_t) * (stack->size));
+        if (address < (const uint8_t *) stack->base)
+            stack_fault_report("VM stack underflow\n");
+
+        if (address >= (const uint8_t *) stack->limit &&
+            address < (const uint8_t *) stack->mapping + stack->mapping_size)
+            stack_fault_report("VM stack overflow\n");
     }
+
+    /* Not ours: crash as if there were no handler. */
+    struct sigaction action = { .sa_handler = SIG_DFL };
+    sigaction(signal, &action, NULL);
 }
 
-uint8_t *blaze_stack_push_byte(blaze_stack_t *stack, uint8_t byte)
+/* Installing the same handler again changes nothing, and needs no lock between threads. */
+static void stack_install_fault_handler()
 {
-    stack_check_realloc(stack);
-    stack->bytes[stack->index++] = byte;
-    return stack->bytes + stack->index - 1;
+    struct sigaction action = {
+        .sa_sigaction = stack_fault_handler,
+        .sa_flags = SA_SIGINFO
+    };
+
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(SIGSEGV, &action, NULL) != 0)
+        fatal_error("could not install the VM stack fault handler");
 }
 
-uint8_t blaze_stack_pop_byte(blaze_stack_t *stack)
+blaze_stack_t blaze_stack_create(size_t size)
 {
-    if (stack->index == 0)
-        fatal_error("Stack is empty");
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    size = (size + page_size - 1) / page_size * page_size;
 
-    return stack->bytes[--stack->index];
+    size_t mapping_size = size + 2 * page_size;
+    uint8_t *mapping = mmap(NULL, mapping_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (mapping == MAP_FAILED || mprotect(mapping + page_size, size, PROT_READ | PROT_WRITE) != 0)
+        fatal_error("could not allocate the VM stack");
+
+    blaze_stack_t stack = {
+        .base = (uint64_t *) (mapping + page_size),
+        .limit = (uint64_t *) (mapping + page_size + size),
+        .mapping = mapping,
+        .mapping_size = mapping_size
+    };
+
+    stack_install_fault_handler();
+    return stack;
+}
+
+void blaze_stack_guard(const blaze_stack_t *stack)
+{
+    guarded_stack = stack;
 }
 
 void blaze_stack_free(blaze_stack_t *stack)
 {
-    free(stack->bytes);
-    stack->size = 0;
-    stack->index = 0;
-}
\ No newline at end of file
+    if (guarded_stack == stack)
+        guarded_stack = NULL;
+
+    if (stack->mapping != NULL)
+        munmap(stack->mapping, stack->mapping_size);
+
+    stack->base = NULL;
+    stack->limit = NULL;
+    stack->mapping = NULL;
+    stack->mapping_size = 0;
+}
@@ -8,15 +8,46 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/*
+ * The VM stack: 64-bit words in a mapping of their own, with a guard page
+ * on each side that cannot be accessed. The stack grows upwards and %sp
+ * points at the next free word.
+ *
+ * Pushes and pops do not check the bounds: running into a guard page
+ * raises SIGSEGV, which is reported as a stack overflow or underflow.
+ * Only instructions that move %sp by more than a word at a time, such as
+ * enter, have to compare it with limit.
+ */
 typedef struct {
-    uint8_t *bytes;
-    size_t size;
-    size_t index;
+    uint64_t *base;
+    uint64_t *limit;
+    void *mapping;
+    size_t mapping_size;
 } blaze_stack_t;
 
-blaze_stack_t blaze_stack_create(size_t initial_size);
-uint8_t *blaze_stack_push_byte(blaze_stack_t *stack, uint8_t byte);
-uint8_t blaze_stack_pop_byte(blaze_stack_t *stack);
+/* Maps a stack of at least size bytes. */
+blaze_stack_t blaze_stack_create(size_t size);
+
+/*
+ * Makes faults on the guard pages of this stack fatal errors in the
+ * calling thread; it must not move. Guarding NULL turns that off.
+ */
+void blaze_stack_guard(const blaze_stack_t *stack);
 void blaze_stack_free(blaze_stack_t *stack);
 
+/* Pushes a word at the stack pointer held in *sp. */
+static inline void blaze_stack_push(uint64_t *sp, uint64_t value)
+{
+    uint64_t *top = (uint64_t *) *sp;
+    *top = value;
+    *sp = (uint64_t) (top + 1);
+}
+
+static inline uint64_t blaze_stack_pop(uint64_t *sp)
+{
+    uint64_t *top = (uint64_t *) *sp - 1;
+    *sp = (uint64_t) top;
+    return *top;
+}
+
 #endif /* BLAZESCRIPT_STACK_H */
@@ -0,0 +1,28 @@
+/*
+ * Generated by "make superinstructions" from the pairs of instructions
+ * the benchmarks ran most often; do not edit. The comments give how many
+ * times each pair ran.
+ */
+
+#ifndef BLAZESCRIPT_SUPERINSTRUCTIONS_H
+#define BLAZESCRIPT_SUPERINSTRUCTIONS_H
+
+#define SUPERINSTRUCTION_TABLE(X) \
+    X(MOV_RR, MOV_IR8, "mov+mov")              /*      7000004 */ \
+    X(MOV_RR, MOV_RR, "mov+mov")               /*      7000000 */ \
+    X(LOAD_RM, LOAD_RM, "load+load")           /*      6000004 */ \
+    X(LOAD_RM, JGE_RR, "load+jge")             /*      4000004 */ \
+    X(MOV_IR8, ADD_RR, "mov+add")              /*      4000001 */ \
+    X(ADD_RR, STORE_MR, "add+store")           /*      4000001 */ \
+    X(LOAD_RM, MOV_IR8, "load+mov")            /*      4000001 */ \
+    X(STORE_MR, JMP, "store+jmp")              /*      4000000 */ \
+    X(CONST_RK, MOV_RR, "const+mov")           /*      4000000 */ \
+    X(STORE_MR, LOAD_RM, "store+load")         /*      3000004 */ \
+    X(MOV_RR, STORE_MR, "mov+store")           /*      3000000 */ \
+    X(MOV_IR8, MOV_IR8, "mov+mov")             /*      2000012 */ \
+    X(MOV_RR, JZ_R, "mov+jz")                  /*      2000000 */ \
+    X(LOAD_RM, CONST_RK, "load+const")         /*      2000000 */ \
+    X(LOAD_RM, MOV_RR, "load+mov")             /*      1000004 */ \
+    X(MOV_RR, CONST_RK, "mov+const")           /*      1000000 */
+
+#endif /* BLAZESCRIPT_SUPERINSTRUCTIONS_H */
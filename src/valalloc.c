@@ -15,39 +15,47 @@ struct val_alloc_tbl val_alloc_tbl_init()
     struct val_alloc_tbl value = {
         .size = 0,
         .capacity = VAL_TBL_INIT_CAP,
-        .values = xcalloc(sizeof (val_t), VAL_TBL_INIT_CAP),
+        .chunk_count = 1,
+        .chunks = xcalloc(1, sizeof (val_t *)),
         .head = NULL
     };
 
+    value.chunks[0] = xcalloc(sizeof (val_t), VAL_TBL_INIT_CAP);
     return value;
 }
 
 bool val_alloc_tbl_resize(struct val_alloc_tbl *tbl)
 {
-    if (tbl->size < tbl->capacity - 1)
+    if (tbl->size < tbl->capacity)
         return false;
 
-    log_warn("Resizing allocation table");
+    log_debug("Adding a chunk to the allocation table");
 
-    tbl->capacity *= 2;
-    tbl->values = xrealloc(tbl->values, (sizeof (val_t)) * tbl->capacity);
+    tbl->chunks = xrealloc(tbl->chunks, (sizeof (val_t *)) * (++tbl->chunk_count));
+    tbl->chunks[tbl->chunk_count - 1] = xcalloc(sizeof (val_t), VAL_TBL_INIT_CAP);
+    tbl->capacity += VAL_TBL_INIT_CAP;
     return true;
 }
 
+static inline val_t *val_alloc_tbl_at(struct val_alloc_tbl *tbl, size_t index)
+{
+    return &tbl->chunks[index / VAL_TBL_INIT_CAP][index % VAL_TBL_INIT_CAP];
+}
+
 val_t *val_alloc(struct val_alloc_tbl *tbl)
 {
     if (tbl->head != NULL)
     {
         struct val_alloc_free_node *free_node = tbl->head;
-        size_t index = free_node->index;
-        log_debug("Restoring memory: %zu", index);
+        val_t *val = free_node->ptr;
+        log_debug("Restoring memory: %p", val);
         tbl->head = free_node->next;
         free(free_node);
-        return &tbl->values[index];
+        return val;
     }
 
     val_alloc_tbl_resize(tbl);
-    val_t *val = &tbl->values[tbl->size++];
+    val_t *val = val_alloc_tbl_at(tbl, tbl->size++);
     val->nofree = false;
     val->self_ptr = val;
     return val;
@@ -55,8 +63,13 @@ val_t *val_alloc(struct val_alloc_tbl *tbl)
 
 val_t *val_multi_alloc(struct val_alloc_tbl *tbl, size_t n)
 {
+    assert(n <= VAL_TBL_INIT_CAP && "Too many values requested at once");
+
+    if ((tbl->size % VAL_TBL_INIT_CAP) + n > VAL_TBL_INIT_CAP)
+        tbl->size += VAL_TBL_INIT_CAP - (tbl->size % VAL_TBL_INIT_CAP);
+
     val_alloc_tbl_resize(tbl);
-    val_t *ptr = tbl->values + tbl->size;
+    val_t *ptr = val_alloc_tbl_at(tbl, tbl->size);
     tbl->size += n;
     return ptr;
 }
@@ -65,7 +78,7 @@ void val_alloc_free(struct val_alloc_tbl *tbl, val_t *ptr, bool free_inner)
 {
     struct val_alloc_free_node *free_node = tbl->head;
     tbl->head = xcalloc(1, sizeof (struct val_alloc_free_node));
-    tbl->head->index = ptr - tbl->values;
+    tbl->head->ptr = ptr;
     tbl->head->next = free_node;
 
     if (free_inner)
@@ -83,10 +96,11 @@ void val_alloc_tbl_free(struct val_alloc_tbl *tbl, bool recursive)
     {
         for (size_t i = 0; i < tbl->size; i++)
         {
-            log_debug("%s", val_type_to_str(tbl->values[i].type));
+            val_t *val = val_alloc_tbl_at(tbl, i);
+            log_debug("%s", val_type_to_str(val->type));
 
-            if (tbl->values[i].type != VAL_NULL)
-                val_free_force_no_root(&tbl->values[i]);
+            if (val->type != VAL_NULL)
+                val_free_force_no_root(val);
         }
     }
 
@@ -99,5 +113,8 @@ void val_alloc_tbl_free(struct val_alloc_tbl *tbl, bool recursive)
         node = tmp;
     }
 
-    free(tbl->values);
+    for (size_t i = 0; i < tbl->chunk_count; i++)
+        free(tbl->chunks[i]);
+
+    free(tbl->chunks);
 }
\ No newline at end of file
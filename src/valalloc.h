@@ -12,17 +12,22 @@
 #define VAL_TBL_INIT_CAP 4096
 #endif
 
+/*
+ * Values are handed out from fixed-size chunks that are never moved, so
+ * pointers to them can be kept in arrays and maps across table growth.
+ */
 struct val_alloc_tbl
 {
     size_t size;
     size_t capacity;
-    val_t *values;
+    size_t chunk_count;
+    val_t **chunks;
     struct val_alloc_free_node *head;
 };
 
 struct val_alloc_free_node
 {
-    size_t index;
+    val_t *ptr;
     struct val_alloc_free_node *next;
 };
 
@@ -0,0 +1,81 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_VM_CONTEXT_H
+#define BLAZESCRIPT_VM_CONTEXT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bytecode.h"
+#include "register.h"
+#include "stack.h"
+#include "vm-heap.h"
+#include "vm-io.h"
+#include "vm-vector.h"
+
+/*
+ * Everything a running program owns: its registers and vector registers
+ * (see vm-vector.h), stack and data memory, its descriptors, and how it
+ * stopped. The VM keeps no other state of its own, so a host may run one
+ * context per thread at the same time. See execution_init() in opcode.h.
+ *
+ * Contexts never write the bytecode they run: what they learn while
+ * running it and any copy of its code they need are theirs (see code
+ * below), so any number of them may run one program, loaded or compiled
+ * once, as long as it outlives them. Their constants may come from the
+ * same pool, since constant strings are immortal and never written.
+ *
+ * error is set when the program fails and is freed by execution_end();
+ * exit_code is what the program passed to the exit syscall. io starts
+ * with the standard streams of the process; output is buffered and
+ * written when execution_run() returns. superinstructions, on by
+ * default, makes execution_run() fuse verified code.
+ *
+ * With jit set, execution_run() translates verified code to native code
+ * first (see jit.h) and keeps it in native for later runs; programs the
+ * JIT cannot translate are interpreted. perf_map makes it describe that
+ * code for perf.
+ *
+ * A recorder set by the host is owned by the context from then on:
+ * execution_run() feeds it every instruction of verified code, which it
+ * then runs without the JIT or superinstructions, and dumps it if the
+ * program fails.
+ *
+ * A profile set by the host (see vm-profile.h) is owned the same way;
+ * execution_run() counts the instructions of verified code in it,
+ * superinstructions included, and runs it without the JIT.
+ *
+ * entry is the code offset execution_run() starts at: 0, unless the
+ * context was resumed from a snapshot (see vm-snapshot.h).
+ *
+ * code is what the context runs, chosen by execution_code() (see
+ * opcode.h), and quickening is what it has learnt about its syscalls, by
+ * code offset; it is only allocated once one of them has run.
+ */
+struct vm_context
+{
+    uint64_t registers[REG_COUNT];
+    vm_vector_t vectors[VREG_COUNT];
+    blaze_stack_t stack;
+    uint64_t *memory;
+    size_t memory_size;
+    struct bytecode *bytecode;
+    uint8_t *code;
+    struct bytecode_quickening *quickening;
+    size_t entry;
+    uint64_t *constants;
+    struct vm_heap heap;
+    struct vm_io io;
+    bool superinstructions;
+    bool jit;
+    bool perf_map;
+    struct jit *native;
+    struct vm_recorder *recorder;
+    struct vm_profile *profile;
+    char *error;
+    uint8_t exit_code;
+};
+
+#endif /* BLAZESCRIPT_VM_CONTEXT_H */
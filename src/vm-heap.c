@@ -0,0 +1,402 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#include "vm-heap.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Free entries of the handle table link to the next one, with this bit set. */
+#define HANDLE_FREE ((uint64_t) 1 << 63)
+#define HANDLE_NONE ((size_t) (HANDLE_FREE - 1))
+
+#define OBJECT_BYTES(size) (sizeof (struct vm_object) + (((size) + 7) & ~(size_t) 7))
+
+void vm_heap_init(struct vm_heap *heap, vm_heap_roots_t roots)
+{
+    *heap = (struct vm_heap) {
+        .limit = VM_HEAP_DEFAULT_LIMIT,
+        .free_handle = HANDLE_NONE,
+        .roots = roots
+    };
+}
+
+void vm_heap_free(struct vm_heap *heap)
+{
+    if (!heap->borrowed)
+        free(heap->space);
+
+    free(heap->handles);
+    *heap = (struct vm_heap) { .free_handle = HANDLE_NONE };
+}
+
+void vm_heap_pin(struct vm_heap *heap)
+{
+    heap->pinned = heap->handle_count;
+}
+
+static struct vm_object *object_at(const struct vm_heap *heap, size_t offset)
+{
+    return (struct vm_object *) (heap->space + offset);
+}
+
+struct vm_object *vm_heap_get(struct vm_heap *heap, uint64_t value)
+{
+    uint64_t index = value & ~VM_HEAP_TAG_MASK;
+
+    if ((value & VM_HEAP_TAG_MASK) != VM_HEAP_TAG || index >= heap->handle_count ||
+        (heap->handles[index] & HANDLE_FREE) != 0)
+        return NULL;
+
+    return object_at(heap, heap->handles[index]);
+}
+
+/* Checks one object of a heap being adopted; slices are checked once all objects are known. */
+static bool object_valid(const struct vm_heap *heap, size_t offset)
+{
+    const struct vm_object *object = object_at(heap, offset);
+
+    if (heap->used - offset < sizeof (struct vm_object) ||
+        OBJECT_BYTES(object->size) < object->size ||
+        OBJECT_BYTES(object->size) > heap->used - offset ||
+        object->handle >= heap->handle_count || heap->handles[object->handle] != offset)
+        return false;
+
+    switch (object->type)
+    {
+        case VM_OBJECT_STRING:
+            return object->length <= object->size;
+
+        case VM_OBJECT_ARRAY:
+            return object->length <= object->size / sizeof (uint64_t);
+
+        case VM_OBJECT_SLICE:
+        case VM_OBJECT_BOX:
+            return object->size >= sizeof (uint64_t);
+
+        default:
+            return false;
+    }
+}
+
+bool vm_heap_adopt(struct vm_heap *heap, uint8_t *space, size_t used, const uint64_t *handles,
+                   size_t handle_count, size_t free_handle, size_t pinned)
+{
+    struct vm_heap adopted = {
+        .space = space,
+        .borrowed = true,
+        .used = used,
+        .size = used,
+        .limit = heap->limit,
+        .handles = xmalloc((handle_count == 0 ? 1 : handle_count) * sizeof (uint64_t)),
+        .handle_count = handle_count,
+        .handle_cap = handle_count == 0 ? 1 : handle_count,
+        .free_handle = free_handle,
+        .pinned = pinned,
+        .roots = heap->roots
+    };
+    bool valid = pinned <= handle_count && handle_count <= UINT32_MAX &&
+                 (free_handle == HANDLE_NONE || free_handle < handle_count);
+
+    memcpy(adopted.handles, handles, handle_count * sizeof (uint64_t));
+
+    size_t live = 0, objects = 0;
+
+    for (size_t i = 0; valid && i < handle_count; i++)
+    {
+        uint64_t next = handles[i] & ~HANDLE_FREE;
+
+        if ((handles[i] & HANDLE_FREE) == 0)
+            live++;
+        else if (next != HANDLE_NONE && next >= handle_count)
+            valid = false;
+    }
+
+    /*
+     * Every object has a handle of its own, so that makes every live handle
+     * lead to one. The size of an object is only read once it is known to
+     * fit, so a truncated heap stops the walk before it runs past the end.
+     */
+    for (size_t offset = 0; valid && offset < used; objects++)
+    {
+        if (!object_valid(&adopted, offset))
+        {
+            valid = false;
+            break;
+        }
+
+        offset += OBJECT_BYTES(object_at(&adopted, offset)->size);
+    }
+
+    valid = valid && objects == live;
+
+    for (size_t offset = 0; valid && offset < used; offset += OBJECT_BYTES(object_at(&adopted, offset)->size))
+    {
+        struct vm_object *object = object_at(&adopted, offset);
+        struct vm_object *target = object->type == VM_OBJECT_SLICE ? vm_heap_get(&adopted, object->data[0]) : NULL;
+
+        if (object->type == VM_OBJECT_SLICE &&
+            (target == NULL || target->type != VM_OBJECT_STRING || object->length > target->size))
+            valid = false;
+    }
+
+    if (!valid)
+    {
+        free(adopted.handles);
+        return false;
+    }
+
+    vm_heap_free(heap);
+    *heap = adopted;
+    return true;
+}
+
+void vm_heap_mark(struct vm_heap *heap, const uint64_t *words, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        struct vm_object *object = vm_heap_get(heap, words[i]);
+
+        if (object == NULL || heap->marks[object->handle])
+            continue;
+
+        heap->marks[object->handle] = 1;
+        heap->mark_stack[heap->mark_count++] = object->handle;
+    }
+}
+
+/* Marks everything reachable from the roots. */
+static void mark_live(struct vm_heap *heap)
+{
+    heap->marks = xcalloc(heap->handle_count == 0 ? 1 : heap->handle_count, 1);
+    heap->mark_stack = xmalloc((heap->handle_count == 0 ? 1 : heap->handle_count) * sizeof (uint32_t));
+    heap->mark_count = 0;
+
+    for (size_t i = 0; i < heap->pinned; i++)
+    {
+        heap->marks[i] = 1;
+        heap->mark_stack[heap->mark_count++] = (uint32_t) i;
+    }
+
+    vm_heap_mark(heap, &heap->held, 1);
+    heap->roots(heap);
+
+    while (heap->mark_count > 0)
+    {
+        struct vm_object *object = object_at(heap, heap->handles[heap->mark_stack[--heap->mark_count]]);
+
+        switch (object->type)
+        {
+            case VM_OBJECT_ARRAY:
+                vm_heap_mark(heap, object->data, object->length);
+                break;
+
+            case VM_OBJECT_SLICE:
+            case VM_OBJECT_BOX:
+                vm_heap_mark(heap, object->data, 1);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+bool vm_heap_collect(struct vm_heap *heap, size_t needed)
+{
+    size_t live = needed;
+
+    mark_live(heap);
+
+    for (size_t offset = 0; offset < heap->used; offset += OBJECT_BYTES(object_at(heap, offset)->size))
+    {
+        if (heap->marks[object_at(heap, offset)->handle])
+            live += OBJECT_BYTES(object_at(heap, offset)->size);
+    }
+
+    size_t size = VM_HEAP_INITIAL_SIZE;
+
+    while (size < live * 2 && size < heap->limit)
+        size *= 2;
+
+    if (size > heap->limit)
+        size = heap->limit;
+
+    if (size < live - needed)
+        size = live - needed;
+
+    uint8_t *space = xmalloc(size == 0 ? 1 : size);
+    size_t used = 0;
+
+    /* Copied in address order, so objects allocated together stay together. */
+    for (size_t offset = 0, bytes; offset < heap->used; offset += bytes)
+    {
+        struct vm_object *object = object_at(heap, offset);
+        bytes = OBJECT_BYTES(object->size);
+
+        if (heap->marks[object->handle])
+        {
+            memcpy(space + used, object, bytes);
+            heap->handles[object->handle] = used;
+            used += bytes;
+        }
+        else
+        {
+            heap->handles[object->handle] = HANDLE_FREE | heap->free_handle;
+            heap->free_handle = object->handle;
+        }
+    }
+
+    free(heap->marks);
+    free(heap->mark_stack);
+
+    if (!heap->borrowed)
+        free(heap->space);
+
+    heap->marks = NULL;
+    heap->mark_stack = NULL;
+    heap->space = space;
+    heap->borrowed = false;
+    heap->size = size;
+    heap->used = used;
+    heap->collections++;
+    return needed <= size - used;
+}
+
+static uint64_t new_handle(struct vm_heap *heap, size_t offset)
+{
+    size_t index = heap->free_handle;
+
+    if (index != HANDLE_NONE)
+        heap->free_handle = (size_t) (heap->handles[index] & ~HANDLE_FREE);
+    else
+    {
+        if (heap->handle_count == UINT32_MAX)
+            return 0;
+
+        if (heap->handle_count == heap->handle_cap)
+        {
+            heap->handle_cap = heap->handle_cap == 0 ? 1024 : heap->handle_cap * 2;
+            heap->handles = xrealloc(heap->handles, heap->handle_cap * sizeof (uint64_t));
+        }
+
+        index = heap->handle_count++;
+    }
+
+    heap->handles[index] = offset;
+    return VM_HEAP_TAG | index;
+}
+
+uint64_t vm_heap_alloc(struct vm_heap *heap, enum vm_object_type type, uint64_t length, size_t size)
+{
+    size_t bytes = OBJECT_BYTES(size);
+
+    if (bytes < size || (bytes > heap->size - heap->used && !vm_heap_collect(heap, bytes)))
+        return 0;
+
+    uint64_t handle = new_handle(heap, heap->used);
+
+    if (handle == 0)
+        return 0;
+
+    struct vm_object *object = object_at(heap, heap->used);
+
+    *object = (struct vm_object) {
+        .type = type,
+        .handle = (uint32_t) (handle & ~VM_HEAP_TAG_MASK),
+        .length = length,
+        .size = size
+    };
+
+    memset(object->data, 0, bytes - sizeof (struct vm_object));
+    heap->used += bytes;
+    return handle;
+}
+
+uint64_t vm_heap_string(struct vm_heap *heap, const char *data, size_t length)
+{
+    uint64_t handle = vm_heap_alloc(heap, VM_OBJECT_STRING, length, length);
+
+    if (handle != 0)
+        memcpy(vm_heap_get(heap, handle)->data, data, length);
+
+    return handle;
+}
+
+const char *vm_heap_string_data(struct vm_heap *heap, uint64_t value, size_t *length)
+{
+    struct vm_object *object = vm_heap_get(heap, value);
+
+    if (object == NULL)
+        return NULL;
+
+    if (object->type == VM_OBJECT_SLICE)
+    {
+        *length = object->length;
+        return (const char *) vm_heap_get(heap, object->data[0])->data;
+    }
+
+    if (object->type != VM_OBJECT_STRING)
+        return NULL;
+
+    *length = object->length;
+    return (const char *) object->data;
+}
+
+uint64_t vm_heap_concat(struct vm_heap *heap, uint64_t left, uint64_t right)
+{
+    size_t left_length, right_length;
+
+    if (vm_heap_string_data(heap, left, &left_length) == NULL ||
+        vm_heap_string_data(heap, right, &right_length) == NULL)
+        return 0;
+
+    struct vm_object *object = vm_heap_get(heap, left);
+    uint64_t base = object->type == VM_OBJECT_SLICE ? object->data[0] : left;
+    struct vm_object *storage = vm_heap_get(heap, base);
+
+    if (storage->length == left_length && storage->size - storage->length >= right_length)
+    {
+        /* If this collects, left keeps base alive; only its address changes. */
+        uint64_t slice = vm_heap_alloc(heap, VM_OBJECT_SLICE, left_length + right_length, sizeof (uint64_t));
+
+        if (slice == 0)
+            return 0;
+
+        const char *data = vm_heap_string_data(heap, right, &right_length);
+        storage = vm_heap_get(heap, base);
+        memmove((char *) storage->data + storage->length, data, right_length);
+        storage->length += right_length;
+        vm_heap_get(heap, slice)->data[0] = base;
+        return slice;
+    }
+
+    /*
+     * A string with room to grow is only ever referred to through slices,
+     * since appending to it changes its length.
+     */
+    size_t length = left_length + right_length;
+    bool slack = length >= VM_HEAP_STRING_SLACK_MIN;
+    uint64_t result = vm_heap_alloc(heap, VM_OBJECT_STRING, length, slack ? length * 2 : length);
+
+    if (result == 0)
+        return 0;
+
+    char *data = (char *) vm_heap_get(heap, result)->data;
+
+    memcpy(data, vm_heap_string_data(heap, left, &left_length), left_length);
+    memcpy(data + left_length, vm_heap_string_data(heap, right, &right_length), right_length);
+
+    if (!slack)
+        return result;
+
+    heap->held = result;
+    uint64_t slice = vm_heap_alloc(heap, VM_OBJECT_SLICE, length, sizeof (uint64_t));
+    heap->held = 0;
+
+    if (slice != 0)
+        vm_heap_get(heap, slice)->data[0] = result;
+
+    return slice;
+}
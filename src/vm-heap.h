@@ -0,0 +1,129 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_VM_HEAP_H
+#define BLAZESCRIPT_VM_HEAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Handles are what registers, the stack, memory and arrays hold to refer
+ * to objects: an index into the handle table with VM_HEAP_TAG in the top
+ * bits, so that integers are unlikely to look like one.
+ */
+#define VM_HEAP_TAG ((uint64_t) 0xB1A2 << 48)
+#define VM_HEAP_TAG_MASK ((uint64_t) 0xFFFF << 48)
+
+#define VM_HEAP_INITIAL_SIZE ((size_t) 256 * 1024)
+#define VM_HEAP_DEFAULT_LIMIT ((size_t) 256 * 1024 * 1024)
+
+/* Strings shorter than this are allocated to fit; see vm_heap_concat(). */
+#define VM_HEAP_STRING_SLACK_MIN 64
+
+enum vm_object_type
+{
+    VM_OBJECT_STRING = 1,
+    VM_OBJECT_SLICE,
+    VM_OBJECT_ARRAY,
+    VM_OBJECT_BOX
+};
+
+/*
+ * An object in the heap. size is the number of payload bytes that follow,
+ * and what length means depends on the type:
+ *
+ *   string  the bytes in use; size is its capacity
+ *   slice   a string made of the first length bytes of the string whose
+ *           handle is data[0]
+ *   array   the number of elements, each a word in data
+ *   box     the type (VT_*) of the value in data[0]
+ */
+struct vm_object
+{
+    uint32_t type;
+    uint32_t handle;
+    uint64_t length;
+    uint64_t size;
+    uint64_t data[];
+};
+
+struct vm_heap;
+
+/*
+ * Marks the roots of the program with vm_heap_mark(). They are scanned
+ * conservatively, since values carry no type: any word that is the handle
+ * of an object keeps it alive. Objects only ever move behind their handle,
+ * so the roots need no updating.
+ */
+typedef void (*vm_heap_roots_t)(struct vm_heap *heap);
+
+/*
+ * The heap of a context: objects are bump-allocated in one space, and
+ * when it is full the ones reachable from the roots are copied to a new
+ * space, which is grown or shrunk to twice what survived but never beyond
+ * limit. The first pinned handles are always alive, and so is held,
+ * which keeps an object the heap is still building. A borrowed space,
+ * such as the mapping of a snapshot, is left to its owner instead of
+ * being freed.
+ */
+struct vm_heap
+{
+    uint8_t *space;
+    bool borrowed;
+    size_t used;
+    size_t size;
+    size_t limit;
+    uint64_t *handles;
+    size_t handle_count;
+    size_t handle_cap;
+    size_t free_handle;
+    size_t pinned;
+    size_t collections;
+    vm_heap_roots_t roots;
+    uint64_t held;
+    uint8_t *marks;
+    uint32_t *mark_stack;
+    size_t mark_count;
+};
+
+void vm_heap_init(struct vm_heap *heap, vm_heap_roots_t roots);
+void vm_heap_free(struct vm_heap *heap);
+
+/* Makes every object allocated so far live for as long as the heap. */
+void vm_heap_pin(struct vm_heap *heap);
+
+/* Returns the handle of a new object with size zeroed payload bytes, or 0 if the heap is full. */
+uint64_t vm_heap_alloc(struct vm_heap *heap, enum vm_object_type type, uint64_t length, size_t size);
+
+/* The object a word is the handle of, or NULL. It is valid until the next allocation. */
+struct vm_object *vm_heap_get(struct vm_heap *heap, uint64_t value);
+
+/*
+ * Takes over the objects and handle table of another heap, as saved by a
+ * snapshot: space is borrowed and handles copied. Returns false, leaving
+ * the heap as it was, if they do not describe a consistent heap.
+ */
+bool vm_heap_adopt(struct vm_heap *heap, uint8_t *space, size_t used, const uint64_t *handles,
+                   size_t handle_count, size_t free_handle, size_t pinned);
+
+void vm_heap_mark(struct vm_heap *heap, const uint64_t *words, size_t count);
+bool vm_heap_collect(struct vm_heap *heap, size_t needed);
+
+uint64_t vm_heap_string(struct vm_heap *heap, const char *data, size_t length);
+
+/*
+ * Concatenates two strings. A string with spare capacity whose last byte
+ * is the last byte of the left operand is appended to in place, and the
+ * result is a slice of it, so building a string piece by piece copies
+ * each byte a constant number of times on average. Both operands must be
+ * reachable from the roots, since allocating may collect.
+ */
+uint64_t vm_heap_concat(struct vm_heap *heap, uint64_t left, uint64_t right);
+
+/* The bytes of a string or slice, or NULL if value is not one. */
+const char *vm_heap_string_data(struct vm_heap *heap, uint64_t value, size_t *length);
+
+#endif /* BLAZESCRIPT_VM_HEAP_H */
@@ -0,0 +1,308 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#define _GNU_SOURCE
+
+#include "vm-io.h"
+#include "opcode.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static struct vm_file vm_file_create(int fd, bool writable)
+{
+    return (struct vm_file) {
+        .fd = fd,
+        .writable = writable,
+        .buffer = xmalloc(VM_IO_BUFFER_SIZE)
+    };
+}
+
+void vm_io_init(struct vm_io *io)
+{
+    io->count = 3;
+    io->files = xcalloc(io->count, sizeof (struct vm_file));
+    io->files[VM_STDIN] = vm_file_create(STDIN_FILENO, false);
+    io->files[VM_STDOUT] = vm_file_create(STDOUT_FILENO, true);
+    io->files[VM_STDERR] = vm_file_create(STDERR_FILENO, true);
+}
+
+void vm_io_free(struct vm_io *io)
+{
+    vm_io_flush(io);
+
+    for (size_t i = 0; i < io->count; i++)
+    {
+        if (io->files[i].fd >= 0 && i > VM_STDERR)
+            close(io->files[i].fd);
+
+        free(io->files[i].buffer);
+    }
+
+    free(io->files);
+    io->files = NULL;
+    io->count = 0;
+}
+
+bool vm_io_flush(struct vm_io *io)
+{
+    bool ok = true;
+
+    for (size_t i = 0; i < io->count; i++)
+    {
+        if (io->files[i].fd >= 0 && io->files[i].writable && !vm_file_flush(&io->files[i]))
+            ok = false;
+    }
+
+    return ok;
+}
+
+struct vm_file *vm_io_get(struct vm_io *io, uint64_t descriptor)
+{
+    if (descriptor >= io->count || io->files[descriptor].fd < 0)
+    {
+        errno = EBADF;
+        return NULL;
+    }
+
+    return &io->files[descriptor];
+}
+
+int64_t vm_io_open(struct vm_io *io, const char *path, uint64_t mode)
+{
+    static const int flags[] = {
+        [OPEN_READ] = O_RDONLY,
+        [OPEN_WRITE] = O_WRONLY | O_CREAT | O_TRUNC,
+        [OPEN_APPEND] = O_WRONLY | O_CREAT | O_APPEND
+    };
+
+    if (mode > OPEN_APPEND)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = open(path, flags[mode] | O_CLOEXEC, 0666);
+
+    if (fd < 0)
+        return -1;
+
+    size_t descriptor = VM_STDERR + 1;
+
+    while (descriptor < io->count && io->files[descriptor].fd >= 0)
+        descriptor++;
+
+    if (descriptor == io->count)
+        io->files = xrealloc(io->files, ++io->count * sizeof (struct vm_file));
+
+    io->files[descriptor] = vm_file_create(fd, mode != OPEN_READ);
+    return (int64_t) descriptor;
+}
+
+bool vm_io_close(struct vm_io *io, uint64_t descriptor)
+{
+    struct vm_file *file = vm_io_get(io, descriptor);
+
+    if (file == NULL || descriptor <= VM_STDERR)
+    {
+        errno = EBADF;
+        return false;
+    }
+
+    bool ok = !file->writable || vm_file_flush(file);
+
+    if (close(file->fd) != 0)
+        ok = false;
+
+    free(file->buffer);
+    *file = (struct vm_file) { .fd = -1 };
+    return ok;
+}
+
+static bool write_all(int fd, const uint8_t *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        data += written;
+        size -= (size_t) written;
+    }
+
+    return true;
+}
+
+bool vm_file_flush(struct vm_file *file)
+{
+    bool ok = write_all(file->fd, file->buffer, file->end);
+
+    /* What could not be written is dropped, like stdio does. */
+    file->end = 0;
+    return ok;
+}
+
+bool vm_file_write(struct vm_file *file, const void *data, size_t size)
+{
+    if (!file->writable)
+    {
+        errno = EBADF;
+        return false;
+    }
+
+    if (size <= VM_IO_BUFFER_SIZE - file->end)
+    {
+        memcpy(file->buffer + file->end, data, size);
+        file->end += size;
+        return true;
+    }
+
+    if (!vm_file_flush(file))
+        return false;
+
+    /* Blocks as big as the buffer gain nothing from a copy. */
+    if (size >= VM_IO_BUFFER_SIZE)
+        return write_all(file->fd, data, size);
+
+    memcpy(file->buffer, data, size);
+    file->end = size;
+    return true;
+}
+
+bool vm_file_printf(struct vm_file *file, const char *fmt, ...)
+{
+    size_t available = VM_IO_BUFFER_SIZE - file->end;
+    va_list args;
+
+    va_start(args, fmt);
+    int length = vsnprintf((char *) file->buffer + file->end, available, fmt, args);
+    va_end(args);
+
+    if (length < 0)
+        return false;
+
+    if ((size_t) length < available)
+    {
+        file->end += (size_t) length;
+        return true;
+    }
+
+    /* It did not fit, so it is formatted again on its own. */
+    char *text;
+
+    va_start(args, fmt);
+    length = vasprintf(&text, fmt, args);
+    va_end(args);
+
+    if (length < 0)
+        return false;
+
+    bool ok = vm_file_write(file, text, (size_t) length);
+
+    free(text);
+    return ok;
+}
+
+/* Writes a number in decimal, which printing does far more often than anything else. */
+bool vm_file_write_int(struct vm_file *file, int64_t value)
+{
+    char digits[20];
+    char *start = digits + sizeof digits;
+    uint64_t magnitude = value < 0 ? (uint64_t) 0 - (uint64_t) value : (uint64_t) value;
+
+    do
+    {
+        *--start = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    }
+    while (magnitude != 0);
+
+    if (value < 0 && !vm_file_putc(file, '-'))
+        return false;
+
+    return vm_file_write(file, start, (size_t) (digits + sizeof digits - start));
+}
+
+/* Refills an empty read buffer; false at the end of the file or on errors. */
+static bool vm_file_fill(struct vm_file *file, bool *failed)
+{
+    if (file->eof)
+        return false;
+
+    ssize_t count;
+
+    do
+        count = read(file->fd, file->buffer, VM_IO_BUFFER_SIZE);
+    while (count < 0 && errno == EINTR);
+
+    if (count <= 0)
+    {
+        file->eof = count == 0;
+        *failed = count < 0;
+        return false;
+    }
+
+    file->start = 0;
+    file->end = (size_t) count;
+    return true;
+}
+
+static int64_t vm_file_read(struct vm_file *file, uint8_t *data, size_t size, bool line)
+{
+    size_t stored = 0;
+    bool failed = false;
+
+    if (file->writable)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    while (stored < size)
+    {
+        if (file->start == file->end && !vm_file_fill(file, &failed))
+            break;
+
+        size_t count = file->end - file->start;
+
+        if (count > size - stored)
+            count = size - stored;
+
+        const uint8_t *newline = line ? memchr(file->buffer + file->start, '\n', count) : NULL;
+
+        if (newline != NULL)
+            count = (size_t) (newline - (file->buffer + file->start)) + 1;
+
+        memcpy(data + stored, file->buffer + file->start, count);
+        file->start += count;
+        stored += count;
+
+        if (newline != NULL)
+            break;
+    }
+
+    return failed && stored == 0 ? -1 : (int64_t) stored;
+}
+
+int64_t vm_file_read_block(struct vm_file *file, uint8_t *data, size_t size)
+{
+    return vm_file_read(file, data, size, false);
+}
+
+int64_t vm_file_read_line(struct vm_file *file, uint8_t *data, size_t size)
+{
+    return vm_file_read(file, data, size, true);
+}
@@ -0,0 +1,84 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_VM_IO_H
+#define BLAZESCRIPT_VM_IO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define VM_IO_BUFFER_SIZE 65536
+
+/* Descriptors every program starts with; the host owns them, so they cannot be closed. */
+#define VM_STDIN  0
+#define VM_STDOUT 1
+#define VM_STDERR 2
+
+/*
+ * A descriptor of a running program: a host file descriptor and a buffer,
+ * used for reading or for writing depending on how it was opened. Reads
+ * fill the buffer with one read(2) at a time and consume it from start to
+ * end; writes append to it and go out with one write(2) when it is full,
+ * flushed or closed. fd is -1 when the descriptor is free.
+ */
+struct vm_file
+{
+    int fd;
+    bool writable;
+    bool eof;
+    uint8_t *buffer;
+    size_t start;
+    size_t end;
+};
+
+/* The descriptors of a program, indexed by the numbers the syscalls take. */
+struct vm_io
+{
+    struct vm_file *files;
+    size_t count;
+};
+
+/* Opens descriptors 0-2 on the standard streams of the process. */
+void vm_io_init(struct vm_io *io);
+
+/* Flushes every descriptor and closes the ones the program opened. */
+void vm_io_free(struct vm_io *io);
+bool vm_io_flush(struct vm_io *io);
+
+/* The open descriptor with this number, or NULL. */
+struct vm_file *vm_io_get(struct vm_io *io, uint64_t descriptor);
+
+/*
+ * Opens a file for reading (OPEN_READ), writing from the start (OPEN_WRITE)
+ * or appending (OPEN_APPEND) and returns its descriptor, or -1 with errno
+ * set.
+ */
+int64_t vm_io_open(struct vm_io *io, const char *path, uint64_t mode);
+bool vm_io_close(struct vm_io *io, uint64_t descriptor);
+
+bool vm_file_write(struct vm_file *file, const void *data, size_t size);
+bool vm_file_printf(struct vm_file *file, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+bool vm_file_write_int(struct vm_file *file, int64_t value);
+bool vm_file_flush(struct vm_file *file);
+
+/*
+ * Read up to size bytes: read_block stops at the end of the file and
+ * read_line also after a newline, which it keeps. Both return the number
+ * of bytes stored, 0 at the end of the file, or -1 on errors.
+ */
+int64_t vm_file_read_block(struct vm_file *file, uint8_t *data, size_t size);
+int64_t vm_file_read_line(struct vm_file *file, uint8_t *data, size_t size);
+
+/* Writes one byte; this is what most writes of the print syscalls are. */
+static inline bool vm_file_putc(struct vm_file *file, char c)
+{
+    if (file->end == VM_IO_BUFFER_SIZE && !vm_file_flush(file))
+        return false;
+
+    file->buffer[file->end++] = (uint8_t) c;
+    return true;
+}
+
+#endif /* BLAZESCRIPT_VM_IO_H */
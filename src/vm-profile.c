@@ -0,0 +1,113 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#include "vm-profile.h"
+#include "disassemble.h"
+#include "opcode.h"
+#include "utils.h"
+#include <stdlib.h>
+
+/* The least the clock takes to read, which every sample also timed. */
+static uint64_t clock_overhead(void)
+{
+    uint64_t least = UINT64_MAX;
+
+    for (int i = 0; i < 64; i++)
+    {
+        uint64_t before = vm_profile_clock();
+        uint64_t after = vm_profile_clock();
+
+        if (after - before < least)
+            least = after - before;
+    }
+
+    return least;
+}
+
+struct vm_profile *vm_profile_create(size_t size)
+{
+    struct vm_profile *profile = xcalloc(1, sizeof (struct vm_profile));
+
+    profile->offsets = xcalloc(size == 0 ? 1 : size, sizeof (uint64_t));
+    profile->size = size;
+    profile->overhead = clock_overhead();
+    return profile;
+}
+
+void vm_profile_free(struct vm_profile *profile)
+{
+    if (profile == NULL)
+        return;
+
+    free(profile->offsets);
+    free(profile);
+}
+
+/* The average cost of an opcode, less what reading the clock cost. */
+static double profile_mean(const struct vm_profile *profile, opcode_t opcode)
+{
+    if (profile->samples[opcode] == 0)
+        return 0;
+
+    double mean = (double) profile->ticks[opcode] / (double) profile->samples[opcode] - (double) profile->overhead;
+    return mean > 0 ? mean : 0;
+}
+
+static const struct vm_profile *sorted_profile;
+
+static int compare_cost(const void *a, const void *b)
+{
+    opcode_t left = *(const opcode_t *) a, right = *(const opcode_t *) b;
+    double left_cost = profile_mean(sorted_profile, left) * (double) sorted_profile->opcodes[left];
+    double right_cost = profile_mean(sorted_profile, right) * (double) sorted_profile->opcodes[right];
+
+    if (left_cost != right_cost)
+        return left_cost < right_cost ? 1 : -1;
+
+    if (sorted_profile->opcodes[left] != sorted_profile->opcodes[right])
+        return sorted_profile->opcodes[left] < sorted_profile->opcodes[right] ? 1 : -1;
+
+    return (int) left - (int) right;
+}
+
+void vm_profile_report(const struct vm_profile *profile, struct bytecode *bytecode, FILE *fp)
+{
+    opcode_t ran[256];
+    size_t count = 0;
+    uint64_t instructions = 0, samples = 0;
+    double total = 0;
+
+    for (unsigned opcode = 0; opcode < OPCODE_COUNT; opcode++)
+    {
+        if (profile->opcodes[opcode] == 0)
+            continue;
+
+        ran[count++] = (opcode_t) opcode;
+        instructions += profile->opcodes[opcode];
+        samples += profile->samples[opcode];
+        total += profile_mean(profile, (opcode_t) opcode) * (double) profile->opcodes[opcode];
+    }
+
+    sorted_profile = profile;
+    qsort(ran, count, sizeof ran[0], compare_cost);
+
+    fprintf(fp, "\n*** profile: %lu instructions, %lu timed\n\n", instructions, samples);
+    fprintf(fp, "     %-20s %14s %7s %12s %16s %7s\n", "opcode", "count", "%", VM_PROFILE_CLOCK_UNIT "/run",
+            VM_PROFILE_CLOCK_UNIT, "%");
+
+    for (size_t i = 0; i < count; i++)
+    {
+        opcode_t opcode = ran[i];
+        double mean = profile_mean(profile, opcode);
+        double cost = mean * (double) profile->opcodes[opcode];
+
+        /* Quickened forms share the mnemonic of their generic opcode. */
+        fprintf(fp, " %02x  %-20s %14lu %6.2f%% %12.1f %16.0f %6.2f%%\n", opcode, opcode_to_str(opcode), profile->opcodes[opcode],
+                100.0 * (double) profile->opcodes[opcode] / (double) instructions, mean, cost,
+                total > 0 ? 100.0 * cost / total : 0.0);
+    }
+
+    fprintf(fp, "\n*** annotated disassembly\n\n");
+    disassemble_annotated(fp, bytecode, profile->offsets);
+}
@@ -0,0 +1,65 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_VM_PROFILE_H
+#define BLAZESCRIPT_VM_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "bytecode.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define VM_PROFILE_CLOCK_UNIT "cycles"
+#else
+#include <time.h>
+#define VM_PROFILE_CLOCK_UNIT "ns"
+#endif
+
+/* One instruction in this many is timed; a power of two. */
+#define VM_PROFILE_SAMPLE_PERIOD 64
+
+/*
+ * What a profiled context ran: how often each opcode and each code offset
+ * was dispatched, and for a sample of the instructions, how long it was
+ * until the next one was dispatched, which is what the handler cost.
+ * Superinstructions and quickened forms count as opcodes of their own, and
+ * a superinstruction as one dispatch at the offset of its first half.
+ */
+struct vm_profile
+{
+    uint64_t opcodes[256];
+    uint64_t samples[256];
+    uint64_t ticks[256];
+    uint64_t *offsets;
+    size_t size;
+    uint64_t overhead;
+};
+
+/* Reads the clock the samples are taken with: the TSC where there is one. */
+static inline uint64_t vm_profile_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+#endif
+}
+
+/* Makes a profile for code of size bytes. */
+struct vm_profile *vm_profile_create(size_t size);
+void vm_profile_free(struct vm_profile *profile);
+
+/*
+ * Writes the opcodes, the ones that took longest first, with how often
+ * they ran and what they cost on average and in all, then the
+ * disassembly of the code with how often each instruction ran.
+ */
+void vm_profile_report(const struct vm_profile *profile, struct bytecode *bytecode, FILE *fp);
+
+#endif /* BLAZESCRIPT_VM_PROFILE_H */
@@ -0,0 +1,221 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#include "vm-recorder.h"
+#include "opcode.h"
+#include "utils.h"
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Signals are delivered to one thread, which runs one VM at a time; see stack.c. */
+static _Thread_local const struct vm_recorder *watched_recorder;
+static _Thread_local const struct bytecode *watched_bytecode;
+
+static const int fatal_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+static struct sigaction chained_actions[sizeof fatal_signals / sizeof fatal_signals[0]];
+static struct sigaction previous_usr1_action;
+
+/* The handlers are the process's: installed by the first thread to watch, restored by the last. */
+static atomic_flag handlers_lock = ATOMIC_FLAG_INIT;
+static size_t watching_threads;
+
+struct vm_recorder *vm_recorder_create(size_t size)
+{
+    struct vm_recorder *recorder = xmalloc(sizeof (struct vm_recorder));
+    size_t capacity = 1;
+
+    while (capacity < size)
+        capacity *= 2;
+
+    *recorder = (struct vm_recorder) {
+        .records = xcalloc(capacity, sizeof (struct vm_record)),
+        .mask = capacity - 1
+    };
+
+    return recorder;
+}
+
+void vm_recorder_free(struct vm_recorder *recorder)
+{
+    if (recorder == NULL)
+        return;
+
+    if (watched_recorder == recorder)
+        vm_recorder_watch(NULL, NULL);
+
+    free(recorder->records);
+    free(recorder);
+}
+
+/* A line being formatted without stdio, which is not async-signal-safe. */
+struct line
+{
+    char text[256];
+    size_t length;
+};
+
+static void line_append(struct line *line, const char *text)
+{
+    while (*text != '\0' && line->length < sizeof line->text)
+        line->text[line->length++] = *text++;
+}
+
+static void line_append_number(struct line *line, uint64_t value, unsigned base, size_t width)
+{
+    char digits[24];
+    size_t count = 0;
+
+    do
+    {
+        digits[count++] = "0123456789abcdef"[value % base];
+        value /= base;
+    }
+    while (value != 0 || count < width);
+
+    while (count > 0 && line->length < sizeof line->text)
+        line->text[line->length++] = digits[--count];
+}
+
+static void line_pad(struct line *line, size_t column)
+{
+    while (line->length < column && line->length < sizeof line->text)
+        line->text[line->length++] = ' ';
+}
+
+static void line_write(struct line *line, int fd)
+{
+    const char *text = line->text;
+    size_t length = line->length;
+
+    while (length > 0)
+    {
+        ssize_t written = write(fd, text, length);
+
+        if (written <= 0)
+            break;
+
+        text += written;
+        length -= (size_t) written;
+    }
+
+    line->length = 0;
+}
+
+void vm_recorder_dump(const struct vm_recorder *recorder, const struct bytecode *bytecode, int fd)
+{
+    uint64_t count = recorder->count;
+    uint64_t kept = count < recorder->mask + 1 ? count : recorder->mask + 1;
+    struct line line = { .length = 0 };
+
+    line_append(&line, "\n*** flight recorder: last ");
+    line_append_number(&line, kept, 10, 1);
+    line_append(&line, " of ");
+    line_append_number(&line, count, 10, 1);
+    line_append(&line, " instructions\n\n");
+    line_write(&line, fd);
+
+    for (uint64_t i = count - kept; i < count; i++)
+    {
+        const struct vm_record *record = &recorder->records[i & recorder->mask];
+        const char *symbol = bytecode != NULL ? bytecode_symbol_at(bytecode, record->offset) : NULL;
+
+        if (symbol != NULL)
+        {
+            line_append(&line, "<");
+            line_append(&line, symbol);
+            line_append(&line, ">:\n");
+        }
+
+        line_append(&line, " ");
+        line_append_number(&line, record->offset, 16, 8);
+        line_append(&line, ":  ");
+        line_append(&line, record->opcode < OPCODE_COUNT ? opcode_to_str(record->opcode) : "(bad)");
+        line_pad(&line, 32);
+        line_append(&line, "r0=0x");
+        line_append_number(&line, record->r0, 16, 1);
+        line_pad(&line, 56);
+        line_append(&line, "r1=0x");
+        line_append_number(&line, record->r1, 16, 1);
+        line_pad(&line, 80);
+        line_append(&line, "r2=0x");
+        line_append_number(&line, record->r2, 16, 1);
+        line_pad(&line, 104);
+        line_append(&line, "depth=");
+        line_append_number(&line, record->depth, 10, 1);
+        line_append(&line, "\n");
+        line_write(&line, fd);
+    }
+}
+
+static void recorder_signal_handler(int signal, siginfo_t *info, void *context)
+{
+    if (watched_recorder != NULL)
+        vm_recorder_dump(watched_recorder, watched_bytecode, STDERR_FILENO);
+
+    if (signal == SIGUSR1)
+        return;
+
+    for (size_t i = 0; i < sizeof fatal_signals / sizeof fatal_signals[0]; i++)
+    {
+        if (fatal_signals[i] != signal)
+            continue;
+
+        /* Whoever handled it before, such as the stack guard, decides what happens next. */
+        if ((chained_actions[i].sa_flags & SA_SIGINFO) != 0)
+            chained_actions[i].sa_sigaction(signal, info, context);
+        else if (chained_actions[i].sa_handler != SIG_IGN && chained_actions[i].sa_handler != SIG_DFL)
+            chained_actions[i].sa_handler(signal);
+        else
+            sigaction(signal, &chained_actions[i], NULL);
+    }
+}
+
+/* Installs the handler, keeping the one it replaces in previous. */
+static void recorder_install(int signal, struct sigaction *previous)
+{
+    struct sigaction action = {
+        .sa_sigaction = recorder_signal_handler,
+        .sa_flags = SA_SIGINFO | SA_RESTART
+    };
+
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(signal, &action, previous) != 0)
+        fatal_error("could not install the flight recorder");
+}
+
+void vm_recorder_watch(const struct vm_recorder *recorder, const struct bytecode *bytecode)
+{
+    bool was_watching = watched_recorder != NULL;
+
+    watched_recorder = recorder;
+    watched_bytecode = bytecode;
+
+    if ((recorder != NULL) == was_watching)
+        return;
+
+    while (atomic_flag_test_and_set(&handlers_lock))
+        ;
+
+    if (recorder != NULL && watching_threads++ == 0)
+    {
+        recorder_install(SIGUSR1, &previous_usr1_action);
+
+        for (size_t i = 0; i < sizeof fatal_signals / sizeof fatal_signals[0]; i++)
+            recorder_install(fatal_signals[i], &chained_actions[i]);
+    }
+    else if (recorder == NULL && --watching_threads == 0)
+    {
+        sigaction(SIGUSR1, &previous_usr1_action, NULL);
+
+        for (size_t i = 0; i < sizeof fatal_signals / sizeof fatal_signals[0]; i++)
+            sigaction(fatal_signals[i], &chained_actions[i], NULL);
+    }
+
+    atomic_flag_clear(&handlers_lock);
+}
@@ -0,0 +1,79 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_VM_RECORDER_H
+#define BLAZESCRIPT_VM_RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bytecode.h"
+
+#define VM_RECORDER_DEFAULT_SIZE 1024
+#define VM_RECORDER_MAX_SIZE ((size_t) 1 << 24)
+
+/*
+ * One instruction as it was about to run. The registers are kept apart so
+ * that they are not copied as one vector, which would have to wait for the
+ * instruction before to finish storing each of them.
+ */
+struct vm_record
+{
+    uint64_t r0;
+    uint32_t offset;
+    uint32_t depth;
+    uint64_t r1;
+    uint8_t opcode;
+    uint64_t r2;
+};
+
+/*
+ * A flight recorder: the last instructions a context ran, in a ring of a
+ * power of two records that count keeps going round. Recording costs a
+ * few stores per instruction and never allocates.
+ */
+struct vm_recorder
+{
+    struct vm_record *records;
+    size_t mask;
+    uint64_t count;
+};
+
+/* Makes a recorder of at least size records. */
+struct vm_recorder *vm_recorder_create(size_t size);
+void vm_recorder_free(struct vm_recorder *recorder);
+
+/*
+ * Fills in the next record, records[count & mask]; the caller then stores
+ * the count it went up to, which is all a dump running in a signal
+ * handler reads from it.
+ */
+static inline void vm_recorder_record(struct vm_record *record, uint32_t offset, uint8_t opcode,
+                                      uint64_t r0, uint64_t r1, uint64_t r2, uint32_t depth)
+{
+    *record = (struct vm_record) {
+        .r0 = r0,
+        .r1 = r1,
+        .r2 = r2,
+        .offset = offset,
+        .depth = depth,
+        .opcode = opcode
+    };
+}
+
+/*
+ * Writes the records, oldest first, with the mnemonic of each and the
+ * symbol of the ones that start a function. It only makes
+ * async-signal-safe calls.
+ */
+void vm_recorder_dump(const struct vm_recorder *recorder, const struct bytecode *bytecode, int fd);
+
+/*
+ * Makes the calling thread dump this recorder to stderr when it receives
+ * SIGUSR1, and before it dies of SIGSEGV, SIGBUS, SIGFPE, SIGILL or
+ * SIGABRT. Watching NULL stops it, and once no thread watches the
+ * handlers those signals had before are put back.
+ */
+void vm_recorder_watch(const struct vm_recorder *recorder, const struct bytecode *bytecode);
+
+#endif /* BLAZESCRIPT_VM_RECORDER_H */
@@ -0,0 +1,251 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#define _GNU_SOURCE
+
+#include "vm-snapshot.h"
+#include "bytecode-file.h"
+#include "bytecode-verify.h"
+#include "opcode.h"
+#include "register.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The state section: this, then the value of every constant of the
+ * program, which for strings is the handle of their copy in the heap.
+ * %fp is saved as the index of the stack word it points to.
+ */
+struct vm_snapshot_state
+{
+    uint64_t registers[REG_COUNT];
+    vm_vector_t vectors[VREG_COUNT];
+    uint64_t entry;
+    uint64_t stack_words;
+    uint64_t pinned;
+    uint64_t free_handle;
+};
+
+static bool snapshot_error(char **error, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+
+    if (vasprintf(error, fmt, args) < 0)
+        *error = NULL;
+
+    va_end(args);
+    return false;
+}
+
+/*
+ * The only words on the stack that point into the code or the stack are
+ * the return addresses pushed by calls and the %fp saved by enter, and
+ * the verifier knows where each frame has them. This walks the frames
+ * from the one at entry down to the main program, checking that each is
+ * where the verifier says it is, and turns those words from addresses
+ * into offsets when saving, or back when resuming. fp and the stack are
+ * in words from the bottom of the stack.
+ */
+static bool snapshot_walk_frames(const struct vm_context *vm, uint64_t *stack, size_t sp, uint64_t fp,
+                                 uint64_t entry, bool saving, char **error)
+{
+    struct bytecode *bytecode = vm->bytecode;
+    const uint8_t *code = vm->code;
+    struct bytecode_stack_state *states = bytecode_verify_stack(bytecode);
+    size_t at = (size_t) entry;
+    bool ok = false;
+
+    if (states == NULL)
+        return snapshot_error(error, "the program does not verify");
+
+    for (;;)
+    {
+        const struct bytecode_stack_state *state = &states[at];
+        size_t bottom;
+
+        if (state->depth == BYTECODE_DEPTH_UNKNOWN || fp > sp)
+            break;
+
+        /* The frame starts at the saved %fp after enter, or at the first word pushed before it. */
+        if (state->locals != BYTECODE_FRAME_NONE)
+        {
+            if (fp == 0 || fp + (uint64_t) state->locals + (uint64_t) state->depth / sizeof (uint64_t) != sp)
+                break;
+
+            bottom = (size_t) fp - 1;
+        }
+        else
+        {
+            if ((uint64_t) state->depth / sizeof (uint64_t) > sp)
+                break;
+
+            bottom = sp - (size_t) state->depth / sizeof (uint64_t);
+        }
+
+        if (state->function == BYTECODE_FUNCTION_MAIN)
+        {
+            ok = bottom == 0;
+            break;
+        }
+
+        if (bottom == 0)
+            break;
+
+        /* The return address is right below the frame, and the caller runs on from it. */
+        uint64_t *slot = &stack[bottom - 1];
+        uint64_t offset = saving ? *slot - (uint64_t) code : *slot;
+
+        if (offset == 0 || offset >= bytecode->size || states[offset].depth == BYTECODE_DEPTH_UNKNOWN)
+            break;
+
+        *slot = saving ? offset : (uint64_t) code + offset;
+
+        if (state->locals != BYTECODE_FRAME_NONE)
+        {
+            uint64_t *saved = &stack[bottom];
+            uint64_t index = saving ? (*saved - (uint64_t) vm->stack.base) / sizeof (uint64_t) : *saved;
+
+            if (index > bottom - 1)
+                break;
+
+            *saved = saving ? index : (uint64_t) (vm->stack.base + index);
+            fp = index;
+        }
+
+        at = (size_t) offset;
+        sp = bottom - 1;
+    }
+
+    free(states);
+    return ok || snapshot_error(error, "the stack does not match the frames of the program");
+}
+
+bool vm_snapshot_write(struct vm_context *vm, const char *path, char **error)
+{
+    struct bytecode *bytecode = vm->bytecode;
+    const uint8_t *ip = (const uint8_t *) vm->registers[IP];
+    size_t stack_words = (size_t) ((uint64_t *) vm->registers[SP] - vm->stack.base);
+
+    for (size_t i = VM_STDERR + 1; i < vm->io.count; i++)
+    {
+        if (vm->io.files[i].fd >= 0)
+            return snapshot_error(error, "cannot save a program with open files");
+    }
+
+    size_t constants_size = bytecode->constant_count * sizeof (uint64_t);
+    struct vm_snapshot_state *state = xmalloc(sizeof *state + constants_size);
+    uint64_t *stack = xmalloc(stack_words * sizeof (uint64_t));
+
+    *state = (struct vm_snapshot_state) {
+        .entry = (uint64_t) (ip - vm->code) + instruction_get_size(ip, bytecode->size - (size_t) (ip - vm->code)),
+        .stack_words = (uint64_t) (vm->stack.limit - vm->stack.base),
+        .pinned = vm->heap.pinned,
+        .free_handle = vm->heap.free_handle
+    };
+
+    memcpy(state->registers, vm->registers, sizeof state->registers);
+    memcpy(state->vectors, vm->vectors, sizeof state->vectors);
+    memcpy(state + 1, vm->constants, constants_size);
+    memcpy(stack, vm->stack.base, stack_words * sizeof (uint64_t));
+    state->registers[R0] = 1;
+    state->registers[IP] = state->registers[IS] = state->registers[SP] = 0;
+    state->registers[FP] = (uint64_t) ((uint64_t *) vm->registers[FP] - vm->stack.base);
+
+    if (!snapshot_walk_frames(vm, stack, stack_words, state->registers[FP], state->entry, true, error))
+    {
+        free(state);
+        free(stack);
+        return false;
+    }
+
+    struct bytecode_blob blobs[] = {
+        { BYTECODE_SECTION_STATE, state, sizeof *state + constants_size },
+        { BYTECODE_SECTION_STACK, stack, stack_words * sizeof (uint64_t) },
+        { BYTECODE_SECTION_MEMORY, vm->memory, vm->memory_size * sizeof (uint64_t) },
+        { BYTECODE_SECTION_HEAP, vm->heap.space, vm->heap.used },
+        { BYTECODE_SECTION_HANDLES, vm->heap.handles, vm->heap.handle_count * sizeof (uint64_t) }
+    };
+
+    /* What the program printed so far belongs before whatever the file does. */
+    vm_io_flush(&vm->io);
+
+    bool ok = bytecode_file_write_blobs(bytecode, blobs, sizeof blobs / sizeof blobs[0], path, error);
+
+    free(state);
+    free(stack);
+    return ok;
+}
+
+/* Whether an offset is where an instruction starts. */
+static bool is_instruction(const struct bytecode *bytecode, uint64_t offset)
+{
+    size_t at = 0;
+
+    while (at < offset && at < bytecode->size)
+    {
+        size_t size = instruction_get_size(bytecode->bytes + at, bytecode->size - at);
+
+        if (size == 0)
+            return false;
+
+        at += size;
+    }
+
+    return at == offset && at < bytecode->size;
+}
+
+bool vm_snapshot_restore(struct vm_context *vm, char **error)
+{
+    struct bytecode *bytecode = vm->bytecode;
+    size_t state_size, stack_size, memory_size, heap_size, handles_size;
+    const struct vm_snapshot_state *state = bytecode_file_section(bytecode, BYTECODE_SECTION_STATE, &state_size);
+
+    if (state == NULL)
+        return true;
+
+    const void *stack = bytecode_file_section(bytecode, BYTECODE_SECTION_STACK, &stack_size);
+    const void *memory = bytecode_file_section(bytecode, BYTECODE_SECTION_MEMORY, &memory_size);
+    void *heap = bytecode_file_section_writable(bytecode, BYTECODE_SECTION_HEAP, &heap_size);
+    const uint64_t *handles = bytecode_file_section(bytecode, BYTECODE_SECTION_HANDLES, &handles_size);
+
+    if (stack == NULL || memory == NULL || heap == NULL || handles == NULL)
+        return snapshot_error(error, "snapshot is incomplete");
+
+    if (state_size != sizeof *state + bytecode->constant_count * sizeof (uint64_t) ||
+        memory_size != vm->memory_size * sizeof (uint64_t) ||
+        stack_size % sizeof (uint64_t) != 0 || stack_size / sizeof (uint64_t) > state->stack_words ||
+        state->stack_words > (uint64_t) (vm->stack.limit - vm->stack.base) ||
+        heap_size % sizeof (uint64_t) != 0 || handles_size % sizeof (uint64_t) != 0)
+        return snapshot_error(error, "snapshot does not match its program");
+
+    if (!is_instruction(bytecode, state->entry))
+        return snapshot_error(error, "snapshot resumes at 0x%08lx, which is not an instruction", state->entry);
+
+    if (!vm_heap_adopt(&vm->heap, heap, heap_size, handles, handles_size / sizeof (uint64_t),
+                       (size_t) state->free_handle, (size_t) state->pinned))
+        return snapshot_error(error, "snapshot has a corrupt heap");
+
+    memcpy(vm->stack.base, stack, stack_size);
+    execution_code(vm);
+
+    if (!snapshot_walk_frames(vm, vm->stack.base, stack_size / sizeof (uint64_t), state->registers[FP],
+                              state->entry, false, error))
+        return false;
+
+    memcpy(vm->registers, state->registers, sizeof vm->registers);
+    memcpy(vm->vectors, state->vectors, sizeof vm->vectors);
+    memcpy(vm->constants, state + 1, bytecode->constant_count * sizeof (uint64_t));
+    memcpy(vm->memory, memory, memory_size);
+
+    vm->registers[SP] = (uint64_t) (vm->stack.base + stack_size / sizeof (uint64_t));
+    vm->registers[FP] = (uint64_t) (vm->stack.base + state->registers[FP]);
+    vm->registers[IS] = (uint64_t) vm->code;
+    vm->registers[IP] = (uint64_t) vm->code + state->entry;
+    vm->entry = (size_t) state->entry;
+    return true;
+}
@@ -0,0 +1,42 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_VM_SNAPSHOT_H
+#define BLAZESCRIPT_VM_SNAPSHOT_H
+
+#include <stdbool.h>
+#include "vm-context.h"
+
+/*
+ * A snapshot is a bytecode file (see bytecode-file.h) of the program with
+ * sections that hold the state of a context stopped at a snapshot
+ * syscall: its registers, stack, data memory and heap. Programs that
+ * spend their start building tables can be run up to that point once,
+ * and their snapshot run from then on.
+ *
+ * Resuming maps the file like any other program and uses the heap in the
+ * mapping in place, made writable, so it costs one page fault per page the
+ * program touches rather than a copy; the collector moves the objects out
+ * when it first runs. The stack and memory are copied.
+ *
+ * The stack holds addresses of the code and of the stack itself: the
+ * return addresses of calls and the %fp saved by enter. The verifier
+ * knows which words those are in every frame, so they are saved as
+ * offsets and made addresses again on resuming, and a stack whose frames
+ * are not where the verifier says is refused. No other word can hold an
+ * address, so nothing else is changed.
+ * Descriptors other than the standard streams are not saved, so a
+ * program that has some open cannot be saved.
+ */
+bool vm_snapshot_write(struct vm_context *vm, const char *path, char **error);
+
+/*
+ * Resumes a context just set up with execution_init() from the snapshot
+ * its bytecode was loaded from; for other programs it does nothing. The
+ * return addresses it makes point into the code the context will run, so
+ * the host must be done setting it up (see execution_code() in opcode.h).
+ */
+bool vm_snapshot_restore(struct vm_context *vm, char **error);
+
+#endif /* BLAZESCRIPT_VM_SNAPSHOT_H */
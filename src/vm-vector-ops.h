@@ -0,0 +1,118 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+/*
+ * The vector instructions, written with the vector types of GCC so that
+ * the compiler picks the instructions. This file has no include guard on
+ * purpose: vm-vector.c includes it once per implementation, with
+ * VM_VECTOR_NAME set to its name and the target it compiles for already
+ * selected.
+ */
+
+#ifndef VM_VECTOR_NAME
+#error "VM_VECTOR_NAME must be defined before including vm-vector-ops.h"
+#endif
+
+#define VM_VECTOR_FN_(name, fn) vector_##name##_##fn
+#define VM_VECTOR_FN_EXPAND_(name, fn) VM_VECTOR_FN_(name, fn)
+#define VM_VECTOR_FN(fn) VM_VECTOR_FN_EXPAND_(VM_VECTOR_NAME, fn)
+
+/* Unsigned lanes wrap around like the scalar instructions do. */
+#define VM_VECTOR_BINARY(fn, type, expr)                                     \
+    static void VM_VECTOR_FN(fn)(vm_vector_t *dst, const vm_vector_t *src)   \
+    {                                                                        \
+        type a, b;                                                           \
+        memcpy(&a, dst, sizeof a);                                           \
+        memcpy(&b, src, sizeof b);                                           \
+        v4u r = (v4u) (expr);                                                \
+        memcpy(dst, &r, sizeof r);                                           \
+    }
+
+VM_VECTOR_BINARY(add, v4u, a + b)
+VM_VECTOR_BINARY(sub, v4u, a - b)
+VM_VECTOR_BINARY(mul, v4u, a * b)
+VM_VECTOR_BINARY(addf, v4f, a + b)
+VM_VECTOR_BINARY(subf, v4f, a - b)
+VM_VECTOR_BINARY(mulf, v4f, a * b)
+VM_VECTOR_BINARY(cmpeq, v4i, a == b)
+VM_VECTOR_BINARY(cmplt, v4i, a < b)
+VM_VECTOR_BINARY(cmpltf, v4f, a < b)
+VM_VECTOR_BINARY(and, v4u, a & b)
+
+static void VM_VECTOR_FN(blend)(vm_vector_t *dst, const vm_vector_t *src, const vm_vector_t *mask)
+{
+    v4u a, b, m;
+
+    memcpy(&a, dst, sizeof a);
+    memcpy(&b, src, sizeof b);
+    memcpy(&m, mask, sizeof m);
+    m = (v4u) (m != 0);
+    a = (b & m) | (a & ~m);
+    memcpy(dst, &a, sizeof a);
+}
+
+static void VM_VECTOR_FN(store_masked)(uint64_t *words, const vm_vector_t *v, const vm_vector_t *mask)
+{
+    for (size_t i = 0; i < VM_VECTOR_LANES; i++)
+    {
+        if (mask->lanes[i] != 0)
+            words[i] = v->lanes[i];
+    }
+}
+
+static uint64_t VM_VECTOR_FN(sum)(const vm_vector_t *v)
+{
+    return v->lanes[0] + v->lanes[1] + v->lanes[2] + v->lanes[3];
+}
+
+static uint64_t VM_VECTOR_FN(sumf)(const vm_vector_t *v)
+{
+    double lanes[VM_VECTOR_LANES];
+    double sum;
+    uint64_t bits;
+
+    memcpy(lanes, v, sizeof lanes);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    memcpy(&bits, &sum, sizeof bits);
+    return bits;
+}
+
+static uint64_t VM_VECTOR_FN(max)(const vm_vector_t *v)
+{
+    int64_t max = (int64_t) v->lanes[0];
+
+    for (size_t i = 1; i < VM_VECTOR_LANES; i++)
+    {
+        if ((int64_t) v->lanes[i] > max)
+            max = (int64_t) v->lanes[i];
+    }
+
+    return (uint64_t) max;
+}
+
+static const struct vm_vector_ops VM_VECTOR_FN(ops) = {
+    .name = VM_VECTOR_NAME_STRING,
+    .binary = {
+        [VM_VECTOR_ADD] = VM_VECTOR_FN(add),
+        [VM_VECTOR_SUB] = VM_VECTOR_FN(sub),
+        [VM_VECTOR_MUL] = VM_VECTOR_FN(mul),
+        [VM_VECTOR_ADDF] = VM_VECTOR_FN(addf),
+        [VM_VECTOR_SUBF] = VM_VECTOR_FN(subf),
+        [VM_VECTOR_MULF] = VM_VECTOR_FN(mulf),
+        [VM_VECTOR_CMPEQ] = VM_VECTOR_FN(cmpeq),
+        [VM_VECTOR_CMPLT] = VM_VECTOR_FN(cmplt),
+        [VM_VECTOR_CMPLTF] = VM_VECTOR_FN(cmpltf),
+        [VM_VECTOR_AND] = VM_VECTOR_FN(and)
+    },
+    .blend = VM_VECTOR_FN(blend),
+    .store_masked = VM_VECTOR_FN(store_masked),
+    .sum = VM_VECTOR_FN(sum),
+    .sumf = VM_VECTOR_FN(sumf),
+    .max = VM_VECTOR_FN(max)
+};
+
+#undef VM_VECTOR_FN_
+#undef VM_VECTOR_FN_EXPAND_
+#undef VM_VECTOR_FN
+#undef VM_VECTOR_BINARY
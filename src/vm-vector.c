@@ -0,0 +1,41 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#include "vm-vector.h"
+#include <stddef.h>
+#include <string.h>
+
+typedef uint64_t v4u __attribute__((vector_size(32)));
+typedef int64_t v4i __attribute__((vector_size(32)));
+typedef double v4f __attribute__((vector_size(32)));
+
+#define VM_VECTOR_NAME generic
+#define VM_VECTOR_NAME_STRING "generic"
+#include "vm-vector-ops.h"
+#undef VM_VECTOR_NAME
+#undef VM_VECTOR_NAME_STRING
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(BLAZEVM_NO_AVX2)
+#define VM_VECTOR_AVX2
+
+/* Only ever called once the processor is known to have AVX2. */
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define VM_VECTOR_NAME avx2
+#define VM_VECTOR_NAME_STRING "avx2"
+#include "vm-vector-ops.h"
+#undef VM_VECTOR_NAME
+#undef VM_VECTOR_NAME_STRING
+#pragma GCC pop_options
+#endif
+
+const struct vm_vector_ops *vm_vector_ops(void)
+{
+#ifdef VM_VECTOR_AVX2
+    /* A load and a test: the runtime finds out what the processor has before main(). */
+    return __builtin_cpu_supports("avx2") ? &vector_avx2_ops : &vector_generic_ops;
+#else
+    return &vector_generic_ops;
+#endif
+}
@@ -0,0 +1,64 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+#ifndef BLAZESCRIPT_VM_VECTOR_H
+#define BLAZESCRIPT_VM_VECTOR_H
+
+#include <stdint.h>
+
+/*
+ * The vector registers, %v0 to %v7, hold 256 bits each: four lanes of 64
+ * bits that the vector instructions treat as signed integers or as
+ * doubles, depending on the instruction. Comparisons set a lane to all
+ * ones where they hold and to zero elsewhere, which is what the masked
+ * instructions take: a lane is selected when it is not zero.
+ */
+#define VREG_COUNT 8
+#define VM_VECTOR_LANES 4
+
+typedef struct
+{
+    uint64_t lanes[VM_VECTOR_LANES];
+} vm_vector_t;
+
+/* Lane-wise operations of two vectors, in the order of their opcodes (see OP_VADD in opcode.h). */
+typedef enum {
+    VM_VECTOR_ADD,
+    VM_VECTOR_SUB,
+    VM_VECTOR_MUL,
+    VM_VECTOR_ADDF,
+    VM_VECTOR_SUBF,
+    VM_VECTOR_MULF,
+    VM_VECTOR_CMPEQ,
+    VM_VECTOR_CMPLT,
+    VM_VECTOR_CMPLTF,
+    VM_VECTOR_AND,
+    VM_VECTOR_BINARY_COUNT
+} vm_vector_binary_t;
+
+/*
+ * One implementation of the vector instructions. binary[op] sets dst to
+ * dst op src; blend copies the lanes of src that mask selects into dst;
+ * store_masked writes the lanes of v that mask selects to words. The
+ * reductions go through the lanes in order, so that every implementation
+ * rounds sums of doubles the same way.
+ */
+struct vm_vector_ops
+{
+    const char *name;
+    void (*binary[VM_VECTOR_BINARY_COUNT])(vm_vector_t *dst, const vm_vector_t *src);
+    void (*blend)(vm_vector_t *dst, const vm_vector_t *src, const vm_vector_t *mask);
+    void (*store_masked)(uint64_t *words, const vm_vector_t *v, const vm_vector_t *mask);
+    uint64_t (*sum)(const vm_vector_t *v);
+    uint64_t (*sumf)(const vm_vector_t *v);
+    uint64_t (*max)(const vm_vector_t *v);
+};
+
+/*
+ * The implementation for the processor: AVX2 where it has it, unless
+ * built with -DBLAZEVM_NO_AVX2, or else portable C.
+ */
+const struct vm_vector_ops *vm_vector_ops(void);
+
+#endif /* BLAZESCRIPT_VM_VECTOR_H */
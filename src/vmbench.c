@@ -0,0 +1,356 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+/*
+ * Measures the instruction throughput of the VM dispatch loops on a tight
+ * counting loop, so that changes to the dispatch core can be compared with
+ * the original function-pointer loop, and counts the dispatches each one
+ * needs. Built with "make bench".
+ *
+ * The last run gives every processor (or as many threads as the second
+ * argument says) a context of its own on one copy of the loop and runs
+ * them all at once, to show how the VM scales with threads now that
+ * contexts share nothing but the bytecode, which they only read. The array sums compare summing data memory
+ * with the scalar instructions and with the vector ones.
+ */
+
+#include "bytecode.h"
+#include "bytecode-builder.h"
+#include "bytecode-verify.h"
+#include "opcode.h"
+#include "register.h"
+#include "utils.h"
+#include "vm-context.h"
+#include "vm-vector.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ITERATIONS 20000000
+
+/* Instructions executed per iteration of the loop built below. */
+#define LOOP_BODY_SIZE 6
+
+/* Sets *body and *body_end to the offsets the loop body spans. */
+static struct bytecode build_loop(uint64_t iterations, size_t *body, size_t *body_end)
+{
+    struct bytecode_builder builder = bytecode_builder_init();
+    struct bytecode *bytecode = &builder.bytecode;
+    size_t loop = bytecode_builder_label(&builder);
+    size_t done = bytecode_builder_label(&builder);
+
+    bytecode_push_byte(bytecode, OP_MOV_IR);
+    bytecode_push_byte(bytecode, R1);
+    bytecode_push_qword(bytecode, iterations);
+    bytecode_push_byte(bytecode, OP_MOV_IR);
+    bytecode_push_byte(bytecode, R2);
+    bytecode_push_qword(bytecode, 1);
+    bytecode_push_byte(bytecode, OP_MOV_IR);
+    bytecode_push_byte(bytecode, R3);
+    bytecode_push_qword(bytecode, 0);
+
+    bytecode_builder_bind(&builder, loop);
+    *body = bytecode->size;
+    bytecode_push_byte(bytecode, OP_ADD_RR);
+    bytecode_push_byte(bytecode, REG_PAIR(R3, R1));
+    bytecode_push_byte(bytecode, OP_STORE_MR);
+    bytecode_push_dword(bytecode, 0);
+    bytecode_push_byte(bytecode, R3);
+    bytecode_push_byte(bytecode, OP_LOAD_RM);
+    bytecode_push_byte(bytecode, R4);
+    bytecode_push_dword(bytecode, 0);
+    bytecode_push_byte(bytecode, OP_SUB_RR);
+    bytecode_push_byte(bytecode, REG_PAIR(R1, R2));
+    bytecode_push_byte(bytecode, OP_JZ_R);
+    bytecode_push_byte(bytecode, R1);
+    bytecode_builder_push_label(&builder, done);
+    bytecode_push_byte(bytecode, OP_JMP);
+    bytecode_builder_push_label(&builder, loop);
+
+    bytecode_builder_bind(&builder, done);
+    *body_end = bytecode->size;
+    bytecode_push_byte(bytecode, OP_HLT);
+
+    struct bytecode result = bytecode_builder_finish(&builder);
+    result.data_size = 1;
+    bytecode_builder_free(&builder);
+    return result;
+}
+
+/*
+ * Counts the dispatches one iteration of the loop takes once it ran: a
+ * superinstruction also runs the instruction after it.
+ */
+static size_t count_dispatches(const uint8_t *code, size_t body, size_t body_end)
+{
+    size_t dispatches = 0;
+
+    for (size_t offset = body; offset < body_end; dispatches++)
+    {
+        opcode_t opcode = code[offset], first, second;
+
+        offset += instruction_get_size(code + offset, body_end - offset);
+
+        if (opcode_get_superinstruction(opcode, &first, &second))
+            offset += instruction_get_size(code + offset, body_end - offset);
+    }
+
+    return dispatches;
+}
+
+static void run(const char *name, bool (*exec)(struct vm_context *), bool verify, bool fuse, bool jit,
+                uint64_t iterations)
+{
+    size_t body, body_end;
+    struct bytecode bytecode = build_loop(iterations, &body, &body_end);
+    char *error = NULL;
+    /* The last iteration leaves through jz and skips the jmp. */
+    uint64_t instructions = LOOP_BODY_SIZE * iterations + 3;
+    struct timespec start, end;
+    struct vm_context vm;
+
+    if (verify && !bytecode_verify(&bytecode, &error))
+        fatal_error("%s: %s", name, error);
+
+    execution_init(&vm, &bytecode);
+    vm.superinstructions = fuse;
+    vm.jit = jit;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!exec(&vm))
+        fatal_error("%s: %s", name, vm.error);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    /* Native code has no dispatches to count, and the indirect loop runs the bytecode itself. */
+    size_t dispatches = jit ? 0 : count_dispatches(vm.code != NULL ? vm.code : bytecode.bytes, body, body_end);
+    double seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    execution_end(&vm);
+    bytecode_free(&bytecode);
+    printf("\033[1;34mBENCH\033[0m %-48s %6.0f ms %9.1f Mops/s %2zu dispatches/iteration\n",
+           name, seconds * 1000, (double) instructions / seconds / 1e6, dispatches);
+}
+
+/* Words of data memory the array sums go through, a multiple of the lanes. */
+#define SUM_ARRAY_SIZE 4096
+
+/*
+ * Sums the array in data memory passes times, into %r3 one word at a time
+ * or into %v0 a vector at a time, which vsum then adds up into %r3.
+ */
+static struct bytecode build_sum(uint64_t passes, bool vector)
+{
+    struct bytecode_builder builder = bytecode_builder_init();
+    struct bytecode *bytecode = &builder.bytecode;
+    size_t pass = bytecode_builder_label(&builder);
+    size_t loop = bytecode_builder_label(&builder);
+    const uint8_t step = vector ? VM_VECTOR_LANES : 1;
+
+    bytecode_push_byte(bytecode, OP_MOV_IR);
+    bytecode_push_byte(bytecode, R6);
+    bytecode_push_qword(bytecode, passes);
+    bytecode_push_byte(bytecode, OP_MOV_IR8);
+    bytecode_push_byte(bytecode, R2);
+    bytecode_push_byte(bytecode, step);
+    bytecode_push_byte(bytecode, OP_MOV_IR8);
+    bytecode_push_byte(bytecode, R7);
+    bytecode_push_byte(bytecode, 1);
+    bytecode_push_byte(bytecode, OP_MOV_IR32);
+    bytecode_push_byte(bytecode, R5);
+    bytecode_push_dword(bytecode, SUM_ARRAY_SIZE);
+    bytecode_push_byte(bytecode, OP_MOV_IR8);
+    bytecode_push_byte(bytecode, R3);
+    bytecode_push_byte(bytecode, 0);
+
+    if (vector)
+    {
+        bytecode_push_byte(bytecode, OP_VSPLAT);
+        bytecode_push_byte(bytecode, 0);
+        bytecode_push_byte(bytecode, R3);
+    }
+
+    bytecode_builder_bind(&builder, pass);
+    bytecode_push_byte(bytecode, OP_MOV_IR8);
+    bytecode_push_byte(bytecode, R1);
+    bytecode_push_byte(bytecode, 0);
+
+    bytecode_builder_bind(&builder, loop);
+
+    if (vector)
+    {
+        bytecode_push_byte(bytecode, OP_VLOAD);
+        bytecode_push_byte(bytecode, 1);
+        bytecode_push_byte(bytecode, R1);
+        bytecode_push_byte(bytecode, OP_VADD);
+        bytecode_push_byte(bytecode, REG_PAIR(0, 1));
+    }
+    else
+    {
+        bytecode_push_byte(bytecode, OP_LOAD_RR);
+        bytecode_push_byte(bytecode, R4);
+        bytecode_push_byte(bytecode, R1);
+        bytecode_push_byte(bytecode, OP_ADD_RR);
+        bytecode_push_byte(bytecode, REG_PAIR(R3, R4));
+    }
+
+    bytecode_push_byte(bytecode, OP_ADD_RR);
+    bytecode_push_byte(bytecode, REG_PAIR(R1, R2));
+    bytecode_push_byte(bytecode, OP_JLT_RR);
+    bytecode_push_byte(bytecode, REG_PAIR(R1, R5));
+    bytecode_builder_push_label(&builder, loop);
+    bytecode_push_byte(bytecode, OP_SUB_RR);
+    bytecode_push_byte(bytecode, REG_PAIR(R6, R7));
+    bytecode_push_byte(bytecode, OP_JNZ_R);
+    bytecode_push_byte(bytecode, R6);
+    bytecode_builder_push_label(&builder, pass);
+
+    if (vector)
+    {
+        bytecode_push_byte(bytecode, OP_VSUM);
+        bytecode_push_byte(bytecode, R3);
+        bytecode_push_byte(bytecode, 0);
+    }
+
+    bytecode_push_byte(bytecode, OP_HLT);
+
+    struct bytecode result = bytecode_builder_finish(&builder);
+    result.data_size = SUM_ARRAY_SIZE;
+    bytecode_builder_free(&builder);
+    return result;
+}
+
+static void run_sum(const char *name, bool vector, uint64_t iterations)
+{
+    uint64_t passes = iterations / SUM_ARRAY_SIZE == 0 ? 1 : iterations / SUM_ARRAY_SIZE;
+    struct bytecode bytecode = build_sum(passes, vector);
+    struct timespec start, end;
+    struct vm_context vm;
+    char *error = NULL;
+
+    if (!bytecode_verify(&bytecode, &error))
+        fatal_error("%s: %s", name, error);
+
+    execution_init(&vm, &bytecode);
+
+    for (size_t i = 0; i < SUM_ARRAY_SIZE; i++)
+        vm.memory[i] = i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!bytecode_exec(&vm))
+        fatal_error("%s: %s", name, vm.error);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (vm.registers[R3] != passes * SUM_ARRAY_SIZE * (SUM_ARRAY_SIZE - 1) / 2)
+        fatal_error("%s: computed a wrong sum", name);
+
+    execution_end(&vm);
+    bytecode_free(&bytecode);
+
+    double seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("\033[1;34mBENCH\033[0m %-48s %6.0f ms %9.1f Mwords/s\n",
+           name, seconds * 1000, (double) (passes * SUM_ARRAY_SIZE) / seconds / 1e6);
+}
+
+struct worker
+{
+    struct vm_context vm;
+    pthread_t thread;
+    bool ok;
+};
+
+static void *worker_run(void *arg)
+{
+    struct worker *worker = arg;
+
+    worker->ok = bytecode_exec(&worker->vm);
+    return NULL;
+}
+
+static void run_parallel(size_t threads, uint64_t iterations)
+{
+    struct worker *workers = xcalloc(threads, sizeof (struct worker));
+    uint64_t instructions = (LOOP_BODY_SIZE * iterations + 3) * threads;
+    struct timespec start, end;
+    char name[64];
+    size_t body, body_end;
+    char *error = NULL;
+
+    snprintf(name, sizeof name, "vm dispatch: fused, %zu contexts in parallel", threads);
+
+    /* Every context runs the same program. */
+    struct bytecode bytecode = build_loop(iterations, &body, &body_end);
+
+    if (!bytecode_verify(&bytecode, &error))
+        fatal_error("%s: %s", name, error);
+
+    for (size_t i = 0; i < threads; i++)
+        execution_init(&workers[i].vm, &bytecode);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        if (pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]) != 0)
+            fatal_error("%s: cannot start thread %zu", name, i);
+    }
+
+    for (size_t i = 0; i < threads; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    /* Every context must have summed iterations..1 on its own. */
+    for (size_t i = 0; i < threads; i++)
+    {
+        if (!workers[i].ok)
+            fatal_error("%s: %s", name, workers[i].vm.error);
+
+        if (workers[i].vm.registers[R3] != iterations * (iterations + 1) / 2)
+            fatal_error("%s: context %zu computed a wrong sum", name, i);
+    }
+
+    size_t dispatches = count_dispatches(workers[0].vm.code, body, body_end);
+    double seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    for (size_t i = 0; i < threads; i++)
+        execution_end(&workers[i].vm);
+
+    bytecode_free(&bytecode);
+    free(workers);
+    printf("\033[1;34mBENCH\033[0m %-48s %6.0f ms %9.1f Mops/s %2zu dispatches/iteration\n",
+           name, seconds * 1000, (double) instructions / seconds / 1e6, dispatches);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t iterations = argc > 1 ? strtoull(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+
+    long contexts = argc > 2 ? strtol(argv[2], NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (iterations == 0 || contexts <= 0)
+        fatal_error("usage: %s [iterations [contexts]]", argv[0]);
+
+    run("vm dispatch: indirect calls", bytecode_exec_indirect, false, false, false, iterations);
+    run("vm dispatch: threaded", bytecode_exec, false, false, false, iterations);
+    run("vm dispatch: threaded, verified", bytecode_exec, true, false, false, iterations);
+    run("vm dispatch: threaded, verified, fused", bytecode_exec, true, true, false, iterations);
+    run("vm dispatch: baseline jit", bytecode_exec, true, false, true, iterations);
+
+    if (contexts > 1)
+        run_parallel((size_t) contexts, iterations);
+
+    char name[64];
+
+    run_sum("array sum: one word at a time", false, iterations);
+    snprintf(name, sizeof name, "array sum: vector registers (%s)", vm_vector_ops()->name);
+    run_sum(name, true, iterations);
+
+    return 0;
+}
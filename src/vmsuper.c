@@ -0,0 +1,316 @@
+/*
+ * Created by rakinar2 on 10/19/26.
+ */
+
+/*
+ * Picks the superinstructions of the VM (see SUPERINSTRUCTION_TABLE in
+ * opcode.h). Given a script, it runs it and adds how often each pair of
+ * fusable instructions ran one right after the other to the profile named
+ * by $VMSUPER_PROFILE; it takes --engine like blaze does, so that the
+ * benchmark scripts can run it instead of blaze. Given --generate and a
+ * profile, it prints superinstructions.h for the pairs that ran most
+ * often. "make superinstructions" does both over the benchmarks.
+ */
+
+#include "bytecode.h"
+#include "compile-bytecode.h"
+#include "constpool.h"
+#include "file.h"
+#include "lexer.h"
+#include "opcode.h"
+#include "parser.h"
+#include "register.h"
+#include "utils.h"
+#include "vm-context.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_SUPERINSTRUCTIONS 16
+
+struct fusable
+{
+    const char *name;
+    opcode_t opcode;
+    bool first;
+};
+
+#define FUSABLE_ENTRY(op) { #op, OP_##op, true },
+#define FUSABLE_BRANCH_ENTRY(op) { #op, OP_##op, false },
+
+static const struct fusable fusables[] = {
+    FUSABLE_OPCODE_TABLE(FUSABLE_ENTRY)
+    FUSABLE_BRANCH_OPCODE_TABLE(FUSABLE_BRANCH_ENTRY)
+};
+
+#define FUSABLE_COUNT (sizeof (fusables) / sizeof (fusables[0]))
+
+/* counts[i][j] is how often fusables[j] ran right after fusables[i]. */
+static uint64_t counts[FUSABLE_COUNT][FUSABLE_COUNT];
+
+static int fusable_index(opcode_t opcode)
+{
+    for (size_t i = 0; i < FUSABLE_COUNT; i++)
+    {
+        if (fusables[i].opcode == opcode)
+            return (int) i;
+    }
+
+    return -1;
+}
+
+static int fusable_find(const char *name)
+{
+    for (size_t i = 0; i < FUSABLE_COUNT; i++)
+    {
+        if (strcmp(fusables[i].name, name) == 0)
+            return (int) i;
+    }
+
+    return -1;
+}
+
+/* A profile has one "FIRST SECOND COUNT" line per pair; a missing one is empty. */
+static void profile_read(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char first[32], second[32];
+    unsigned long long count;
+
+    if (fp == NULL)
+        return;
+
+    while (fscanf(fp, "%31s %31s %llu", first, second, &count) == 3)
+    {
+        int i = fusable_find(first), j = fusable_find(second);
+
+        /* Instructions that stopped being fusable are dropped. */
+        if (i >= 0 && j >= 0 && fusables[i].first)
+            counts[i][j] += count;
+    }
+
+    fclose(fp);
+}
+
+static void profile_write(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL)
+        fatal_error("cannot open '%s' for writing", path);
+
+    for (size_t i = 0; i < FUSABLE_COUNT; i++)
+    {
+        for (size_t j = 0; j < FUSABLE_COUNT; j++)
+        {
+            if (counts[i][j] != 0)
+                fprintf(fp, "%s %s %llu\n", fusables[i].name, fusables[j].name, (unsigned long long) counts[i][j]);
+        }
+    }
+
+    if (fclose(fp) != 0)
+        fatal_error("cannot write '%s'", path);
+}
+
+/* Compiles a script the way blazevm does; the constant pool is never freed. */
+static struct bytecode compile_script(const char *filepath)
+{
+    static struct constpool constants;
+    struct bytecode bytecode;
+    char *error = NULL;
+    struct filebuf filebuf = filebuf_init(filepath);
+    filebuf_read(&filebuf);
+    filebuf_close(&filebuf);
+
+    struct lex lex = lex_init((char *) filepath, filebuf.content);
+    lex_analyze(&lex);
+
+    struct parser parser = parser_init_from_lex(&lex);
+    constants = constpool_create();
+    parser_set_constpool(&parser, &constants);
+
+    ast_node_t node = parser_create_ast_node(&parser);
+
+    if (!compile_bytecode(&node, &constants, &bytecode, &error))
+        fatal_error("cannot compile '%s': %s", filepath, error);
+
+    parser_ast_free_inner(&node);
+    parser_free(&parser);
+    lex_free(&lex);
+    filebuf_free(&filebuf);
+    return bytecode;
+}
+
+/*
+ * Runs a program through the handlers one instruction at a time, like
+ * bytecode_exec_indirect(), and counts the pairs. Only an instruction that
+ * ran because the one before it fell through makes a pair: a jump target
+ * may also be reached from elsewhere.
+ */
+static bool profile_run(struct vm_context *vm)
+{
+    struct bytecode *bytecode = vm->bytecode;
+    uint8_t *const end = bytecode->bytes + bytecode->size;
+    int indexes[256];
+    int previous = -1;
+
+    for (size_t i = 0; i < 256; i++)
+        indexes[i] = fusable_index((opcode_t) i);
+
+    vm->registers[IP] = (uint64_t) bytecode->bytes;
+    vm->registers[IS] = (uint64_t) bytecode->bytes;
+
+    while (vm->registers[IP] != 0)
+    {
+        uint8_t *ip = (uint8_t *) vm->registers[IP];
+
+        if (ip < bytecode->bytes || ip >= end)
+        {
+            vm->error = strdup("%ip points to a memory address that is out of range");
+            return false;
+        }
+
+        int current = indexes[*ip];
+
+        if (previous >= 0 && current >= 0)
+            counts[previous][current]++;
+
+        if (*ip == OP_HLT)
+            return true;
+
+        uint8_t *result = instruction_exec(vm, *ip);
+
+        if (vm->error != NULL)
+            return false;
+
+        vm->registers[IP] = result == NULL ? vm->registers[IP] + 1 : (uint64_t) result;
+        previous = current >= 0 && fusables[current].first && vm->registers[IP] == (uint64_t) (ip + instruction_get_size(ip, end - ip))
+                   ? current : -1;
+    }
+
+    return true;
+}
+
+static void profile(const char *filepath)
+{
+    const char *path = getenv("VMSUPER_PROFILE");
+    struct vm_context vm;
+
+    if (path == NULL)
+        fatal_error("VMSUPER_PROFILE must name the profile to add to");
+
+    struct bytecode bytecode = compile_script(filepath);
+
+    execution_init(&vm, &bytecode);
+    blaze_stack_guard(&vm.stack);
+
+    if (!profile_run(&vm))
+        fatal_error("%s: %s", filepath, vm.error);
+
+    execution_end(&vm);
+    bytecode_free(&bytecode);
+
+    profile_read(path);
+    profile_write(path);
+}
+
+struct pair
+{
+    size_t first;
+    size_t second;
+    uint64_t count;
+};
+
+static int pair_compare(const void *a, const void *b)
+{
+    const struct pair *left = a, *right = b;
+
+    if (left->count != right->count)
+        return left->count < right->count ? 1 : -1;
+
+    return left->first != right->first ? (int) left->first - (int) right->first
+                                       : (int) left->second - (int) right->second;
+}
+
+static void generate(const char *path, size_t limit)
+{
+    struct pair *pairs = xmalloc(FUSABLE_COUNT * FUSABLE_COUNT * sizeof (struct pair));
+    size_t pair_count = 0;
+
+    profile_read(path);
+
+    for (size_t i = 0; i < FUSABLE_COUNT; i++)
+    {
+        for (size_t j = 0; j < FUSABLE_COUNT; j++)
+        {
+            if (counts[i][j] != 0)
+                pairs[pair_count++] = (struct pair) { i, j, counts[i][j] };
+        }
+    }
+
+    if (pair_count == 0)
+        fatal_error("'%s' is an empty profile", path);
+
+    qsort(pairs, pair_count, sizeof (struct pair), pair_compare);
+
+    if (pair_count > limit)
+        pair_count = limit;
+
+    puts("/*\n"
+         " * Generated by \"make superinstructions\" from the pairs of instructions\n"
+         " * the benchmarks ran most often; do not edit. The comments give how many\n"
+         " * times each pair ran.\n"
+         " */\n"
+         "\n"
+         "#ifndef BLAZESCRIPT_SUPERINSTRUCTIONS_H\n"
+         "#define BLAZESCRIPT_SUPERINSTRUCTIONS_H\n"
+         "\n"
+         "#define SUPERINSTRUCTION_TABLE(X) \\");
+
+    for (size_t i = 0; i < pair_count; i++)
+    {
+        const struct fusable *first = &fusables[pairs[i].first];
+        const struct fusable *second = &fusables[pairs[i].second];
+        char row[96];
+
+        snprintf(row, sizeof row, "X(%s, %s, \"%s+%s\")", first->name, second->name,
+                 opcode_to_str(first->opcode), opcode_to_str(second->opcode));
+        printf("    %-42s /* %12llu */%s\n", row, (unsigned long long) pairs[i].count,
+               i + 1 < pair_count ? " \\" : "");
+    }
+
+    puts("\n#endif /* BLAZESCRIPT_SUPERINSTRUCTIONS_H */");
+    free(pairs);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "--generate") == 0)
+    {
+        size_t limit = argc > 3 ? strtoull(argv[3], NULL, 10) : DEFAULT_SUPERINSTRUCTIONS;
+
+        if (limit == 0)
+            fatal_error("the number of superinstructions must be positive");
+
+        generate(argv[2], limit);
+        return 0;
+    }
+
+    const char *script = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        /* The tree-walker runs no bytecode, so there is nothing to profile. */
+        if (strcmp(argv[i], "--engine=tree") == 0)
+            return 0;
+
+        if (strncmp(argv[i], "--engine=", 9) != 0)
+            script = argv[i];
+    }
+
+    if (script == NULL)
+        fatal_error("usage: %s [--engine=vm] SCRIPT | --generate PROFILE [COUNT]", argv[0]);
+
+    profile(script);
+    return 0;
+}
@@ -0,0 +1,196 @@
+#!/bin/sh
+
+. "$(dirname "$0")"/setup.sh
+
+# blazec writes x86-64 objects and links them with the system's ld; as is
+# there to cross-check the objects.
+if [ "$(uname -m)" != "x86_64" ] || [ "$(uname -s)" != "Linux" ] || [ ! -x /usr/bin/as ] || [ ! -x /usr/bin/ld ]; then
+    printf "\033[1;33mSKIP\033[0m \033[2m%s\033[0m\n" "blazec needs as and ld for x86-64 Linux"
+    exit 0
+fi
+
+EXECUTABLE="${FILE%.bl}.out"
+
+# The runtime library is found relative to the top of the build tree.
+blaze_run() {
+    (cd .. && "$BLAZEC" $BLAZEC_FLAGS -o "$EXECUTABLE" "$FILE") && "$EXECUTABLE" | sed -r "s/\x1B\[([0-9]{1,3}(;[0-9]{1,2};?)?)?[mGK]//g"
+}
+
+blaze_test_name "Compile the whole language to native code"
+blaze_file << EOF
+var s = "";
+var n = 0;
+
+loop (10 as i) {
+    s = s + "abcdef" + i;
+    n = n + i * 2 - 1 % 3;
+}
+
+println(s, n, true, null, 5 % 3);
+
+function add(a, b) {
+    a + b;
+}
+
+function many(a, b, c, d, e, f, g, h) {
+    a + b + c + d + e + f + g + h;
+}
+
+function fact(n) {
+    var r = 1;
+
+    if (n > 1) {
+        r = n * fact(n - 1);
+    }
+
+    r;
+}
+
+println(add(1, 2), add("x", 3), add(add(1, 2), add(3, 4)));
+println(many(1, 2, 3, 4, 5, 6, 7, 8), 1, 2, 3, 4, 5, 6, 7, "eight");
+
+const x = 3;
+
+if (x > 2) {
+    println("big");
+} else {
+    println("small");
+}
+
+if (x == 4)
+    println("four");
+else
+    println("not four");
+
+println("12" == 12, "12" === 12, "true" == true, "null" != null, x != 3);
+
+var a = array [1, "two", fact(5), array [x, null]];
+var b = a;
+b = 7 / 2;
+println(fact(20), a, b);
+exit(3);
+println("unreachable");
+EOF
+blaze_test "abcdef0abcdef1abcdef2abcdef3abcdef4abcdef5abcdef6abcdef7abcdef8abcdef9 80 true null 2\n3 x3 10\n36 1 2 3 4 5 6 7 eight\nbig\nnot four\ntrue false true false false\n2432902008176640000 Array (4) [1, \"two\", 120, Array (2) [3, null]] 3.500000\n"
+
+"$EXECUTABLE" > /dev/null
+
+if [ "$?" = "3" ]; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (exit code)"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (exit code)"
+    rm -f "$EXECUTABLE"
+    exit 127
+fi
+
+
+blaze_test_name "Keep ints and bools in machine words"
+blaze_file << EOF
+var sum = 0;
+var even = 0;
+var big = false;
+
+loop (100000 as i) {
+    sum = sum + i * 3 - i % 7;
+
+    if (i % 2 == 0) {
+        even = even + 1;
+    }
+
+    big = i > 10;
+}
+
+function fib(n) {
+    var r = n;
+
+    if (n > 1) {
+        r = fib(n - 1) + fib(n - 2);
+    }
+
+    r;
+}
+
+function down(n) {
+    var r = 0;
+
+    if (n > 0) {
+        r = down(n - 1);
+    } else {
+        r = "bottom";
+    }
+
+    r;
+}
+
+var x = 1;
+x = "now " + x;
+
+println(sum, even, big, fib(20), down(3), x, 1 == true, 2 === 2, 3 !== true);
+EOF
+blaze_test "14999550005 50000 true 6765 bottom now 1 true true false\n"
+
+# Only println() gets a boxed value: the loop makes no values at all.
+blaze_file << EOF
+var sum = 0;
+
+loop (1000 as i) {
+    if (i % 3 != 0) {
+        sum = sum + i;
+    }
+}
+
+println(sum);
+EOF
+
+if [ "$(cd .. && "$BLAZEC" -G "$FILE" | grep -c create_intval)" = "1" ]; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (boxing)"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (boxing)"
+    rm -f "$EXECUTABLE"
+    exit 127
+fi
+
+
+blaze_test_name "Write objects without the system assembler"
+blaze_file << EOF
+function pick(a, b, c, d, e, f, g, h) {
+    var r = h;
+
+    if (a < b) {
+        r = g * 1000000000000;
+    }
+
+    r;
+}
+
+var s = "tab	and quote '";
+
+loop (3 as i) {
+    s = s + i;
+}
+
+println(pick(1, 2, 3, 4, 5, 6, 7, 8), pick(2, 1, 3, 4, 5, 6, 7, "eight"), s);
+EOF
+blaze_test "7000000000000 eight tab\tand quote '012\n"
+
+TEST_NAME="$TEST_NAME (system assembler)"
+BLAZEC_FLAGS="-A"
+blaze_test "7000000000000 eight tab\tand quote '012\n"
+BLAZEC_FLAGS=""
+
+rm -f "$EXECUTABLE"
+
+blaze_test_name "Reject println() without arguments"
+blaze_file << EOF
+println();
+EOF
+
+if ! (cd .. && "$BLAZEC" -o "$EXECUTABLE" "$FILE") 2> "$FILE.err" &&
+   grep -q "function println() requires at least 1 argument to be passed" "$FILE.err"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+    exit 127
+fi
+
+rm -f "$EXECUTABLE" "$FILE.err"
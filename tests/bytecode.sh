@@ -0,0 +1,589 @@
+#!/bin/sh
+
+. "$(dirname "$0")"/setup.sh
+
+BLAZE_FLAGS="--engine=vm"
+
+blaze_test_name "Run loops and arithmetic on the bytecode VM"
+blaze_file << EOF
+var s = "";
+var n = 0;
+
+loop (10 as i) {
+    s = s + "abcdef" + i;
+    n = n + i * 2 - 1 % 3;
+}
+
+println(s, n, true, null, 5 % 3);
+EOF
+blaze_test "abcdef0abcdef1abcdef2abcdef3abcdef4abcdef5abcdef6abcdef7abcdef8abcdef9 80 true null 2\n"
+
+blaze_test_name "Call functions on the bytecode VM"
+blaze_file << EOF
+function add(a, b) {
+    a + b;
+}
+
+function sq(v) {
+    v * v;
+}
+
+println(add(1, 2), add("x", 3), add(add(1, 2), add(3, 4)));
+println(1 + (2 + (3 + (4 + (5 + (6 + (7 + (8 + sq(9 + sq(2))))))))));
+EOF
+blaze_test "3 x3 10\n205\n"
+
+blaze_test_name "Branch and compare on the bytecode VM"
+blaze_file << EOF
+const x = 3;
+
+if (x > 2) {
+    println("big");
+} else {
+    println("small");
+}
+
+if (x == 4)
+    println("four");
+else
+    println("not four");
+
+println("12" == 12, "12" === 12, "true" == true, "null" != null, x != 3);
+exit(0);
+println("unreachable");
+EOF
+blaze_test "big\nnot four\ntrue false true false false\n"
+
+blaze_test_name "Recurse deeply on the bytecode VM"
+blaze_file << EOF
+function fact(n) {
+    var r = 1;
+
+    if (n > 1) {
+        r = n * fact(n - 1);
+    }
+
+    r;
+}
+
+function depth(n) {
+    var r = 0;
+
+    if (n > 0) {
+        r = 1 + depth(n - 1);
+    }
+
+    r;
+}
+
+println(fact(20), depth(200000));
+EOF
+blaze_test "2432902008176640000 200000\n"
+
+blaze_test_name "Save compiled bytecode to a file and run it"
+blaze_file << EOF
+function greet(name) {
+    "Hello, " + name + "!";
+}
+
+loop (2 as i) {
+    println(greet("world"), i);
+}
+EOF
+OUTPUT="${FILE%.bl}.blc"
+"$BLAZEVM" -o "$OUTPUT" "$FILE" || exit 1
+BLAZE="$BLAZEVM" BLAZE_FLAGS="" FILE="$OUTPUT" blaze_test "Hello, world! 0\nHello, world! 1\n"
+
+blaze_test_name "Quicken syscalls that keep doing the same thing"
+blaze_file << EOF
+loop (8 as i) {
+    println(i);
+}
+EOF
+BLAZE="$BLAZEVM" BLAZE_FLAGS="" blaze_test "0\n1\n2\n3\n4\n5\n6\n7\n"
+
+if "$BLAZEVM" -q "$FILE" 2>&1 >/dev/null | grep -q "syscall.write.int *; 4 hits, 0 misses"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (counters)"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (counters)"
+    exit 127
+fi
+
+blaze_test_name "Run superinstructions and jump between their halves"
+blaze_file << EOF
+var total = 0;
+var count = 0;
+
+loop (30 as i) {
+    if (i % 3 == 0) {
+        total = total + i;
+    } else {
+        count = count + 1;
+    }
+}
+
+println(total, count);
+EOF
+blaze_test "135 20\n"
+
+# Files are written with the superinstructions, which only this build knows by their numbers.
+OUTPUT="${FILE%.bl}.blc"
+"$BLAZEVM" -o "$OUTPUT" "$FILE" || exit 1
+BLAZE="$BLAZEVM" BLAZE_FLAGS="" FILE="$OUTPUT" blaze_test "135 20\n"
+printf '\377\377\377\377' | dd of="$OUTPUT" bs=1 seek=12 conv=notrunc 2>/dev/null
+
+if "$BLAZEVM" "$OUTPUT" 2>&1 | grep -q "superinstructions of another build of the VM"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (other build)"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (other build)"
+    exit 127
+fi
+
+rm -f "$OUTPUT"
+
+blaze_test_name "Encode immediates and constant indices of every size"
+{
+    for i in $(seq 1 200); do
+        echo "var s$i = \"string $i\";"
+    done
+
+    echo 'println(s1, s128, s200, 0 - 5, 0 - 200, 100000, 0 - 3000000000, 5000000000);'
+} | blaze_file
+blaze_test "string 1 string 128 string 200 -5 -200 100000 -3000000000 5000000000\n"
+
+blaze_test_name "Report a VM stack overflow"
+blaze_file << EOF
+function depth(n) {
+    var r = 0;
+    r = 1 + depth(n + 1);
+    r;
+}
+
+println(depth(0));
+EOF
+
+if "$BLAZEVM" "$FILE" 2>&1 >/dev/null | grep -q "VM stack overflow"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+    exit 127
+fi
+
+blaze_test_name "Run programs as native code with --jit"
+blaze_file << EOF
+var total = 0;
+
+function fib(n) {
+    var r = n;
+
+    if (n >= 2) {
+        r = fib(n - 1) + fib(n - 2);
+    }
+
+    r;
+}
+
+loop (10 as i) {
+    total = total + fib(i);
+}
+
+println(total, fib(20), 17 % 5, (0 - 17) % 5, 7 % (0 - 1), 2 <= 2, "a" + total == "a88");
+EOF
+BLAZE="$BLAZEVM" BLAZE_FLAGS="--jit" blaze_test "88 6765 2 -2 0 true true\n"
+
+"$BLAZEVM" --perf-map "$FILE" > /dev/null &
+PID=$!
+wait "$PID"
+
+if grep -q "blaze-jit:fib(INTEGER)" "/tmp/perf-$PID.map"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (perf map)"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (perf map)"
+    exit 127
+fi
+
+rm -f "/tmp/perf-$PID.map"
+
+# pushb and popb are left to the interpreter, and so is the whole program.
+OUTPUT="${FILE%.bl}.bin"
+printf '\054\000\003\054\001\004\054\002\052\006\002\007\002\004\001' > "$OUTPUT"
+"$BLAZEVM" --perf-map "$OUTPUT" > "$OUTPUT.out" &
+PID=$!
+wait "$PID"
+
+if grep -q "42" "$OUTPUT.out" && [ ! -e "/tmp/perf-$PID.map" ]; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (fallback)"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (fallback)"
+    exit 127
+fi
+
+rm -f "$OUTPUT" "$OUTPUT.out"
+
+# A jump that never runs still has to land on an instruction, as the JIT translates it too.
+printf '\001\023\000\000\000\347' > "$OUTPUT"
+"$BLAZEVM" --jit "$OUTPUT" > "$OUTPUT.out" 2>&1
+
+if [ "$?" = "1" ] && grep -q "jump target 0xe7000000 is past the end of the code" "$OUTPUT.out"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (dead jump)"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (dead jump)"
+    exit 127
+fi
+
+rm -f "$OUTPUT" "$OUTPUT.out"
+
+blaze_test_name "Refuse malformed code at the offset of the fault"
+
+# Runs raw code, which must be refused with the given error before it starts.
+verify_fails() {
+    printf "$2" > "$OUTPUT"
+    "$BLAZEVM" "$OUTPUT" > "$OUTPUT.out" 2>&1
+
+    if [ "$?" = "1" ] && grep -q "bytecode verification failed at $3" "$OUTPUT.out"; then
+        printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME ($1)"
+    else
+        printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME ($1)"
+        exit 127
+    fi
+}
+
+verify_fails "invalid opcode" '\377' "0x00000000: invalid opcode 0xff"
+verify_fails "truncated operand" '\001\002\000\001' "0x00000001: mov needs 10 bytes but only 3 are left"
+verify_fails "register out of range" '\002\021\000\000\000\000\000\000\000\000\001' \
+    "0x00000000: operand 1 of mov is not a register: 0x11"
+verify_fails "jump into an instruction" '\023\007\000\000\000\002\000\000\000\000\000\000\000\000\000\001' \
+    "0x00000000: jump target 0x00000007 is not the start of an instruction"
+verify_fails "jump past the end" '\023\010\000\000\000\001' "0x00000000: jump target 0x00000008 is past the end of the code"
+verify_fails "unbalanced stack at ret" '\025\006\000\000\000\001\027\000\026' "0x00000008: ret with 8 bytes still pushed"
+verify_fails "constant out of range" '\033\000\005\001' \
+    "0x00000000: operand 2 of const refers to constant 0x00000005, but there are only 0"
+verify_fails "truncated constant index" '\033\000\200' "0x00000000: the constant index of const is truncated or too large"
+
+rm -f "$OUTPUT" "$OUTPUT.out"
+
+blaze_test_name "Read and write files with the I/O syscalls"
+bytes() {
+    for byte in "$@"; do
+        printf "\\$(printf %03o "0x$byte")"
+    done
+}
+
+# A header with 16 qwords of data memory, 127 bytes of code and one section.
+OUTPUT="${FILE%.bl}.blc"
+{
+    bytes 7f 42 4c 5a 02 00 01 00 00 00 00 00 00 00 00 00
+    bytes 10 00 00 00 00 00 00 00 9f 00 00 00 00 00 00 00
+    # Reads two paths from stdin and opens the first for reading and the
+    # second for writing, through the buffers at 0 and 64.
+    bytes 2c 00 0b 2c 01 00 2c 02 00 2c 03 40 04 2c 05 01 0a 05 09 20
+    bytes 2c 01 00 2c 03 00 2c 00 09 04 09 60
+    bytes 2c 00 0b 2c 01 00 2c 02 40 2c 03 40 04 0a 05 09 20
+    bytes 2c 01 40 2c 03 01 2c 00 09 04 09 70
+    # Copies the first to the second, up to 5 bytes of a line at a time.
+    bytes 2c 00 0b 09 16 2c 02 70 2c 03 05 04 14 00 5c 00 00 00
+    bytes 09 30 2c 00 0d 09 17 04 13 3d 00 00 00
+    # Closes both and copies the rest of stdin to stdout.
+    bytes 2c 00 0a 09 16 04 09 17 2c 00 0a 04
+    bytes 2c 00 0c 2c 01 00 2c 02 00 2c 03 64 04 09 30 2c 00 0d 2c 01 01 04 01
+    # The code section.
+    bytes 01 00 00 00 00 00 00 00 20 00 00 00 00 00 00 00 7f 00 00 00 00 00 00 00
+} > "$OUTPUT"
+
+printf 'first line\nsecond, longer line\nlast' > "$OUTPUT.in"
+rm -f "$OUTPUT.copy"
+
+if printf '%s\n%s\nleft over\n' "$OUTPUT.in" "$OUTPUT.copy" | "$BLAZEVM" "$OUTPUT" > "$OUTPUT.out" &&
+   printf 'left over\n' | cmp -s - "$OUTPUT.out" && cmp -s "$OUTPUT.in" "$OUTPUT.copy"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+    exit 127
+fi
+
+rm -f "$OUTPUT.in" "$OUTPUT.copy" "$OUTPUT.out"
+
+blaze_test_name "Collect garbage strings in a small VM heap"
+blaze_file << EOF
+var total = 0;
+
+loop (100000 as i) {
+    var s = "item " + i + " of many, padded out to a few dozen bytes";
+    total = total + 1;
+}
+
+var t = "";
+
+loop (2000 as i) {
+    t = t + i % 10;
+}
+
+println(total);
+println(t == t + "");
+EOF
+BLAZE="$BLAZEVM" BLAZE_FLAGS="--heap-size 256K" blaze_test '100000\ntrue\n'
+
+blaze_file << EOF
+var s = "abcdefghijklmnopqrstuvwxyz";
+
+loop (20 as i) {
+    s = s + s;
+}
+EOF
+
+if "$BLAZEVM" --heap-size 1M "$FILE" 2>&1 >/dev/null | grep -q "VM heap exhausted"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (exhausted)"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (exhausted)"
+    exit 127
+fi
+
+blaze_test_name "Keep arrays and boxes in the VM heap"
+OUTPUT="${FILE%.bl}.bin"
+{
+    # A three element array in r5, with 42 stored at and loaded from 1.
+    bytes 2c 00 0e 2c 01 03 04 09 50
+    bytes 2c 00 10 09 15 2c 02 01 2c 03 2a 04
+    bytes 2c 00 0f 09 15 2c 02 01 04 09 20 2c 00 03 2c 01 04 04
+    # Its length, then a boxed true printed with the type unboxed with it.
+    bytes 2c 00 11 09 15 04 09 20 2c 00 03 2c 01 04 04
+    bytes 2c 00 12 2c 01 05 2c 02 01 04 09 10 2c 00 13 04 09 20 2c 00 03 04
+    # Loads from 3, which is out of range.
+    bytes 2c 00 0f 09 15 2c 02 03 04 01
+} > "$OUTPUT"
+
+"$BLAZEVM" "$OUTPUT" 2> "$OUTPUT.err" | tail -3 | sed -r "s/\x1B\[([0-9]{1,3}(;[0-9]{1,2};?)?)?[mGK]//g" > "$OUTPUT.out"
+
+if printf '42\n3\ntrue\n' | cmp -s - "$OUTPUT.out" && grep -q "Array index out of range: 3 of 3" "$OUTPUT.err"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+    exit 127
+fi
+
+rm -f "$OUTPUT" "$OUTPUT.out" "$OUTPUT.err"
+
+blaze_test_name "Compile array literals to the array syscalls"
+blaze_file << EOF
+function wrap(v) {
+    array [v, array [v + 1, "s" + v], null];
+}
+
+const a = array [1, "two", true, array []];
+println(a);
+println(1, 2, 3, 4, 5, 6, 7, 8, 9, array [wrap(1), "z"], a);
+
+if (a)
+    println(wrap("x"));
+EOF
+blaze_test 'Array (4) [1, "two", true, Array (0) []]\n1 2 3 4 5 6 7 8 9 Array (2) [Array (3) [1, Array (2) [2, "s1"], null], "z"] Array (4) [1, "two", true, Array (0) []]\nArray (3) ["x", Array (2) ["x1", "sx"], null]\n'
+
+blaze_test_name "Resume a program from a snapshot"
+OUTPUT="${FILE%.bl}.blc"
+{
+    bytes 7f 42 4c 5a 02 00 01 00 00 00 00 00 00 00 00 00
+    bytes 10 00 00 00 00 00 00 00 92 00 00 00 00 00 00 00
+    # Builds an array in r6 with 7 at 2, and the string "42" on the stack.
+    bytes 2c 00 0e 2c 01 03 04 09 60 2c 00 10 09 16 2c 02 02 2c 03 07 04
+    bytes 2c 00 05 2c 01 04 2c 02 2a 04 17 00
+    # Reads a path from stdin and saves a snapshot there, then stops.
+    bytes 2c 00 0b 2c 01 00 2c 02 00 2c 03 40 04 2c 05 01 0a 05 09 20 2c 01 00 2c 00 14 04
+    bytes 1d 00 43 00 00 00 01
+    # Resumed: prints the string, the element and a new string.
+    bytes 18 02 2c 00 03 2c 01 07 04
+    bytes 2c 00 0f 09 16 2c 02 02 04 09 20 2c 00 03 2c 01 04 04
+    bytes 2c 00 05 2c 01 04 2c 02 09 04 09 20 2c 00 03 2c 01 07 04 01
+    # The code section.
+    bytes 01 00 00 00 00 00 00 00 20 00 00 00 00 00 00 00 72 00 00 00 00 00 00 00
+} > "$OUTPUT"
+
+for flags in "" "--jit"; do
+    rm -f "$OUTPUT.snap"
+
+    if echo "$OUTPUT.snap" | "$BLAZEVM" $flags "$OUTPUT" > "$OUTPUT.out" && [ ! -s "$OUTPUT.out" ] &&
+       "$BLAZEVM" $flags "$OUTPUT.snap" | sed -r "s/\x1B\[([0-9]{1,3}(;[0-9]{1,2};?)?)?[mGK]//g" > "$OUTPUT.out" &&
+       printf '42\n7\n9\n' | cmp -s - "$OUTPUT.out"; then
+        printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME${flags:+ ($flags)}"
+    else
+        printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME${flags:+ ($flags)}"
+        exit 127
+    fi
+done
+
+rm -f "$OUTPUT.snap" "$OUTPUT.out"
+
+blaze_test_name "Resume a snapshot taken inside a function"
+{
+    bytes 7f 42 4c 5a 02 00 01 00 00 00 00 00 00 00 00 00
+    bytes 10 00 00 00 00 00 00 00 71 00 00 00 00 00 00 00
+    # Reads a path from stdin, calls the function at 0x27, then prints 7.
+    bytes 2c 00 0b 2c 01 00 2c 02 00 2c 03 40 04 2c 05 01 0a 05 09 20 2c 01 00
+    bytes 15 27 00 00 00 2c 00 03 2c 01 04 2c 02 07 04 01
+    # Keeps 42 in a local and saves a snapshot; resumed, prints the local.
+    bytes 28 01 00 00 00 00 2c 04 2a 2b 00 00 00 00 04 2c 00 14 04
+    bytes 1d 00 42 00 00 00 29 16
+    bytes 2a 02 00 00 00 00 2c 00 03 2c 01 04 04 29 16
+    # The code section.
+    bytes 01 00 00 00 00 00 00 00 20 00 00 00 00 00 00 00 51 00 00 00 00 00 00 00
+} > "$OUTPUT"
+
+for flags in "" "--jit"; do
+    rm -f "$OUTPUT.snap"
+
+    if echo "$OUTPUT.snap" | "$BLAZEVM" $flags "$OUTPUT" > /dev/null &&
+       "$BLAZEVM" $flags "$OUTPUT.snap" | sed -r "s/\x1B\[([0-9]{1,3}(;[0-9]{1,2};?)?)?[mGK]//g" > "$OUTPUT.out" &&
+       printf '42\n7\n' | cmp -s - "$OUTPUT.out"; then
+        printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME${flags:+ ($flags)}"
+    else
+        printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME${flags:+ ($flags)}"
+        exit 127
+    fi
+done
+
+# The stack starts with the return address, saved as the offset 0x1c; 0x1d is inside an instruction.
+table=$(od -An -tu8 -j24 -N8 "$OUTPUT.snap")
+count=$(od -An -tu2 -j6 -N2 "$OUTPUT.snap")
+stack=
+
+for i in $(seq 0 $((count - 1))); do
+    set -- $(od -An -tu8 -j$((table + 24 * i)) -N24 "$OUTPUT.snap")
+    [ "$1" = 5 ] && stack=$2
+done
+
+printf '\035' | dd of="$OUTPUT.snap" bs=1 seek="$stack" conv=notrunc 2> /dev/null
+
+if ! "$BLAZEVM" "$OUTPUT.snap" > /dev/null 2> "$OUTPUT.err" &&
+   grep -q "the stack does not match the frames of the program" "$OUTPUT.err"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (bad return address)"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (bad return address)"
+    exit 127
+fi
+
+rm -f "$OUTPUT" "$OUTPUT.snap" "$OUTPUT.out" "$OUTPUT.err"
+
+blaze_test_name "Dump the flight recorder when a program fails"
+blaze_file << EOF
+function next(n) {
+    n + 1;
+}
+
+var t = 0;
+
+loop (5 as i) {
+    t = t + next(i);
+}
+
+println(t % (t - t));
+EOF
+
+"$BLAZEVM" --record=8 "$FILE" > /dev/null 2> "$FILE.err"
+
+if grep -q "flight recorder: last 8 of" "$FILE.err" && [ "$(grep -c "r0=0x" "$FILE.err")" = 8 ] &&
+   tail -2 "$FILE.err" | grep -q " mod " && tail -1 "$FILE.err" | grep -q "Division by zero"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+    exit 127
+fi
+
+rm -f "$FILE.err"
+
+# Raw programs are only disassembled when asked to.
+OUTPUT="${FILE%.bl}.bin"
+printf '\054\000\003\054\001\004\054\002\052\004\001' > "$OUTPUT"
+
+if [ "$("$BLAZEVM" "$OUTPUT" | sed -r "s/\x1B\[([0-9]{1,3}(;[0-9]{1,2};?)?)?[mGK]//g")" = "$(printf '42\nSystem halted')" ] &&
+   "$BLAZEVM" -d "$OUTPUT" | grep -q "syscall"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (disassembly)"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (disassembly)"
+    exit 127
+fi
+
+rm -f "$OUTPUT"
+
+blaze_test_name "Profile the instructions a program runs"
+blaze_file << EOF
+loop (6 as i) {
+    println(i);
+}
+EOF
+
+"$BLAZEVM" --profile "$FILE" 2> "$FILE.err" | sed -r "s/\x1B\[([0-9]{1,3}(;[0-9]{1,2};?)?)?[mGK]//g" > "$FILE.out"
+
+if printf '0\n1\n2\n3\n4\n5\n' | cmp -s - "$FILE.out" && grep -q "^\*\*\* profile: [0-9]* instructions" "$FILE.err" &&
+   grep -Eq "^ 23  jge +7 " "$FILE.err" && grep -Eq "^ +6 [0-9a-f]+:  23 .* jge " "$FILE.err"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+    exit 127
+fi
+
+rm -f "$FILE.out" "$FILE.err"
+
+blaze_test_name "Run vector instructions on the data memory"
+OUTPUT="${FILE%.bl}.blc"
+{
+    bytes 7f 42 4c 5a 02 00 01 00 00 00 00 00 00 00 00 00
+    bytes 08 00 00 00 00 00 00 00 e4 00 00 00 00 00 00 00
+    # Stores 1, 2, 3 and 4, and prints the sum of them times 10.
+    bytes 2c 03 01 1a 00 00 00 00 03 2c 03 02 1a 01 00 00 00 03
+    bytes 2c 03 03 1a 02 00 00 00 03 2c 03 04 1a 03 00 00 00 03
+    bytes 2c 05 00 2e 00 05 2c 06 0a 30 01 06 33 01 3d 02 00
+    bytes 2c 00 04 2c 01 04 04 2c 00 04 2c 01 03 2c 02 0a 04
+    # Stores 10 over the lanes above 25, then prints the largest and the sum.
+    bytes 2c 07 19 30 03 07 38 30 3c 05 01 03 2e 05 05 3f 02 05
+    bytes 2c 00 04 2c 01 04 04 2c 00 04 2c 01 03 2c 02 0a 04
+    bytes 3d 02 05
+    bytes 2c 00 04 2c 01 04 04 2c 00 04 2c 01 03 2c 02 0a 04
+    # Doubles four lanes of 1.5 and checks that they sum to 12.0.
+    bytes 02 08 00 00 00 00 00 00 f8 3f 30 06 08 34 66 3e 02 06
+    bytes 02 09 00 00 00 00 00 00 28 40 0d 29
+    bytes 2c 00 04 2c 01 04 04 2c 00 04 2c 01 03 2c 02 0a 04
+    # Blends 10 into the same lanes of the products and prints their sum.
+    bytes 3b 01 03 3d 02 00
+    bytes 2c 00 04 2c 01 04 04 2c 00 04 2c 01 03 2c 02 0a 04 01
+    # The code section.
+    bytes 01 00 00 00 00 00 00 00 20 00 00 00 00 00 00 00 c4 00 00 00 00 00 00 00
+} > "$OUTPUT"
+
+for flags in "" "--jit"; do
+    if [ "$("$BLAZEVM" $flags "$OUTPUT" | sed -r "s/\x1B\[([0-9]{1,3}(;[0-9]{1,2};?)?)?[mGK]//g")" = "$(printf '100\n10\n23\n1\n50')" ]; then
+        printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME${flags:+ ($flags)}"
+    else
+        printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME${flags:+ ($flags)}"
+        exit 127
+    fi
+done
+
+# Vector registers are checked like the others, and so are the slots they reach.
+printf '\056\011\000\001' > "$OUTPUT"
+
+if "$BLAZEVM" "$OUTPUT" 2>&1 | grep -q "operand 1 of vload is not a vector register"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (invalid register)"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (invalid register)"
+    exit 127
+fi
+
+printf '\054\005\000\056\000\005\001' > "$OUTPUT"
+
+if "$BLAZEVM" "$OUTPUT" 2>&1 | grep -q "Invalid memory address: 0x00000000"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (invalid address)"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME (invalid address)"
+    exit 127
+fi
+
+blaze_test_name "Print only values that bytecode can hold"
+printf '\054\000\004\054\001\002\054\002\101\004\001' > "$OUTPUT"
+
+if "$BLAZEVM" "$OUTPUT" 2>&1 | grep -q "Invalid value type: 0x02"; then
+    printf "\033[1;32mPASS\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+else
+    printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
+    exit 127
+fi
+
+rm -f "$OUTPUT"
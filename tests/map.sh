@@ -0,0 +1,50 @@
+#!/bin/sh
+
+. "$(dirname "$0")"/setup.sh
+
+blaze_test_name "Create, update and read a map"
+blaze_file << EOF
+const m = map("a", 1, 2, "two");
+map_set(m, "b", true);
+map_set(m, "a", 10);
+println(m);
+println(map_get(m, "a"), map_get(m, 2), map_get(m, "missing"), map_get(m, "missing", 0));
+println(map_size(m));
+EOF
+blaze_test 'Map (3) {"a" => 10, 2 => "two", "b" => true}\n10 two null 0\n3\n'
+
+blaze_test_name "Integer and string keys are distinct"
+blaze_file << EOF
+const m = map();
+map_set(m, 1, "int");
+map_set(m, "1", "string");
+println(map_get(m, 1), map_get(m, "1"), map_size(m));
+EOF
+blaze_test "int string 2\n"
+
+blaze_test_name "Delete keys and keep insertion order"
+blaze_file << EOF
+const m = map();
+
+loop (100 as i) {
+    map_set(m, i, i * 2);
+}
+
+loop (98 as i) {
+    map_delete(m, i);
+}
+
+println(map_has(m, 0), map_has(m, 99), map_delete(m, 0));
+map_set(m, "z", 0);
+println(map_keys(m), map_values(m));
+EOF
+blaze_test 'false true false\nArray (3) [98, 99, "z"] Array (3) [196, 198, 0]\n'
+
+blaze_test_name "Store arrays in maps"
+blaze_file << EOF
+const m = map("arr", array [1, 2, "s"]);
+map_set(m, "more", array [true]);
+println(m);
+println(map_get(m, "arr"), map_values(m));
+EOF
+blaze_test 'Map (2) {"arr" => Array (3) [1, 2, "s"], "more" => Array (1) [true]}\nArray (3) [1, 2, "s"] Array (2) [Array (3) [1, 2, "s"], Array (1) [true]]\n'
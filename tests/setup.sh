@@ -3,7 +3,7 @@
 TEST_NAME="Unnamed"
 
 blaze_run() {
-    "$BLAZE" "$FILE" | sed -r "s/\x1B\[([0-9]{1,3}(;[0-9]{1,2};?)?)?[mGK]//g"
+    "$BLAZE" $BLAZE_FLAGS "$FILE" | sed -r "s/\x1B\[([0-9]{1,3}(;[0-9]{1,2};?)?)?[mGK]//g"
 }
 
 blaze_file() {
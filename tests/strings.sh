@@ -0,0 +1,56 @@
+#!/bin/sh
+
+. "$(dirname "$0")"/setup.sh
+
+blaze_test_name "Concatenate strings with other types"
+blaze_file << EOF
+println("a" + 1, 2 + "b", "c" + true, false + "d", null + "e", "f" + null);
+EOF
+blaze_test "a1 2b ctrue falsed nulle fnull\n"
+
+blaze_test_name "Build strings longer than the inline storage"
+blaze_file << EOF
+var s = "";
+
+loop (10 as i) {
+    s = s + "abcdef" + i;
+}
+
+const copy = s;
+s = s + "!";
+println(s);
+println(copy);
+EOF
+blaze_test "abcdef0abcdef1abcdef2abcdef3abcdef4abcdef5abcdef6abcdef7abcdef8abcdef9!\nabcdef0abcdef1abcdef2abcdef3abcdef4abcdef5abcdef6abcdef7abcdef8abcdef9\n"
+
+blaze_test_name "Reuse interned string literals"
+blaze_file << EOF
+var out = "";
+
+loop (3 as i) {
+    const s = "literal";
+    out = out + s + "-";
+}
+
+println(out, "literal" == "literal");
+EOF
+blaze_test "literal-literal-literal- true\n"
+
+blaze_test_name "Prepend and append to long strings"
+blaze_file << EOF
+var s = "-";
+
+loop (20 as i) {
+    s = "<" + i + s + i + ">";
+}
+
+println(s);
+EOF
+blaze_test "<19<18<17<16<15<14<13<12<11<10<9<8<7<6<5<4<3<2<1<0-0>1>2>3>4>5>6>7>8>9>10>11>12>13>14>15>16>17>18>19>\n"
+
+blaze_test_name "Compare strings with other types"
+blaze_file << EOF
+println("12" == 12, 12 == "12", "12" === 12, "true" == true, "null" != null);
+println("abc" == "abd", "abc" != "abcd", "abc" === "abc", "" == "");
+EOF
+blaze_test "true true false true false\nfalse true true true\n"